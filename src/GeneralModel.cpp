@@ -14,14 +14,11 @@
 #include "common.hpp"
 #include "molecule.hpp"
 #include "GeneralModel.hpp"
+#include "physicalconstants.hpp"
+#include "logging.hpp"
 
 #include "kinsol.hpp"
 
-// Physical constants
-static const double F = 9.6485341e4; // nC.nmol^-1
-static const double R = 8.314472e3;  // pJ.nmol^-1.K^-1
-static const double T = 310.0;       // K (value?)
-
 static const double zeroTolerance = 1.0e-4;
 
 static double calcU(const double E)
@@ -34,9 +31,8 @@ static double calcE(const double U)
     return U * R * T / F;
 }
 
-GeneralModel::GeneralModel()
+GeneralModel::GeneralModel() : mActiveTransport(NULL), mActiveFluxFunction(NULL), mActiveDerivativeFunction(NULL)
 {
-    // nothing to do?
 }
 
 GeneralModel::~GeneralModel()
@@ -77,7 +73,7 @@ void GeneralModel::initialise()
 
     minimumPotentialValue = calcU(-200.0);
     maximumPotentialValue = calcU(200.0);
-    std::cout << "Potentials restricted to the range: " << minimumPotentialValue << " <= U <= "
+    *context.diagnostics << "Potentials restricted to the range: " << minimumPotentialValue << " <= U <= "
               << maximumPotentialValue << std::endl;
 }
 
@@ -87,7 +83,8 @@ double GeneralModel::solveCurrentClampPotentials(int& errorFlag, const bool upda
 	/**
 	 * This is the function called by KINSOL when solving for the open-circuit case.
 	 */
-    if (updateOnly && (debugLevel() > 19)) std::cout << "Updating open-circuit electroneutrality" << std::endl;
+    if (updateOnly && GET_CONTEXT_DEBUG(context, 19))
+        *context.diagnostics << "Updating open-circuit electroneutrality" << std::endl;
 
 	/* solve for electroneutrality as per the open-circuit case presented in Figure 4
 	 * of the Latta et al (1984) paper. Talk about E_x but actually using U_x.
@@ -109,14 +106,12 @@ double GeneralModel::solveCurrentClampPotentials(int& errorFlag, const bool upda
     }
     else
     {
-        mode = 0;
-        if (solveOneVariable(this, minimumPotentialValue, maximumPotentialValue) > 0)
+        if (solveOneVariable(this, VoltageClampPotentials, minimumPotentialValue, maximumPotentialValue) > 0)
         {
             std::cerr << "Failed to solve voltage clamp case for U_t = " << U_t << std::endl;
             errorFlag = 1;
             return 0.0;
         }
-        mode = 1;
     }
 
 	/*
@@ -138,7 +133,8 @@ double GeneralModel::solveCurrentClampPotentials(int& errorFlag, const bool upda
     else
     {
         error = I_j + I_a - I_t;
-        if (debugLevel() > 10) std::cout << "Current open-circuit error = " << error << std::endl;
+        if (GET_CONTEXT_DEBUG(context, 10))
+            *context.diagnostics << "Current open-circuit error = " << error << std::endl;
     }
     return error;
 }
@@ -149,9 +145,9 @@ double GeneralModel::solveVoltageClampPotentials(const bool updateOnly)
 	 * This is the function called by KINSOL when solving for the voltage-clamp case.
 	 */
 
-    if (updateOnly && (debugLevel() > 19))
+    if (updateOnly && GET_CONTEXT_DEBUG(context, 19))
     {
-        std::cout << "Updating voltage clamp electroneutrality" << std::endl;
+        *context.diagnostics << "Updating voltage clamp electroneutrality" << std::endl;
     }
 
 	/* solve for electroneutrality as per the voltage-clamp case presented in Figure 3
@@ -167,8 +163,8 @@ double GeneralModel::solveVoltageClampPotentials(const bool updateOnly)
 	 */
 	U_b = U_t - U_a;
 
-    if (debugLevel() > 20)
-        std::cout << "solving/updating for E_a and E_b, current values: U_a=" << U_a << "; U_b=" << U_b
+    if (GET_CONTEXT_DEBUG(context, 20))
+        *context.diagnostics << "solving/updating for E_a and E_b, current values: U_a=" << U_a << "; U_b=" << U_b
                   << "; U_t=" << U_t << std::endl;
 
 	/*
@@ -191,8 +187,10 @@ double GeneralModel::solveVoltageClampPotentials(const bool updateOnly)
     else
     {
         error = I_a - I_b;
-        if (debugLevel() > 99) std::cout << "I_a = " << I_a << "; I_b = " << I_b << "; error = " << error << std::endl;
-        if (debugLevel() > 20) std::cout << "Current voltage-clamp error = " << error << std::endl;
+        if (GET_CONTEXT_DEBUG(context, 99))
+            *context.diagnostics << "I_a = " << I_a << "; I_b = " << I_b << "; error = " << error << std::endl;
+        if (GET_CONTEXT_DEBUG(context, 20))
+            *context.diagnostics << "Current voltage-clamp error = " << error << std::endl;
     }
     return error;
 }
@@ -202,13 +200,17 @@ void GeneralModel::calculateSoluteMembraneFluxes()
     /*
 	 * Apical membrane fluxes assumed to be entirely passive (eq 7)
 	 */
-    if (debugLevel() > 99) std::cout << "apical membrane fluxes";
+    if (GET_CONTEXT_DEBUG(context, 99)) *context.diagnostics << "apical membrane fluxes";
     calculatePassiveFluxes(mJ_a, mP_a, mZ, mC_a, mC_c, U_a);
 	/*
      * Basolateral membrane flux also passive
 	 */
-    if (debugLevel() > 99) std::cout << "basolateral membrane fluxes";
+    if (GET_CONTEXT_DEBUG(context, 99)) *context.diagnostics << "basolateral membrane fluxes";
     calculatePassiveFluxes(mJ_b, mP_b, mZ, mC_c, mC_b, U_b);
+    /*
+     * Plus any active transporters on either membrane
+     */
+    if (mActiveFluxFunction) mActiveFluxFunction(mActiveTransport, *this);
 }
 
 void GeneralModel::calculateSoluteParacellularFluxes()
@@ -223,7 +225,7 @@ void GeneralModel::compute_I_a()
 {
 	I_a = 0;
     for (unsigned int i=0; i<mJ_a.size(); ++i) I_a += (*mZ[i]) * (*mJ_a[i]);
-    if (debugLevel() > 99) std::cout << "pre-I_a = " << I_a;
+    if (GET_CONTEXT_DEBUG(context, 99)) *context.diagnostics << "pre-I_a = " << I_a;
 	I_a *= F * A_a;
 }
 
@@ -231,7 +233,7 @@ void GeneralModel::compute_I_b()
 {
     I_b = 0;
     for (unsigned int i=0; i<mJ_b.size(); ++i) I_b += (*mZ[i]) * (*mJ_b[i]);
-    if (debugLevel() > 99) std::cout << "; pre-I_b = " << I_b << std::endl;
+    if (GET_CONTEXT_DEBUG(context, 99)) *context.diagnostics << "; pre-I_b = " << I_b << std::endl;
     I_b *= F * A_b;
 }
 
@@ -247,72 +249,90 @@ void GeneralModel::calculatePassiveFluxes(std::vector<double*>& J, const std::ve
                                                    const std::vector<double*>& C2, const double U)
 {
     int i, N=J.size();
+    // checked once rather than for each flux
+    const bool trace = GET_CONTEXT_DEBUG(context, 99);
 
     for (i=0; i<N; i++)
     {
         if (fabs((*z[i])*U) > zeroTolerance)
         {
             (*J[i]) = (*P[i]) * (*z[i]) * U * ((*C1[i]) - (*C2[i]) * exp(-(*z[i]) * U)) / (1.0 - exp(-(*z[i]) * U));
-            if (debugLevel() > 99) std::cout << "; J[" << i << "] = " << (*J[i]);
+            if (trace) *context.diagnostics << "; J[" << i << "] = " << (*J[i]);
         }
         else
         {
             // as per my interpretation of footnote 4 of Latta paper, to avoid / by zero and given improved
             // accuracy of double vs float...
             (*J[i]) = (*P[i]) * (*z[i]) * (F / (R * T)) * ((*C1[i]) - (*C2[i]));
-            if (debugLevel() > 99) std::cout << "; Japprox[" << i << "] = " << (*J[i]);
+            if (trace) *context.diagnostics << "; Japprox[" << i << "] = " << (*J[i]);
+        }
+    }
+    if (trace) *context.diagnostics << std::endl;
+}
+
+void GeneralModel::calculatePassiveFluxDerivatives(std::vector<double>& dJdC1, std::vector<double>& dJdC2,
+                                                   std::vector<double>& dJdU, const std::vector<double*>& P,
+                                                   const std::vector<double*>& z, const std::vector<double*>& C1,
+                                                   const std::vector<double*>& C2, const double U)
+{
+    int i, N=P.size();
+
+    for (i=0; i<N; i++)
+    {
+        double zU = (*z[i]) * U;
+        if (fabs(zU) > zeroTolerance)
+        {
+            // J = P.a.(C1 - C2.e)/(1 - e) with a = z.U and e = exp(-a)
+            double e = exp(-zU);
+            double d = 1.0 - e;
+            double c = (*C1[i]) - (*C2[i]) * e;
+            dJdC1[i] = (*P[i]) * zU / d;
+            dJdC2[i] = -(*P[i]) * zU * e / d;
+            dJdU[i] = (*P[i]) * (*z[i]) * ((c + zU * (*C2[i]) * e) / d - zU * e * c / (d * d));
+        }
+        else
+        {
+            // consistent with the small potential approximation used in calculatePassiveFluxes
+            dJdC1[i] = (*P[i]) * (*z[i]) * (F / (R * T));
+            dJdC2[i] = -dJdC1[i];
+            dJdU[i] = 0.0;
         }
     }
-    if (debugLevel() > 99) std::cout << std::endl;
 }
 
-void GeneralModel::printState(std::ostream& s, double &time)
+void GeneralModel::printState(TrajectoryWriter& output, double time)
 {
-    s << time << "\t" << V;
     E_t = calcE(U_t);
     E_a = calcE(U_a);
     E_b = calcE(U_b);
-    s << "\t" << E_t << "\t" << E_a << "\t" << E_b;
-    //for (unsigned int i=0; i< C_c.size(); ++i) s << "\t" << C_c[i];
-    //double JNa_net = J_a[Na] + J_j[Na];
-    //double JK_net = J_a[K] + J_j[K];
-    //s << "\t" << JNa_net << "\t" << JK_net << "\t" << I_t << "\t" << I_a << "\t" << I_b << "\t" << I_j;
-    s << std::endl;
+    double row[] = { time, V, E_t, E_a, E_b };
+    output.writeRow(row);
 }
 
-void GeneralModel::printStateHeader(std::ostream& s)
+std::vector<std::string> GeneralModel::stateColumnNames() const
 {
-    s << "# time";          // 1
-    s << "\tV";             // 2
-    s << "\tE_t";           // 3
-    s << "\tE_a";           // 4
-    s << "\tE_b";           // 5
-    // needs to match the class enum...
-    s << "\tNa";            // 6
-    s << "\tK";             // 7
-    s << "\tCl";            // 8
-    s << "\tX1";            // 9
-    s << "\tX2";            // 10
-    s << "\tJNa_net";       // 11
-    s << "\tJK_net";        // 12
-    s << "\tI_t";           // 13
-    s << "\tI_a";           // 14
-    s << "\tI_b";           // 15
-    s << "\tI_j";           // 16
-    s << std::endl;
+    std::vector<std::string> names;
+    names.push_back("time");    // 1
+    names.push_back("V");       // 2
+    names.push_back("E_t");     // 3
+    names.push_back("E_a");     // 4
+    names.push_back("E_b");     // 5
+    return names;
 }
 
 std::vector<double> GeneralModel::calculateRHS(double time, int &errorFlag)
 {
     std::vector<double> f(mC_c.size() + 1); // number of species + cell volume
+    ++statistics.rhsEvaluations;
 
-    if (debugLevel() > 1) std::cout << "Calculate RHS for time: " << time << std::endl;
+    if (GET_CONTEXT_DEBUG(context, 1))
+        *context.diagnostics << "Calculate RHS for time: " << time << std::endl;
 
     // compute membrane potentials
     if ((modelMode == OpenCircuit) || (modelMode == SaltStepper))
     {
-        mode = 1; // we want to solve for membrane potentials at the open-circuit conditions
-        if (solveOneVariable(this, minimumPotentialValue, maximumPotentialValue) > 0)
+        // we want to solve for membrane potentials at the open-circuit conditions
+        if (solveOneVariable(this, OpenCircuitPotentials, minimumPotentialValue, maximumPotentialValue) > 0)
         {
             std::cerr << "calculateRHS: Failed to solve open circuit case" << std::endl;
             errorFlag = 1;
@@ -321,8 +341,8 @@ std::vector<double> GeneralModel::calculateRHS(double time, int &errorFlag)
     }
     else if (modelMode == ShortCircuit)
     {
-        mode = 0; // we want to solve for membrane potentials at the voltage-clamp conditions
-        if (solveOneVariable(this, minimumPotentialValue, maximumPotentialValue) > 0)
+        // we want to solve for membrane potentials at the voltage-clamp conditions
+        if (solveOneVariable(this, VoltageClampPotentials, minimumPotentialValue, maximumPotentialValue) > 0)
         {
             std::cerr << "calculateRHS: Failed to solve voltage clamp case" << std::endl;
             errorFlag = 2;
@@ -334,6 +354,13 @@ std::vector<double> GeneralModel::calculateRHS(double time, int &errorFlag)
         std::cerr << "Doh! invalid modelMode?" << std::endl;
     }
 
+    return calculateRates();
+}
+
+std::vector<double> GeneralModel::calculateRates()
+{
+    std::vector<double> f(mC_c.size() + 1); // number of species + cell volume
+
     // dV/dt
     calculateWaterFluxes();
     f[0] = A_a * Jw_a + A_b * Jw_b;
@@ -347,6 +374,271 @@ std::vector<double> GeneralModel::calculateRHS(double time, int &errorFlag)
     return f;
 }
 
+std::vector<double> GeneralModel::calculateJacobian(double time, int& errorFlag)
+{
+    unsigned int i, k, N = mC_c.size();
+    unsigned int NEQ = N + 1; // number of species + cell volume
+    std::vector<double> jac(NEQ * NEQ, 0.0);
+    errorFlag = 0;
+    ++statistics.jacobianEvaluations;
+
+    if (GET_CONTEXT_DEBUG(context, 1))
+        *context.diagnostics << "Calculate Jacobian for time: " << time << std::endl;
+
+    // fluxes and their partial derivatives at the current (electroneutral) membrane potentials
+    U_b = U_t - U_a;
+    calculateSoluteMembraneFluxes();
+    std::vector<double> dJa_dCa(N), dJa_dCc(N), dJb_dCc(N), dJb_dCb(N);
+    MembraneFluxDerivatives d;
+    d.dJa_dU.resize(N);
+    d.dJb_dU.resize(N);
+    calculatePassiveFluxDerivatives(dJa_dCa, dJa_dCc, d.dJa_dU, mP_a, mZ, mC_a, mC_c, U_a);
+    calculatePassiveFluxDerivatives(dJb_dCc, dJb_dCb, d.dJb_dU, mP_b, mZ, mC_c, mC_b, U_b);
+    d.dJa_dCc.assign(N * N, 0.0);
+    d.dJb_dCc.assign(N * N, 0.0);
+    for (i = 0; i < N; ++i)
+    {
+        d.dJa_dCc[i*N + i] = dJa_dCc[i];
+        d.dJb_dCc[i*N + i] = dJb_dCc[i];
+    }
+    if (mActiveDerivativeFunction) mActiveDerivativeFunction(mActiveTransport, *this, d);
+
+    // current sensitivities to the intracellular concentrations
+    std::vector<double> dIa_dC(N, 0.0), dIb_dC(N, 0.0), dIj_dC(N, 0.0);
+    for (i = 0; i < N; ++i)
+    {
+        for (k = 0; k < N; ++k)
+        {
+            dIa_dC[k] += (*mZ[i]) * d.dJa_dCc[i*N + k];
+            dIb_dC[k] += (*mZ[i]) * d.dJb_dCc[i*N + k];
+        }
+    }
+    for (k = 0; k < N; ++k)
+    {
+        dIa_dC[k] *= F * A_a;
+        dIb_dC[k] *= F * A_b;
+    }
+
+    // and hence the sensitivities of the membrane potentials to the intracellular concentrations
+    std::vector<double> dUa_dC(N), dUb_dC(N);
+    errorFlag = solvePotentialSensitivities(d, dIa_dC, dIb_dC, dIj_dC, dUa_dC, dUb_dC);
+    if (errorFlag != 0) return jac;
+
+    // dV/dt depends only on the intracellular concentrations
+    calculateWaterFluxes();
+    double f0 = A_a * Jw_a + A_b * Jw_b;
+    for (k = 0; k < N; ++k)
+    {
+        jac[(k+1)*NEQ] = R * T * (A_a * Lp_a * (*mSigma_a[k]) + A_b * Lp_b * (*mSigma_b[k]));
+    }
+
+    // solutes
+    for (i = 0; i < N; ++i)
+    {
+        double fi = (A_a * (*mJ_a[i]) - A_b * (*mJ_b[i]) - (*mC_c[i]) * f0) / V;
+        jac[i+1] = -fi / V;
+        for (k = 0; k < N; ++k)
+        {
+            double dfi = A_a * (d.dJa_dCc[i*N + k] + d.dJa_dU[i] * dUa_dC[k])
+                    - A_b * (d.dJb_dCc[i*N + k] + d.dJb_dU[i] * dUb_dC[k]) - (*mC_c[i]) * jac[(k+1)*NEQ];
+            if (i == k) dfi -= f0;
+            jac[(k+1)*NEQ + i+1] = dfi / V;
+        }
+    }
+    return jac;
+}
+
+int GeneralModel::solvePotentialSensitivities(const MembraneFluxDerivatives& d, const std::vector<double>& dIa,
+                                              const std::vector<double>& dIb, const std::vector<double>& dIj,
+                                              std::vector<double>& dUa, std::vector<double>& dUb)
+{
+    unsigned int i, k, N = mC_c.size(), M = dIa.size();
+    double dIa_dUa = 0.0, dIb_dUb = 0.0;
+    for (i = 0; i < N; ++i)
+    {
+        dIa_dUa += (*mZ[i]) * d.dJa_dU[i];
+        dIb_dUb += (*mZ[i]) * d.dJb_dU[i];
+    }
+    dIa_dUa *= F * A_a;
+    dIb_dUb *= F * A_b;
+
+    /*
+     * Implicit function theorem applied to the electroneutrality conditions.
+     */
+    if ((modelMode == OpenCircuit) || (modelMode == SaltStepper))
+    {
+        // g1 = I_a(U_a) - I_b(U_t - U_a) = 0 and g2 = I_j(U_t) + I_a(U_a) - I_t = 0
+        std::vector<double> dJj_dCa(N), dJj_dCb(N), dJj_dU(N);
+        calculatePassiveFluxDerivatives(dJj_dCa, dJj_dCb, dJj_dU, mP_j, mZ, mC_a, mC_b, U_t);
+        double dIj_dUt = 0.0;
+        for (i = 0; i < N; ++i) dIj_dUt += (*mZ[i]) * dJj_dU[i];
+        dIj_dUt *= F * A_a;
+        double a11 = dIa_dUa + dIb_dUb, a12 = -dIb_dUb;
+        double a21 = dIa_dUa, a22 = dIj_dUt;
+        double det = a11 * a22 - a12 * a21;
+        if (det == 0.0)
+        {
+            std::cerr << "solvePotentialSensitivities: singular open circuit electroneutrality system" << std::endl;
+            return 1;
+        }
+        for (k = 0; k < M; ++k)
+        {
+            double dg1 = dIa[k] - dIb[k];
+            double dg2 = dIa[k] + dIj[k];
+            double dUt = (a21 * dg1 - a11 * dg2) / det;
+            dUa[k] = (a12 * dg2 - a22 * dg1) / det;
+            dUb[k] = dUt - dUa[k];
+        }
+    }
+    else if (modelMode == ShortCircuit)
+    {
+        // g = I_a(U_a) - I_b(U_t - U_a) = 0, with U_t clamped
+        double a = dIa_dUa + dIb_dUb;
+        if (a == 0.0)
+        {
+            std::cerr << "solvePotentialSensitivities: singular voltage clamp electroneutrality system" << std::endl;
+            return 2;
+        }
+        for (k = 0; k < M; ++k)
+        {
+            dUa[k] = -(dIa[k] - dIb[k]) / a;
+            dUb[k] = -dUa[k];
+        }
+    }
+    else
+    {
+        std::cerr << "Doh! invalid modelMode?" << std::endl;
+    }
+    return 0;
+}
+
+std::vector<double> GeneralModel::calculateParameterDerivatives(const std::vector<double*>& parameters, double time,
+                                                                int& errorFlag)
+{
+    unsigned int i, p, N = mC_c.size(), NP = parameters.size();
+    unsigned int NEQ = N + 1; // number of species + cell volume
+    std::vector<double> dfdp(NEQ * NP, 0.0);
+    errorFlag = 0;
+
+    if (GET_CONTEXT_DEBUG(context, 1))
+        *context.diagnostics << "Calculate parameter derivatives for time: " << time << std::endl;
+
+    // fluxes and their partial derivatives at the current (electroneutral) membrane potentials
+    U_b = U_t - U_a;
+    calculateSoluteMembraneFluxes();
+    calculateSoluteParacellularFluxes();
+    std::vector<double> dJa_dCa(N), dJa_dCc(N), dJb_dCc(N), dJb_dCb(N);
+    MembraneFluxDerivatives d;
+    d.dJa_dU.resize(N);
+    d.dJb_dU.resize(N);
+    calculatePassiveFluxDerivatives(dJa_dCa, dJa_dCc, d.dJa_dU, mP_a, mZ, mC_a, mC_c, U_a);
+    calculatePassiveFluxDerivatives(dJb_dCc, dJb_dCb, d.dJb_dU, mP_b, mZ, mC_c, mC_b, U_b);
+    // the active fluxes depend on neither the parameters nor the membrane potentials, so they add nothing here
+
+    // the passive fluxes are linear in the permeabilities, so we need the fluxes for unit permeability
+    std::vector<double> unit(N, 1.0), phi_a(N), phi_b(N), phi_j(N);
+    std::vector<double*> unitP(N), pPhi_a(N), pPhi_b(N), pPhi_j(N);
+    for (i = 0; i < N; ++i)
+    {
+        unitP[i] = &unit[i];
+        pPhi_a[i] = &phi_a[i];
+        pPhi_b[i] = &phi_b[i];
+        pPhi_j[i] = &phi_j[i];
+    }
+    calculatePassiveFluxes(pPhi_a, unitP, mZ, mC_a, mC_c, U_a);
+    calculatePassiveFluxes(pPhi_b, unitP, mZ, mC_c, mC_b, U_b);
+    calculatePassiveFluxes(pPhi_j, unitP, mZ, mC_a, mC_b, U_t);
+
+    /*
+     * The partial derivatives of the fluxes, currents and rates with respect to each parameter at fixed membrane
+     * potentials.
+     */
+    double dJwa_dLpa = 0.0, dJwb_dLpb = 0.0;
+    for (i = 0; i < N; ++i)
+    {
+        dJwa_dLpa += (*mSigma_a[i]) * ((*mC_c[i]) - (*mC_a[i]));
+        dJwb_dLpb += (*mSigma_b[i]) * ((*mC_c[i]) - (*mC_b[i]));
+    }
+    dJwa_dLpa *= R * T;
+    dJwb_dLpb *= R * T;
+    calculateWaterFluxes();
+    std::vector<double> dIa(NP, 0.0), dIb(NP, 0.0), dIj(NP, 0.0);
+    for (p = 0; p < NP; ++p)
+    {
+        double* parameter = parameters[p];
+        double* df = &dfdp[p*NEQ];
+        if (parameter == &Lp_a) df[0] = A_a * dJwa_dLpa;
+        else if (parameter == &Lp_b) df[0] = A_b * dJwb_dLpb;
+        else if (parameter == &A_a)
+        {
+            df[0] = Jw_a;
+            for (i = 0; i < N; ++i)
+            {
+                df[i+1] = (*mJ_a[i]) / V;
+                dIa[p] += (*mZ[i]) * (*mJ_a[i]);
+                dIj[p] += (*mZ[i]) * (*mJ_j[i]);
+            }
+            dIa[p] *= F;
+            dIj[p] *= F;
+        }
+        else if (parameter == &A_b)
+        {
+            df[0] = Jw_b;
+            for (i = 0; i < N; ++i)
+            {
+                df[i+1] = -(*mJ_b[i]) / V;
+                dIb[p] += (*mZ[i]) * (*mJ_b[i]);
+            }
+            dIb[p] *= F;
+        }
+        else
+        {
+            bool found = false;
+            for (i = 0; (i < N) && !found; ++i)
+            {
+                if (parameter == mP_a[i])
+                {
+                    df[i+1] = A_a * phi_a[i] / V;
+                    dIa[p] = F * A_a * (*mZ[i]) * phi_a[i];
+                    found = true;
+                }
+                else if (parameter == mP_b[i])
+                {
+                    df[i+1] = -A_b * phi_b[i] / V;
+                    dIb[p] = F * A_b * (*mZ[i]) * phi_b[i];
+                    found = true;
+                }
+                else if (parameter == mP_j[i])
+                {
+                    dIj[p] = F * A_a * (*mZ[i]) * phi_j[i];
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                std::cerr << "calculateParameterDerivatives: unknown parameter" << std::endl;
+                errorFlag = 3;
+                return dfdp;
+            }
+        }
+        // the volume change dilutes the intracellular concentrations
+        for (i = 0; i < N; ++i) df[i+1] -= (*mC_c[i]) * df[0] / V;
+    }
+
+    // and add in the effect of the parameters on the membrane potentials
+    std::vector<double> dUa(NP), dUb(NP);
+    errorFlag = solvePotentialSensitivities(d, dIa, dIb, dIj, dUa, dUb);
+    if (errorFlag != 0) return dfdp;
+    for (p = 0; p < NP; ++p)
+    {
+        for (i = 0; i < N; ++i)
+        {
+            dfdp[p*NEQ + i+1] += (A_a * d.dJa_dU[i] * dUa[p] - A_b * d.dJb_dU[i] * dUb[p]) / V;
+        }
+    }
+    return dfdp;
+}
+
 void GeneralModel::calculateWaterFluxes()
 {
     Jw_a = Jw_b = 0;
@@ -375,6 +667,64 @@ void GeneralModel::initialiseSaltStepper()
 #endif
 }
 
+int GeneralModel::moleculeIndex(const std::string& typeId) const
+{
+    int index = 0;
+    for (auto i=mMolecules.begin(); i!=mMolecules.end(); ++i, ++index)
+    {
+        if (i->first == typeId) return index;
+    }
+    return -1;
+}
+
+std::string GeneralModel::moleculeTypeId(int index) const
+{
+    int j = 0;
+    for (auto i=mMolecules.begin(); i!=mMolecules.end(); ++i, ++j)
+    {
+        if (j == index) return i->first;
+    }
+    return "";
+}
+
+bool GeneralModel::isMembranePermeant(int index) const
+{
+    if ((*mP_a[index] != 0.0) || (*mP_b[index] != 0.0)) return true;
+    if (mActivelyTransported.size() > (unsigned int)index) return mActivelyTransported[index];
+    return false;
+}
+
+std::vector<std::string> GeneralModel::parameterNames() const
+{
+    std::vector<std::string> names;
+    names.push_back("Lp_a");
+    names.push_back("Lp_b");
+    names.push_back("A_a");
+    names.push_back("A_b");
+    const char* permeabilities[] = { "P_a", "P_b", "P_j" };
+    for (int p = 0; p < 3; ++p)
+        for (auto i = mMolecules.begin(); i != mMolecules.end(); ++i)
+            names.push_back(std::string(permeabilities[p]) + "[" + i->first + "]");
+    return names;
+}
+
+double* GeneralModel::parameter(const std::string& name)
+{
+    if (name == "Lp_a") return &Lp_a;
+    if (name == "Lp_b") return &Lp_b;
+    if (name == "A_a") return &A_a;
+    if (name == "A_b") return &A_b;
+    size_t open = name.find('[');
+    if ((open == std::string::npos) || (name[name.size()-1] != ']')) return NULL;
+    int index = moleculeIndex(name.substr(open+1, name.size()-open-2));
+    if ((index < 0) || (index >= (int)mP_a.size())) return NULL;
+    std::string permeability = name.substr(0, open);
+    if (permeability == "P_a") return mP_a[index];
+    if (permeability == "P_b") return mP_b[index];
+    if (permeability == "P_j") return mP_j[index];
+    return NULL;
+}
+
 int GeneralModel::addMolecule(const Molecule &molecule)
 {
     if (mMolecules.count(molecule.typeId) > 0)
@@ -15,8 +15,25 @@
 
 #include <vector>
 #include <map>
+#include <string>
 
+#include "common.hpp"
+#include "solverstatistics.hpp"
 #include "molecule.hpp"
+#include "trajectorywriter.hpp"
+
+/**
+ * Partial derivatives of the membrane fluxes with respect to the intracellular concentrations and the membrane
+ * potentials, used by active transport terms to contribute to the Jacobian.
+ */
+class MembraneFluxDerivatives
+{
+public:
+    // d(J_a[i])/d(C_c[k]) and d(J_b[i])/d(C_c[k]), stored row-major as [i*N + k]
+    std::vector<double> dJa_dCc, dJb_dCc;
+    // d(J_a[i])/d(U_a) and d(J_b[i])/d(U_b)
+    std::vector<double> dJa_dU, dJb_dU;
+};
 
 /**
  * This class defines a general epithelial transport model based on the Latta et al (1984)
@@ -35,6 +52,61 @@ public:
      */
     int addMolecule(const Molecule& molecule);
 
+    /**
+     * @brief Get the index of the molecule with the given type ID in the model vectors (mC_c, mJ_a, etc.).
+     * @param typeId The type ID of the molecule.
+     * @return The index of the molecule, or -1 if the molecule is not in this model.
+     */
+    int moleculeIndex(const std::string& typeId) const;
+
+    /**
+     * @brief Get the type ID of the molecule at the given index in the model vectors.
+     * @param index The index of the molecule.
+     * @return The type ID of the molecule, or an empty string if the index is out of range.
+     */
+    std::string moleculeTypeId(int index) const;
+
+    /**
+     * @brief Add the given set of active transporters to the membrane fluxes of this model.
+     * The transporters are composed at compile time (see transporters.hpp), so the only indirection is a single
+     * call per membrane flux evaluation. The transporter set must outlive this model and the molecules it refers
+     * to must have already been added to the model.
+     * @param transporters The transporter set.
+     * @return zero on success.
+     */
+    template<class Transporters>
+    int setActiveTransport(Transporters& transporters)
+    {
+        if (transporters.resolve(*this) != 0) return -1;
+        mActivelyTransported.assign(mMolecules.size(), false);
+        transporters.markTransported(mActivelyTransported);
+        mActiveTransport = static_cast<void*>(&transporters);
+        mActiveFluxFunction = &evaluateActiveFluxes<Transporters>;
+        mActiveDerivativeFunction = &evaluateActiveFluxDerivatives<Transporters>;
+        return 0;
+    }
+
+    /**
+     * @brief Check if the given molecule is able to cross either of the cell membranes.
+     * @param index The index of the molecule.
+     * @return true if the molecule has a passive permeability or is actively transported.
+     */
+    bool isMembranePermeant(int index) const;
+
+    /**
+     * @brief Get the location of the named parameter in this model, for use with sensitivity analysis etc.
+     * Parameters are named Lp_a, Lp_b, A_a, A_b, or P_a[typeId], P_b[typeId] and P_j[typeId] for the
+     * permeabilities of the molecule with the given type ID. The model must have been initialised.
+     * @param name The name of the parameter.
+     * @return A pointer to the parameter value, or NULL if there is no such parameter.
+     */
+    double* parameter(const std::string& name);
+
+    /**
+     * @brief The names of all the parameters in this model that can be used with parameter.
+     */
+    std::vector<std::string> parameterNames() const;
+
 	/**
 	 * Initialise the model
 	 */
@@ -76,32 +148,69 @@ public:
                                 const std::vector<double *> &z, const std::vector<double *> &C1,
                                 const std::vector<double *> &C2, const double U);
 
+    /**
+      * Generic method for evaluating the partial derivatives of the passive fluxes with respect to the
+      * concentrations on either side of the membrane and the (non-dimensional) membrane potential.
+      */
+    void calculatePassiveFluxDerivatives(std::vector<double>& dJdC1, std::vector<double>& dJdC2,
+                                         std::vector<double>& dJdU, const std::vector<double *> &P,
+                                         const std::vector<double *> &z, const std::vector<double *> &C1,
+                                         const std::vector<double *> &C2, const double U);
+
     /**
       * Compute the water fluxes for the current state of the cell.
       */
     void calculateWaterFluxes();
 
     /**
-      Print the current state of the model.
+      Write the current state of the model as a row of the trajectory.
       */
-    void printState(std::ostream& s, double& time);
+    void printState(TrajectoryWriter& output, double time);
 
     /**
-      Print the header for the states in this model.
+      The names of the columns written by printState.
       */
-    void printStateHeader(std::ostream& s);
+    std::vector<std::string> stateColumnNames() const;
 
     /**
       Calculate the RHS of the differential equation system.
       */
     std::vector<double> calculateRHS(double time, int& errorFlag);
 
+    /**
+      Calculate the RHS of the differential equation system at the current membrane potentials, without solving
+      for electroneutrality first, e.g., when the potentials are solved for a sheet of cells together.
+      */
+    std::vector<double> calculateRates();
+
+    /**
+      Calculate the Jacobian of the RHS with respect to the state variables (cell volume and intracellular
+      concentrations). The membrane potentials are treated as implicit functions of the intracellular
+      concentrations through the electroneutrality conditions, so this must be called with the potentials
+      that were solved for in the most recent RHS evaluation at the current state.
+      @return The dense Jacobian stored column-major, i.e., element (i,j) is at [j*NEQ + i].
+      */
+    std::vector<double> calculateJacobian(double time, int& errorFlag);
+
+    /**
+      Calculate the partial derivatives of the RHS with respect to the given parameters (see parameter), including
+      their effect on the electroneutral membrane potentials. As for calculateJacobian, this must be called with
+      the potentials that were solved for in the most recent RHS evaluation at the current state.
+      @return The derivatives stored column-major, i.e., the derivative of f[i] with respect to parameter p is at
+      [p*NEQ + i].
+      */
+    std::vector<double> calculateParameterDerivatives(const std::vector<double*>& parameters, double time,
+                                                      int& errorFlag);
+
 	void compute_I_a();
     void compute_I_b();
     void compute_I_j();
 
-	// the current mode for Kinsol
-	int mode;
+    // the settings and diagnostic output of this model's simulation, used by the model and its solvers
+    SimulationContext context;
+
+    // the evaluations of this model and the KINSOL solves for its membrane potentials, counted by the solvers
+    SolverStatistics statistics;
 
     // the current mode for the model
     enum ModelMode
@@ -140,7 +249,35 @@ public:
     std::vector<double*> mZ;
 
 private:
+    /**
+      Solve the linearised electroneutrality conditions for the changes in the apical and basolateral membrane
+      potentials corresponding to the given changes in the currents at fixed potentials.
+      @return zero on success.
+      */
+    int solvePotentialSensitivities(const MembraneFluxDerivatives& d, const std::vector<double>& dIa,
+                                    const std::vector<double>& dIb, const std::vector<double>& dIj,
+                                    std::vector<double>& dUa, std::vector<double>& dUb);
+
+    template<class Transporters>
+    static void evaluateActiveFluxes(void* transporters, GeneralModel& model)
+    {
+        static_cast<Transporters*>(transporters)->addFluxes(model);
+    }
+
+    template<class Transporters>
+    static void evaluateActiveFluxDerivatives(void* transporters, const GeneralModel& model,
+                                              MembraneFluxDerivatives& derivatives)
+    {
+        static_cast<Transporters*>(transporters)->addDerivatives(model, derivatives);
+    }
+
     std::map<std::string, Molecule> mMolecules;
+
+    // active transport
+    void* mActiveTransport;
+    void (*mActiveFluxFunction)(void*, GeneralModel&);
+    void (*mActiveDerivativeFunction)(void*, const GeneralModel&, MembraneFluxDerivatives&);
+    std::vector<bool> mActivelyTransported;
 };
 
 #endif /* GENERALMODEL_HPP_ */
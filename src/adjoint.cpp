@@ -0,0 +1,461 @@
+/*
+ * adjoint.cpp
+ *
+ * Adjoint sensitivity analysis of scalar objectives for GeneralModel.
+ */
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <cvodes/cvodes.h>
+#include <cvodes/cvodes_dense.h>
+#include <nvector/nvector_serial.h>
+#include <sundials/sundials_types.h>
+#include <sundials/sundials_dense.h>
+
+#include "common.hpp"
+#include "GeneralModel.hpp"
+#include "adjoint.hpp"
+#include "trajectorywriter.hpp"
+#include "logging.hpp"
+
+#define ZERO   RCONST(0.0)
+
+#define RTOL  RCONST(1.0e-5)   /* scalar relative tolerance            */
+#define ATOL  RCONST(1.0e-6)   /* vector absolute tolerance components */
+#define MAX_STEPS 100000
+#define CHECKPOINT_STEPS 100   /* integration steps between checkpoints */
+
+typedef struct
+{
+    GeneralModel* model;
+    std::vector<double*> parameters;
+    const AdjointObjective* objective;
+    // work space for the objective evaluations
+    std::vector<double> y, dgdy;
+} AdjointData;
+
+/* Functions Called by the CVODES Solver */
+static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data);
+static int jac(long int N, realtype t, N_Vector y, N_Vector fy, DlsMat J, void *user_data,
+               N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
+static int fQ(realtype t, N_Vector y, N_Vector qdot, void *user_data);
+static int fB(realtype t, N_Vector y, N_Vector yB, N_Vector yBdot, void *user_dataB);
+static int jacB(long int NB, realtype t, N_Vector y, N_Vector yB, N_Vector fyB, DlsMat JB, void *user_dataB,
+                N_Vector tmp1B, N_Vector tmp2B, N_Vector tmp3B);
+static int fQB(realtype t, N_Vector y, N_Vector yB, N_Vector qBdot, void *user_dataB);
+
+/* Private Helper Functions */
+static int evaluateModel(AdjointData* data, realtype t, N_Vector y);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+
+/*
+ * The CVODES memory and vectors used in computing the gradient, freed however we leave computeAdjointGradient.
+ */
+class AdjointMemory
+{
+public:
+    AdjointMemory() : cvodeMem(NULL), y(NULL), abstol(NULL), q(NULL), yB(NULL), qB(NULL)
+    {
+    }
+    ~AdjointMemory()
+    {
+        if (y) N_VDestroy_Serial(y);
+        if (abstol) N_VDestroy_Serial(abstol);
+        if (q) N_VDestroy_Serial(q);
+        if (yB) N_VDestroy_Serial(yB);
+        if (qB) N_VDestroy_Serial(qB);
+        if (cvodeMem) CVodeFree(&cvodeMem);
+    }
+    void* cvodeMem;
+    N_Vector y, abstol, q, yB, qB;
+};
+
+int computeAdjointGradient(GeneralModel* model, const std::vector<double*>& parameters, double t0, double tf,
+                           const AdjointObjective& objective, double& value, std::vector<double>& gradient)
+{
+    if ((objective.integrand && !objective.integrandGradient)
+            || (objective.terminal && !objective.terminalGradient))
+    {
+        std::cerr << "computeAdjointGradient: the objective must provide the gradients of its integrand and "
+                  << "terminal parts" << std::endl;
+        return -1;
+    }
+    unsigned int i, N = model->mC_c.size();
+    unsigned int NEQ = N + 1; // number of species + cell volume
+    unsigned int NP = parameters.size();
+    AdjointData data;
+    data.model = model;
+    data.parameters = parameters;
+    data.objective = &objective;
+    data.y.resize(NEQ);
+    data.dgdy.resize(NEQ);
+    AdjointMemory mem;
+    realtype t;
+    int flag;
+
+    /*
+     * Forward integration, with checkpointing, of the model and the integrated part of the objective.
+     */
+    mem.y = N_VNew_Serial(NEQ);
+    if (check_flag((void *)mem.y, "N_VNew_Serial", 0)) return(1);
+    mem.abstol = N_VNew_Serial(NEQ);
+    if (check_flag((void *)mem.abstol, "N_VNew_Serial", 0)) return(1);
+    NV_Ith_S(mem.y, 0) = model->V;
+    for (i = 0; i < N; ++i) NV_Ith_S(mem.y, i+1) = *(model->mC_c[i]);
+    // tighter tolerance on volume which is several orders of magnitude smaller than the concentrations
+    NV_Ith_S(mem.abstol, 0) = ATOL / 100.0;
+    for (i = 0; i < N; ++i) NV_Ith_S(mem.abstol, i+1) = ATOL;
+
+    mem.cvodeMem = CVodeCreate(CV_BDF, CV_NEWTON);
+    if (check_flag((void *)mem.cvodeMem, "CVodeCreate", 0)) return(1);
+    flag = CVodeInit(mem.cvodeMem, f, t0, mem.y);
+    if (check_flag(&flag, "CVodeInit", 1)) return(1);
+    flag = CVodeSVtolerances(mem.cvodeMem, RTOL, mem.abstol);
+    if (check_flag(&flag, "CVodeSVtolerances", 1)) return(1);
+    flag = CVodeSetUserData(mem.cvodeMem, static_cast<void*>(&data));
+    if (check_flag(&flag, "CVodeSetUserData", 1)) return(1);
+    flag = CVodeSetMaxNumSteps(mem.cvodeMem, MAX_STEPS);
+    if (check_flag(&flag, "CVodeSetMaxNumSteps", 1)) return(1);
+    flag = CVDense(mem.cvodeMem, NEQ);
+    if (check_flag(&flag, "CVDense", 1)) return(1);
+    flag = CVDlsSetDenseJacFn(mem.cvodeMem, jac);
+    if (check_flag(&flag, "CVDlsSetDenseJacFn", 1)) return(1);
+    if (objective.integrand)
+    {
+        mem.q = N_VNew_Serial(1);
+        if (check_flag((void *)mem.q, "N_VNew_Serial", 0)) return(1);
+        NV_Ith_S(mem.q, 0) = ZERO;
+        flag = CVodeQuadInit(mem.cvodeMem, fQ, mem.q);
+        if (check_flag(&flag, "CVodeQuadInit", 1)) return(1);
+    }
+    flag = CVodeAdjInit(mem.cvodeMem, CHECKPOINT_STEPS, CV_HERMITE);
+    if (check_flag(&flag, "CVodeAdjInit", 1)) return(1);
+
+    int numberOfCheckpoints;
+    flag = CVodeF(mem.cvodeMem, tf, mem.y, &t, CV_NORMAL, &numberOfCheckpoints);
+    if (check_flag(&flag, "CVodeF", 1)) return(2);
+    if (GET_CONTEXT_DEBUG(model->context, 0))
+        *model->context.diagnostics << "computeAdjointGradient: number of checkpoints = " << numberOfCheckpoints
+                                    << std::endl;
+
+    value = 0.0;
+    for (i = 0; i < NEQ; ++i) data.y[i] = NV_Ith_S(mem.y, i);
+    std::vector<double> finalState(data.y);
+    if (objective.integrand)
+    {
+        flag = CVodeGetQuad(mem.cvodeMem, &t, mem.q);
+        if (check_flag(&flag, "CVodeGetQuad", 1)) return(2);
+        value += NV_Ith_S(mem.q, 0);
+    }
+    if (objective.terminal) value += objective.terminal(data.y);
+
+    /*
+     * Backward integration of the adjoint system
+     *    lambda' = -(df/dy)^T lambda - (dg/dy)^T, lambda(tf) = (dphi/dy)^T
+     * along with the quadrature for the gradient
+     *    dG/dp = integral from t0 to tf of lambda^T df/dp dt
+     */
+    gradient.assign(NP, 0.0);
+    if (NP > 0)
+    {
+        mem.yB = N_VNew_Serial(NEQ);
+        if (check_flag((void *)mem.yB, "N_VNew_Serial", 0)) return(1);
+        mem.qB = N_VNew_Serial(NP);
+        if (check_flag((void *)mem.qB, "N_VNew_Serial", 0)) return(1);
+        N_VConst_Serial(ZERO, mem.yB);
+        N_VConst_Serial(ZERO, mem.qB);
+        if (objective.terminal)
+        {
+            objective.terminalGradient(data.y, data.dgdy);
+            for (i = 0; i < NEQ; ++i) NV_Ith_S(mem.yB, i) = data.dgdy[i];
+        }
+
+        int which;
+        flag = CVodeCreateB(mem.cvodeMem, CV_BDF, CV_NEWTON, &which);
+        if (check_flag(&flag, "CVodeCreateB", 1)) return(1);
+        flag = CVodeInitB(mem.cvodeMem, which, fB, tf, mem.yB);
+        if (check_flag(&flag, "CVodeInitB", 1)) return(1);
+        flag = CVodeSStolerancesB(mem.cvodeMem, which, RTOL, ATOL);
+        if (check_flag(&flag, "CVodeSStolerancesB", 1)) return(1);
+        flag = CVodeSetUserDataB(mem.cvodeMem, which, static_cast<void*>(&data));
+        if (check_flag(&flag, "CVodeSetUserDataB", 1)) return(1);
+        flag = CVodeSetMaxNumStepsB(mem.cvodeMem, which, MAX_STEPS);
+        if (check_flag(&flag, "CVodeSetMaxNumStepsB", 1)) return(1);
+        flag = CVDenseB(mem.cvodeMem, which, NEQ);
+        if (check_flag(&flag, "CVDenseB", 1)) return(1);
+        flag = CVDlsSetDenseJacFnB(mem.cvodeMem, which, jacB);
+        if (check_flag(&flag, "CVDlsSetDenseJacFnB", 1)) return(1);
+        flag = CVodeQuadInitB(mem.cvodeMem, which, fQB, mem.qB);
+        if (check_flag(&flag, "CVodeQuadInitB", 1)) return(1);
+
+        flag = CVodeB(mem.cvodeMem, t0, CV_NORMAL);
+        if (check_flag(&flag, "CVodeB", 1)) return(3);
+        flag = CVodeGetB(mem.cvodeMem, which, &t, mem.yB);
+        if (check_flag(&flag, "CVodeGetB", 1)) return(3);
+        flag = CVodeGetQuadB(mem.cvodeMem, which, &t, mem.qB);
+        if (check_flag(&flag, "CVodeGetQuadB", 1)) return(3);
+        // the initial state is independent of the parameters, so there is no lambda(t0)^T dy0/dp term
+        for (unsigned int p = 0; p < NP; ++p) gradient[p] = NV_Ith_S(mem.qB, p);
+    }
+
+    // leave the model at its final state
+    model->V = finalState[0];
+    for (i = 0; i < N; ++i) *(model->mC_c[i]) = finalState[i+1];
+    int errorFlag = 0;
+    model->calculateRHS(tf, errorFlag);
+    return errorFlag;
+}
+
+int createTrajectoryErrorObjective(const std::string& filename, const GeneralModel& model,
+                                   AdjointObjective& objective)
+{
+    // either format written by get-simulator
+    std::vector<std::string> names;
+    std::vector<std::vector<double> > rows;
+    if (readTrajectory(filename, names, rows) != 0)
+    {
+        std::cerr << "createTrajectoryErrorObjective: unable to read the reference trajectory: " << filename
+                  << std::endl;
+        return -1;
+    }
+    // the reference data and which state variable each column corresponds to
+    struct Reference
+    {
+        std::vector<double> times;
+        std::vector<int> states;
+        std::vector<std::vector<double> > values;
+        std::vector<double> weights;
+    };
+    std::shared_ptr<Reference> reference(new Reference());
+    std::vector<int> columns;
+    // map the column names to state variables
+    for (unsigned int column = 0; column < names.size(); ++column)
+    {
+        const std::string& name = names[column];
+        int state = -1;
+        if (name == "V") state = 0;
+        else
+        {
+            for (unsigned int i = 0; i < model.mC_c.size(); ++i)
+            {
+                std::string typeId = model.moleculeTypeId(i);
+                if (typeId.substr(typeId.find_last_of('/') + 1) == name) state = i + 1;
+            }
+        }
+        if (state >= 0)
+        {
+            columns.push_back(column);
+            reference->states.push_back(state);
+        }
+    }
+    reference->values.resize(columns.size());
+    for (const std::vector<double>& values: rows)
+    {
+        if (values.empty() || columns.empty()) continue;
+        if (!reference->times.empty() && (values[0] < reference->times.back())) continue;
+        reference->times.push_back(values[0]);
+        for (unsigned int k = 0; k < columns.size(); ++k)
+            reference->values[k].push_back(((unsigned int)columns[k] < values.size()) ? values[columns[k]] : 0.0);
+    }
+    if (reference->times.empty() || columns.empty())
+    {
+        std::cerr << "createTrajectoryErrorObjective: no usable data in the reference trajectory: " << filename
+                  << std::endl;
+        return -2;
+    }
+    for (unsigned int k = 0; k < columns.size(); ++k)
+    {
+        double scale = 0.0;
+        for (unsigned int j = 0; j < reference->times.size(); ++j)
+            scale = std::max(scale, fabs(reference->values[k][j]));
+        reference->weights.push_back((scale > 0.0) ? 1.0 / (scale * scale) : 1.0);
+    }
+
+    // linear interpolation of the k'th reference variable, held constant outside the reference time range
+    auto interpolate = [reference](unsigned int k, double t)
+    {
+        const std::vector<double>& times = reference->times;
+        const std::vector<double>& values = reference->values[k];
+        if (t <= times.front()) return values.front();
+        if (t >= times.back()) return values.back();
+        unsigned int j = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+        double dt = times[j] - times[j-1];
+        if (dt <= 0.0) return values[j];
+        return values[j-1] + (values[j] - values[j-1]) * (t - times[j-1]) / dt;
+    };
+    objective.integrand = [reference, interpolate](double t, const std::vector<double>& y)
+    {
+        double g = 0.0;
+        for (unsigned int k = 0; k < reference->states.size(); ++k)
+        {
+            double e = y[reference->states[k]] - interpolate(k, t);
+            g += reference->weights[k] * e * e;
+        }
+        return g;
+    };
+    objective.integrandGradient = [reference, interpolate](double t, const std::vector<double>& y,
+            std::vector<double>& dgdy)
+    {
+        dgdy.assign(y.size(), 0.0);
+        for (unsigned int k = 0; k < reference->states.size(); ++k)
+        {
+            int s = reference->states[k];
+            dgdy[s] += 2.0 * reference->weights[k] * (y[s] - interpolate(k, t));
+        }
+    };
+    return 0;
+}
+
+/*
+ *--------------------------------------------------------------------
+ * FUNCTIONS CALLED BY CVODES
+ *--------------------------------------------------------------------
+ */
+
+static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_data);
+    GeneralModel* model = data->model;
+    model->V = NV_Ith_S(y, 0);
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = NV_Ith_S(y, i+1);
+
+    int errorFlag = 0;
+    std::vector<double> rates = model->calculateRHS((double)t, errorFlag);
+    if (errorFlag != 0) return 1; // positive value to indicate a recoverable failure
+    for (unsigned int i = 0; i < rates.size(); ++i) NV_Ith_S(ydot, i) = rates[i];
+    return 0;
+}
+
+/*
+ * As for the Cvodes wrapper, CVODES always evaluates f(t,y) immediately before asking for the Jacobian at y so the
+ * membrane potentials held by the model are those for this state.
+ */
+static int jac(long int N, realtype t, N_Vector y, N_Vector fy, DlsMat J, void *user_data,
+               N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_data);
+    GeneralModel* model = data->model;
+    model->V = NV_Ith_S(y, 0);
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = NV_Ith_S(y, i+1);
+
+    int errorFlag = 0;
+    std::vector<double> dfdy = model->calculateJacobian((double)t, errorFlag);
+    if (errorFlag != 0) return 1;
+    for (long int j = 0; j < N; ++j)
+        for (long int i = 0; i < N; ++i) DENSE_ELEM(J, i, j) = dfdy[j*N + i];
+    return 0;
+}
+
+static int fQ(realtype t, N_Vector y, N_Vector qdot, void *user_data)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_data);
+    for (unsigned int i = 0; i < data->y.size(); ++i) data->y[i] = NV_Ith_S(y, i);
+    NV_Ith_S(qdot, 0) = data->objective->integrand((double)t, data->y);
+    return 0;
+}
+
+/*
+ * The adjoint right hand side, -(df/dy)^T yB - (dg/dy)^T. The forward solution y at t is interpolated by CVODES
+ * from the checkpoints, so here we need to solve for the corresponding membrane potentials.
+ */
+static int fB(realtype t, N_Vector y, N_Vector yB, N_Vector yBdot, void *user_dataB)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_dataB);
+    if (evaluateModel(data, t, y) != 0) return 1;
+    int errorFlag = 0;
+    std::vector<double> dfdy = data->model->calculateJacobian((double)t, errorFlag);
+    if (errorFlag != 0) return 1;
+    unsigned int NEQ = data->y.size();
+    if (data->objective->integrand) data->objective->integrandGradient((double)t, data->y, data->dgdy);
+    else data->dgdy.assign(NEQ, 0.0);
+    for (unsigned int i = 0; i < NEQ; ++i)
+    {
+        double sum = data->dgdy[i];
+        for (unsigned int j = 0; j < NEQ; ++j) sum += dfdy[i*NEQ + j] * NV_Ith_S(yB, j);
+        NV_Ith_S(yBdot, i) = -sum;
+    }
+    return 0;
+}
+
+static int jacB(long int NB, realtype t, N_Vector y, N_Vector yB, N_Vector fyB, DlsMat JB, void *user_dataB,
+                N_Vector tmp1B, N_Vector tmp2B, N_Vector tmp3B)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_dataB);
+    if (evaluateModel(data, t, y) != 0) return 1;
+    int errorFlag = 0;
+    std::vector<double> dfdy = data->model->calculateJacobian((double)t, errorFlag);
+    if (errorFlag != 0) return 1;
+    for (long int j = 0; j < NB; ++j)
+        for (long int i = 0; i < NB; ++i) DENSE_ELEM(JB, i, j) = -dfdy[i*NB + j];
+    return 0;
+}
+
+/*
+ * The gradient quadrature, integrated backward from tf so that qB(t0) = integral from t0 to tf of yB^T df/dp dt.
+ */
+static int fQB(realtype t, N_Vector y, N_Vector yB, N_Vector qBdot, void *user_dataB)
+{
+    AdjointData* data = static_cast<AdjointData*>(user_dataB);
+    if (evaluateModel(data, t, y) != 0) return 1;
+    int errorFlag = 0;
+    std::vector<double> dfdp = data->model->calculateParameterDerivatives(data->parameters, (double)t, errorFlag);
+    if (errorFlag != 0) return -1; // unknown parameters will not go away
+    unsigned int NEQ = data->y.size();
+    for (unsigned int p = 0; p < data->parameters.size(); ++p)
+    {
+        double sum = 0.0;
+        for (unsigned int i = 0; i < NEQ; ++i) sum += NV_Ith_S(yB, i) * dfdp[p*NEQ + i];
+        NV_Ith_S(qBdot, p) = -sum;
+    }
+    return 0;
+}
+
+/*
+ *--------------------------------------------------------------------
+ * PRIVATE FUNCTIONS
+ *--------------------------------------------------------------------
+ */
+
+static int evaluateModel(AdjointData* data, realtype t, N_Vector y)
+{
+    GeneralModel* model = data->model;
+    for (unsigned int i = 0; i < data->y.size(); ++i) data->y[i] = NV_Ith_S(y, i);
+    model->V = data->y[0];
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = data->y[i+1];
+    int errorFlag = 0;
+    model->calculateRHS((double)t, errorFlag);
+    return errorFlag;
+}
+
+static int check_flag(void *flagvalue, const char *funcname, int opt)
+{
+    int *errflag;
+
+    /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+    if (opt == 0 && flagvalue == NULL)
+    {
+        fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n", funcname);
+        return(1);
+    }
+    /* Check if flag < 0 */
+    else if (opt == 1)
+    {
+        errflag = (int *) flagvalue;
+        if (*errflag < 0)
+        {
+            fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n", funcname, *errflag);
+            return(1);
+        }
+    }
+    /* Check if function returned NULL pointer - no memory allocated */
+    else if (opt == 2 && flagvalue == NULL)
+    {
+        fprintf(stderr, "\nMEMORY_ERROR: %s() failed - returned NULL pointer\n\n", funcname);
+        return(1);
+    }
+    return(0);
+}
@@ -0,0 +1,67 @@
+/*
+ * adjoint.hpp
+ *
+ * Adjoint sensitivity analysis of scalar objectives for GeneralModel.
+ */
+
+#ifndef ADJOINT_HPP_
+#define ADJOINT_HPP_
+
+#include <vector>
+#include <string>
+#include <functional>
+
+class GeneralModel;
+
+/**
+ * A scalar objective of the model state y = [V, C_c...],
+ *    G = integral from t0 to tf of g(t, y) dt + phi(y(tf))
+ * Either part may be left empty. The objective is assumed not to depend directly on the model parameters.
+ */
+class AdjointObjective
+{
+public:
+    // the integrand g(t, y) and its gradient with respect to y
+    std::function<double(double, const std::vector<double>&)> integrand;
+    std::function<void(double, const std::vector<double>&, std::vector<double>&)> integrandGradient;
+
+    // the terminal objective phi(y) and its gradient with respect to y
+    std::function<double(const std::vector<double>&)> terminal;
+    std::function<void(const std::vector<double>&, std::vector<double>&)> terminalGradient;
+};
+
+/**
+ * @brief Create an objective measuring the integrated squared error between the model and a reference trajectory.
+ * The reference trajectory is read from a file in either of the formats written by the get-simulator (e.g.,
+ * testing/latta/saved-results/results.data), with a header naming the columns. The cell volume is matched to
+ * the column named V and each molecule to the column named with the last segment of its type ID (e.g., Na for
+ * http://cellml.sourceforge.net/ns/ion/Na); molecules without a matching column are ignored. The reference is
+ * linearly interpolated in time and each variable's error is scaled by its largest reference magnitude.
+ * @param filename The reference trajectory file.
+ * @param model The (initialised) model the objective will be applied to.
+ * @param objective The objective to set up.
+ * @return zero on success.
+ */
+int createTrajectoryErrorObjective(const std::string& filename, const GeneralModel& model,
+                                   AdjointObjective& objective);
+
+/**
+ * @brief Compute the gradient of a scalar objective with respect to the given model parameters using the adjoint
+ * method.
+ * The model is integrated forward from its current state, in its current mode, from t0 to tf with checkpointing.
+ * The adjoint system is then integrated backward, accumulating the gradient by quadrature, so the cost is about two
+ * simulations regardless of the number of parameters. The initial state is assumed to be independent of the
+ * parameters. On return the model is left at its state at tf.
+ * @param model The model.
+ * @param parameters The parameters to differentiate with respect to (see GeneralModel::parameter).
+ * @param t0 The initial time.
+ * @param tf The final time.
+ * @param objective The objective.
+ * @param value On success, the value of the objective.
+ * @param gradient On success, the gradient of the objective with respect to each parameter.
+ * @return zero on success.
+ */
+int computeAdjointGradient(GeneralModel* model, const std::vector<double*>& parameters, double t0, double tf,
+                           const AdjointObjective& objective, double& value, std::vector<double>& gradient);
+
+#endif /* ADJOINT_HPP_ */
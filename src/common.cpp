@@ -1,6 +1,9 @@
+#include <iostream>
+#include <atomic>
+
 #include "common.hpp"
 
-static int _debugLevel_ = 0;
+static std::atomic<int> _debugLevel_(0);
 
 void setDebugLevel(const int level)
 {
@@ -11,3 +14,7 @@ int debugLevel()
 {
     return _debugLevel_;
 }
+
+SimulationContext::SimulationContext() : debugLevel(_debugLevel_), diagnostics(&std::cout)
+{
+}
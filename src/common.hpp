@@ -1,7 +1,33 @@
 #ifndef COMMON_HPP
 #define COMMON_HPP
 
+#include <iosfwd>
+
+/**
+ * @brief Set the default debug level, given to the simulation contexts created after this call. Should be set
+ * before any simulations are started, e.g., from the command line.
+ */
 void setDebugLevel(const int level);
 int debugLevel();
 
+/**
+ * @brief The settings of one simulation that would otherwise be process-wide.
+ *
+ * The model, its solvers and their callbacks only use the context of the model they are working on, so simulations
+ * with their own models can be run concurrently in one process.
+ */
+class SimulationContext
+{
+public:
+    /**
+     * @brief A context with the default debug level, writing its diagnostics to std::cout.
+     */
+    SimulationContext();
+
+    // the amount of diagnostic output, zero for none
+    int debugLevel;
+    // where the diagnostic output is written
+    std::ostream* diagnostics;
+};
+
 #endif // COMMON_HPP
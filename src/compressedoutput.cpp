@@ -0,0 +1,434 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+
+#include <zlib.h>
+#include <lzma.h>
+#include <bzlib.h>
+
+#include "compressedoutput.hpp"
+
+// the size of the blocks handed to the background thread
+#define COMPRESSED_OUTPUT_BLOCK_SIZE (1 << 20)
+// the number of blocks that may be waiting for the background thread before the producer has to wait
+#define COMPRESSED_OUTPUT_MAXIMUM_QUEUED_BLOCKS 32
+// the compression levels, favouring speed as the background thread has to keep up with the simulation: the fast
+// end of the gzip levels (1-9) and xz presets (0-9), and bzip2's smallest (100k) blocks
+#define GZIP_LEVEL 3
+#define XZ_PRESET 3
+#define BZIP2_BLOCK_SIZE 1
+
+static bool endsWith(const std::string& s, const std::string& suffix)
+{
+    return (s.size() >= suffix.size()) && (s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+CompressedOutput::Compression CompressedOutput::compressionForPath(const std::string& path)
+{
+    if (endsWith(path, ".gz")) return Gzip;
+    if (endsWith(path, ".xz")) return Xz;
+    if (endsWith(path, ".bz2")) return Bzip2;
+    return None;
+}
+
+std::string CompressedOutput::extension(Compression compression)
+{
+    switch (compression)
+    {
+    case Gzip:
+        return ".gz";
+    case Xz:
+        return ".xz";
+    case Bzip2:
+        return ".bz2";
+    default:
+        return "";
+    }
+}
+
+int CompressedOutput::parseCompression(const std::string& name, Compression& compression)
+{
+    if (name == "none") compression = None;
+    else if ((name == "gz") || (name == "gzip")) compression = Gzip;
+    else if (name == "xz") compression = Xz;
+    else if ((name == "bz2") || (name == "bzip2")) compression = Bzip2;
+    else
+    {
+        std::cerr << "CompressedOutput: unknown compression: " << name << " (expected none, gz, xz or bz2)"
+                  << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+CompressedOutput::CompressedOutput() : mFile(NULL), mCompression(None), mStream(NULL), mClosing(false),
+    mError(false)
+{
+}
+
+CompressedOutput::~CompressedOutput()
+{
+    close();
+}
+
+int CompressedOutput::open(const std::string& path, Compression compression)
+{
+    close();
+    mFile = std::fopen(path.c_str(), "wb");
+    if (!mFile)
+    {
+        std::cerr << "CompressedOutput::open: unable to create the file: " << path << std::endl;
+        return -1;
+    }
+    mCompression = compression;
+    int status = 0;
+    if (compression == Gzip)
+    {
+        z_stream* z = new z_stream();
+        // 16 + MAX_WBITS for a gzip header rather than a zlib one
+        status = (deflateInit2(z, GZIP_LEVEL, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK) ? 0 : -2;
+        mStream = z;
+    }
+    else if (compression == Xz)
+    {
+        lzma_stream* x = new lzma_stream();
+        *x = LZMA_STREAM_INIT;
+        status = (lzma_easy_encoder(x, XZ_PRESET, LZMA_CHECK_CRC64) == LZMA_OK) ? 0 : -2;
+        mStream = x;
+    }
+    else if (compression == Bzip2)
+    {
+        bz_stream* b = new bz_stream();
+        status = (BZ2_bzCompressInit(b, BZIP2_BLOCK_SIZE, 0, 0) == BZ_OK) ? 0 : -2;
+        mStream = b;
+    }
+    if (status != 0)
+    {
+        std::cerr << "CompressedOutput::open: unable to initialise the compression for: " << path << std::endl;
+        mError = true;
+        close();
+        return status;
+    }
+    mBlock.reserve(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    mCompressed.resize(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    mClosing = false;
+    mError = false;
+    mThread = std::thread(&CompressedOutput::run, this);
+    return 0;
+}
+
+int CompressedOutput::write(const char* data, size_t size)
+{
+    if (!mFile) return -1;
+    while (size > 0)
+    {
+        size_t n = std::min(size, COMPRESSED_OUTPUT_BLOCK_SIZE - mBlock.size());
+        mBlock.insert(mBlock.end(), data, data + n);
+        data += n;
+        size -= n;
+        if (mBlock.size() == COMPRESSED_OUTPUT_BLOCK_SIZE) flush();
+    }
+    return mError ? -2 : 0;
+}
+
+void CompressedOutput::flush()
+{
+    if (!mFile || mBlock.empty()) return;
+    std::unique_lock<std::mutex> lock(mMutex);
+    mQueueChanged.wait(lock, [this]() { return mQueue.size() < COMPRESSED_OUTPUT_MAXIMUM_QUEUED_BLOCKS; });
+    mQueue.push_back(std::vector<char>());
+    mQueue.back().swap(mBlock);
+    if (!mFree.empty())
+    {
+        mBlock.swap(mFree.back());
+        mFree.pop_back();
+    }
+    else mBlock.reserve(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    mQueueChanged.notify_all();
+}
+
+int CompressedOutput::close()
+{
+    if (mThread.joinable())
+    {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosing = true;
+        }
+        mQueueChanged.notify_all();
+        mThread.join();
+    }
+    if (mStream)
+    {
+        switch (mCompression)
+        {
+        case Gzip:
+            deflateEnd(static_cast<z_stream*>(mStream));
+            delete static_cast<z_stream*>(mStream);
+            break;
+        case Xz:
+            lzma_end(static_cast<lzma_stream*>(mStream));
+            delete static_cast<lzma_stream*>(mStream);
+            break;
+        case Bzip2:
+            BZ2_bzCompressEnd(static_cast<bz_stream*>(mStream));
+            delete static_cast<bz_stream*>(mStream);
+            break;
+        default:
+            break;
+        }
+        mStream = NULL;
+    }
+    if (!mFile) return 0;
+    if (std::fclose(mFile) != 0) mError = true;
+    mFile = NULL;
+    mBlock.clear();
+    mBlock.shrink_to_fit();
+    mCompressed.clear();
+    mCompressed.shrink_to_fit();
+    mQueue.clear();
+    mFree.clear();
+    return mError ? -3 : 0;
+}
+
+void CompressedOutput::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true)
+    {
+        mQueueChanged.wait(lock, [this]() { return mClosing || !mQueue.empty(); });
+        if (mQueue.empty()) break;
+        std::vector<char> block;
+        block.swap(mQueue.front());
+        mQueue.pop_front();
+        lock.unlock();
+        if (!mError && (compress(block.data(), block.size(), false) != 0)) mError = true;
+        block.clear();
+        lock.lock();
+        mFree.push_back(std::vector<char>());
+        mFree.back().swap(block);
+        mQueueChanged.notify_all();
+    }
+    lock.unlock();
+    if (!mError && (compress(NULL, 0, true) != 0)) mError = true;
+}
+
+int CompressedOutput::writeFile(const char* data, size_t size)
+{
+    if ((size > 0) && (std::fwrite(data, 1, size, mFile) != size))
+    {
+        std::cerr << "CompressedOutput: error writing the file" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int CompressedOutput::compress(const char* data, size_t size, bool finish)
+{
+    char* out = mCompressed.data();
+    const size_t outSize = mCompressed.size();
+    switch (mCompression)
+    {
+    case Gzip:
+    {
+        z_stream* z = static_cast<z_stream*>(mStream);
+        z->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        z->avail_in = size;
+        int ret;
+        do
+        {
+            z->next_out = reinterpret_cast<Bytef*>(out);
+            z->avail_out = outSize;
+            ret = deflate(z, finish ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_ERROR) return -1;
+            if (writeFile(out, outSize - z->avail_out) != 0) return -2;
+        } while (finish ? (ret != Z_STREAM_END) : (z->avail_out == 0));
+        return 0;
+    }
+    case Xz:
+    {
+        lzma_stream* x = static_cast<lzma_stream*>(mStream);
+        x->next_in = reinterpret_cast<const uint8_t*>(data);
+        x->avail_in = size;
+        lzma_ret ret;
+        do
+        {
+            x->next_out = reinterpret_cast<uint8_t*>(out);
+            x->avail_out = outSize;
+            ret = lzma_code(x, finish ? LZMA_FINISH : LZMA_RUN);
+            if ((ret != LZMA_OK) && (ret != LZMA_STREAM_END)) return -1;
+            if (writeFile(out, outSize - x->avail_out) != 0) return -2;
+        } while (finish ? (ret != LZMA_STREAM_END) : ((x->avail_in > 0) || (x->avail_out == 0)));
+        return 0;
+    }
+    case Bzip2:
+    {
+        bz_stream* b = static_cast<bz_stream*>(mStream);
+        b->next_in = const_cast<char*>(data);
+        b->avail_in = size;
+        int ret;
+        do
+        {
+            b->next_out = out;
+            b->avail_out = outSize;
+            ret = BZ2_bzCompress(b, finish ? BZ_FINISH : BZ_RUN);
+            if ((ret != BZ_RUN_OK) && (ret != BZ_FINISH_OK) && (ret != BZ_STREAM_END)) return -1;
+            if (writeFile(out, outSize - b->avail_out) != 0) return -2;
+        } while (finish ? (ret != BZ_STREAM_END) : (b->avail_in > 0));
+        return 0;
+    }
+    default:
+        return writeFile(data, size);
+    }
+}
+
+CompressedOutputStream::CompressedOutputStream() : std::ostream(NULL), mBuffer(mOutput)
+{
+    rdbuf(&mBuffer);
+}
+
+CompressedOutputStream::~CompressedOutputStream()
+{
+    close();
+}
+
+int CompressedOutputStream::open(const std::string& path, CompressedOutput::Compression compression)
+{
+    clear();
+    if (mOutput.open(path, compression) != 0)
+    {
+        setstate(std::ios_base::failbit);
+        return -1;
+    }
+    return 0;
+}
+
+int CompressedOutputStream::close()
+{
+    return mOutput.close();
+}
+
+CompressedOutputStream::Buffer::Buffer(CompressedOutput& output) : mOutput(output)
+{
+}
+
+CompressedOutputStream::Buffer::int_type CompressedOutputStream::Buffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    char ch = traits_type::to_char_type(c);
+    return (mOutput.write(&ch, 1) == 0) ? c : traits_type::eof();
+}
+
+std::streamsize CompressedOutputStream::Buffer::xsputn(const char* s, std::streamsize n)
+{
+    return (mOutput.write(s, n) == 0) ? n : 0;
+}
+
+int CompressedOutputStream::Buffer::sync()
+{
+    // std::endl flushes the stream after every line, so only hand over whole blocks
+    return 0;
+}
+
+static int gunzip(const std::string& compressed, std::string& content)
+{
+    z_stream z = z_stream();
+    // 32 + MAX_WBITS to accept either a gzip or zlib header
+    if (inflateInit2(&z, 32 + MAX_WBITS) != Z_OK) return -1;
+    z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+    z.avail_in = compressed.size();
+    std::vector<char> out(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    int ret = Z_OK;
+    while (true)
+    {
+        z.next_out = reinterpret_cast<Bytef*>(out.data());
+        z.avail_out = out.size();
+        ret = inflate(&z, Z_NO_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_STREAM_END)) break;
+        content.append(out.data(), out.size() - z.avail_out);
+        if (ret == Z_STREAM_END)
+        {
+            // concatenated gzip members
+            if (z.avail_in == 0) break;
+            inflateReset(&z);
+        }
+    }
+    inflateEnd(&z);
+    return (ret == Z_STREAM_END) ? 0 : -2;
+}
+
+static int unxz(const std::string& compressed, std::string& content)
+{
+    lzma_stream x = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&x, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) return -1;
+    x.next_in = reinterpret_cast<const uint8_t*>(compressed.data());
+    x.avail_in = compressed.size();
+    std::vector<char> out(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    lzma_ret ret;
+    do
+    {
+        x.next_out = reinterpret_cast<uint8_t*>(out.data());
+        x.avail_out = out.size();
+        ret = lzma_code(&x, LZMA_FINISH);
+        content.append(out.data(), out.size() - x.avail_out);
+    } while (ret == LZMA_OK);
+    lzma_end(&x);
+    return (ret == LZMA_STREAM_END) ? 0 : -2;
+}
+
+static int bunzip2(const std::string& compressed, std::string& content)
+{
+    bz_stream b = bz_stream();
+    if (BZ2_bzDecompressInit(&b, 0, 0) != BZ_OK) return -1;
+    b.next_in = const_cast<char*>(compressed.data());
+    b.avail_in = compressed.size();
+    std::vector<char> out(COMPRESSED_OUTPUT_BLOCK_SIZE);
+    int ret;
+    do
+    {
+        b.next_out = out.data();
+        b.avail_out = out.size();
+        ret = BZ2_bzDecompress(&b);
+        content.append(out.data(), out.size() - b.avail_out);
+        // truncated input
+        if ((ret == BZ_OK) && (b.avail_in == 0) && (b.avail_out > 0)) break;
+    } while (ret == BZ_OK);
+    BZ2_bzDecompressEnd(&b);
+    return (ret == BZ_STREAM_END) ? 0 : -2;
+}
+
+int readCompressedFile(const std::string& path, std::string& content)
+{
+    content.clear();
+    std::ifstream is(path.c_str(), std::ios::binary);
+    if (!is)
+    {
+        std::cerr << "readCompressedFile: unable to open the file: " << path << std::endl;
+        return -1;
+    }
+    std::ostringstream buffer;
+    buffer << is.rdbuf();
+    std::string data = buffer.str();
+    static const char xzMagic[6] = { '\xFD', '7', 'z', 'X', 'Z', '\0' };
+    int status;
+    if ((data.size() >= 2) && (data[0] == '\x1F') && (data[1] == '\x8B')) status = gunzip(data, content);
+    else if ((data.size() >= 6) && (memcmp(data.data(), xzMagic, 6) == 0)) status = unxz(data, content);
+    else if ((data.size() >= 3) && (data.compare(0, 3, "BZh") == 0)) status = bunzip2(data, content);
+    else
+    {
+        content.swap(data);
+        return 0;
+    }
+    if (status != 0)
+    {
+        std::cerr << "readCompressedFile: unable to decompress the file: " << path << std::endl;
+        return -2;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+#ifndef COMPRESSEDOUTPUT_HPP
+#define COMPRESSEDOUTPUT_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+
+/**
+ * @brief An output file written, and optionally compressed, by a background thread.
+ *
+ * Data is collected into large blocks which are handed to the background thread as they fill, so the thread
+ * producing the output only copies memory. If the background thread falls behind by more than a limited number of
+ * blocks the producer waits for it, rather than holding an unbounded amount of output in memory.
+ */
+class CompressedOutput
+{
+public:
+    enum Compression
+    {
+        None = 0,
+        Gzip = 1,
+        Xz = 2,
+        Bzip2 = 3
+    };
+
+    /**
+     * @brief The compression implied by the extension of the given path (.gz, .xz or .bz2), None otherwise.
+     */
+    static Compression compressionForPath(const std::string& path);
+
+    /**
+     * @brief The file extension, including the dot, for the given compression. Empty for None.
+     */
+    static std::string extension(Compression compression);
+
+    /**
+     * @brief Parse the name of a compression (none, gz/gzip, xz, bz2/bzip2).
+     * @return zero on success.
+     */
+    static int parseCompression(const std::string& name, Compression& compression);
+
+    CompressedOutput();
+    ~CompressedOutput();
+
+    /**
+     * @brief Create the file and start the background thread.
+     * @param path The path of the file.
+     * @param compression The compression to apply to the file.
+     * @return zero on success.
+     */
+    int open(const std::string& path, Compression compression);
+
+    /**
+     * @brief Add data to the file.
+     * @return zero on success, non-zero if the file has already failed.
+     */
+    int write(const char* data, size_t size);
+
+    /**
+     * @brief Hand the current partial block to the background thread.
+     */
+    void flush();
+
+    /**
+     * @brief Write out all the remaining data, finish the compressed stream and close the file.
+     * @return zero on success.
+     */
+    int close();
+
+    bool isOpen() const { return mFile != NULL; }
+
+private:
+    CompressedOutput(const CompressedOutput&) = delete;
+    CompressedOutput& operator=(const CompressedOutput&) = delete;
+
+    void run();
+    int compress(const char* data, size_t size, bool finish);
+    int writeFile(const char* data, size_t size);
+
+    std::FILE* mFile;
+    Compression mCompression;
+    void* mStream;
+    std::vector<char> mBlock;
+    std::vector<char> mCompressed;
+    // the blocks waiting for the background thread and those it has finished with, for reuse
+    std::deque<std::vector<char> > mQueue;
+    std::vector<std::vector<char> > mFree;
+    std::mutex mMutex;
+    std::condition_variable mQueueChanged;
+    bool mClosing;
+    std::atomic<bool> mError;
+    std::thread mThread;
+};
+
+/**
+ * @brief A std::ostream writing to a CompressedOutput, for output written with the stream operators.
+ */
+class CompressedOutputStream : public std::ostream
+{
+public:
+    CompressedOutputStream();
+    ~CompressedOutputStream();
+
+    int open(const std::string& path, CompressedOutput::Compression compression);
+    int close();
+    bool is_open() const { return mOutput.isOpen(); }
+
+private:
+    class Buffer : public std::streambuf
+    {
+    public:
+        explicit Buffer(CompressedOutput& output);
+    protected:
+        int_type overflow(int_type c);
+        std::streamsize xsputn(const char* s, std::streamsize n);
+        int sync();
+    private:
+        CompressedOutput& mOutput;
+    };
+
+    CompressedOutput mOutput;
+    Buffer mBuffer;
+};
+
+/**
+ * @brief Read a whole file, decompressing it if it is gzip, xz or bzip2 compressed (detected from its content).
+ * @param path The path of the file.
+ * @param content On success, the (decompressed) content of the file.
+ * @return zero on success.
+ */
+int readCompressedFile(const std::string& path, std::string& content);
+
+#endif // COMPRESSEDOUTPUT_HPP
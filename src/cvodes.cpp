@@ -1,6 +1,7 @@
 /* Wrapper around CVODES */
 
 #include <cstdio>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -15,20 +16,25 @@
 #include "common.hpp"
 #include "cvodes.hpp"
 #include "GeneralModel.hpp"
+#include "tracing.hpp"
 
 /* Problem Constants */
 
 #define RTOL  RCONST(1.0e-3)   /* scalar relative tolerance            */
 #define ATOL  RCONST(1.0e-4)   /* vector absolute tolerance components */
 
-/* Function Called by the Solver */
+/* Functions Called by the Solver */
 static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data);
+static int jac(long int N, realtype t, N_Vector y, N_Vector fy, DlsMat J, void *user_data,
+               N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
+static int fS(int Ns, realtype t, N_Vector y, N_Vector ydot, N_Vector* yS, N_Vector* ySdot, void *user_data,
+              N_Vector tmp1, N_Vector tmp2);
 
 /* Private functions to output results */
 //static void PrintOutput(realtype t, realtype y1, realtype y2, realtype y3);
 
 /* Private function to print final statistics */
-static void PrintFinalStats(void *cvode_mem);
+static void PrintFinalStats(void *cvode_mem, std::ostream& os);
 
 /* Private function to check function return values */
 static int check_flag(void *flagvalue, const char *funcname, int opt);
@@ -43,10 +49,13 @@ Cvodes::Cvodes()
 {
     cvodeMem = NULL;
     y = NULL;
+    model = NULL;
+    yS = NULL;
 }
 
 int Cvodes::initialise(GeneralModel* model, double initialTime, double maxStep)
 {
+    this->model = model;
     int NEQ = model->mC_c.size() + 1; // number of species + cell volume
     realtype reltol, abstol;
     int flag;
@@ -93,12 +102,17 @@ int Cvodes::initialise(GeneralModel* model, double initialTime, double maxStep)
     flag = CVDense(cvodeMem, NEQ);
     if (check_flag(&flag, "CVDense", 1)) return(1);
 
+    /* Use the analytic Jacobian rather than the difference quotient approximation, each column of
+     * which would otherwise need a full electroneutrality solve */
+    flag = CVDlsSetDenseJacFn(cvodeMem, jac);
+    if (check_flag(&flag, "CVDlsSetDenseJacFn", 1)) return(1);
+
     // set the maximum step size
     flag = CVodeSetMaxStep(cvodeMem, maxStep);
     if (check_flag(&flag, "CVodeSetMaxStep", 1)) return(1);
 
-    /* pass through the model as the user data */
-    flag = CVodeSetUserData(cvodeMem, static_cast<void*>(model));
+    /* pass through this integrator, and hence the model, as the user data */
+    flag = CVodeSetUserData(cvodeMem, static_cast<void*>(this));
     if (check_flag(&flag, "CVodeSetUserData", 1)) return(1);
 
     return 0;
@@ -109,11 +123,14 @@ Cvodes::~Cvodes()
     if (cvodeMem)
     {
         /* Print some final statistics */
-        PrintFinalStats(cvodeMem);
+        PrintFinalStats(cvodeMem, *model->context.diagnostics);
 
         /* Free y vector */
         N_VDestroy_Serial(y);
 
+        /* Free the sensitivity vectors */
+        if (yS) N_VDestroyVectorArray_Serial(yS, sensitivityParameters.size());
+
         /* Free integrator memory */
         CVodeFree(&cvodeMem);
     }
@@ -121,16 +138,90 @@ Cvodes::~Cvodes()
 
 int Cvodes::integrate(double& t, double tout)
 {
+    GET_TRACE_SCOPE("solver", "integrator step");
     int flag;
     flag = CVode(cvodeMem, tout, y, &t, CV_NORMAL);
     if (check_flag(&flag, "CVode", 1)) return(1);
+    if (yS)
+    {
+        realtype tret;
+        flag = CVodeGetSens(cvodeMem, &tret, yS);
+        if (check_flag(&flag, "CVodeGetSens", 1)) return(1);
+    }
     return(0);
 }
 
+int Cvodes::enableSensitivities(const std::vector<double*>& parameters)
+{
+    if (yS)
+    {
+        std::cerr << "Cvodes::enableSensitivities: sensitivities have already been enabled" << std::endl;
+        return -1;
+    }
+    int Ns = parameters.size();
+    if (Ns < 1) return 0;
+    sensitivityTargets = parameters;
+    sensitivityParameters.resize(Ns);
+    mSensitivityScales.resize(Ns);
+    for (int p = 0; p < Ns; ++p)
+    {
+        sensitivityParameters[p] = *(parameters[p]);
+        // scale the sensitivity error control by the parameter magnitude
+        mSensitivityScales[p] = (sensitivityParameters[p] != 0.0) ? fabs(sensitivityParameters[p]) : 1.0;
+    }
+
+    yS = N_VCloneVectorArray_Serial(Ns, y);
+    if (check_flag((void *)yS, "N_VCloneVectorArray_Serial", 0)) return(1);
+    for (int p = 0; p < Ns; ++p) N_VConst_Serial(RCONST(0.0), yS[p]);
+
+    /* The sensitivity right hand sides are computed analytically (see fS) rather than by difference quotients on
+     * f, each of which would need a full electroneutrality solve, and corrected with the staggered method */
+    int flag = CVodeSensInit(cvodeMem, Ns, CV_STAGGERED, fS, yS);
+    if (check_flag(&flag, "CVodeSensInit", 1)) return(1);
+    flag = CVodeSensEEtolerances(cvodeMem);
+    if (check_flag(&flag, "CVodeSensEEtolerances", 1)) return(1);
+    flag = CVodeSetSensParams(cvodeMem, sensitivityParameters.data(), mSensitivityScales.data(), NULL);
+    if (check_flag(&flag, "CVodeSetSensParams", 1)) return(1);
+    flag = CVodeSetSensErrCon(cvodeMem, TRUE);
+    if (check_flag(&flag, "CVodeSetSensErrCon", 1)) return(1);
+    return 0;
+}
+
+int Cvodes::numberOfSensitivities() const
+{
+    return yS ? sensitivityParameters.size() : 0;
+}
+
+std::vector<double> Cvodes::getSensitivities() const
+{
+    std::vector<double> s;
+    if (!yS) return s;
+    long int NEQ = NV_LENGTH_S(y);
+    s.resize(sensitivityParameters.size() * NEQ);
+    for (unsigned int p = 0; p < sensitivityParameters.size(); ++p)
+        for (long int i = 0; i < NEQ; ++i) s[p*NEQ + i] = NV_Ith_S(yS[p], i);
+    return s;
+}
+
+int Cvodes::setStopTime(double tstop)
+{
+    int flag = CVodeSetStopTime(cvodeMem, tstop);
+    if (check_flag(&flag, "CVodeSetStopTime", 1)) return(1);
+    return 0;
+}
+
 int Cvodes::reInitialise(double time)
 {
     int flag = CVodeReInit(cvodeMem, time, y);
     if (check_flag(&flag, "CVodeReInit", 1)) return(1);
+    if (yS)
+    {
+        // pick up any changes made to the parameters at this discontinuity, the sensitivities are continuous
+        for (unsigned int p = 0; p < sensitivityTargets.size(); ++p)
+            sensitivityParameters[p] = *(sensitivityTargets[p]);
+        flag = CVodeSensReInit(cvodeMem, CV_STAGGERED, yS);
+        if (check_flag(&flag, "CVodeSensReInit", 1)) return(1);
+    }
 
     return 0;
 }
@@ -147,7 +238,11 @@ int Cvodes::reInitialise(double time)
 
 static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data)
 {
-    GeneralModel* model = static_cast<GeneralModel*>(user_data);
+    Cvodes* cvodes = static_cast<Cvodes*>(user_data);
+    GeneralModel* model = cvodes->model;
+    // update the parameters, the integrator owns their values while sensitivities are enabled
+    for (unsigned int p = 0; p < cvodes->sensitivityTargets.size(); ++p)
+        *(cvodes->sensitivityTargets[p]) = cvodes->sensitivityParameters[p];
     // update state variables
     model->V = Ith(y,1);
     for (unsigned int i=0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = Ith(y, i+2);
@@ -164,6 +259,78 @@ static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data)
     return(0);
 }
 
+/*
+ * Jacobian routine. Compute J(t,y) = df/dy.
+ *
+ * CVODES always evaluates f(t,y) immediately before asking for the Jacobian at y, so the membrane
+ * potentials currently held by the model are the electroneutral potentials for this state.
+ */
+
+static int jac(long int N, realtype t, N_Vector y, N_Vector fy, DlsMat J, void *user_data,
+               N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
+{
+    Cvodes* cvodes = static_cast<Cvodes*>(user_data);
+    GeneralModel* model = cvodes->model;
+    for (unsigned int p = 0; p < cvodes->sensitivityTargets.size(); ++p)
+        *(cvodes->sensitivityTargets[p]) = cvodes->sensitivityParameters[p];
+    // update state variables
+    model->V = Ith(y,1);
+    for (unsigned int i=0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = Ith(y, i+2);
+
+    int errorFlag = 0;
+    std::vector<double> dfdy = model->calculateJacobian((double)t, errorFlag);
+    if (errorFlag != 0)
+    {
+        std::cerr << "CVODES-Jacobian-fcn failed!" << std::endl;
+        return 1; // positive value to indicate a recoverable failure
+    }
+    for (long int j=0; j < N; ++j)
+        for (long int i=0; i < N; ++i) DENSE_ELEM(J, i, j) = dfdy[j*N + i];
+
+    return(0);
+}
+
+/*
+ * Sensitivity right hand side routine. Compute ySdot[p] = J(t,y) yS[p] + df/dp for each sensitivity parameter.
+ *
+ * The Jacobian and parameter derivatives need the electroneutral potentials at y, and CVODES may have evaluated f
+ * at a different state since, so the RHS is evaluated here first.
+ */
+
+static int fS(int Ns, realtype t, N_Vector y, N_Vector ydot, N_Vector* yS, N_Vector* ySdot, void *user_data,
+              N_Vector tmp1, N_Vector tmp2)
+{
+    Cvodes* cvodes = static_cast<Cvodes*>(user_data);
+    GeneralModel* model = cvodes->model;
+    for (unsigned int p = 0; p < cvodes->sensitivityTargets.size(); ++p)
+        *(cvodes->sensitivityTargets[p]) = cvodes->sensitivityParameters[p];
+    // update state variables
+    model->V = Ith(y,1);
+    for (unsigned int i=0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = Ith(y, i+2);
+
+    int errorFlag = 0;
+    model->calculateRHS((double)t, errorFlag);
+    std::vector<double> dfdy, dfdp;
+    if (errorFlag == 0) dfdy = model->calculateJacobian((double)t, errorFlag);
+    if (errorFlag == 0) dfdp = model->calculateParameterDerivatives(cvodes->sensitivityTargets, (double)t, errorFlag);
+    if (errorFlag != 0)
+    {
+        std::cerr << "CVODES-sensitivity-RHS-fcn failed!" << std::endl;
+        return 1; // positive value to indicate a recoverable failure
+    }
+    long int N = NV_LENGTH_S(y);
+    for (int p = 0; p < Ns; ++p)
+    {
+        for (long int i = 0; i < N; ++i)
+        {
+            double s = dfdp[p*N + i];
+            for (long int j = 0; j < N; ++j) s += dfdy[j*N + i] * NV_Ith_S(yS[p], j);
+            NV_Ith_S(ySdot[p], i) = s;
+        }
+    }
+    return(0);
+}
+
 /*
  *-------------------------------
  * Private helper functions
@@ -189,7 +356,7 @@ static void PrintOutput(realtype t, realtype y1, realtype y2, realtype y3)
  * Get and print some final statistics
  */
 
-static void PrintFinalStats(void *cvode_mem)
+static void PrintFinalStats(void *cvode_mem, std::ostream& os)
 {
     long int nst, nfe, nsetups, nje, nfeLS, nni, ncfn, netf, nge;
     int flag;
@@ -215,11 +382,12 @@ static void PrintFinalStats(void *cvode_mem)
     flag = CVodeGetNumGEvals(cvode_mem, &nge);
     check_flag(&flag, "CVodeGetNumGEvals", 1);
 
-    printf("\nFinal Statistics:\n");
-    printf("nst = %-6ld nfe  = %-6ld nsetups = %-6ld nfeLS = %-6ld nje = %ld\n",
-           nst, nfe, nsetups, nfeLS, nje);
-    printf("nni = %-6ld ncfn = %-6ld netf = %-6ld nge = %ld\n \n",
-           nni, ncfn, netf, nge);
+    char buffer[256];
+    snprintf(buffer, sizeof(buffer), "\nFinal Statistics:\n"
+             "nst = %-6ld nfe  = %-6ld nsetups = %-6ld nfeLS = %-6ld nje = %ld\n"
+             "nni = %-6ld ncfn = %-6ld netf = %-6ld nge = %ld\n \n",
+             nst, nfe, nsetups, nfeLS, nje, nni, ncfn, netf, nge);
+    os << buffer;
 }
 
 /*
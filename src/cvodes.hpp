@@ -20,6 +20,8 @@
 #define Ith(v,i)    NV_Ith_S(v,i-1)       /* Ith numbers components 1..NEQ */
 #define IJth(A,i,j) DENSE_ELEM(A,i-1,j-1) /* IJth numbers rows,cols 1..NEQ */
 
+#include <vector>
+
 class GeneralModel;
 
 class Cvodes
@@ -29,7 +31,7 @@ public:
     ~Cvodes();
 
     /**
-      Initialise CVODES for this model. @returns zero on success.
+      Initialise CVODES for this model, a maxStep of zero leaves the step size unlimited. @returns zero on success.
       */
     int initialise(GeneralModel* model, double initialTime, double maxStep);
 
@@ -43,8 +45,43 @@ public:
       */
     int integrate(double& t, double tout);
 
+    /**
+      * Set a time the integrator must not step past, e.g., the time of the next discontinuity in a protocol.
+      * @returns zero on success.
+      */
+    int setStopTime(double tstop);
+
+    /**
+      * Enable forward sensitivity analysis with respect to the given model parameters, e.g., &model.Lp_a or
+      * model.mP_a[i] (see GeneralModel::parameter). Must be called after initialise, the sensitivities are zero
+      * at the current time. While sensitivities are enabled the integrator owns the values of these parameters,
+      * any changes made to the model parameters are picked up when the integrator is re-initialised.
+      * @returns zero on success.
+      */
+    int enableSensitivities(const std::vector<double*>& parameters);
+
+    /**
+      * The number of parameters sensitivities are being computed for.
+      */
+    int numberOfSensitivities() const;
+
+    /**
+      * Get the current sensitivities of the state variables, element [p*NEQ + i] is the sensitivity of state
+      * variable i (cell volume then intracellular concentrations) with respect to parameter p.
+      */
+    std::vector<double> getSensitivities() const;
+
     void* cvodeMem;
     N_Vector y;
+    GeneralModel* model;
+
+    // forward sensitivity analysis, the parameter values used by the integrator and where they live in the model
+    N_Vector* yS;
+    std::vector<double> sensitivityParameters;
+    std::vector<double*> sensitivityTargets;
+
+private:
+    std::vector<double> mSensitivityScales;
 };
 
 #endif // CVODES_HPP
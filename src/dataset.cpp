@@ -4,3 +4,29 @@
 
 #include "dataset.hpp"
 
+
+void MyVariable::startTrajectory()
+{
+    samplePoint = 0;
+}
+
+void MyVariable::addValue(double value)
+{
+    if (!aggregate)
+    {
+        data.push_back(value);
+        return;
+    }
+    if (samplePoint >= statistics.size()) statistics.push_back(RunningStatistics(aggregateQuantiles));
+    statistics[samplePoint++].add(value);
+}
+
+void MyData::setAggregation(const std::vector<double>& quantiles)
+{
+    for (auto& v: variables)
+    {
+        v.second.aggregate = true;
+        v.second.aggregateQuantiles = quantiles;
+        v.second.data.clear();
+    }
+}
@@ -5,14 +5,41 @@
 #include <map>
 #include <vector>
 
+#include "statistics.hpp"
+#include "decimation.hpp"
+
 class MyVariable
 {
 public:
+    MyVariable() : outputIndex(-1), sensitivityIndex(-1), aggregate(false), samplePoint(0)
+    {
+    }
+
+    /**
+     * @brief Start a new trajectory of this variable, e.g., for the next repeat of a repeated task.
+     */
+    void startTrajectory();
+
+    /**
+     * @brief Record the next value of the current trajectory. The value is appended to data or, if aggregating,
+     * added to the statistics for its sample point.
+     */
+    void addValue(double value);
+
     std::string target;
     std::string taskReference;
     std::map<std::string, std::string> namespaces; // used to resolve the target XPath in the source document
     std::vector<double> data;
     int outputIndex; // used by the simulation engine to determine where data comes from
+    // if set, this variable is the sensitivity of the target with respect to the parameter with this XPath
+    std::string sensitivityTarget;
+    int sensitivityIndex; // used by the simulation engine to determine where sensitivity data comes from
+    // if true, the trajectories are summarised by streaming statistics at each sample point rather than stored in
+    // data, so memory doesn't grow with the number of repeats
+    bool aggregate;
+    std::vector<double> aggregateQuantiles; // the probabilities of the quantiles to estimate when aggregating
+    std::vector<RunningStatistics> statistics; // the statistics at each sample point when aggregating
+    unsigned int samplePoint; // the index of the next value in the current trajectory
 };
 
 class VariableList : public std::map<std::string, MyVariable>
@@ -33,10 +60,28 @@ public:
     std::string dataReference; // the data generator id
     VariableList variables;
     ParameterList parameters;
+
+    /**
+     * @brief Summarise the trajectories of the variables of this data set by their statistics at each sample point
+     * rather than storing every trajectory.
+     * @param quantiles The probabilities of the quantiles to estimate.
+     */
+    void setAggregation(const std::vector<double>& quantiles);
 };
 
+class ResultListener;
+
 class DataSet : public std::map<std::string, MyData>
 {
+public:
+    DataSet() : publisher(NULL)
+    {
+    }
+
+    // the decimation applied to the samples of the (non-aggregated) data sets as they are produced
+    DecimationOptions decimation;
+    // if set, the stored rows are also given to the listener as they are produced
+    ResultListener* publisher;
 };
 
 #endif // DATASET_HPP
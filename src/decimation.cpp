@@ -0,0 +1,238 @@
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <algorithm>
+
+#include "decimation.hpp"
+
+int DecimationOptions::parse(const std::string& specification)
+{
+    std::string name = specification.substr(0, specification.find(':'));
+    std::vector<double> arguments;
+    size_t start = specification.find(':');
+    while (start != std::string::npos)
+    {
+        size_t end = specification.find(':', start + 1);
+        std::string argument = specification.substr(start + 1, (end == std::string::npos) ? end : end - start - 1);
+        char* last;
+        double value = strtod(argument.c_str(), &last);
+        if (argument.empty() || (*last != '\0') || (value < 0.0))
+        {
+            std::cerr << "DecimationOptions::parse: invalid argument: " << argument << " in: " << specification
+                      << std::endl;
+            return -1;
+        }
+        arguments.push_back(value);
+        start = end;
+    }
+    if ((name == "none") && arguments.empty()) method = None;
+    else if ((name == "lttb") && (arguments.size() == 1) && (arguments[0] >= 3.0))
+    {
+        method = Lttb;
+        numberOfPoints = (unsigned int)arguments[0];
+    }
+    else if ((name == "pla") && (arguments.size() >= 1) && (arguments.size() <= 2))
+    {
+        method = PiecewiseLinear;
+        relativeTolerance = arguments[0];
+        absoluteTolerance = (arguments.size() > 1) ? arguments[1] : 0.0;
+    }
+    else
+    {
+        std::cerr << "DecimationOptions::parse: invalid decimation: " << specification
+                  << " (expected lttb:<number of points> or pla:<relative tolerance>[:<absolute tolerance>])"
+                  << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+Decimator::Decimator(const DecimationOptions& options, unsigned int expectedNumberOfSamples,
+                     unsigned int numberOfColumns, const std::function<void(double, const std::vector<double>&)>& emit)
+    : mOptions(options), mNumberOfColumns(numberOfColumns), mEmit(emit), mNumberOfSamples(0), mNumberOfSelected(0),
+      mHavePending(false), mBucketIndex(0), mBucketEnd(0), mNumberOfBucketedSamples(0), mNumberOfBuckets(1)
+{
+    if (mOptions.method == DecimationOptions::Lttb)
+    {
+        // nothing to do if we are already asked to keep every sample
+        if ((mOptions.numberOfPoints < 3) || (expectedNumberOfSamples <= mOptions.numberOfPoints))
+            mOptions.method = DecimationOptions::None;
+        else
+        {
+            // the first and last samples are kept, the rest are divided into numberOfPoints - 2 buckets
+            mNumberOfBucketedSamples = expectedNumberOfSamples - 2;
+            mNumberOfBuckets = mOptions.numberOfPoints - 2;
+            mBucketEnd = bucketEnd(0);
+            mNextSum.assign(numberOfColumns + 1, 0.0);
+            mScale.assign(numberOfColumns, 0.0);
+        }
+    }
+    else if (mOptions.method == DecimationOptions::PiecewiseLinear)
+    {
+        mLowerSlope.assign(numberOfColumns, -std::numeric_limits<double>::infinity());
+        mUpperSlope.assign(numberOfColumns, std::numeric_limits<double>::infinity());
+    }
+}
+
+unsigned long Decimator::bucketEnd(unsigned long bucket) const
+{
+    // in integer arithmetic, so that the last bucket ends exactly at the last sample expected
+    return 1 + (bucket + 1) * mNumberOfBucketedSamples / mNumberOfBuckets;
+}
+
+void Decimator::emit(const Sample& sample)
+{
+    ++mNumberOfSelected;
+    mEmit(sample[0], std::vector<double>(sample.begin() + 1, sample.end()));
+}
+
+void Decimator::add(double time, const std::vector<double>& values)
+{
+    Sample sample(1, time);
+    sample.insert(sample.end(), values.begin(), values.begin() + mNumberOfColumns);
+    if (mNumberOfSamples++ == 0)
+    {
+        // the first sample is always kept
+        emit(sample);
+        mSelected = sample;
+        mAnchor = sample;
+        return;
+    }
+    switch (mOptions.method)
+    {
+    case DecimationOptions::Lttb:
+        // hold back the latest sample, as the last sample is not part of any bucket
+        if (mHavePending) addLttb(mPending);
+        mPending.swap(sample);
+        mHavePending = true;
+        break;
+    case DecimationOptions::PiecewiseLinear:
+        addPiecewiseLinear(sample);
+        break;
+    default:
+        emit(sample);
+        break;
+    }
+}
+
+void Decimator::finish()
+{
+    if (!mHavePending) return;
+    if (mOptions.method == DecimationOptions::Lttb)
+    {
+        if (!mBucket.empty())
+        {
+            if (mNextBucket.empty()) selectLttbBucket(mPending);
+            else
+            {
+                Sample average(mNextSum);
+                for (double& x: average) x /= mNextBucket.size();
+                selectLttbBucket(average);
+            }
+        }
+        if (!mNextBucket.empty())
+        {
+            mBucket.swap(mNextBucket);
+            mNextBucket.clear();
+            selectLttbBucket(mPending);
+        }
+        mBucket.clear();
+    }
+    // the last sample is always kept
+    emit(mPending);
+    mHavePending = false;
+}
+
+void Decimator::addLttb(const Sample& sample)
+{
+    // the index of this sample in the time course
+    unsigned long index = mNumberOfSamples - 2;
+    if (index >= mBucketEnd)
+    {
+        // the next bucket is complete, so we can select from the current one
+        if (!mBucket.empty())
+        {
+            Sample average(mNextSum);
+            for (double& x: average) x /= mNextBucket.size();
+            selectLttbBucket(average);
+        }
+        mBucket.swap(mNextBucket);
+        mNextBucket.clear();
+        std::fill(mNextSum.begin(), mNextSum.end(), 0.0);
+        while (index >= mBucketEnd) mBucketEnd = bucketEnd(++mBucketIndex);
+    }
+    mNextBucket.push_back(sample);
+    for (unsigned int j = 0; j <= mNumberOfColumns; ++j) mNextSum[j] += sample[j];
+    for (unsigned int j = 0; j < mNumberOfColumns; ++j) mScale[j] = std::max(mScale[j], fabs(sample[j + 1]));
+}
+
+void Decimator::selectLttbBucket(const Sample& next)
+{
+    // the sample of the bucket forming the largest triangle with the last selected sample and the next bucket's
+    // average, summing the areas of the columns relative to their scale
+    const Sample& a = mSelected;
+    const Sample& c = next;
+    double largestArea = -1.0;
+    unsigned int selected = 0;
+    for (unsigned int i = 0; i < mBucket.size(); ++i)
+    {
+        const Sample& b = mBucket[i];
+        double area = 0.0;
+        for (unsigned int j = 1; j <= mNumberOfColumns; ++j)
+        {
+            double scale = (mScale[j - 1] > 0.0) ? mScale[j - 1] : 1.0;
+            area += fabs((a[0] - c[0]) * (b[j] - a[j]) - (a[0] - b[0]) * (c[j] - a[j])) / scale;
+        }
+        if (area > largestArea)
+        {
+            largestArea = area;
+            selected = i;
+        }
+    }
+    emit(mBucket[selected]);
+    mSelected = mBucket[selected];
+}
+
+void Decimator::addPiecewiseLinear(const Sample& sample)
+{
+    // the segment from the anchor to this sample is within tolerance of all the samples since the anchor if its
+    // slope is within the bounds set by those samples
+    double dt = sample[0] - mAnchor[0];
+    bool withinTolerance = dt > 0.0;
+    for (unsigned int j = 0; withinTolerance && (j < mNumberOfColumns); ++j)
+    {
+        double slope = (sample[j + 1] - mAnchor[j + 1]) / dt;
+        withinTolerance = (slope >= mLowerSlope[j]) && (slope <= mUpperSlope[j]);
+    }
+    if (!withinTolerance && mHavePending)
+    {
+        // keep the previous sample and start a new segment from it
+        emit(mPending);
+        mAnchor = mPending;
+        std::fill(mLowerSlope.begin(), mLowerSlope.end(), -std::numeric_limits<double>::infinity());
+        std::fill(mUpperSlope.begin(), mUpperSlope.end(), std::numeric_limits<double>::infinity());
+        dt = sample[0] - mAnchor[0];
+    }
+    if (dt <= 0.0)
+    {
+        // a repeated time, keep it rather than divide by zero
+        emit(sample);
+        mAnchor = sample;
+        std::fill(mLowerSlope.begin(), mLowerSlope.end(), -std::numeric_limits<double>::infinity());
+        std::fill(mUpperSlope.begin(), mUpperSlope.end(), std::numeric_limits<double>::infinity());
+        mHavePending = false;
+        return;
+    }
+    for (unsigned int j = 0; j < mNumberOfColumns; ++j)
+    {
+        double y = sample[j + 1];
+        double tolerance = std::max(mOptions.absoluteTolerance, mOptions.relativeTolerance * fabs(y));
+        mLowerSlope[j] = std::max(mLowerSlope[j], (y - tolerance - mAnchor[j + 1]) / dt);
+        mUpperSlope[j] = std::min(mUpperSlope[j], (y + tolerance - mAnchor[j + 1]) / dt);
+    }
+    mPending = sample;
+    mHavePending = true;
+}
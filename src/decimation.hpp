@@ -0,0 +1,109 @@
+#ifndef DECIMATION_HPP
+#define DECIMATION_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * @brief How the samples of a report are to be decimated.
+ */
+class DecimationOptions
+{
+public:
+    enum Method
+    {
+        None = 0,
+        // largest-triangle-three-buckets (Steinarsson, 2013), keeping a fixed number of points
+        Lttb = 1,
+        // error-bounded piecewise-linear simplification, keeping the points needed so that linear interpolation
+        // between them is within the tolerances of every sample
+        PiecewiseLinear = 2
+    };
+
+    DecimationOptions() : method(None), numberOfPoints(1000), absoluteTolerance(0.0), relativeTolerance(1.0e-3)
+    {
+    }
+
+    /**
+     * @brief Parse a decimation specification: "lttb:<number of points>" or
+     * "pla:<relative tolerance>[:<absolute tolerance>]".
+     * @return zero on success.
+     */
+    int parse(const std::string& specification);
+
+    Method method;
+    // the number of points to keep for Lttb
+    unsigned int numberOfPoints;
+    // the allowed error of the interpolated values for PiecewiseLinear, the larger of the absolute tolerance and
+    // the relative tolerance times the magnitude of the sample
+    double absoluteTolerance;
+    double relativeTolerance;
+};
+
+/**
+ * @brief Online decimation of a time course.
+ *
+ * Samples (the time and the value of each column) are added as they are produced by the integrator and the
+ * selected samples are passed to the given function, in order, with a lag of at most a few buckets (Lttb) or
+ * one segment (PiecewiseLinear). Samples are kept or dropped as a whole, so the columns stay aligned. The first and
+ * last samples are always kept.
+ */
+class Decimator
+{
+public:
+    /**
+     * @param options The decimation to apply.
+     * @param expectedNumberOfSamples The number of samples expected in the time course, used to size the Lttb
+     * buckets.
+     * @param numberOfColumns The number of values in each sample.
+     * @param emit The function to call with the time and values of each selected sample.
+     */
+    Decimator(const DecimationOptions& options, unsigned int expectedNumberOfSamples, unsigned int numberOfColumns,
+              const std::function<void(double, const std::vector<double>&)>& emit);
+
+    void add(double time, const std::vector<double>& values);
+
+    /**
+     * @brief Select from any samples still held and emit the last sample.
+     */
+    void finish();
+
+    unsigned long numberOfSamples() const { return mNumberOfSamples; }
+    unsigned long numberOfSelectedSamples() const { return mNumberOfSelected; }
+
+private:
+    // a sample with its time at index 0
+    typedef std::vector<double> Sample;
+
+    unsigned long bucketEnd(unsigned long bucket) const;
+    void emit(const Sample& sample);
+    void addLttb(const Sample& sample);
+    void selectLttbBucket(const Sample& next);
+    void addPiecewiseLinear(const Sample& sample);
+
+    DecimationOptions mOptions;
+    unsigned int mNumberOfColumns;
+    std::function<void(double, const std::vector<double>&)> mEmit;
+    unsigned long mNumberOfSamples;
+    unsigned long mNumberOfSelected;
+    bool mHavePending;
+    Sample mPending;
+    // Lttb: the last selected sample, the bucket being selected from and the one after it with its sum, the
+    // index and end of the next bucket, the number of samples divided into buckets and the number of buckets, and
+    // the scale of each column
+    Sample mSelected;
+    std::vector<Sample> mBucket, mNextBucket;
+    Sample mNextSum;
+    unsigned long mBucketIndex;
+    unsigned long mBucketEnd;
+    unsigned long mNumberOfBucketedSamples;
+    unsigned long mNumberOfBuckets;
+    std::vector<double> mScale;
+    // PiecewiseLinear: the bounds on the slope of the segment from the anchor that keep the samples since the
+    // anchor within tolerance
+    Sample mAnchor;
+    std::vector<double> mLowerSlope, mUpperSlope;
+};
+
+#endif // DECIMATION_HPP
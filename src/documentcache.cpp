@@ -0,0 +1,329 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cerrno>
+#include <cctype>
+#include <iterator>
+#include <thread>
+#include <atomic>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#  include <direct.h>
+#  include <process.h>
+#  define makeDirectory(path) _mkdir(path)
+#  define getpid _getpid
+#else
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <unistd.h>
+#  define makeDirectory(path) mkdir(path, 0755)
+#endif
+
+#include "documentcache.hpp"
+#include "utils.hpp"
+
+class DocumentCacheConfiguration
+{
+public:
+    DocumentCacheConfiguration() : offline(false), maximumAge(0)
+    {
+        // the cache is only used when asked for, by configureDocumentCache or by setting GET_SIMULATOR_CACHE_DIR
+        const char* e = getenv("GET_SIMULATOR_CACHE_DIR");
+        if (e) directory = e;
+        e = getenv("GET_SIMULATOR_OFFLINE");
+        if (e && (std::string(e) == "1")) offline = true;
+    }
+
+    std::string directory;
+    bool offline;
+    long maximumAge;
+};
+
+static DocumentCacheConfiguration& configuration()
+{
+    static DocumentCacheConfiguration c;
+    return c;
+}
+
+void configureDocumentCache(const std::string& directory, bool offline, long maximumAge)
+{
+    DocumentCacheConfiguration& c = configuration();
+    c.directory = directory;
+    c.offline = offline;
+    c.maximumAge = maximumAge;
+}
+
+std::string defaultDocumentCacheDirectory()
+{
+    const char* e = getenv("GET_SIMULATOR_CACHE_DIR");
+    if (e) return std::string(e);
+    e = getenv("XDG_CACHE_HOME");
+    if (e && e[0]) return std::string(e) + "/get-simulator";
+    e = getenv("HOME");
+    if (e && e[0]) return std::string(e) + "/.cache/get-simulator";
+    return "";
+}
+
+std::string documentCacheDirectory()
+{
+    return configuration().directory;
+}
+
+bool documentCacheEnabled()
+{
+    return !configuration().directory.empty();
+}
+
+bool documentCacheOffline()
+{
+    return documentCacheEnabled() && configuration().offline;
+}
+
+bool isCacheableUrl(const std::string& url)
+{
+    return documentCacheEnabled() && ((url.compare(0, 7, "http://") == 0) || (url.compare(0, 8, "https://") == 0));
+}
+
+/*
+ * Create the given directory and any missing parents.
+ */
+static int makeDirectories(const std::string& path)
+{
+    for (size_t p = path.find('/', 1); ; p = path.find('/', p + 1))
+    {
+        std::string d = path.substr(0, p);
+        if (!d.empty() && (makeDirectory(d.c_str()) != 0) && (errno != EEXIST))
+        {
+            std::cerr << "Unable to create the cache directory: " << d << std::endl;
+            return -1;
+        }
+        if (p == std::string::npos) break;
+    }
+    return 0;
+}
+
+static std::string entryPath(const std::string& url)
+{
+    return configuration().directory + "/urls/" + sha256(url);
+}
+
+static std::string objectPath(const std::string& hash)
+{
+    return configuration().directory + "/objects/" + hash;
+}
+
+/*
+ * Write the file via a temporary file and a rename so that concurrent runs sharing the cache never see partially
+ * written files. The temporary file name is unique to the process, thread and call, as the threads of a process
+ * may write the same entry at once.
+ */
+static int writeFileAtomically(const std::string& path, const std::string& content)
+{
+    static std::atomic<unsigned long> counter(0);
+    std::ostringstream tmp;
+    tmp << path << ".tmp." << getpid() << "." << std::this_thread::get_id() << "." << counter++;
+    std::ofstream os(tmp.str().c_str(), std::ios::binary);
+    if (!os)
+    {
+        std::cerr << "Unable to write the cache file: " << tmp.str() << std::endl;
+        return -1;
+    }
+    os.write(content.data(), content.size());
+    os.close();
+    if (!os || (std::rename(tmp.str().c_str(), path.c_str()) != 0))
+    {
+        std::cerr << "Unable to write the cache file: " << path << std::endl;
+        std::remove(tmp.str().c_str());
+        return -2;
+    }
+    return 0;
+}
+
+static int writeEntry(const CachedDocument& document)
+{
+    std::ostringstream entry;
+    entry << "url " << document.url << "\n"
+          << "etag " << document.etag << "\n"
+          << "last-modified " << document.lastModified << "\n"
+          << "hash " << document.hash << "\n"
+          << "fetched " << document.fetchTime << "\n";
+    return writeFileAtomically(entryPath(document.url), entry.str());
+}
+
+bool findCachedDocument(const std::string& url, CachedDocument& document, std::string& content)
+{
+    if (!isCacheableUrl(url)) return false;
+    std::ifstream is(entryPath(url).c_str());
+    if (!is) return false;
+    CachedDocument d;
+    std::string line;
+    while (std::getline(is, line))
+    {
+        size_t space = line.find(' ');
+        std::string key = line.substr(0, space);
+        std::string value = (space == std::string::npos) ? "" : line.substr(space + 1);
+        if (key == "url") d.url = value;
+        else if (key == "etag") d.etag = value;
+        else if (key == "last-modified") d.lastModified = value;
+        else if (key == "hash") d.hash = value;
+        else if (key == "fetched") d.fetchTime = atol(value.c_str());
+    }
+    // guard against hash collisions of the URL and against missing or corrupt objects
+    if ((d.url != url) || d.hash.empty()) return false;
+    std::ifstream object(objectPath(d.hash).c_str(), std::ios::binary);
+    if (!object) return false;
+    std::string c((std::istreambuf_iterator<char>(object)), std::istreambuf_iterator<char>());
+    if (sha256(c) != d.hash) return false;
+    document = d;
+    content.swap(c);
+    return true;
+}
+
+bool cachedDocumentIsFresh(const CachedDocument& document)
+{
+    if (documentCacheOffline()) return true;
+    return (std::time(NULL) - document.fetchTime) < configuration().maximumAge;
+}
+
+std::vector<std::string> conditionalRequestHeaders(const CachedDocument& document)
+{
+    std::vector<std::string> headers;
+    if (!document.etag.empty()) headers.push_back("If-None-Match: " + document.etag);
+    if (!document.lastModified.empty()) headers.push_back("If-Modified-Since: " + document.lastModified);
+    return headers;
+}
+
+/*
+ * Split the raw headers into lines, keeping only those of the final response (e.g., after a 100 Continue).
+ */
+static std::vector<std::string> finalResponseHeaders(const std::string& responseHeaders)
+{
+    std::vector<std::string> lines, headers;
+    splitString(responseHeaders, '\n', lines);
+    for (std::string line: lines)
+    {
+        if (!line.empty() && (line[line.size() - 1] == '\r')) line.erase(line.size() - 1);
+        if (line.compare(0, 5, "HTTP/") == 0) headers.clear();
+        if (!line.empty()) headers.push_back(line);
+    }
+    return headers;
+}
+
+static std::string headerValue(const std::vector<std::string>& headers, const std::string& name)
+{
+    for (const std::string& h: headers)
+    {
+        if (h.size() <= name.size() || (h[name.size()] != ':')) continue;
+        bool match = true;
+        for (size_t i = 0; match && (i < name.size()); ++i) match = (tolower(h[i]) == tolower(name[i]));
+        if (!match) continue;
+        size_t start = h.find_first_not_of(" \t", name.size() + 1);
+        return (start == std::string::npos) ? "" : h.substr(start);
+    }
+    return "";
+}
+
+int responseStatusCode(const std::string& responseHeaders)
+{
+    std::vector<std::string> headers = finalResponseHeaders(responseHeaders);
+    if (headers.empty() || (headers[0].compare(0, 5, "HTTP/") != 0)) return 0;
+    size_t space = headers[0].find(' ');
+    if (space == std::string::npos) return 0;
+    return atoi(headers[0].c_str() + space + 1);
+}
+
+int storeCachedDocument(const std::string& url, const std::string& responseHeaders, const std::string& content)
+{
+    if (!isCacheableUrl(url)) return 0;
+    const std::string& directory = configuration().directory;
+    if ((makeDirectories(directory + "/urls") != 0) || (makeDirectories(directory + "/objects") != 0)) return -1;
+    std::vector<std::string> headers = finalResponseHeaders(responseHeaders);
+    CachedDocument document;
+    document.url = url;
+    document.etag = headerValue(headers, "ETag");
+    document.lastModified = headerValue(headers, "Last-Modified");
+    document.hash = sha256(content);
+    document.fetchTime = std::time(NULL);
+    // the content is addressed by its hash, so it only needs writing if we haven't seen it before
+    std::ifstream existing(objectPath(document.hash).c_str());
+    if (!existing && (writeFileAtomically(objectPath(document.hash), content) != 0)) return -2;
+    return writeEntry(document);
+}
+
+int refreshCachedDocument(CachedDocument& document)
+{
+    document.fetchTime = std::time(NULL);
+    return writeEntry(document);
+}
+
+/*
+ * SHA-256 (FIPS 180-4).
+ */
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotateRight(uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+static void sha256Block(const unsigned char* block, uint32_t* h)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t(block[4*i]) << 24) | (uint32_t(block[4*i+1]) << 16) | (uint32_t(block[4*i+2]) << 8)
+               | uint32_t(block[4*i+3]);
+    for (int i = 16; i < 64; ++i)
+    {
+        uint32_t s0 = rotateRight(w[i-15], 7) ^ rotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+        uint32_t s1 = rotateRight(w[i-2], 17) ^ rotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = k + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g))
+                      + SHA256_K[i] + w[i];
+        uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        k = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+std::string sha256(const std::string& data)
+{
+    uint32_t h[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+                      0x5be0cd19 };
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data.data());
+    size_t n = data.size(), i = 0;
+    for (; i + 64 <= n; i += 64) sha256Block(bytes + i, h);
+    // pad the remainder with a one bit, zeros and the message length in bits
+    unsigned char tail[128] = { 0 };
+    size_t r = n - i;
+    for (size_t j = 0; j < r; ++j) tail[j] = bytes[i + j];
+    tail[r] = 0x80;
+    size_t tailLength = (r < 56) ? 64 : 128;
+    uint64_t bits = uint64_t(n) * 8;
+    for (int j = 0; j < 8; ++j) tail[tailLength - 1 - j] = (unsigned char)(bits >> (8 * j));
+    sha256Block(tail, h);
+    if (tailLength == 128) sha256Block(tail + 64, h);
+    std::ostringstream hex;
+    for (int j = 0; j < 8; ++j) hex << std::hex << std::setw(8) << std::setfill('0') << h[j];
+    return hex.str();
+}
@@ -0,0 +1,104 @@
+#ifndef DOCUMENTCACHE_HPP
+#define DOCUMENTCACHE_HPP
+
+#include <string>
+#include <vector>
+
+/**
+ * The cache entry for a URL: the validators returned by the server and the hash of the content, which is stored
+ * separately so that identical documents at different URLs are only stored once.
+ */
+class CachedDocument
+{
+public:
+    CachedDocument() : fetchTime(0)
+    {
+    }
+
+    std::string url;
+    std::string etag;
+    std::string lastModified;
+    std::string hash; // the SHA-256 of the content
+    long fetchTime; // when the content was last fetched or revalidated, in seconds since the epoch
+};
+
+/**
+ * @brief Configure the local document cache used by getUrlContent and prefetchUrls.
+ *
+ * Only HTTP(S) URLs are cached. The cache directory holds the content of each document in objects/<hash> and the
+ * entry for each URL in urls/<hash of the URL>. Entries are revalidated with the server using their ETag and
+ * Last-Modified validators unless they are younger than the maximum age or the cache is offline. Cached models
+ * reach CSim as local files through the DocumentMirror.
+ *
+ * The cache is disabled until this is called with a directory, unless $GET_SIMULATOR_CACHE_DIR is set.
+ *
+ * @param directory The cache directory, an empty string to disable the cache.
+ * @param offline If true, only cached content is used and the network is never accessed.
+ * @param maximumAge Entries fetched or revalidated less than this many seconds ago are used without revalidation.
+ */
+void configureDocumentCache(const std::string& directory, bool offline, long maximumAge);
+
+/**
+ * @brief The default cache directory: $GET_SIMULATOR_CACHE_DIR if set, otherwise get-simulator in
+ * $XDG_CACHE_HOME or $HOME/.cache.
+ */
+std::string defaultDocumentCacheDirectory();
+
+/**
+ * @brief The cache directory currently configured, an empty string if the cache is disabled.
+ */
+std::string documentCacheDirectory();
+
+bool documentCacheEnabled();
+bool documentCacheOffline();
+
+/**
+ * @brief Check if the content of the given URL will be cached.
+ */
+bool isCacheableUrl(const std::string& url);
+
+/**
+ * @brief Look for the given URL in the cache.
+ * @param url The URL.
+ * @param document On success, the cache entry for the URL.
+ * @param content On success, the cached content.
+ * @return true if the URL is in the cache and its content is available.
+ */
+bool findCachedDocument(const std::string& url, CachedDocument& document, std::string& content);
+
+/**
+ * @brief Check if the given cache entry can be used without revalidating it with the server.
+ */
+bool cachedDocumentIsFresh(const CachedDocument& document);
+
+/**
+ * @brief The request headers to revalidate the given cache entry, e.g., If-None-Match.
+ */
+std::vector<std::string> conditionalRequestHeaders(const CachedDocument& document);
+
+/**
+ * @brief Store the content fetched for a URL, along with the validators in the response headers.
+ * @param url The URL.
+ * @param responseHeaders The raw response headers.
+ * @param content The content.
+ * @return zero on success.
+ */
+int storeCachedDocument(const std::string& url, const std::string& responseHeaders, const std::string& content);
+
+/**
+ * @brief Record that the server confirmed the cache entry is still valid (a 304 Not Modified response).
+ * @return zero on success.
+ */
+int refreshCachedDocument(CachedDocument& document);
+
+/**
+ * @brief Get the status code of the final response in the given raw response headers, zero if there is none.
+ */
+int responseStatusCode(const std::string& responseHeaders);
+
+/**
+ * @brief The SHA-256 digest of the given data as a hexadecimal string.
+ */
+std::string sha256(const std::string& data);
+
+#endif // DOCUMENTCACHE_HPP
@@ -0,0 +1,191 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#ifndef _MSC_VER
+#  include <unistd.h>
+#endif
+
+#include "documentmirror.hpp"
+#include "utils.hpp"
+#include "omexarchive.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
+
+#define XLINK_NAMESPACE "http://www.w3.org/1999/xlink"
+
+/*
+ * Collect all the CellML import elements in the given document.
+ */
+static void findImports(xmlNodePtr node, std::vector<xmlNodePtr>& imports)
+{
+    for (xmlNodePtr n = node; n; n = n->next)
+    {
+        if (n->type != XML_ELEMENT_NODE) continue;
+        if (xmlStrEqual(n->name, BAD_CAST "import") && xmlHasNsProp(n, BAD_CAST "href", BAD_CAST XLINK_NAMESPACE))
+            imports.push_back(n);
+        findImports(n->children, imports);
+    }
+}
+
+static std::string importUrl(xmlNodePtr import, const std::string& baseUrl)
+{
+    xmlChar* href = xmlGetNsProp(import, BAD_CAST "href", BAD_CAST XLINK_NAMESPACE);
+    std::string url = buildAbsoluteUri((char*)href, baseUrl);
+    xmlFree(href);
+    return url;
+}
+
+/*
+ * A file name for the local copy of the given URL: the last segment of its path, restricted to safe characters.
+ */
+static std::string localFileName(const std::string& url, int index)
+{
+    std::string path = url.substr(0, url.find_first_of("?#"));
+    std::string name = path.substr(path.rfind('/') + 1);
+    for (char& c: name)
+    {
+        bool safe = ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) ||
+                    (c == '.') || (c == '_') || (c == '-');
+        if (!safe) c = '_';
+    }
+    std::ostringstream file;
+    file << index << "-" << (name.empty() ? std::string("document") : name);
+    return file.str();
+}
+
+DocumentMirror::DocumentMirror()
+{
+}
+
+DocumentMirror::~DocumentMirror()
+{
+    // the scratch directory was recorded first, and remove deletes (empty) directories too
+    for (auto f = mScratchFiles.rbegin(); f != mScratchFiles.rend(); ++f) std::remove(f->c_str());
+}
+
+int DocumentMirror::createScratchDirectory()
+{
+    if (!mScratchDirectory.empty()) return 0;
+#ifndef _MSC_VER
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-models-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(&name[0]))
+    {
+        std::cerr << "DocumentMirror: unable to create a scratch directory" << std::endl;
+        return -1;
+    }
+    mScratchDirectory = &name[0];
+    mScratchFiles.push_back(mScratchDirectory);
+    return 0;
+#else
+    std::cerr << "DocumentMirror: not supported on this platform" << std::endl;
+    return -1;
+#endif
+}
+
+int DocumentMirror::mirror(const std::vector<std::string>& urls)
+{
+    GET_TRACE_SCOPE("io", "mirror documents");
+    std::map<std::string, std::string> documents;
+    int numberOfFailures = prefetchUrls(urls, true, documents);
+    // parse everything fetched, so the imports can be followed and rewritten
+    std::map<std::string, xmlDocPtr> parsed;
+    std::map<std::string, std::vector<xmlNodePtr> > imports;
+    for (const auto& d: documents)
+    {
+        xmlDocPtr doc = xmlReadMemory(d.second.data(), d.second.size(), d.first.c_str(), NULL,
+                                      XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+        parsed[d.first] = doc;
+        if (doc) findImports(xmlDocGetRootElement(doc), imports[d.first]);
+    }
+    // the documents fetched over the network need a local copy, and so do local documents importing them
+    std::set<std::string> toMirror;
+    for (const auto& d: documents)
+        if (!isFileUrl(d.first) && !isOmexUrl(d.first)) toMirror.insert(d.first);
+    bool added = !toMirror.empty();
+    while (added)
+    {
+        added = false;
+        for (const auto& i: imports)
+        {
+            if (toMirror.count(i.first)) continue;
+            for (xmlNodePtr import: i.second)
+            {
+                if (toMirror.count(importUrl(import, i.first)))
+                {
+                    toMirror.insert(i.first);
+                    added = true;
+                    break;
+                }
+            }
+        }
+    }
+    if (!toMirror.empty() && (createScratchDirectory() != 0))
+    {
+        for (auto& p: parsed) if (p.second) xmlFreeDoc(p.second);
+        return numberOfFailures + toMirror.size();
+    }
+    for (const std::string& url: toMirror)
+    {
+        std::string path = mScratchDirectory + "/" + localFileName(url, mLocalUrls.size());
+        mLocalUrls[url] = "file://" + path;
+    }
+    for (const std::string& url: toMirror)
+    {
+        std::string path = fileUrlPath(mLocalUrls[url]);
+        xmlDocPtr doc = parsed[url];
+        bool ok;
+        if (doc)
+        {
+            // the local copy is in a different place, so all its imports need absolute (or mirrored) URLs
+            for (xmlNodePtr import: imports[url])
+            {
+                std::string importedUrl = importUrl(import, url);
+                auto local = mLocalUrls.find(importedUrl);
+                std::string href = (local == mLocalUrls.end()) ? omexLocalUrl(importedUrl) : local->second;
+                xmlAttrPtr attribute = xmlHasNsProp(import, BAD_CAST "href", BAD_CAST XLINK_NAMESPACE);
+                xmlSetNsProp(import, attribute->ns, BAD_CAST "href", BAD_CAST href.c_str());
+            }
+            ok = xmlSaveFile(path.c_str(), doc) >= 0;
+        }
+        else
+        {
+            // not XML, so there is nothing to rewrite; leave it to the loader to report
+            const std::string& content = documents[url];
+            std::ofstream os(path.c_str(), std::ios::binary);
+            os.write(content.data(), content.size());
+            ok = bool(os);
+        }
+        if (ok)
+        {
+            mScratchFiles.push_back(path);
+            GET_LOG(LogDebug, "Mirrored " << url << " to " << path);
+        }
+        else
+        {
+            std::cerr << "DocumentMirror: unable to write the local copy of " << url << std::endl;
+            std::remove(path.c_str());
+            mLocalUrls.erase(url);
+            ++numberOfFailures;
+        }
+    }
+    for (auto& p: parsed) if (p.second) xmlFreeDoc(p.second);
+    return numberOfFailures;
+}
+
+std::string DocumentMirror::localUrl(const std::string& url) const
+{
+    auto i = mLocalUrls.find(url);
+    return (i == mLocalUrls.end()) ? url : i->second;
+}
@@ -0,0 +1,48 @@
+#ifndef DOCUMENTMIRROR_HPP
+#define DOCUMENTMIRROR_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * @brief Local copies of model documents fetched over the network, for tools that can only load a model from a
+ * URL themselves (i.e., CSim).
+ *
+ * The models and their imports are fetched together with prefetchUrls, going through the document cache, and any
+ * that are not already local files are written to a scratch directory with their imports pointing at the local
+ * copies. Loading a model from its local URL therefore needs no further requests. The scratch directory is
+ * removed when the mirror is destroyed, so a mirror should live as long as the models may be loaded (e.g., for
+ * one SED-ML document).
+ */
+class DocumentMirror
+{
+public:
+    DocumentMirror();
+    ~DocumentMirror();
+
+    /**
+     * @brief Fetch the given documents and their CellML imports and mirror them locally.
+     * @return The number of documents that could not be fetched or mirrored; those are left to be fetched again
+     * when they are loaded.
+     */
+    int mirror(const std::vector<std::string>& urls);
+
+    /**
+     * @brief The URL to load the given document from: the file:// URL of its local copy if it has been mirrored,
+     * otherwise the URL itself.
+     */
+    std::string localUrl(const std::string& url) const;
+
+private:
+    DocumentMirror(const DocumentMirror&) = delete;
+    DocumentMirror& operator=(const DocumentMirror&) = delete;
+
+    int createScratchDirectory();
+
+    std::string mScratchDirectory;
+    std::vector<std::string> mScratchFiles;
+    std::map<std::string, std::string> mLocalUrls;
+};
+
+#endif // DOCUMENTMIRROR_HPP
@@ -0,0 +1,148 @@
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <sstream>
+
+#include "enginecache.hpp"
+#include "simulationenginecsim.hpp"
+#include "dataset.hpp"
+#include "setvaluechange.hpp"
+
+class SimulationEngineCache
+{
+public:
+    SimulationEngineCache() : capacity(0), hits(0), misses(0)
+    {
+    }
+
+    ~SimulationEngineCache()
+    {
+        for (auto& entry: idle) delete entry.second;
+    }
+
+    // remove the least recently used engines until there are no more than the given number
+    void trim(unsigned int size)
+    {
+        while (idle.size() > size)
+        {
+            delete idle.back().second;
+            idle.pop_back();
+        }
+    }
+
+    std::mutex mutex;
+    unsigned int capacity;
+    // the idle engines, most recently used first
+    std::list<std::pair<std::string, SimulationEngineCsim*> > idle;
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static SimulationEngineCache& cache()
+{
+    static SimulationEngineCache c;
+    return c;
+}
+
+void configureSimulationEngineCache(unsigned int capacity)
+{
+    SimulationEngineCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.capacity = capacity;
+    c.trim(capacity);
+}
+
+bool simulationEngineCacheEnabled()
+{
+    SimulationEngineCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    return c.capacity > 0;
+}
+
+static void appendTarget(std::ostringstream& key, const std::string& target,
+                         const std::map<std::string, std::string>& namespaces)
+{
+    // the namespaces are needed to resolve the prefixes in the XPath
+    key << target << "\t";
+    for (const auto& ns: namespaces) key << ns.first << "=" << ns.second << "\t";
+}
+
+std::string simulationEngineKey(const std::string& modelUrl, const std::vector<MyVariable*>& variables,
+                                const std::vector<MySetValueChange*>& changes)
+{
+    std::ostringstream key;
+    key << modelUrl << "\n";
+    for (const MyVariable* v: variables)
+    {
+        key << "output\t";
+        appendTarget(key, v->target, v->namespaces);
+        key << "sensitivity\t" << v->sensitivityTarget << "\n";
+    }
+    for (const MySetValueChange* change: changes)
+    {
+        key << "input\t";
+        appendTarget(key, change->targetXpath, change->namespaces);
+        key << "\n";
+    }
+    return key.str();
+}
+
+SimulationEngineCsim* acquireSimulationEngine(const std::string& key)
+{
+    SimulationEngineCache& c = cache();
+    SimulationEngineCsim* engine = NULL;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        if (c.capacity == 0) return NULL;
+        for (auto entry = c.idle.begin(); entry != c.idle.end(); ++entry)
+        {
+            if (entry->first == key)
+            {
+                engine = entry->second;
+                c.idle.erase(entry);
+                break;
+            }
+        }
+        if (engine) ++c.hits;
+        else ++c.misses;
+    }
+    if (engine && (engine->resetToInitialConditions() != 0))
+    {
+        delete engine;
+        engine = NULL;
+    }
+    return engine;
+}
+
+void releaseSimulationEngine(const std::string& key, SimulationEngineCsim* engine)
+{
+    if (!engine) return;
+    SimulationEngineCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    if (key.empty() || (c.capacity == 0))
+    {
+        delete engine;
+        return;
+    }
+    c.idle.push_front(std::make_pair(key, engine));
+    c.trim(c.capacity);
+}
+
+void clearSimulationEngineCache()
+{
+    SimulationEngineCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    c.trim(0);
+}
+
+void simulationEngineCacheStatistics(unsigned int& size, unsigned long& hits, unsigned long& misses)
+{
+    SimulationEngineCache& c = cache();
+    std::lock_guard<std::mutex> lock(c.mutex);
+    size = c.idle.size();
+    hits = c.hits;
+    misses = c.misses;
+}
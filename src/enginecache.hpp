@@ -0,0 +1,55 @@
+#ifndef ENGINECACHE_HPP
+#define ENGINECACHE_HPP
+
+#include <string>
+#include <vector>
+
+class SimulationEngineCsim;
+class MyVariable;
+class MySetValueChange;
+
+/**
+ * @brief Configure the cache of instantiated CSim simulation engines.
+ *
+ * Loading and compiling a model is usually the most expensive part of a short simulation, so a long-running
+ * process (e.g., get-sed-ml-client --serve) can keep the engines of completed tasks and reuse them for later tasks
+ * of the same model with the same outputs and inputs. The least recently used engines are discarded once there are
+ * more than the given number of idle engines. The cache is disabled by default.
+ *
+ * @param capacity The maximum number of idle engines to keep, zero to disable the cache (discarding any engines in
+ * it).
+ */
+void configureSimulationEngineCache(unsigned int capacity);
+
+bool simulationEngineCacheEnabled();
+
+/**
+ * @brief The cache key for an engine of the given model with the given outputs and inputs, in the order they are
+ * added to the engine.
+ */
+std::string simulationEngineKey(const std::string& modelUrl, const std::vector<MyVariable*>& variables,
+                                const std::vector<MySetValueChange*>& changes);
+
+/**
+ * @brief Take an idle engine with the given key from the cache. The engine is reset to its initial conditions and
+ * belongs to the caller until it is released.
+ * @return the engine, or NULL if there is no idle engine with the key.
+ */
+SimulationEngineCsim* acquireSimulationEngine(const std::string& key);
+
+/**
+ * @brief Return an engine to the cache once its task is complete, or delete it if the cache is disabled.
+ */
+void releaseSimulationEngine(const std::string& key, SimulationEngineCsim* engine);
+
+/**
+ * @brief Delete all the idle engines in the cache.
+ */
+void clearSimulationEngineCache();
+
+/**
+ * @brief The number of idle engines in the cache and the number of times an engine was, or wasn't, found.
+ */
+void simulationEngineCacheStatistics(unsigned int& size, unsigned long& hits, unsigned long& misses);
+
+#endif // ENGINECACHE_HPP
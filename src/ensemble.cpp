@@ -0,0 +1,159 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "simulationenginecsim.hpp"
+#include "ensemble.hpp"
+
+/*
+ * A worker owns a simulation engine with the model compiled and the inputs and outputs flagged, along with its own
+ * copy of the set value changes so that workers can apply different input values concurrently.
+ */
+class EnsembleWorker
+{
+public:
+    EnsembleWorker() : used(false)
+    {
+    }
+
+    SimulationEngineCsim engine;
+    std::vector<MySetValueChange> changes;
+    std::vector<int> outputIndices;
+    // will only be true once the engine has been used for a simulation and needs to be reset before the next
+    bool used;
+    // the sampled outputs of the current simulation
+    std::vector<double> times;
+    std::vector<std::vector<double> > outputs;
+};
+
+TaskEnsemble::TaskEnsemble()
+{
+}
+
+TaskEnsemble::~TaskEnsemble()
+{
+    for (auto w: mWorkers) delete w;
+}
+
+int TaskEnsemble::initialise(const std::string& modelUrl, const MySimulation& simulation,
+                             const std::vector<MySetValueChange>& inputs, const std::vector<MyVariable>& outputs,
+                             int numberOfWorkers)
+{
+    if (!simulation.isCsim())
+    {
+        std::cerr << "TaskEnsemble::initialise: ensembles can only be run for CSim simulations" << std::endl;
+        return -1;
+    }
+    if (simulation.numberOfPoints < 1)
+    {
+        std::cerr << "TaskEnsemble::initialise: the simulation must have at least one output point" << std::endl;
+        return -1;
+    }
+    mSimulation = simulation;
+    if (numberOfWorkers <= 0) numberOfWorkers = std::thread::hardware_concurrency();
+    if (numberOfWorkers <= 0) numberOfWorkers = 1;
+    for (auto w: mWorkers) delete w;
+    mWorkers.clear();
+    // the models are compiled one at a time, only the simulations are performed in parallel
+    for (int i = 0; i < numberOfWorkers; ++i)
+    {
+        EnsembleWorker* worker = new EnsembleWorker();
+        mWorkers.push_back(worker);
+        if (worker->engine.loadModel(modelUrl) != 0) return -2;
+        int numberOfErrors = 0;
+        for (const MySetValueChange& input: inputs)
+        {
+            worker->changes.push_back(input);
+            numberOfErrors += worker->engine.addInputVariable(worker->changes.back());
+        }
+        for (const MyVariable& output: outputs)
+        {
+            MyVariable v(output);
+            v.sensitivityTarget = "";
+            numberOfErrors += worker->engine.addOutputVariable(v);
+            worker->outputIndices.push_back(v.outputIndex);
+        }
+        if (numberOfErrors > 0) return numberOfErrors;
+        if (worker->engine.instantiateSimulation() != 0)
+        {
+            std::cerr << "TaskEnsemble::initialise: error instantiating the simulation" << std::endl;
+            return -3;
+        }
+        worker->outputs.resize(outputs.size());
+    }
+    return 0;
+}
+
+bool TaskEnsemble::simulate(EnsembleWorker& worker, const std::vector<double>& point)
+{
+    worker.times.clear();
+    for (auto& o: worker.outputs) o.clear();
+    // start each simulation from the initial conditions of the model
+    if (worker.used) worker.engine.resetSimulator(true);
+    worker.used = true;
+    for (unsigned int p = 0; p < worker.changes.size(); ++p)
+    {
+        worker.changes[p].currentRangeValue = point[p];
+        if (worker.engine.applySetValueChange(worker.changes[p]) != 0) return false;
+    }
+    if (worker.engine.initialiseSimulation(mSimulation, mSimulation.initialTime, mSimulation.startTime) != 0)
+        return false;
+    auto captureResults = [&worker](double time)
+    {
+        const std::vector<double>& outputs = worker.engine.getOutputValues();
+        worker.times.push_back(time);
+        for (unsigned int k = 0; k < worker.outputIndices.size(); ++k)
+            worker.outputs[k].push_back(outputs[worker.outputIndices[k]]);
+    };
+    captureResults(mSimulation.startTime);
+    double dt = (mSimulation.endTime - mSimulation.startTime) / mSimulation.numberOfPoints;
+    for (int i = 1; i <= mSimulation.numberOfPoints; ++i)
+    {
+        if (worker.engine.simulateModelOneStep(dt) != 0) return false;
+        captureResults(mSimulation.startTime + i * dt);
+    }
+    return true;
+}
+
+int TaskEnsemble::run(const std::vector<std::vector<double> >& points, const EnsembleResultHandler& handler)
+{
+    if (mWorkers.empty())
+    {
+        std::cerr << "TaskEnsemble::run: must initialise the ensemble first" << std::endl;
+        return -1;
+    }
+    std::atomic<unsigned int> next(0);
+    auto work = [this, &points, &handler, &next](int w)
+    {
+        EnsembleWorker& worker = *(mWorkers[w]);
+        unsigned int i;
+        while ((i = next++) < points.size())
+        {
+            bool success = simulate(worker, points[i]);
+            handler(i, success, worker.times, worker.outputs);
+        }
+    };
+    // the calling thread acts as the first worker
+    unsigned int numberOfThreads = std::min(mWorkers.size(), points.size());
+    std::vector<std::thread> threads;
+    for (unsigned int w = 1; w < numberOfThreads; ++w) threads.push_back(std::thread(work, w));
+    work(0);
+    for (auto& t: threads) t.join();
+    return 0;
+}
+
+std::vector<double> TaskEnsemble::sampleTimes() const
+{
+    std::vector<double> times;
+    double dt = (mSimulation.endTime - mSimulation.startTime) / mSimulation.numberOfPoints;
+    for (int i = 0; i <= mSimulation.numberOfPoints; ++i) times.push_back(mSimulation.startTime + i * dt);
+    return times;
+}
+
+int TaskEnsemble::numberOfWorkers() const
+{
+    return mWorkers.size();
+}
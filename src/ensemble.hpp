@@ -0,0 +1,74 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "dataset.hpp"
+#include "setvaluechange.hpp"
+#include "utilityclasses.hpp"
+
+class EnsembleWorker;
+
+/**
+ * Handler for the result of one member of an ensemble: the index of the member's input values, whether the
+ * simulation succeeded, and the sample times and corresponding values of each output. Handlers are called
+ * concurrently from the worker threads, so they must only modify state belonging to the given member or
+ * synchronise their access to shared state.
+ */
+typedef std::function<void(unsigned int index, bool success, const std::vector<double>& times,
+                           const std::vector<std::vector<double> >& outputs)> EnsembleResultHandler;
+
+/**
+ * @brief Run many simulations of a CSim task with different values for a set of model inputs.
+ *
+ * Each worker owns a simulation engine that is compiled once in initialise and then reset and re-used for every
+ * member of the ensemble it simulates. The members are shared out between the workers, which run in parallel.
+ * The outputs are sampled on the uniform time course of the simulation.
+ */
+class TaskEnsemble
+{
+public:
+    TaskEnsemble();
+    ~TaskEnsemble();
+
+    /**
+     * @brief Load and compile the model for each worker.
+     * @param modelUrl The URL of the CellML model.
+     * @param simulation The simulation to run for each member, must be a CSim simulation.
+     * @param inputs The model inputs to set for each member, their namespaces must be set to resolve their XPaths.
+     * @param outputs The outputs to sample, their namespaces must be set to resolve their target XPaths.
+     * @param numberOfWorkers The number of workers, zero to use all available cores.
+     * @return zero on success.
+     */
+    int initialise(const std::string& modelUrl, const MySimulation& simulation,
+                   const std::vector<MySetValueChange>& inputs, const std::vector<MyVariable>& outputs,
+                   int numberOfWorkers);
+
+    /**
+     * @brief Simulate the ensemble with the given input values, blocking until all members have been simulated.
+     * @param points The values of the inputs for each member, in the order they were given to initialise.
+     * @param handler Called with the result of each member.
+     * @return zero on success.
+     */
+    int run(const std::vector<std::vector<double> >& points, const EnsembleResultHandler& handler);
+
+    /**
+     * @brief The times at which the outputs of each member are sampled.
+     */
+    std::vector<double> sampleTimes() const;
+
+    /**
+     * @brief The number of workers simulating the ensemble in parallel.
+     */
+    int numberOfWorkers() const;
+
+private:
+    bool simulate(EnsembleWorker& worker, const std::vector<double>& point);
+
+    MySimulation mSimulation;
+    std::vector<EnsembleWorker*> mWorkers;
+};
+
+#endif // ENSEMBLE_HPP
@@ -0,0 +1,668 @@
+/*
+ * epithelialsheet.cpp
+ *
+ * A tissue-level model of a sheet of epithelial cells sharing lumen and interstitial compartments.
+ */
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <cvodes/cvodes.h>
+#include <cvodes/cvodes_spgmr.h>
+#include <nvector/nvector_serial.h>
+#include <sundials/sundials_dense.h>
+#include <sundials/sundials_types.h>
+
+#include "common.hpp"
+#include "GeneralModel.hpp"
+#include "epithelialsheet.hpp"
+#include "kinsol.hpp"
+#include "logging.hpp"
+
+#define RTOL  RCONST(1.0e-3)   /* scalar relative tolerance            */
+#define ATOL  RCONST(1.0e-4)   /* vector absolute tolerance components */
+
+/* the open-circuit potential, the current tolerance for each cell is the same as for the KINSOL solves */
+#define CURRENT_TOLERANCE 1.0e-7
+#define POTENTIAL_TOLERANCE 1.0e-10
+#define FIRST_POTENTIAL_STEP 1.0e-3
+#define MAX_POTENTIAL_ITERATIONS 50
+
+/* Functions Called by the Solver */
+static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data);
+static int psetup(realtype t, N_Vector y, N_Vector fy, booleantype jok, booleantype *jcurPtr, realtype gamma,
+                  void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3);
+static int psolve(realtype t, N_Vector y, N_Vector fy, N_Vector r, N_Vector z, realtype gamma, realtype delta,
+                  int lr, void *user_data, N_Vector tmp);
+
+/* Private function to check function return values */
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+
+/**
+ * A minimal pool of worker threads used to evaluate contiguous ranges of cells in parallel. The calling thread
+ * evaluates the first range itself.
+ */
+class SheetWorkers
+{
+public:
+    SheetWorkers(int numberOfThreads) : mTask(NULL), mN(0), mGeneration(0), mRemaining(0), mStop(false)
+    {
+        for (int i = 1; i < numberOfThreads; ++i) mThreads.push_back(std::thread(&SheetWorkers::work, this, i));
+    }
+
+    ~SheetWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mStart.notify_all();
+        for (auto& t: mThreads) t.join();
+    }
+
+    /**
+     * Run task(begin, end) over the range [0, n), blocking until all the ranges have been evaluated.
+     */
+    void run(int n, const std::function<void(int, int)>& task)
+    {
+        if (mThreads.empty())
+        {
+            task(0, n);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mTask = &task;
+            mN = n;
+            mRemaining = mThreads.size();
+            ++mGeneration;
+        }
+        mStart.notify_all();
+        task(0, range(n, 1));
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this]{ return mRemaining == 0; });
+    }
+
+private:
+    int range(int n, int index)
+    {
+        return (int)(((long int)n * index) / (long int)(mThreads.size() + 1));
+    }
+
+    void work(int index)
+    {
+        int generation = 0;
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStart.wait(lock, [&]{ return mStop || (mGeneration != generation); });
+            if (mStop) return;
+            generation = mGeneration;
+            const std::function<void(int, int)>* task = mTask;
+            int n = mN;
+            lock.unlock();
+            (*task)(range(n, index), range(n, index+1));
+            lock.lock();
+            if (--mRemaining == 0) mDone.notify_one();
+        }
+    }
+
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mStart, mDone;
+    const std::function<void(int, int)>* mTask;
+    int mN, mGeneration, mRemaining;
+    bool mStop;
+};
+
+/**
+ * Storage for the block diagonal preconditioner.
+ */
+class SheetPreconditioner
+{
+public:
+    ~SheetPreconditioner()
+    {
+        for (auto b: blocks) DestroyMat(b);
+        for (auto p: pivots) DestroyArray(p);
+    }
+
+    // the saved Jacobian block for each cell (column-major)
+    std::vector<std::vector<double> > jacobians;
+    // the factorised I - gamma * J for each cell
+    std::vector<DlsMat> blocks;
+    std::vector<long int*> pivots;
+    // per-cell contributions to the diagonal of the shared compartment Jacobian blocks
+    std::vector<double> lumenContributions, interstitialContributions;
+    // I - gamma * J for the (diagonal) shared compartment blocks
+    std::vector<double> lumenDiagonal, interstitialDiagonal;
+};
+
+EpithelialSheet::EpithelialSheet() : modelMode(GeneralModel::OpenCircuit), lumenVolume(1.0), interstitialVolume(1.0),
+    U_t(0.0), I_t(0.0), mNumberOfMolecules(0),
+    mWorkers(NULL), mPreconditioner(NULL), mCvodeMem(NULL), mNvY(NULL)
+{
+}
+
+EpithelialSheet::~EpithelialSheet()
+{
+    freeIntegrator();
+    if (mWorkers) delete mWorkers;
+    if (mPreconditioner) delete mPreconditioner;
+    for (auto c: mCells) delete c;
+}
+
+GeneralModel& EpithelialSheet::addCell()
+{
+    GeneralModel* cell = new GeneralModel();
+    cell->context = context;
+    mCells.push_back(cell);
+    return *cell;
+}
+
+int EpithelialSheet::numberOfCells() const
+{
+    return mCells.size();
+}
+
+GeneralModel& EpithelialSheet::cell(int index)
+{
+    return *(mCells[index]);
+}
+
+void EpithelialSheet::freeIntegrator()
+{
+    if (mCvodeMem) CVodeFree(&mCvodeMem);
+    mCvodeMem = NULL;
+    if (mNvY) N_VDestroy_Serial(mNvY);
+    mNvY = NULL;
+}
+
+void EpithelialSheet::runCells(const std::function<void(int, int)>& evaluate)
+{
+    mWorkers->run(mCells.size(), evaluate);
+    flushCellDiagnostics();
+}
+
+void EpithelialSheet::flushCellDiagnostics()
+{
+    for (std::ostringstream& d: mCellDiagnostics)
+    {
+        if (d.tellp() <= 0) continue;
+        *context.diagnostics << d.str();
+        d.str("");
+    }
+}
+
+int EpithelialSheet::numberOfStates() const
+{
+    return mCells.size() * (mNumberOfMolecules + 1) + 2 * mNumberOfMolecules;
+}
+
+int EpithelialSheet::initialise(double initialTime, double maxStep, int numberOfThreads)
+{
+    if (mCells.empty())
+    {
+        std::cerr << "EpithelialSheet::initialise: no cells in the sheet." << std::endl;
+        return -1;
+    }
+    if ((modelMode != GeneralModel::OpenCircuit) && (modelMode != GeneralModel::ShortCircuit))
+    {
+        std::cerr << "EpithelialSheet::initialise: the sheet can only be open or short circuited." << std::endl;
+        return -1;
+    }
+    for (auto c: mCells)
+    {
+        c->initialise();
+        // the cells are voltage clamped at the transepithelial potential of the sheet
+        c->modelMode = GeneralModel::ShortCircuit;
+    }
+    U_t = (modelMode == GeneralModel::OpenCircuit) ? mCells[0]->U_t : 0.0;
+    I_t = 0.0;
+    mNumberOfMolecules = mCells[0]->mC_c.size();
+    for (unsigned int i = 1; i < mCells.size(); ++i)
+    {
+        bool consistent = ((int)mCells[i]->mC_c.size() == mNumberOfMolecules);
+        for (int k = 0; consistent && (k < mNumberOfMolecules); ++k)
+            consistent = (*(mCells[i]->mZ[k]) == *(mCells[0]->mZ[k]));
+        if (!consistent)
+        {
+            std::cerr << "EpithelialSheet::initialise: cell " << i << " does not have the same molecules as cell 0."
+                      << std::endl;
+            return -2;
+        }
+    }
+    // the state vector is wrapped by the integrator of any previous initialisation
+    freeIntegrator();
+
+    // the shared compartments start with the bath concentrations of the first cell
+    int N = mNumberOfMolecules;
+    C_lumen.resize(N);
+    C_interstitium.resize(N);
+    for (int k = 0; k < N; ++k)
+    {
+        C_lumen[k] = *(mCells[0]->mC_a[k]);
+        C_interstitium[k] = *(mCells[0]->mC_b[k]);
+    }
+
+    int NEQ = numberOfStates();
+    y.resize(NEQ);
+    for (unsigned int i = 0; i < mCells.size(); ++i)
+    {
+        int o = i * (N + 1);
+        y[o] = mCells[i]->V;
+        for (int k = 0; k < N; ++k) y[o + k + 1] = *(mCells[i]->mC_c[k]);
+    }
+    int lumenOffset = mCells.size() * (N + 1);
+    for (int k = 0; k < N; ++k)
+    {
+        y[lumenOffset + k] = C_lumen[k];
+        y[lumenOffset + N + k] = C_interstitium[k];
+    }
+    mCellErrors.resize(mCells.size());
+    mCellCurrents.resize(mCells.size());
+
+    if (numberOfThreads <= 0) numberOfThreads = std::thread::hardware_concurrency();
+    if (numberOfThreads <= 0) numberOfThreads = 1;
+    if (numberOfThreads > (int)mCells.size()) numberOfThreads = mCells.size();
+    if (GET_CONTEXT_DEBUG(context, 0))
+        *context.diagnostics << "EpithelialSheet: " << mCells.size() << " cells, " << NEQ << " state variables, using "
+                             << numberOfThreads << " thread(s)" << std::endl;
+    if (mWorkers) delete mWorkers;
+    mWorkers = new SheetWorkers(numberOfThreads);
+    flushCellDiagnostics();
+    mCellDiagnostics.clear();
+    mCellDiagnostics.resize(mCells.size());
+    for (unsigned int i = 0; i < mCells.size(); ++i) mCells[i]->context.diagnostics = &mCellDiagnostics[i];
+
+    if (mPreconditioner) delete mPreconditioner;
+    mPreconditioner = new SheetPreconditioner();
+    mPreconditioner->jacobians.resize(mCells.size());
+    for (unsigned int i = 0; i < mCells.size(); ++i)
+    {
+        mPreconditioner->blocks.push_back(NewDenseMat(N + 1, N + 1));
+        mPreconditioner->pivots.push_back(NewLintArray(N + 1));
+    }
+    mPreconditioner->lumenContributions.resize(mCells.size() * N);
+    mPreconditioner->interstitialContributions.resize(mCells.size() * N);
+    mPreconditioner->lumenDiagonal.resize(N);
+    mPreconditioner->interstitialDiagonal.resize(N);
+
+    /* Set up CVODES, using the same tolerances as for the single cell */
+    mNvY = N_VMake_Serial(NEQ, y.data());
+    if (check_flag((void *)mNvY, "N_VMake_Serial", 0)) return(1);
+    N_Vector abstolVector = N_VNew_Serial(NEQ);
+    if (check_flag((void *)abstolVector, "N_VNew_Serial", 0)) return(1);
+    N_VConst_Serial(ATOL, abstolVector);
+    for (unsigned int i = 0; i < mCells.size(); ++i) NV_Ith_S(abstolVector, i * (N + 1)) = ATOL / 100.0;
+
+    mCvodeMem = CVodeCreate(CV_BDF, CV_NEWTON);
+    if (check_flag((void *)mCvodeMem, "CVodeCreate", 0)) return(1);
+    int flag = CVodeInit(mCvodeMem, f, initialTime, mNvY);
+    if (check_flag(&flag, "CVodeInit", 1)) return(1);
+    flag = CVodeSVtolerances(mCvodeMem, RTOL, abstolVector);
+    N_VDestroy_Serial(abstolVector);
+    if (check_flag(&flag, "CVodeSVtolerances", 1)) return(1);
+    // the Jacobian is dense in the shared compartment rows and columns but block diagonal otherwise, so use a
+    // Krylov solver (with matrix-free Jacobian-vector products) preconditioned by the block diagonal.
+    flag = CVSpgmr(mCvodeMem, PREC_LEFT, 0);
+    if (check_flag(&flag, "CVSpgmr", 1)) return(1);
+    flag = CVSpilsSetPreconditioner(mCvodeMem, psetup, psolve);
+    if (check_flag(&flag, "CVSpilsSetPreconditioner", 1)) return(1);
+    flag = CVodeSetMaxStep(mCvodeMem, maxStep);
+    if (check_flag(&flag, "CVodeSetMaxStep", 1)) return(1);
+    flag = CVodeSetUserData(mCvodeMem, static_cast<void*>(this));
+    if (check_flag(&flag, "CVodeSetUserData", 1)) return(1);
+
+    return 0;
+}
+
+int EpithelialSheet::integrate(double& t, double tout)
+{
+    int flag = CVode(mCvodeMem, tout, mNvY, &t, CV_NORMAL);
+    if (check_flag(&flag, "CVode", 1)) return(1);
+    setState(y.data());
+    return(0);
+}
+
+void EpithelialSheet::setCellState(int cell, const double* y)
+{
+    int N = mNumberOfMolecules;
+    int o = cell * (N + 1);
+    int lumenOffset = mCells.size() * (N + 1);
+    GeneralModel* c = mCells[cell];
+    c->V = y[o];
+    for (int k = 0; k < N; ++k)
+    {
+        *(c->mC_c[k]) = y[o + k + 1];
+        *(c->mC_a[k]) = y[lumenOffset + k];
+        *(c->mC_b[k]) = y[lumenOffset + N + k];
+    }
+}
+
+void EpithelialSheet::setState(const double* y)
+{
+    int N = mNumberOfMolecules;
+    int lumenOffset = mCells.size() * (N + 1);
+    for (unsigned int i = 0; i < mCells.size(); ++i) setCellState(i, y);
+    for (int k = 0; k < N; ++k)
+    {
+        C_lumen[k] = y[lumenOffset + k];
+        C_interstitium[k] = y[lumenOffset + N + k];
+    }
+}
+
+double EpithelialSheet::transepithelialCurrent(double U, int& errorFlag)
+{
+    std::function<void(int, int)> cellCurrents = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            GeneralModel* c = mCells[i];
+            c->U_t = U;
+            mCellErrors[i] = solveOneVariable(c, VoltageClampPotentials, c->minimumPotentialValue,
+                                              c->maximumPotentialValue);
+            if (mCellErrors[i] != 0) continue;
+            c->calculateSoluteParacellularFluxes();
+            c->compute_I_j();
+            // the current through the cell (I_a = I_b once it is electroneutral) and around it
+            mCellCurrents[i] = c->I_a + c->I_j;
+        }
+    };
+    runCells(cellCurrents);
+    double current = 0.0;
+    for (unsigned int i = 0; i < mCells.size(); ++i)
+    {
+        if (mCellErrors[i] != 0)
+        {
+            std::cerr << "EpithelialSheet: failed to voltage clamp cell " << i << " at U_t = " << U << std::endl;
+            errorFlag = mCellErrors[i];
+            return 0.0;
+        }
+        // summed in order, so the result does not depend on the number of threads
+        current += mCellCurrents[i];
+    }
+    return current;
+}
+
+int EpithelialSheet::solveOpenCircuitPotential()
+{
+    /*
+     * Each evaluation of the current voltage clamps every cell, so use secant steps from the previous potential,
+     * which is usually close, falling back to bisection once the root has been bracketed. The last potential
+     * evaluated is the solution, so the cells are left in the state for it.
+     */
+    const GeneralModel* first = mCells[0];
+    double lower = first->minimumPotentialValue, upper = first->maximumPotentialValue;
+    double tolerance = CURRENT_TOLERANCE * mCells.size();
+    int errorFlag = 0;
+    double x0 = U_t, f0 = transepithelialCurrent(x0, errorFlag);
+    if (errorFlag != 0) return errorFlag;
+    if (fabs(f0) <= tolerance)
+    {
+        I_t = f0;
+        return 0;
+    }
+    double x1 = ((x0 + FIRST_POTENTIAL_STEP) <= upper) ? (x0 + FIRST_POTENTIAL_STEP) : (x0 - FIRST_POTENTIAL_STEP);
+    double f1 = transepithelialCurrent(x1, errorFlag);
+    bool bracketed = false;
+    double a = x0, fa = f0, b = x1;
+    for (int iteration = 0; iteration < MAX_POTENTIAL_ITERATIONS; ++iteration)
+    {
+        if (errorFlag != 0) return errorFlag;
+        if ((fabs(f1) <= tolerance) || (fabs(x1 - x0) <= POTENTIAL_TOLERANCE))
+        {
+            U_t = x1;
+            I_t = f1;
+            if (GET_CONTEXT_DEBUG(context, 10))
+                *context.diagnostics << "EpithelialSheet: open circuit U_t = " << U_t << " (current " << I_t
+                                     << ") after " << iteration + 2 << " evaluations" << std::endl;
+            return 0;
+        }
+        // keep the bracket [a, b] around the root up to date
+        if (bracketed)
+        {
+            if ((f1 < 0.0) == (fa < 0.0))
+            {
+                a = x1;
+                fa = f1;
+            }
+            else b = x1;
+        }
+        else if ((f0 < 0.0) != (f1 < 0.0))
+        {
+            bracketed = true;
+            a = x0;
+            fa = f0;
+            b = x1;
+        }
+        // a flat current (no secant) only happens away from the root, so step further out
+        double x2 = (f1 != f0) ? (x1 - f1 * (x1 - x0) / (f1 - f0)) : (x1 + 2.0 * (x1 - x0));
+        if (bracketed)
+        {
+            if ((x2 <= std::min(a, b)) || (x2 >= std::max(a, b))) x2 = 0.5 * (a + b);
+        }
+        else if (x2 < lower) x2 = lower;
+        else if (x2 > upper) x2 = upper;
+        x0 = x1;
+        f0 = f1;
+        x1 = x2;
+        f1 = transepithelialCurrent(x1, errorFlag);
+    }
+    std::cerr << "EpithelialSheet: unable to solve for the open circuit transepithelial potential" << std::endl;
+    return 1;
+}
+
+int EpithelialSheet::calculateRHS(double time, const double* y, double* ydot)
+{
+    int N = mNumberOfMolecules;
+    int lumenOffset = mCells.size() * (N + 1);
+
+    std::function<void(int, int)> cellStates = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i) setCellState(i, y);
+    };
+    runCells(cellStates);
+
+    // the potentials couple all the cells, so are solved for before any of the rates
+    int errorFlag = 0;
+    if (modelMode == GeneralModel::OpenCircuit) errorFlag = solveOpenCircuitPotential();
+    else
+    {
+        U_t = 0.0;
+        I_t = transepithelialCurrent(U_t, errorFlag);
+    }
+    if (errorFlag != 0)
+    {
+        std::cerr << "EpithelialSheet::calculateRHS: failed to solve for the membrane potentials" << std::endl;
+        return errorFlag;
+    }
+
+    // given the potentials, the cells are independent
+    std::function<void(int, int)> cellRates = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            GeneralModel* c = mCells[i];
+            ++c->statistics.rhsEvaluations;
+            std::vector<double> f = c->calculateRates();
+            for (int k = 0; k <= N; ++k) ydot[i * (N + 1) + k] = f[k];
+        }
+    };
+    runCells(cellRates);
+
+    for (int k = 0; k < N; ++k) ydot[lumenOffset + k] = ydot[lumenOffset + N + k] = 0.0;
+    for (unsigned int i = 0; i < mCells.size(); ++i)
+    {
+        const GeneralModel* c = mCells[i];
+        for (int k = 0; k < N; ++k)
+        {
+            // apical and paracellular fluxes leave the lumen, basolateral and paracellular fluxes enter the
+            // interstitium
+            ydot[lumenOffset + k] -= c->A_a * (*(c->mJ_a[k]) + *(c->mJ_j[k]));
+            ydot[lumenOffset + N + k] += c->A_b * (*(c->mJ_b[k])) + c->A_a * (*(c->mJ_j[k]));
+        }
+    }
+    for (int k = 0; k < N; ++k)
+    {
+        ydot[lumenOffset + k] /= lumenVolume;
+        ydot[lumenOffset + N + k] /= interstitialVolume;
+    }
+    return 0;
+}
+
+int EpithelialSheet::setupPreconditioner(const double* y, double gamma, bool jacobianOk)
+{
+    int N = mNumberOfMolecules;
+    int NC = N + 1;
+    SheetPreconditioner* p = mPreconditioner;
+
+    std::function<void(int, int)> cellBlocks = [&](int begin, int end)
+    {
+        std::vector<double> dJdC1(N), dJdC2(N), dJdU(N);
+        for (int i = begin; i < end; ++i)
+        {
+            mCellErrors[i] = 0;
+            GeneralModel* c = mCells[i];
+            if (!jacobianOk)
+            {
+                // the cell potentials are those from the RHS evaluation at this state, see Cvodes, and the cells
+                // are voltage clamped so the Jacobian is at a fixed transepithelial potential
+                setCellState(i, y);
+                int errorFlag = 0;
+                p->jacobians[i] = c->calculateJacobian(0.0, errorFlag);
+                if (errorFlag != 0)
+                {
+                    mCellErrors[i] = errorFlag;
+                    continue;
+                }
+                // contributions to the shared compartment diagonals, ignoring the dependence of the membrane
+                // potentials on the bath concentrations
+                c->calculatePassiveFluxDerivatives(dJdC1, dJdC2, dJdU, c->mP_a, c->mZ, c->mC_a, c->mC_c, c->U_a);
+                for (int k = 0; k < N; ++k) p->lumenContributions[i * N + k] = -c->A_a * dJdC1[k];
+                c->calculatePassiveFluxDerivatives(dJdC1, dJdC2, dJdU, c->mP_b, c->mZ, c->mC_c, c->mC_b, c->U_b);
+                for (int k = 0; k < N; ++k) p->interstitialContributions[i * N + k] = c->A_b * dJdC2[k];
+                c->calculatePassiveFluxDerivatives(dJdC1, dJdC2, dJdU, c->mP_j, c->mZ, c->mC_a, c->mC_b, c->U_t);
+                for (int k = 0; k < N; ++k)
+                {
+                    p->lumenContributions[i * N + k] -= c->A_a * dJdC1[k];
+                    p->interstitialContributions[i * N + k] += c->A_a * dJdC2[k];
+                }
+            }
+            DlsMat b = p->blocks[i];
+            const std::vector<double>& jac = p->jacobians[i];
+            for (int col = 0; col < NC; ++col)
+                for (int row = 0; row < NC; ++row)
+                    DENSE_ELEM(b, row, col) = ((row == col) ? 1.0 : 0.0) - gamma * jac[col * NC + row];
+            if (DenseGETRF(b, p->pivots[i]) != 0) mCellErrors[i] = 1;
+        }
+    };
+    runCells(cellBlocks);
+    for (unsigned int i = 0; i < mCells.size(); ++i)
+    {
+        if (mCellErrors[i] != 0) return 1; // recoverable, CVODES will try again with a smaller step
+    }
+
+    for (int k = 0; k < N; ++k)
+    {
+        double lumen = 0.0, interstitium = 0.0;
+        for (unsigned int i = 0; i < mCells.size(); ++i)
+        {
+            lumen += p->lumenContributions[i * N + k];
+            interstitium += p->interstitialContributions[i * N + k];
+        }
+        p->lumenDiagonal[k] = 1.0 - gamma * lumen / lumenVolume;
+        p->interstitialDiagonal[k] = 1.0 - gamma * interstitium / interstitialVolume;
+    }
+    return 0;
+}
+
+int EpithelialSheet::solvePreconditioner(const double* r, double* z)
+{
+    int N = mNumberOfMolecules;
+    int NC = N + 1;
+    int lumenOffset = mCells.size() * NC;
+    SheetPreconditioner* p = mPreconditioner;
+    std::function<void(int, int)> cellSolves = [&](int begin, int end)
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            for (int k = 0; k < NC; ++k) z[i * NC + k] = r[i * NC + k];
+            DenseGETRS(p->blocks[i], p->pivots[i], z + i * NC);
+        }
+    };
+    runCells(cellSolves);
+    for (int k = 0; k < N; ++k)
+    {
+        z[lumenOffset + k] = r[lumenOffset + k] / p->lumenDiagonal[k];
+        z[lumenOffset + N + k] = r[lumenOffset + N + k] / p->interstitialDiagonal[k];
+    }
+    return 0;
+}
+
+/*
+ *-------------------------------
+ * Functions called by the solver
+ *-------------------------------
+ */
+
+static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data)
+{
+    EpithelialSheet* sheet = static_cast<EpithelialSheet*>(user_data);
+    if (sheet->calculateRHS((double)t, NV_DATA_S(y), NV_DATA_S(ydot)) != 0)
+    {
+        std::cerr << "EpithelialSheet-RHS-fcn failed!" << std::endl;
+        return -1; // negative value to indicate non-recoverable failure
+    }
+    return(0);
+}
+
+static int psetup(realtype t, N_Vector y, N_Vector fy, booleantype jok, booleantype *jcurPtr, realtype gamma,
+                  void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3)
+{
+    EpithelialSheet* sheet = static_cast<EpithelialSheet*>(user_data);
+    *jcurPtr = !jok;
+    return sheet->setupPreconditioner(NV_DATA_S(y), gamma, jok);
+}
+
+static int psolve(realtype t, N_Vector y, N_Vector fy, N_Vector r, N_Vector z, realtype gamma, realtype delta,
+                  int lr, void *user_data, N_Vector tmp)
+{
+    EpithelialSheet* sheet = static_cast<EpithelialSheet*>(user_data);
+    return sheet->solvePreconditioner(NV_DATA_S(r), NV_DATA_S(z));
+}
+
+/*
+ * Check function return value...
+ *   opt == 0 means SUNDIALS function allocates memory so check if
+ *            returned NULL pointer
+ *   opt == 1 means SUNDIALS function returns a flag so check if
+ *            flag >= 0
+ */
+
+static int check_flag(void *flagvalue, const char *funcname, int opt)
+{
+    int *errflag;
+
+    /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+    if (opt == 0 && flagvalue == NULL) {
+        fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n",
+                funcname);
+        return(1); }
+
+    /* Check if flag < 0 */
+    else if (opt == 1) {
+        errflag = (int *) flagvalue;
+        if (*errflag < 0) {
+            fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n",
+                    funcname, *errflag);
+            return(1); }}
+
+    return(0);
+}
@@ -0,0 +1,177 @@
+/*
+ * epithelialsheet.hpp
+ *
+ * A tissue-level model of a sheet of epithelial cells sharing lumen and interstitial compartments.
+ */
+
+#ifndef EPITHELIALSHEET_HPP_
+#define EPITHELIALSHEET_HPP_
+
+#include <vector>
+#include <sstream>
+#include <functional>
+
+#include <nvector/nvector_serial.h>
+
+#include "common.hpp"
+#include "GeneralModel.hpp"
+
+class SheetWorkers;
+class SheetPreconditioner;
+
+/**
+ * @brief A sheet of (possibly heterogeneous) epithelial cells coupled through shared compartments.
+ *
+ * Each cell is a GeneralModel. Rather than having fixed mucosal and serosal baths, all the cells in the sheet
+ * share a single, well-mixed, lumen (mucosal) and interstitial (serosal) compartment whose concentrations evolve
+ * with the sum of the apical, basolateral and paracellular fluxes from every cell. The compartment volumes are
+ * taken to be maintained constant (i.e., water exchanged with the cells is made up from an isotonic reservoir).
+ *
+ * The cells are in parallel between the shared compartments, so they all see the same transepithelial potential.
+ * In open circuit it is solved for so that the current through the whole sheet, the sum of the transcellular and
+ * paracellular currents of every cell, is zero; in short circuit it is clamped at zero. Each cell is voltage
+ * clamped at that potential, solving for its own apical and basolateral potentials so that the current into the
+ * cell balances the current out of it.
+ *
+ * The state of the whole sheet is held in one batched vector,
+ *    [V, C_c[0..N-1]] for each cell, followed by C_lumen[0..N-1] and C_interstitium[0..N-1],
+ * and is integrated with CVODES using a Krylov linear solver preconditioned by the block diagonal of the
+ * Jacobian (the analytic Jacobian of each cell at a fixed transepithelial potential plus the diagonal of the shared
+ * compartment blocks), leaving the coupling of the cells through the common potential to the Krylov iterations.
+ * The per-cell potentials, fluxes and Jacobian blocks are evaluated in parallel.
+ */
+class EpithelialSheet
+{
+public:
+    EpithelialSheet();
+    ~EpithelialSheet();
+
+    /**
+     * @brief Add a new cell to this sheet.
+     * The returned cell is owned by the sheet and should be fully configured (molecules and parameters) before
+     * the sheet is initialised. All cells in a sheet must contain the same set of molecules. The model mode of
+     * the cell is set by the sheet.
+     * @return The new cell.
+     */
+    GeneralModel& addCell();
+
+    /**
+     * @brief The number of cells in this sheet.
+     */
+    int numberOfCells() const;
+
+    /**
+     * @brief Access the cell with the given index.
+     */
+    GeneralModel& cell(int index);
+
+    /**
+     * @brief The number of state variables in the batched state vector.
+     */
+    int numberOfStates() const;
+
+    /**
+     * @brief Initialise the cells and the integrator for this sheet.
+     * The initial shared compartment concentrations are taken from the mucosal and serosal concentrations of
+     * the first cell, and the initial transepithelial potential from its E_t.
+     * @param initialTime The initial value of the variable of integration.
+     * @param maxStep The maximum step size for the integrator.
+     * @param numberOfThreads The number of threads to use in evaluating the cells, zero to use all available cores.
+     * @return zero on success.
+     */
+    int initialise(double initialTime, double maxStep, int numberOfThreads = 0);
+
+    /**
+     * @brief Integrate the sheet from t to tout.
+     * @return zero on success and t updated to final value.
+     */
+    int integrate(double& t, double tout);
+
+    /**
+     * @brief Calculate the RHS of the batched differential equation system.
+     * @param time The current time.
+     * @param y The batched state vector.
+     * @param ydot The batched rates.
+     * @return zero on success.
+     */
+    int calculateRHS(double time, const double* y, double* ydot);
+
+    /**
+     * @brief Update and factorise the block diagonal preconditioner P = I - gamma * J.
+     * @param y The batched state vector at which the cell Jacobians are evaluated.
+     * @param gamma The scalar from the Newton matrix.
+     * @param jacobianOk If true, the previously saved Jacobian blocks are reused.
+     * @return zero on success, positive for a recoverable failure.
+     */
+    int setupPreconditioner(const double* y, double gamma, bool jacobianOk);
+
+    /**
+     * @brief Solve P z = r with the current preconditioner.
+     * @return zero on success.
+     */
+    int solvePreconditioner(const double* r, double* z);
+
+    /**
+     * @brief Copy the given batched state into the cells and shared compartments.
+     */
+    void setState(const double* y);
+
+    // OpenCircuit or ShortCircuit, for the whole sheet
+    GeneralModel::ModelMode modelMode;
+
+    // volumes of the shared compartments
+    double lumenVolume, interstitialVolume;
+
+    // the (non-dimensional) transepithelial potential common to all the cells and the total current through the
+    // sheet, from the most recent RHS evaluation
+    double U_t, I_t;
+
+    // the current concentrations in the shared compartments
+    std::vector<double> C_lumen, C_interstitium;
+
+    // the current batched state
+    std::vector<double> y;
+
+    // the settings and diagnostic output of the sheet, given to the cells as they are added
+    SimulationContext context;
+
+private:
+    void setCellState(int cell, const double* y);
+
+    /**
+     * @brief Free the integrator, if there is one.
+     */
+    void freeIntegrator();
+
+    /**
+     * @brief Run the given evaluation over all the cells with the worker threads, then write the diagnostics the
+     * cells produced to the diagnostics of the sheet, in cell order.
+     */
+    void runCells(const std::function<void(int, int)>& evaluate);
+    void flushCellDiagnostics();
+
+    /**
+     * @brief Voltage clamp every cell at the given transepithelial potential.
+     * @return The total current through the sheet.
+     */
+    double transepithelialCurrent(double U, int& errorFlag);
+
+    /**
+     * @brief Solve for the transepithelial potential at which no current flows through the sheet.
+     * @return zero on success.
+     */
+    int solveOpenCircuitPotential();
+
+    std::vector<GeneralModel*> mCells;
+    int mNumberOfMolecules;
+    SheetWorkers* mWorkers;
+    SheetPreconditioner* mPreconditioner;
+    std::vector<int> mCellErrors;
+    std::vector<double> mCellCurrents;
+    // each cell writes its diagnostics here, so that the worker threads never share a stream
+    std::vector<std::ostringstream> mCellDiagnostics;
+    void* mCvodeMem;
+    N_Vector mNvY;
+};
+
+#endif /* EPITHELIALSHEET_HPP_ */
@@ -0,0 +1,471 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+#include "common.hpp"
+#include "utils.hpp"
+#include "estimation.hpp"
+#include "logging.hpp"
+
+/*
+ * Linear interpolation of the sampled values at time t, returning false if t is outside the sampled range.
+ */
+static bool interpolate(const std::vector<double>& times, const std::vector<double>& values, double t, double& value)
+{
+    if (times.empty() || (t < times.front()) || (t > times.back())) return false;
+    unsigned int j = std::upper_bound(times.begin(), times.end(), t) - times.begin();
+    if (j >= times.size())
+    {
+        value = values.back();
+        return true;
+    }
+    double dt = times[j] - times[j-1];
+    value = (dt > 0.0) ? values[j-1] + (values[j] - values[j-1]) * (t - times[j-1]) / dt : values[j];
+    return true;
+}
+
+static double dot(const std::vector<double>& a, const std::vector<double>& b)
+{
+    return std::inner_product(a.begin(), a.end(), b.begin(), 0.0);
+}
+
+ParameterEstimation::ParameterEstimation() : mNumberOfEvaluations(0)
+{
+}
+
+ParameterEstimation::~ParameterEstimation()
+{
+}
+
+int ParameterEstimation::initialise(const std::string& modelUrl, const MySimulation& simulation,
+                                    const std::vector<EstimationParameter>& parameters,
+                                    const std::vector<EstimationData>& data, int numberOfWorkers)
+{
+    if (parameters.empty() || data.empty())
+    {
+        std::cerr << "ParameterEstimation::initialise: need at least one parameter and one set of reference data"
+                  << std::endl;
+        return -1;
+    }
+    mData = data;
+    mDataScales.clear();
+    for (const EstimationData& d: mData)
+    {
+        double scale = 0.0;
+        for (double v: d.values) scale = std::max(scale, fabs(v));
+        mDataScales.push_back((scale > 0.0) ? scale : 1.0);
+    }
+    // the optimisers work with the parameters scaled by their initial values
+    mScales.clear();
+    mLowerBounds.clear();
+    mUpperBounds.clear();
+    for (const EstimationParameter& p: parameters)
+    {
+        double scale = (p.initialValue != 0.0) ? fabs(p.initialValue) : 1.0;
+        mScales.push_back(scale);
+        mLowerBounds.push_back((p.lowerBound > -DBL_MAX) ? p.lowerBound / scale : -DBL_MAX);
+        mUpperBounds.push_back((p.upperBound < DBL_MAX) ? p.upperBound / scale : DBL_MAX);
+    }
+
+    std::vector<MySetValueChange> inputs;
+    for (const EstimationParameter& p: parameters) inputs.push_back(p.change);
+    std::vector<MyVariable> outputs;
+    for (const EstimationData& d: mData) outputs.push_back(d.variable);
+    return mEnsemble.initialise(modelUrl, simulation, inputs, outputs, numberOfWorkers);
+}
+
+double ParameterEstimation::objective(const std::vector<double>& times,
+                                      const std::vector<std::vector<double> >& outputs) const
+{
+    double objective = 0.0;
+    for (unsigned int k = 0; k < mData.size(); ++k)
+    {
+        const EstimationData& d = mData[k];
+        for (unsigned int j = 0; j < d.times.size(); ++j)
+        {
+            double simulated;
+            if (!interpolate(times, outputs[k], d.times[j], simulated)) continue;
+            double e = (simulated - d.values[j]) / mDataScales[k];
+            objective += d.weight * e * e;
+        }
+    }
+    return std::isfinite(objective) ? objective : HUGE_VAL;
+}
+
+int ParameterEstimation::evaluate(const std::vector<std::vector<double> >& points, std::vector<double>& values)
+{
+    values.assign(points.size(), HUGE_VAL);
+    return mEnsemble.run(points, [this, &values](unsigned int index, bool success, const std::vector<double>& times,
+                                                 const std::vector<std::vector<double> >& outputs)
+    {
+        if (!success) return;
+        ++mNumberOfEvaluations;
+        values[index] = objective(times, outputs);
+    });
+}
+
+int ParameterEstimation::estimate(const EstimationOptions& options, std::vector<EstimationParameter>& parameters,
+                                  double& value)
+{
+    if (parameters.size() != mScales.size())
+    {
+        std::cerr << "ParameterEstimation::estimate: the parameters do not match those the estimation was "
+                  << "initialised with" << std::endl;
+        return -1;
+    }
+    std::vector<double> u;
+    for (unsigned int i = 0; i < parameters.size(); ++i) u.push_back(parameters[i].initialValue / mScales[i]);
+    project(u);
+    int status;
+    if (options.method == EstimationOptions::QuasiNewton) status = quasiNewton(options, u, value);
+    else status = nelderMead(options, u, value);
+    if (status < 0) return status;
+    std::vector<double> x = toParameters(u);
+    for (unsigned int i = 0; i < parameters.size(); ++i) parameters[i].estimate = x[i];
+    return status;
+}
+
+long ParameterEstimation::numberOfEvaluations() const
+{
+    return mNumberOfEvaluations;
+}
+
+std::vector<double> ParameterEstimation::toParameters(const std::vector<double>& u) const
+{
+    std::vector<double> x(u.size());
+    for (unsigned int i = 0; i < u.size(); ++i) x[i] = u[i] * mScales[i];
+    return x;
+}
+
+void ParameterEstimation::project(std::vector<double>& u) const
+{
+    for (unsigned int i = 0; i < u.size(); ++i) u[i] = std::min(std::max(u[i], mLowerBounds[i]), mUpperBounds[i]);
+}
+
+int ParameterEstimation::evaluateScaled(const std::vector<std::vector<double> >& points, std::vector<double>& values)
+{
+    std::vector<std::vector<double> > x;
+    for (const auto& u: points) x.push_back(toParameters(u));
+    return evaluate(x, values);
+}
+
+/*
+ * Nelder-Mead simplex minimisation, with the reflection, expansion and both contraction points evaluated together
+ * in a single parallel batch each iteration.
+ */
+int ParameterEstimation::nelderMead(const EstimationOptions& options, std::vector<double>& x, double& value)
+{
+    unsigned int n = x.size();
+    std::vector<std::vector<double> > simplex(n+1, x);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        double step = 0.1 * ((x[i] != 0.0) ? fabs(x[i]) : 1.0);
+        simplex[i+1][i] += step;
+        project(simplex[i+1]);
+        // step the other way if we are at the upper bound
+        if (simplex[i+1][i] == x[i]) simplex[i+1][i] -= step;
+        project(simplex[i+1]);
+    }
+    std::vector<double> f;
+    if (evaluateScaled(simplex, f) != 0) return -1;
+
+    std::vector<unsigned int> order(n+1);
+    for (int iteration = 0; iteration < options.maximumIterations; ++iteration)
+    {
+        for (unsigned int i = 0; i <= n; ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&f](unsigned int a, unsigned int b) { return f[a] < f[b]; });
+        unsigned int best = order[0], worst = order[n], secondWorst = order[n-1];
+        GET_LOG(LogDebug, "Nelder-Mead iteration " << iteration << ": objective = " << f[best]);
+        if (fabs(f[worst] - f[best]) <= options.tolerance * (fabs(f[best]) + options.tolerance))
+        {
+            x = simplex[best];
+            value = f[best];
+            return 0;
+        }
+        std::vector<double> centroid(n, 0.0);
+        for (unsigned int i = 0; i <= n; ++i)
+        {
+            if (i == worst) continue;
+            for (unsigned int j = 0; j < n; ++j) centroid[j] += simplex[i][j] / n;
+        }
+        // reflection, expansion, outside contraction and inside contraction
+        const double coefficients[4] = { 1.0, 2.0, 0.5, -0.5 };
+        std::vector<std::vector<double> > candidates(4, centroid);
+        for (unsigned int c = 0; c < 4; ++c)
+        {
+            for (unsigned int j = 0; j < n; ++j) candidates[c][j] += coefficients[c] * (centroid[j] - simplex[worst][j]);
+            project(candidates[c]);
+        }
+        std::vector<double> fc;
+        if (evaluateScaled(candidates, fc) != 0) return -1;
+        int accept = -1;
+        if (fc[0] < f[best]) accept = (fc[1] < fc[0]) ? 1 : 0;
+        else if (fc[0] < f[secondWorst]) accept = 0;
+        else if (fc[0] < f[worst]) accept = (fc[2] <= fc[0]) ? 2 : -1;
+        else accept = (fc[3] < f[worst]) ? 3 : -1;
+        if (accept >= 0)
+        {
+            simplex[worst] = candidates[accept];
+            f[worst] = fc[accept];
+        }
+        else
+        {
+            // shrink towards the best point
+            std::vector<std::vector<double> > shrunk;
+            std::vector<unsigned int> indices;
+            for (unsigned int i = 0; i <= n; ++i)
+            {
+                if (i == best) continue;
+                for (unsigned int j = 0; j < n; ++j)
+                    simplex[i][j] = simplex[best][j] + 0.5 * (simplex[i][j] - simplex[best][j]);
+                shrunk.push_back(simplex[i]);
+                indices.push_back(i);
+            }
+            std::vector<double> fs;
+            if (evaluateScaled(shrunk, fs) != 0) return -1;
+            for (unsigned int i = 0; i < indices.size(); ++i) f[indices[i]] = fs[i];
+        }
+    }
+    unsigned int best = std::min_element(f.begin(), f.end()) - f.begin();
+    x = simplex[best];
+    value = f[best];
+    return 1;
+}
+
+/*
+ * Forward difference gradient of the objective in the scaled variables, with all the perturbed points evaluated in
+ * a single parallel batch.
+ */
+int ParameterEstimation::gradient(const std::vector<double>& u, double value, std::vector<double>& g)
+{
+    unsigned int n = u.size();
+    std::vector<std::vector<double> > points(n, u);
+    std::vector<double> h(n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        h[i] = 1.0e-4 * std::max(fabs(u[i]), 1.0);
+        // difference backwards if we are at the upper bound
+        if (u[i] + h[i] > mUpperBounds[i]) h[i] = -h[i];
+        points[i][i] += h[i];
+    }
+    std::vector<double> f;
+    if (evaluateScaled(points, f) != 0) return -1;
+    g.resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        if (f[i] == HUGE_VAL) return 1;
+        g[i] = (f[i] - value) / h[i];
+    }
+    return 0;
+}
+
+/*
+ * BFGS minimisation with the search direction projected onto the bounds. A range of step lengths is evaluated in
+ * a single parallel batch and the longest step satisfying the Armijo condition is taken.
+ */
+int ParameterEstimation::quasiNewton(const EstimationOptions& options, std::vector<double>& x, double& value)
+{
+    unsigned int n = x.size();
+    std::vector<double> f;
+    if (evaluateScaled(std::vector<std::vector<double> >(1, x), f) != 0) return -1;
+    value = f[0];
+    if (value == HUGE_VAL)
+    {
+        std::cerr << "ParameterEstimation: unable to evaluate the objective at the initial values" << std::endl;
+        return -2;
+    }
+    std::vector<double> g, gNew, d(n), s(n), y(n), Hy(n);
+    if (gradient(x, value, g) != 0) return -2;
+    // the approximate inverse Hessian, row-major
+    std::vector<double> H(n*n, 0.0);
+    for (unsigned int i = 0; i < n; ++i) H[i*n + i] = 1.0;
+    bool steepestDescent = true;
+    unsigned int numberOfSteps = std::max((unsigned int)mEnsemble.numberOfWorkers(), 8u);
+
+    for (int iteration = 0; iteration < options.maximumIterations; ++iteration)
+    {
+        GET_LOG(LogDebug, "Quasi-Newton iteration " << iteration << ": objective = " << value);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            d[i] = 0.0;
+            for (unsigned int j = 0; j < n; ++j) d[i] -= H[i*n + j] * g[j];
+            // no movement out through an active bound
+            if (((x[i] <= mLowerBounds[i]) && (d[i] < 0.0)) || ((x[i] >= mUpperBounds[i]) && (d[i] > 0.0)))
+                d[i] = 0.0;
+        }
+        // the scaled variables are relative to the initial values, so limit the change in any one step
+        double largest = 0.0;
+        for (unsigned int i = 0; i < n; ++i) largest = std::max(largest, fabs(d[i]));
+        if (largest > 1.0) for (unsigned int i = 0; i < n; ++i) d[i] /= largest;
+        if (dot(d, g) >= 0.0)
+        {
+            if (steepestDescent) return 0; // no descent direction within the bounds
+            for (unsigned int i = 0; i < n*n; ++i) H[i] = (i % (n+1) == 0) ? 1.0 : 0.0;
+            steepestDescent = true;
+            --iteration;
+            continue;
+        }
+        std::vector<std::vector<double> > points(numberOfSteps, x);
+        double alpha = 1.0;
+        for (unsigned int k = 0; k < numberOfSteps; ++k, alpha *= 0.5)
+        {
+            for (unsigned int i = 0; i < n; ++i) points[k][i] += alpha * d[i];
+            project(points[k]);
+        }
+        if (evaluateScaled(points, f) != 0) return -1;
+        int accept = -1;
+        for (unsigned int k = 0; (k < numberOfSteps) && (accept < 0); ++k)
+        {
+            for (unsigned int i = 0; i < n; ++i) s[i] = points[k][i] - x[i];
+            if (f[k] <= value + 1.0e-4 * dot(g, s)) accept = k;
+        }
+        if (accept < 0)
+        {
+            // the quasi-Newton direction failed, fall back to steepest descent before giving up
+            if (steepestDescent) return 0;
+            for (unsigned int i = 0; i < n*n; ++i) H[i] = (i % (n+1) == 0) ? 1.0 : 0.0;
+            steepestDescent = true;
+            continue;
+        }
+        for (unsigned int i = 0; i < n; ++i) s[i] = points[accept][i] - x[i];
+        double previousValue = value;
+        x = points[accept];
+        value = f[accept];
+        if (fabs(previousValue - value) <= options.tolerance * (fabs(previousValue) + options.tolerance)) return 0;
+        if (gradient(x, value, gNew) != 0) return -2;
+        for (unsigned int i = 0; i < n; ++i) y[i] = gNew[i] - g[i];
+        g = gNew;
+        // BFGS update of the inverse Hessian, skipped if the curvature condition is not satisfied
+        double sy = dot(s, y);
+        if (sy > 1.0e-12 * sqrt(dot(s, s) * dot(y, y)))
+        {
+            // scale the initial approximation before the first update
+            if (steepestDescent) for (unsigned int i = 0; i < n*n; ++i) H[i] *= sy / dot(y, y);
+            for (unsigned int i = 0; i < n; ++i)
+            {
+                Hy[i] = 0.0;
+                for (unsigned int j = 0; j < n; ++j) Hy[i] += H[i*n + j] * y[j];
+            }
+            double yHy = dot(y, Hy);
+            for (unsigned int i = 0; i < n; ++i)
+                for (unsigned int j = 0; j < n; ++j)
+                    H[i*n + j] += ((sy + yHy) * s[i] * s[j]) / (sy * sy) - (Hy[i] * s[j] + s[i] * Hy[j]) / sy;
+            steepestDescent = false;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Read the time and given column from each numeric row of the reference data.
+ */
+static int readReferenceData(const std::string& url, int column, EstimationData& data)
+{
+    std::string content = getUrlContent(url);
+    if (content.empty())
+    {
+        std::cerr << "Unable to load the reference data: " << url << std::endl;
+        return 1;
+    }
+    std::replace(content.begin(), content.end(), ',', ' ');
+    std::istringstream lines(content);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        std::istringstream row(line);
+        std::vector<double> values;
+        double v;
+        while (row >> v) values.push_back(v);
+        if ((int)values.size() <= column) continue;
+        data.times.push_back(values[0]);
+        data.values.push_back(values[column]);
+    }
+    if (data.times.empty())
+    {
+        std::cerr << "No reference data found in column " << column << " of: " << url << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+int readEstimationSpecification(const std::string& url, std::string& taskId,
+                                std::vector<EstimationParameter>& parameters, std::vector<EstimationData>& data,
+                                EstimationOptions& options)
+{
+    std::string content = getUrlContent(url);
+    if (content.empty())
+    {
+        std::cerr << "Unable to load the estimation specification: " << url << std::endl;
+        return 1;
+    }
+    int numberOfErrors = 0;
+    std::istringstream lines(content);
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream entry(line);
+        std::string keyword;
+        if (!(entry >> keyword)) continue;
+        bool valid = true;
+        if (keyword == "task") valid = static_cast<bool>(entry >> taskId);
+        else if (keyword == "parameter")
+        {
+            EstimationParameter p;
+            valid = static_cast<bool>(entry >> p.change.targetXpath >> p.initialValue);
+            double lower, upper;
+            if (valid && (entry >> lower >> upper))
+            {
+                p.lowerBound = lower;
+                p.upperBound = upper;
+                valid = (lower <= p.initialValue) && (p.initialValue <= upper);
+            }
+            if (valid) parameters.push_back(p);
+        }
+        else if (keyword == "data")
+        {
+            EstimationData d;
+            std::string dataUrl;
+            int column = 1;
+            valid = static_cast<bool>(entry >> d.variable.target >> dataUrl);
+            if (valid && (entry >> column)) entry >> d.weight;
+            if (valid && (column < 1)) valid = false;
+            if (valid)
+            {
+                if (readReferenceData(buildAbsoluteUri(dataUrl, url), column, d) == 0) data.push_back(d);
+                else ++numberOfErrors;
+            }
+        }
+        else if (keyword == "method")
+        {
+            std::string method;
+            valid = static_cast<bool>(entry >> method);
+            if (method == "nelder-mead") options.method = EstimationOptions::NelderMead;
+            else if (method == "quasi-newton") options.method = EstimationOptions::QuasiNewton;
+            else valid = false;
+        }
+        else if (keyword == "workers") valid = static_cast<bool>(entry >> options.numberOfWorkers);
+        else if (keyword == "iterations") valid = static_cast<bool>(entry >> options.maximumIterations);
+        else if (keyword == "tolerance") valid = static_cast<bool>(entry >> options.tolerance);
+        else valid = false;
+        if (!valid)
+        {
+            std::cerr << "Invalid entry on line " << lineNumber << " of the estimation specification: " << line
+                      << std::endl;
+            ++numberOfErrors;
+        }
+    }
+    if (taskId.empty())
+    {
+        std::cerr << "The estimation specification must give the task to estimate the parameters of" << std::endl;
+        ++numberOfErrors;
+    }
+    return numberOfErrors;
+}
@@ -0,0 +1,164 @@
+#ifndef ESTIMATION_HPP
+#define ESTIMATION_HPP
+
+#include <string>
+#include <vector>
+#include <cfloat>
+#include <atomic>
+
+#include "dataset.hpp"
+#include "setvaluechange.hpp"
+#include "utilityclasses.hpp"
+#include "ensemble.hpp"
+
+/**
+ * A model input to be estimated. The input is mapped to the model in the same way as the set value changes of a
+ * repeated task.
+ */
+class EstimationParameter
+{
+public:
+    EstimationParameter() : initialValue(0.0), lowerBound(-DBL_MAX), upperBound(DBL_MAX), estimate(0.0)
+    {
+    }
+
+    MySetValueChange change;
+    double initialValue;
+    double lowerBound, upperBound;
+    // the estimated value, once the estimation has been performed
+    double estimate;
+};
+
+/**
+ * Reference data for a model output. The output is mapped to the model in the same way as the variables of a
+ * data generator.
+ */
+class EstimationData
+{
+public:
+    EstimationData() : weight(1.0)
+    {
+    }
+
+    MyVariable variable;
+    std::vector<double> times, values;
+    // the weight given to this output's contribution to the objective
+    double weight;
+};
+
+class EstimationOptions
+{
+public:
+    enum Method
+    {
+        NelderMead = 1,
+        QuasiNewton = 2
+    };
+
+    EstimationOptions() : method(NelderMead), numberOfWorkers(0), maximumIterations(200), tolerance(1.0e-6)
+    {
+    }
+
+    Method method;
+    // the number of simulation engines to evaluate the objective with in parallel, zero to use all available cores
+    int numberOfWorkers;
+    int maximumIterations;
+    // relative tolerance on the change in objective value used to decide convergence
+    double tolerance;
+};
+
+/**
+ * @brief In-process estimation of the inputs of a CSim simulation task.
+ *
+ * The objective is the weighted sum of squared errors between the model outputs and the reference data, with each
+ * output's errors scaled by its largest reference magnitude. The simulated outputs are sampled on the uniform time
+ * course of the simulation and linearly interpolated to the reference times. The objective is evaluated with a
+ * TaskEnsemble, so the model is compiled once for each worker and batches of evaluations are run in parallel.
+ */
+class ParameterEstimation
+{
+public:
+    ParameterEstimation();
+    ~ParameterEstimation();
+
+    /**
+     * @brief Load and compile the model for each worker.
+     * @param modelUrl The URL of the CellML model.
+     * @param simulation The simulation to run for each objective evaluation, must be a CSim simulation.
+     * @param parameters The inputs to estimate, their namespaces must be set to resolve their target XPaths.
+     * @param data The reference data, the variable namespaces must be set to resolve their target XPaths.
+     * @param numberOfWorkers The number of workers, zero to use all available cores.
+     * @return zero on success.
+     */
+    int initialise(const std::string& modelUrl, const MySimulation& simulation,
+                   const std::vector<EstimationParameter>& parameters, const std::vector<EstimationData>& data,
+                   int numberOfWorkers);
+
+    /**
+     * @brief Evaluate the objective at each of the given points in parallel.
+     * @param points The values of the parameters, in the order they were given to initialise.
+     * @param values On return, the objective value at each point, HUGE_VAL if the simulation failed.
+     * @return zero on success.
+     */
+    int evaluate(const std::vector<std::vector<double> >& points, std::vector<double>& values);
+
+    /**
+     * @brief Estimate the parameters, starting from their initial values.
+     * @param options The estimation options.
+     * @param parameters The parameters, updated with their estimates on success.
+     * @param value On success, the objective value at the estimate.
+     * @return zero on success, a positive value if the maximum number of iterations was reached without
+     * convergence (the estimates are still set to the best point found).
+     */
+    int estimate(const EstimationOptions& options, std::vector<EstimationParameter>& parameters, double& value);
+
+    /**
+     * @brief The number of objective evaluations performed so far.
+     */
+    long numberOfEvaluations() const;
+
+private:
+    double objective(const std::vector<double>& times, const std::vector<std::vector<double> >& outputs) const;
+    int nelderMead(const EstimationOptions& options, std::vector<double>& x, double& value);
+    int quasiNewton(const EstimationOptions& options, std::vector<double>& x, double& value);
+    int gradient(const std::vector<double>& u, double value, std::vector<double>& g);
+    // map between the scaled variables used by the optimisers and the parameter values
+    std::vector<double> toParameters(const std::vector<double>& u) const;
+    void project(std::vector<double>& u) const;
+    int evaluateScaled(const std::vector<std::vector<double> >& points, std::vector<double>& values);
+
+    TaskEnsemble mEnsemble;
+    std::vector<EstimationData> mData;
+    std::vector<double> mDataScales;
+    // the bounds of the scaled variables and the scale of each parameter
+    std::vector<double> mLowerBounds, mUpperBounds, mScales;
+    std::atomic<long> mNumberOfEvaluations;
+};
+
+/**
+ * @brief Read a parameter estimation specification. The specification is a text file with one entry per line,
+ * with '#' starting a comment:
+ *
+ *    task <task id>
+ *    parameter <target XPath> <initial value> [<lower bound> <upper bound>]
+ *    data <target XPath> <reference data URL> [<column> [<weight>]]
+ *    method nelder-mead|quasi-newton
+ *    workers <number of workers>
+ *    iterations <maximum number of iterations>
+ *    tolerance <relative tolerance>
+ *
+ * Reference data files contain whitespace or comma separated columns with the time in the first column and the
+ * values in the given column (default 1, counting from zero); lines that do not start with a number are ignored.
+ * Relative data URLs are resolved against the specification URL.
+ * @param url The URL of the specification.
+ * @param taskId On success, the ID of the task to estimate the parameters of.
+ * @param parameters On success, the parameters to estimate.
+ * @param data On success, the reference data.
+ * @param options On success, the estimation options.
+ * @return zero on success, otherwise the number of errors.
+ */
+int readEstimationSpecification(const std::string& url, std::string& taskId,
+                                std::vector<EstimationParameter>& parameters, std::vector<EstimationData>& data,
+                                EstimationOptions& options);
+
+#endif // ESTIMATION_HPP
@@ -12,46 +12,299 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <cstdlib>
+#include <csignal>
 
 #include "get_simulator_config.h"
 
 #include "common.hpp"
 #include "utils.hpp"
+#include "documentcache.hpp"
+#include "mappedfile.hpp"
+#include "omexarchive.hpp"
 #include "sedml.hpp"
+#include "estimation.hpp"
+#include "sampling.hpp"
+#include "globalsensitivity.hpp"
+#include "compressedoutput.hpp"
+#include "decimation.hpp"
+#include "resultpublisher.hpp"
+#include "enginecache.hpp"
+#include "simulationserver.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
 
 static void printVersion()
 {
-    std::cout << "GET Simulator (sed-ml client) version " << GET_SIMULATOR_VERSION_STRING
-              << " (" << GET_SIMULATOR_VERSION << ")\n"
-              << "http://get.readthedocs.io"
-              << std::endl;
+    GET_LOG(LogInfo, "GET Simulator (sed-ml client) version " << GET_SIMULATOR_VERSION_STRING
+            << " (" << GET_SIMULATOR_VERSION << ")\n"
+            << "http://get.readthedocs.io");
 }
 
 static void usage(const char* progName)
 {
-    std::cerr << "Usage: " << progName << " <SED-ML document URL> [report results file]" << std::endl;
-    std::cerr << "\tWill output results to stdout if no report results file given" << std::endl;
+    std::cerr << "Usage: " << progName << " --serve <socket path> [--workers <number>] [--engine-cache <number>]"
+              << " [--cache] [--cache-dir <directory>] [--no-cache] [--offline] [--cache-max-age <seconds>]"
+              << " [--trace] [--quiet] [--log-level <level>]" << std::endl;
+    std::cerr << "   or: " << progName << " <SED-ML document or COMBINE archive URL> [report results file]"
+              << " [--estimate <estimation specification URL>] [--sample <sampling specification URL>]"
+              << " [--sobol <sampling specification URL>] [--aggregate <data set ID>|*]..."
+              << " [--cache] [--cache-dir <directory>] [--no-cache] [--offline] [--cache-max-age <seconds>]"
+              << " [--compress gz|xz|bz2] [--decimate <report ID>|* lttb:<points>|pla:<tolerance>[:<absolute>]]..."
+              << " [--publish <socket path>] [--stats <statistics file>] [--trace <trace file>] [--quiet]"
+              << " [--log-level <level>]" << std::endl;
+    std::cerr << "\tWill output results to stdout if no report results file given, the results file is compressed"
+              << " if its name ends in .gz, .xz or .bz2" << std::endl;
+    std::cerr << "\t--estimate: estimate the parameters of a task rather than executing the document, with the"
+              << " estimates written to the results file (or stdout)" << std::endl;
+    std::cerr << "\t--sample: sample the inputs of a task rather than executing the document, with the statistics of"
+              << " its outputs written to the results file (or stdout)" << std::endl;
+    std::cerr << "\t--sobol: compute the Sobol sensitivity indices of the outputs of a task with respect to the inputs"
+              << " of a sampling specification, written to the results file (or stdout)" << std::endl;
+    std::cerr << "\t--aggregate: report the statistics of the given data set (or all data sets) at each sample point"
+              << " over the repeats of its task rather than every trajectory" << std::endl;
+    std::cerr << "\t--cache: keep fetched documents in " << defaultDocumentCacheDirectory() << ", or with --cache-dir"
+              << " in the given directory; without these documents are always fetched unless GET_SIMULATOR_CACHE_DIR"
+              << " is set, and --no-cache ignores it" << std::endl;
+    std::cerr << "\t--offline: only use documents already in the cache" << std::endl;
+    std::cerr << "\t--cache-max-age: use cached documents younger than this without checking they are up to date"
+              << std::endl;
+    std::cerr << "\t--compress: compress the results file, adding the extension of the compression to its name"
+              << std::endl;
+    std::cerr << "\t--decimate: keep a fixed number of the samples of the given report (or all reports) chosen by the"
+              << " largest-triangle-three-buckets method (lttb), or only the samples needed for linear interpolation"
+              << " to be within the given relative and absolute tolerances (pla)" << std::endl;
+    std::cerr << "\t--publish: publish the report rows as they are produced to clients of the given UNIX domain socket"
+              << std::endl;
+    std::cerr << "\t--stats: write the solver statistics of each task as JSON to the given file, by default next to the"
+              << " results file with the extension .stats.json" << std::endl;
+    std::cerr << "\t--serve: run SED-ML jobs submitted over HTTP to the given UNIX domain socket, e.g., with curl"
+              << " --unix-socket <socket path> --data-binary @sim.xml http://localhost/run?base=<document URL>,"
+              << " until interrupted" << std::endl;
+    std::cerr << "\t--workers: the number of jobs to run at once (default the number of processors)" << std::endl;
+    std::cerr << "\t--engine-cache: the number of compiled models to keep for later jobs (default 16)" << std::endl;
+    std::cerr << "\t--trace: record where the time goes and write it to the given file as Chrome trace JSON, which can"
+              << " be opened in https://ui.perfetto.dev; with --serve the trace is fetched with GET /trace" << std::endl;
+    std::cerr << "\t--quiet: only write warnings and errors, the same as --log-level warning" << std::endl;
+    std::cerr << "\t--log-level: the most verbose messages to write, one of error, warning, info (default), debug or"
+              << " trace" << std::endl;
 }
 
-int main(int argc, char* argv[])
+// the default solver statistics file, the results file without its compression extension and with .stats.json
+static std::string statisticsFileFor(const std::string& resultsFile, CompressedOutput::Compression compression)
+{
+    std::string path = resultsFile;
+    std::string extension = CompressedOutput::extension(compression);
+    if ((path.size() > extension.size()) && (path.compare(path.size() - extension.size(), extension.size(),
+                                                          extension) == 0))
+        path.erase(path.size() - extension.size());
+    return path + ".stats.json";
+}
+
+// handle the logging options common to both modes, returning true if the argument was one of them
+static bool loggingOption(int argc, char* argv[], int& i, int& status)
+{
+    std::string arg(argv[i]);
+    if (arg == "--quiet") setLogLevel(LogWarning);
+    else if ((arg == "--log-level") && ((i+1) < argc))
+    {
+        LogLevel level;
+        status = parseLogLevel(argv[++i], level);
+        if (status == 0) setLogLevel(level);
+    }
+    else return false;
+    return true;
+}
+
+// records a trace for the life of the run and writes it when the run finishes, however it finishes
+class TraceFile
+{
+public:
+    TraceFile(const std::string& path) : mPath(path)
+    {
+        if (!mPath.empty()) startTracing();
+    }
+
+    ~TraceFile()
+    {
+        if (mPath.empty()) return;
+        stopTracing();
+        std::ofstream os(mPath.c_str());
+        if (!os.is_open() || (writeChromeTrace(os) != 0))
+            std::cerr << "Unable to write the trace file: " << mPath << std::endl;
+    }
+
+private:
+    std::string mPath;
+};
+
+// the server to stop when interrupted
+static SimulationServer* runningServer = NULL;
+
+static void stopServer(int)
 {
+    if (runningServer) runningServer->stop();
+}
+
+static int serve(int argc, char* argv[])
+{
+    std::string socketPath = argv[2];
+    unsigned int numberOfWorkers = 0, engineCacheCapacity = 16;
+    std::string cacheDirectory = documentCacheDirectory();
+    bool offline = documentCacheOffline();
+    long cacheMaximumAge = 0;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        int status = 0;
+        if (loggingOption(argc, argv, i, status))
+        {
+            if (status != 0) return -1;
+        }
+        else if ((arg == "--workers") && ((i+1) < argc)) numberOfWorkers = atoi(argv[++i]);
+        else if (arg == "--trace") startTracing();
+        else if ((arg == "--engine-cache") && ((i+1) < argc)) engineCacheCapacity = atoi(argv[++i]);
+        else if (arg == "--cache") cacheDirectory = defaultDocumentCacheDirectory();
+        else if ((arg == "--cache-dir") && ((i+1) < argc)) cacheDirectory = argv[++i];
+        else if (arg == "--no-cache") cacheDirectory = "";
+        else if (arg == "--offline") offline = true;
+        else if ((arg == "--cache-max-age") && ((i+1) < argc)) cacheMaximumAge = atol(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
     printVersion();
+    configureDocumentCache(cacheDirectory, offline, cacheMaximumAge);
+    configureSimulationEngineCache(engineCacheCapacity);
+    SimulationServer server;
+    if (server.open(socketPath, numberOfWorkers) != 0) return -2;
+    runningServer = &server;
+    signal(SIGINT, stopServer);
+    signal(SIGTERM, stopServer);
+    int status = server.run();
+    runningServer = NULL;
+    configureSimulationEngineCache(0);
+    return status;
+}
+
+int main(int argc, char* argv[])
+{
+    // before any threads (e.g., the server's workers) might use curl
+    initialiseUrlFetching();
     if (argc < 2)
     {
         usage(argv[0]);
         return -1;
     }
-    std::string url = buildAbsoluteUri(argv[1], "");
-    std::string sedDocumentString = getUrlContent(url);
-    if (sedDocumentString.empty())
+    if (std::string(argv[1]) == "--serve")
     {
-        std::cerr << "Unable to load document: " << url.c_str() << std::endl;
-        usage(argv[0]);
-        return -3;
+        if (argc < 3)
+        {
+            usage(argv[0]);
+            return -1;
+        }
+        return serve(argc, argv);
     }
-    //std::cout << "SED-ML document string: [[[" << sedDocumentString.c_str() << "]]]" << std::endl;
+    std::string resultsFile, estimationUrl, samplingUrl, sobolUrl;
+    std::vector<std::string> aggregateDataSets;
+    std::vector<std::pair<std::string, DecimationOptions> > decimatedReports;
+    std::string publishSocket, traceFile, statisticsFile;
+    std::string cacheDirectory = documentCacheDirectory();
+    bool offline = documentCacheOffline();
+    CompressedOutput::Compression compression = CompressedOutput::None;
+    long cacheMaximumAge = 0;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        int status = 0;
+        if (loggingOption(argc, argv, i, status))
+        {
+            if (status != 0) return -1;
+        }
+        else if ((arg == "--estimate") && ((i+1) < argc)) estimationUrl = buildAbsoluteUri(argv[++i], "");
+        else if ((arg == "--sample") && ((i+1) < argc)) samplingUrl = buildAbsoluteUri(argv[++i], "");
+        else if ((arg == "--sobol") && ((i+1) < argc)) sobolUrl = buildAbsoluteUri(argv[++i], "");
+        else if ((arg == "--aggregate") && ((i+1) < argc)) aggregateDataSets.push_back(argv[++i]);
+        else if ((arg == "--publish") && ((i+1) < argc)) publishSocket = argv[++i];
+        else if ((arg == "--trace") && ((i+1) < argc)) traceFile = argv[++i];
+        else if ((arg == "--stats") && ((i+1) < argc)) statisticsFile = argv[++i];
+        else if ((arg == "--decimate") && ((i+2) < argc))
+        {
+            DecimationOptions decimation;
+            if (decimation.parse(argv[i+2]) != 0) return -1;
+            decimatedReports.push_back(std::make_pair(std::string(argv[i+1]), decimation));
+            i += 2;
+        }
+        else if (arg == "--cache") cacheDirectory = defaultDocumentCacheDirectory();
+        else if ((arg == "--cache-dir") && ((i+1) < argc)) cacheDirectory = argv[++i];
+        else if (arg == "--no-cache") cacheDirectory = "";
+        else if (arg == "--offline") offline = true;
+        else if ((arg == "--cache-max-age") && ((i+1) < argc)) cacheMaximumAge = atol(argv[++i]);
+        else if ((arg == "--compress") && ((i+1) < argc))
+        {
+            if (CompressedOutput::parseCompression(argv[++i], compression) != 0) return -1;
+        }
+        else if (resultsFile.empty() && (arg.compare(0, 2, "--") != 0)) resultsFile = arg;
+        else
+        {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    TraceFile trace(traceFile);
+    printVersion();
+    configureDocumentCache(cacheDirectory, offline, cacheMaximumAge);
+    std::string url = buildAbsoluteUri(argv[1], "");
     Sedml sed;
-    if (sed.parseFromString(sedDocumentString) != 0)
+    int parseStatus;
+    // must outlive the execution of the document, so that the models in the archive can be loaded
+    OmexArchive archive;
+    if (isFileUrl(url) && isZipFile(fileUrlPath(url)))
+    {
+        // a COMBINE archive, the document and its models are read straight from the archive
+        std::string location, sedDocumentString;
+        if (archive.open(fileUrlPath(url)) != 0)
+        {
+            std::cerr << "Unable to open the archive: " << url.c_str() << std::endl;
+            return -3;
+        }
+        location = archive.masterSedmlLocation();
+        if (location.empty() || (archive.read(location, sedDocumentString) != 0))
+        {
+            std::cerr << "Unable to find a SED-ML document in the archive: " << url.c_str() << std::endl;
+            return -3;
+        }
+        url = archive.url(location);
+        GET_LOG(LogInfo, "Using the SED-ML document " << location << " from the archive: " << url);
+        parseStatus = sed.parseFromBuffer(sedDocumentString.c_str(), url);
+    }
+    else if (isFileUrl(url))
+    {
+        // local documents are mapped and handed straight to the parser, without going through curl or a copy
+        MappedFile document;
+        if (document.open(fileUrlPath(url)) != 0)
+        {
+            std::cerr << "Unable to load document: " << url.c_str() << std::endl;
+            usage(argv[0]);
+            return -3;
+        }
+        parseStatus = sed.parseFromBuffer(document.data(), url);
+    }
+    else
+    {
+        std::string sedDocumentString = getUrlContent(url);
+        if (sedDocumentString.empty())
+        {
+            std::cerr << "Unable to load document: " << url.c_str() << std::endl;
+            usage(argv[0]);
+            return -3;
+        }
+        //std::cout << "SED-ML document string: [[[" << sedDocumentString.c_str() << "]]]" << std::endl;
+        parseStatus = sed.parseFromString(sedDocumentString);
+    }
+    if (parseStatus != 0)
     {
         std::cerr << "Error parsing SED-ML document: " << url.c_str() << std::endl;
         return -1;
@@ -63,6 +316,121 @@ int main(int argc, char* argv[])
         std::cerr << "There were errors building the simulation execution manifest." << std::endl;
         return -2;
     }
+    const std::vector<double> aggregateQuantiles = { 0.05, 0.5, 0.95 };
+    for (const std::string& id: aggregateDataSets)
+    {
+        if (sed.aggregateDataSet(id, aggregateQuantiles) != 0)
+        {
+            std::cerr << "Unable to aggregate the data set: " << id << std::endl;
+            return -2;
+        }
+    }
+    for (const auto& report: decimatedReports)
+    {
+        if (sed.decimateReport(report.first, report.second) != 0)
+        {
+            std::cerr << "Unable to decimate the report: " << report.first << std::endl;
+            return -2;
+        }
+    }
+    // must outlive the execution of the tasks
+    ResultPublisher publisher;
+    if (!publishSocket.empty())
+    {
+        if ((publisher.open(publishSocket) != 0) || (sed.publishResults(&publisher) != 0)) return -2;
+        GET_LOG(LogInfo, "Publishing results to: " << publishSocket);
+    }
+
+    // the results are compressed and written by a background thread
+    CompressedOutputStream fs;
+    if (!resultsFile.empty())
+    {
+        if (compression == CompressedOutput::None) compression = CompressedOutput::compressionForPath(resultsFile);
+        else if (CompressedOutput::compressionForPath(resultsFile) != compression)
+            resultsFile += CompressedOutput::extension(compression);
+        if (fs.open(resultsFile, compression) != 0) return -1;
+        if (statisticsFile.empty()) statisticsFile = statisticsFileFor(resultsFile, compression);
+    }
+
+    if (!estimationUrl.empty())
+    {
+        std::string taskId;
+        std::vector<EstimationParameter> parameters;
+        std::vector<EstimationData> data;
+        EstimationOptions options;
+        if (readEstimationSpecification(estimationUrl, taskId, parameters, data, options) != 0)
+        {
+            std::cerr << "Error reading the estimation specification: " << estimationUrl << std::endl;
+            return -5;
+        }
+        double value;
+        int status = sed.estimateParameters(taskId, parameters, data, options, value);
+        if (status < 0)
+        {
+            std::cerr << "There were some errors estimating the parameters." << std::endl;
+            return -5;
+        }
+        if (status > 0) std::cerr << "The parameter estimation did not converge." << std::endl;
+        std::ostream& os = fs.is_open() ? fs : std::cout;
+        os.precision(10);
+        os << "# objective = " << value << std::endl;
+        for (const EstimationParameter& p: parameters) os << p.change.targetXpath << "\t" << p.estimate << std::endl;
+        if (fs.is_open()) fs.close();
+        return 0;
+    }
+
+    if (!samplingUrl.empty())
+    {
+        std::string taskId;
+        std::vector<SamplingInput> inputs;
+        std::vector<MyVariable> outputs;
+        SamplingOptions options;
+        if (readSamplingSpecification(samplingUrl, taskId, inputs, outputs, options) != 0)
+        {
+            std::cerr << "Error reading the sampling specification: " << samplingUrl << std::endl;
+            return -6;
+        }
+        EnsembleStatistics results;
+        if (sed.sampleTask(taskId, inputs, outputs, options, results) != 0)
+        {
+            std::cerr << "There were some errors sampling the task." << std::endl;
+            return -6;
+        }
+        std::vector<std::string> names;
+        for (const MyVariable& output: outputs) names.push_back(outputName(output.target));
+        std::ostream& os = fs.is_open() ? fs : std::cout;
+        os.precision(10);
+        results.write(os, names);
+        if (fs.is_open()) fs.close();
+        return 0;
+    }
+
+    if (!sobolUrl.empty())
+    {
+        std::string taskId;
+        std::vector<SamplingInput> inputs;
+        std::vector<MyVariable> outputs;
+        SamplingOptions options;
+        if (readSamplingSpecification(sobolUrl, taskId, inputs, outputs, options) != 0)
+        {
+            std::cerr << "Error reading the sampling specification: " << sobolUrl << std::endl;
+            return -7;
+        }
+        SobolIndices results;
+        if (sed.sobolIndices(taskId, inputs, outputs, options, results) != 0)
+        {
+            std::cerr << "There were some errors computing the Sobol indices." << std::endl;
+            return -7;
+        }
+        std::vector<std::string> outputNames, inputNames;
+        for (const MyVariable& output: outputs) outputNames.push_back(outputName(output.target));
+        for (const SamplingInput& input: inputs) inputNames.push_back(outputName(input.change.targetXpath));
+        std::ostream& os = fs.is_open() ? fs : std::cout;
+        os.precision(10);
+        results.write(os, outputNames, inputNames);
+        if (fs.is_open()) fs.close();
+        return 0;
+    }
 
     // now we can actually execute the tasks
     if (sed.execute() != 0)
@@ -71,15 +439,26 @@ int main(int argc, char* argv[])
         return -3;
     }
 
-    std::fstream fs;
-    if (argc > 2) fs.open(argv[2], std::fstream::out);
     // and generate the reports
     if (sed.serialiseReports(fs.is_open() ? fs : std::cout) != 0)
     {
         std::cerr << "There were some errors serialising the reports." << std::endl;
         return -4;
     }
-    if (fs.is_open()) fs.close();
+    if (fs.is_open() && (fs.close() != 0))
+    {
+        std::cerr << "There were some errors writing the results file." << std::endl;
+        return -4;
+    }
+    if (!statisticsFile.empty())
+    {
+        std::ofstream os(statisticsFile.c_str());
+        if (!os || (sed.serialiseSolverStatistics(os) != 0) || !os)
+        {
+            std::cerr << "There were some errors writing the solver statistics to: " << statisticsFile << std::endl;
+            return -4;
+        }
+    }
 
     //sed.checkBob();
 
@@ -6,12 +6,16 @@
  */
 
 #include <iostream>
-#include <fstream>
+#include <string>
 
 #include "common.hpp"
 #include "GeneralModel.hpp"
 #include "cvodes.hpp"
 #include "kinsol.hpp"
+#include "steadystate.hpp"
+#include "protocol.hpp"
+#include "adjoint.hpp"
+#include "trajectorywriter.hpp"
 
 /*
   Can GET be a collection of code that gets combined with the generated code from CellML models and then compiled by LLVM at run time? or is GET an application that calls code generated from CellML models as required?
@@ -29,11 +33,63 @@
  * performed using SED-ML - but that is step 2.
  */
 
+static void printUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " <CellML model> [--steady-state] [--sensitivity <parameter>]..."
+              << " [--gradient <reference trajectory>] [--binary] [--compress gz|xz|bz2] [--encoding delta|xor]"
+              << std::endl;
+    std::cout << "\t--steady-state: solve directly for the initial open-circuit steady state rather than integrating to it"
+              << std::endl;
+    std::cout << "\t--sensitivity: compute the sensitivities of the state variables to the given parameter (Lp_a, Lp_b,"
+              << " A_a, A_b, P_a[typeId], P_b[typeId], P_j[typeId]), written to sensitivities.data" << std::endl;
+    std::cout << "\t--gradient: compute the gradient of the error against the given reference trajectory over the"
+              << " open-circuit phase with respect to all of the model parameters" << std::endl;
+    std::cout << "\t--binary: write the trajectories in the compact binary format (results.bin, sensitivities.bin)"
+              << " rather than text; get-trajectory-convert converts them to text for plotting" << std::endl;
+    std::cout << "\t--compress: compress the trajectories, adding the extension of the compression to the file names"
+              << std::endl;
+    std::cout << "\t--encoding: store each value of the binary trajectories as the difference (delta) or exclusive or"
+              << " (xor) with the previous value of the same column, which compresses better" << std::endl;
+}
+
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    if (argc < 2)
     {
-        std::cout << "Usage: " << argv[0] << " <CellML model>" << std::endl;
+        printUsage(argv[0]);
+        return -1;
+    }
+    bool directSteadyState = false;
+    std::vector<std::string> sensitivityParameters;
+    std::string referenceTrajectory;
+    TrajectoryWriter::Format format = TrajectoryWriter::Text;
+    TrajectoryWriter::Encoding encoding = TrajectoryWriter::Plain;
+    CompressedOutput::Compression compression = CompressedOutput::None;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--steady-state") directSteadyState = true;
+        else if ((arg == "--sensitivity") && ((i+1) < argc)) sensitivityParameters.push_back(argv[++i]);
+        else if ((arg == "--gradient") && ((i+1) < argc)) referenceTrajectory = argv[++i];
+        else if (arg == "--binary") format = TrajectoryWriter::Binary;
+        else if ((arg == "--compress") && ((i+1) < argc))
+        {
+            if (CompressedOutput::parseCompression(argv[++i], compression) != 0) return -1;
+        }
+        else if ((arg == "--encoding") && ((i+1) < argc))
+        {
+            if (TrajectoryWriter::parseEncoding(argv[++i], encoding) != 0) return -1;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+    if (directSteadyState && (sensitivityParameters.size() > 0))
+    {
+        std::cerr << "get: sensitivities are integrated from the initial conditions and can not be combined with "
+                  << "--steady-state" << std::endl;
         return -1;
     }
 
@@ -43,10 +99,10 @@ int main(int argc, char* argv[])
     setDebugLevel(0);
 
     // set up output
-    std::ofstream output;
-    output.open("results.data");
-    output.precision(5);
-    output.setf(std::ios_base::uppercase | std::ios_base::scientific);
+    const std::string extension = ((format == TrajectoryWriter::Binary) ? ".bin" : ".data")
+        + CompressedOutput::extension(compression);
+    TrajectoryWriter output;
+    if (output.open("results" + extension, format, model.stateColumnNames(), encoding) != 0) return 1;
     // set the way numbers should be streamed out
     std::cout.precision(5);
     std::cout.setf(std::ios_base::uppercase | std::ios_base::scientific);
@@ -55,62 +111,126 @@ int main(int argc, char* argv[])
     Cvodes cvodes;
 
     /*
-     * 1) transport parameters, initial conditions, t_initial, t_final, and
-     * delta_t are specified, and integration variable t is initialised to t_initial.
+     * Transport parameters, initial conditions and t_initial are specified, and integration variable t is
+     * initialised to t_initial. The integrator is free to choose its own step size, with the model state
+     * sampled every output_interval.
      */
     double t_initial = 0.0; // seconds
-    double t_final = 1500; // seconds
-    double delta_t = 1.0; // seconds
+    double output_interval = 1.0; // seconds
     double t = t_initial;
     model.initialise();
-    model.printStateHeader(output);
     model.printState(output, t_initial);
-    cvodes.initialise(&model, t_initial, delta_t);
+    cvodes.initialise(&model, t_initial, 0.0);
+
+    /*
+     * Forward sensitivities of the state variables to any requested parameters.
+     */
+    TrajectoryWriter sensitivityOutput;
+    if (sensitivityParameters.size() > 0)
+    {
+        std::vector<double*> parameters;
+        for (unsigned int p = 0; p < sensitivityParameters.size(); ++p)
+        {
+            double* parameter = model.parameter(sensitivityParameters[p]);
+            if (parameter == NULL)
+            {
+                std::cerr << "get: unknown sensitivity parameter: " << sensitivityParameters[p] << std::endl;
+                return -1;
+            }
+            parameters.push_back(parameter);
+        }
+        if (cvodes.enableSensitivities(parameters) != 0) return 1;
+        std::vector<std::string> columns(1, "time");
+        for (unsigned int p = 0; p < sensitivityParameters.size(); ++p)
+        {
+            columns.push_back("d(V)/d(" + sensitivityParameters[p] + ")");
+            for (unsigned int i = 0; i < model.mC_c.size(); ++i)
+                columns.push_back("d(C_c[" + std::to_string(i) + "])/d(" + sensitivityParameters[p] + ")");
+        }
+        if (sensitivityOutput.open("sensitivities" + extension, format, columns, encoding) != 0) return 1;
+    }
 
     double initialVolume = model.V;
 
+    /*
+     * The protocol: open-circuit until steady state, then short-circuit, then the salt stepper mode, held for the
+     * duration of the Latta et al steps in serosal and mucosal NaCl (five steps of 300 seconds) and the addition of
+     * ouabain (500 seconds). The bath changes and the pump need Na, K and Cl in the model, which it doesn't define
+     * yet, so only the mode changes are applied.
+     */
+    double t_steadyState = 1500.0; // seconds
+    double t_saltStepper = t_steadyState + 1500.0;
+    double t_final = t_saltStepper + 500.0 + 5 * 300.0 + 500.0;
+
+    Protocol protocol;
+    if (sensitivityParameters.size() > 0)
+    {
+        protocol.setSampleObserver([&cvodes, &sensitivityOutput](double time) {
+            std::vector<double> s = cvodes.getSensitivities();
+            s.insert(s.begin(), time);
+            sensitivityOutput.writeRow(s);
+        });
+    }
+    protocol.addEvent(t_steadyState, "short-circuit", [](GeneralModel& m) {
+        m.modelMode = GeneralModel::ShortCircuit;
+        m.U_t = 0.0;
+        return 0;
+    });
+    protocol.addEvent(t_saltStepper, "salt stepper", [](GeneralModel& m) {
+        m.initialiseSaltStepper(); // change the model mode and parameters
+        return 0;
+    });
+
     /*
      * Solve to steady state in the open-circuit mode.
      */
     model.modelMode = GeneralModel::OpenCircuit;
-    while (t <= t_final)
+    if (!referenceTrajectory.empty())
     {
-        double tout = t + delta_t;
         /*
-         * 2) membrane potentials are computed.
-         * @FIXME: this needs to be done inside the CVODE RHS function...but maybe ok if small enough time step?
+         * The adjoint gradient of the error against the reference trajectory over the open-circuit phase. This
+         * integrates the model independently of the protocol, so the initial state is restored afterwards.
          */
-        //        model.mode = 1; // we want to solve for membrane potentials at the open-circuit conditions
-        //        if (solveOneVariable(&model) > 0)
-        //        {
-        //            std::cerr << "Failed to solve open circuit case" << std::endl;
-        //            break;
-        //        }
-
-        /*
-         * 3) solute and water fluxes are computed using the membrane potentials and the
-         * respective flux equations.
-         */
-        /*
-         * 4) the state equations are evaluated and are integrated to t+delta_t.
-         */
-        if (cvodes.integrate(t, tout) != 0)
+        AdjointObjective objective;
+        if (createTrajectoryErrorObjective(referenceTrajectory, model, objective) != 0) return 1;
+        std::vector<std::string> names = model.parameterNames();
+        std::vector<double*> parameters;
+        for (unsigned int p = 0; p < names.size(); ++p) parameters.push_back(model.parameter(names[p]));
+        double V0 = model.V;
+        std::vector<double> C0;
+        for (unsigned int i = 0; i < model.mC_c.size(); ++i) C0.push_back(*(model.mC_c[i]));
+        double value;
+        std::vector<double> gradient;
+        if (computeAdjointGradient(&model, parameters, t_initial, t_steadyState, objective, value, gradient) != 0)
         {
-            std::cerr << "get: integration failed in steady-state block" << std::endl;
-            output.close();
+            std::cerr << "get: unable to compute the adjoint gradient" << std::endl;
             return 1;
         }
-        /*
-         * 5) additional variables are computed, and all results saved off-line.
-         */
-        /*
-         * 6) t is updated to t+delta_t and a comparison is made with t_final. If t_final
-         * has been reached, the computation ends. Otherwise, the program returns to step
-         * 2 to continue the integration.
-         */
-
+        std::cout << "Objective = " << value << std::endl;
+        for (unsigned int p = 0; p < names.size(); ++p)
+            std::cout << "d(objective)/d(" << names[p] << ") = " << gradient[p] << std::endl;
+        model.V = V0;
+        for (unsigned int i = 0; i < model.mC_c.size(); ++i) *(model.mC_c[i]) = C0[i];
+    }
+    if (directSteadyState)
+    {
+        if (solveSteadyState(&model) != 0)
+        {
+            std::cerr << "get: unable to solve for the open-circuit steady state" << std::endl;
+            return 1;
+        }
+        // continue the protocol from the same point in time as the integrated steady state, the integrator
+        // is re-initialised with this state at the short-circuit event.
+        t = t_steadyState;
+        Ith(cvodes.y, 1) = model.V;
+        for (unsigned int i = 0; i < model.mC_c.size(); ++i) Ith(cvodes.y, i+2) = *(model.mC_c[i]);
         model.printState(output, t);
     }
+    else if (protocol.run(model, cvodes, t, t_steadyState, output_interval, output) != 0)
+    {
+        std::cerr << "get: integration failed in steady-state block" << std::endl;
+        return 1;
+    }
 
     // dump out SS results to compare to table 2 in Latta et al paper.
     std::cout << "Steady state results\n"
@@ -123,95 +243,14 @@ int main(int argc, char* argv[])
               << "V/V(t=0) = " << model.V / initialVolume << std::endl;
 
     /*
-     * and now switch to the short-circuit case
+     * and now the rest of the protocol
      */
-    cvodes.reInitialise(t); // reset the integrator
-    model.modelMode = GeneralModel::ShortCircuit;
-    model.U_t = 0.0;
-    t_final += 1500;
-    while (t <= t_final)
+    if (protocol.run(model, cvodes, t, t_final, output_interval, output) != 0)
     {
-        double tout = t + delta_t;
-        if (cvodes.integrate(t, tout) != 0)
-        {
-            std::cerr << "get: integration failed in short-circuit block" << std::endl;
-            output.close();
-            return 2;
-        }
-        model.printState(output, t);
+        std::cerr << "get: integration failed in the protocol after the steady state" << std::endl;
+        return 2;
     }
 
-    /*
-     * and the salt stepper mode to test the sodium pump
-     */
-    //setDebugLevel(51);
-    model.initialiseSaltStepper(); // change the model mode and parameters
-    // integrate to get a steady state
-    cvodes.reInitialise(t); // reset the integrator
-    t_final += 500;
-    while (t <= t_final)
-    {
-        double tout = t + delta_t;
-        if (cvodes.integrate(t, tout) != 0)
-        {
-            std::cerr << "get: integration failed in salt-stepper block" << std::endl;
-            output.close();
-            return 3;
-        }
-        model.printState(output, t);
-    }
-    // and now the steps in NaCl
-    std::vector<double> NaCl;
-    NaCl.push_back(13.3);
-    NaCl.push_back(26.7);
-    NaCl.push_back(40.0);
-    NaCl.push_back(53.3);
-    NaCl.push_back(66.7);
-    double duration = 300.0;
-    //setDebugLevel(51);
-    for (unsigned int i = 0; i < NaCl.size(); ++i)
-    {
-        //model.C_b[GeneralModel::Na] = NaCl[i];
-        //model.C_b[GeneralModel::Cl] = NaCl[i];
-        double serosalChangeTime = t;
-        t_final += duration;
-        bool mucosalSet = false;
-        while (t <= t_final)
-        {
-            if (!mucosalSet && (t >= (serosalChangeTime + 10.0)))
-            {
-                // 10 seconds later
-                //model.C_a[GeneralModel::Na] = NaCl[i];
-                //model.C_a[GeneralModel::Cl] = NaCl[i];
-                mucosalSet = true;
-            }
-            double tout = t + delta_t;
-            if (cvodes.integrate(t, tout) != 0)
-            {
-                std::cerr << "get: integration failed in salt-stepper block 2 part " << i << std::endl;
-                output.close();
-                return 4;
-            }
-            model.printState(output, t);
-        }
-    }
-    // and the final step puts Imax=0 simulating the addition of ouabain to the serosal solution
-    //model.Imax = 0.0;
-    t_final += 500.0;
-    while (t <= t_final)
-    {
-        double tout = t + delta_t;
-        if (cvodes.integrate(t, tout) != 0)
-        {
-            std::cerr << "get: integration failed in final salt-stepper block" << std::endl;
-            output.close();
-            return 5;
-        }
-        model.printState(output, t);
-    }
-
-    output.close();
+    if ((output.close() != 0) || (sensitivityOutput.close() != 0)) return 3;
     return 0;
 }
-
-
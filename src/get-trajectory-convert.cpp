@@ -0,0 +1,66 @@
+/*
+ * get-trajectory-convert.cpp
+ *
+ * Convert trajectories written by the get-simulator between the text and binary formats, e.g., to plot a binary
+ * results.bin with the gnuplot scripts in testing/latta.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "trajectorywriter.hpp"
+
+static void printUsage(const char* name)
+{
+    std::cout << "Usage: " << name << " <input trajectory> <output trajectory> [--text|--binary]"
+              << " [--encoding plain|delta|xor]" << std::endl;
+    std::cout << "\tThe format and compression of the input are detected automatically, the output is written as"
+              << " text (the default) or in the binary format, compressed if its name ends in .gz, .xz or .bz2"
+              << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        printUsage(argv[0]);
+        return -1;
+    }
+    TrajectoryWriter::Format format = TrajectoryWriter::Text;
+    TrajectoryWriter::Encoding encoding = TrajectoryWriter::Plain;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if (arg == "--text") format = TrajectoryWriter::Text;
+        else if (arg == "--binary") format = TrajectoryWriter::Binary;
+        else if ((arg == "--encoding") && ((i+1) < argc))
+        {
+            if (TrajectoryWriter::parseEncoding(argv[++i], encoding) != 0) return -1;
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return -1;
+        }
+    }
+    std::vector<std::string> columnNames;
+    std::vector<std::vector<double> > rows;
+    if (readTrajectory(argv[1], columnNames, rows) != 0) return 1;
+    if (columnNames.empty() && !rows.empty())
+    {
+        // a text trajectory without a header, name the columns by number as gnuplot does
+        for (unsigned int i = 0; i < rows[0].size(); ++i) columnNames.push_back(std::to_string(i + 1));
+    }
+    TrajectoryWriter output;
+    if (output.open(argv[2], format, columnNames, encoding) != 0) return 2;
+    std::vector<double> row(columnNames.size());
+    for (const std::vector<double>& r: rows)
+    {
+        // pad or truncate ragged text rows to the number of columns
+        for (unsigned int i = 0; i < row.size(); ++i) row[i] = (i < r.size()) ? r[i] : 0.0;
+        output.writeRow(row);
+    }
+    if (output.close() != 0) return 2;
+    return 0;
+}
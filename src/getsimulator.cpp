@@ -0,0 +1,189 @@
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "getsimulator.hpp"
+#include "utils.hpp"
+#include "mappedfile.hpp"
+#include "omexarchive.hpp"
+#include "sedml.hpp"
+#include "resultlistener.hpp"
+
+/**
+ * Pass the results to the execution callbacks.
+ */
+class CallbackListener : public ResultListener
+{
+public:
+    explicit CallbackListener(const ExecutionCallbacks& callbacks) : mCallbacks(callbacks), mNextStream(1)
+    {
+    }
+
+    uint32_t beginStream(const std::string& name, const std::vector<std::string>& columnNames)
+    {
+        uint32_t stream = mNextStream++;
+        if (mCallbacks.streamStarted) mCallbacks.streamStarted(stream, name, columnNames);
+        return stream;
+    }
+
+    void publishRow(uint32_t stream, double time, const std::vector<double>& values)
+    {
+        if (mCallbacks.row) mCallbacks.row(stream, time, values);
+    }
+
+    void endStream(uint32_t stream)
+    {
+        if (mCallbacks.streamFinished) mCallbacks.streamFinished(stream);
+    }
+
+private:
+    const ExecutionCallbacks& mCallbacks;
+    uint32_t mNextStream;
+};
+
+SimulationExperiment::SimulationExperiment() : mSed(NULL), mArchive(NULL), mManifestBuilt(false)
+{
+    initialiseUrlFetching();
+}
+
+SimulationExperiment::~SimulationExperiment()
+{
+    if (mSed) delete mSed;
+    if (mArchive) delete mArchive;
+}
+
+int SimulationExperiment::load(const std::string& url)
+{
+    std::string absoluteUrl = buildAbsoluteUri(url, "");
+    if (isFileUrl(absoluteUrl) && isZipFile(fileUrlPath(absoluteUrl)))
+    {
+        // a COMBINE archive, the document and its models are read straight from the archive
+        OmexArchive* archive = new OmexArchive();
+        std::string location, document;
+        if (archive->open(fileUrlPath(absoluteUrl)) != 0)
+        {
+            std::cerr << "SimulationExperiment::load: unable to open the archive: " << absoluteUrl << std::endl;
+            delete archive;
+            return -1;
+        }
+        location = archive->masterSedmlLocation();
+        if (location.empty() || (archive->read(location, document) != 0))
+        {
+            std::cerr << "SimulationExperiment::load: unable to find a SED-ML document in the archive: "
+                      << absoluteUrl << std::endl;
+            delete archive;
+            return -2;
+        }
+        int status = loadFromString(document, archive->url(location));
+        // after loading, which discards any previous archive
+        mArchive = archive;
+        return status;
+    }
+    if (isFileUrl(absoluteUrl))
+    {
+        // local documents are mapped and handed straight to the parser
+        MappedFile document;
+        if (document.open(fileUrlPath(absoluteUrl)) != 0)
+        {
+            std::cerr << "SimulationExperiment::load: unable to load the document: " << absoluteUrl << std::endl;
+            return -3;
+        }
+        return parse(document.data(), absoluteUrl);
+    }
+    std::string document = getUrlContent(absoluteUrl);
+    if (document.empty())
+    {
+        std::cerr << "SimulationExperiment::load: unable to load the document: " << absoluteUrl << std::endl;
+        return -3;
+    }
+    return loadFromString(document, absoluteUrl);
+}
+
+int SimulationExperiment::loadFromString(const std::string& document, const std::string& baseUrl)
+{
+    return parse(document.c_str(), baseUrl);
+}
+
+int SimulationExperiment::parse(const char* document, const std::string& baseUrl)
+{
+    if (mSed) delete mSed;
+    if (mArchive) delete mArchive;
+    mArchive = NULL;
+    mManifestBuilt = false;
+    mUrl = baseUrl;
+    mSed = new Sedml();
+    if (mSed->parseFromBuffer(document, baseUrl) != 0)
+    {
+        std::cerr << "SimulationExperiment::load: error parsing the SED-ML document: " << baseUrl
+                  << std::endl;
+        delete mSed;
+        mSed = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int SimulationExperiment::buildManifest()
+{
+    if (!mSed)
+    {
+        std::cerr << "SimulationExperiment::buildManifest: no document has been loaded" << std::endl;
+        return -1;
+    }
+    if (mSed->buildExecutionManifest(mUrl) != 0) return -2;
+    mManifestBuilt = true;
+    return 0;
+}
+
+int SimulationExperiment::aggregateDataSet(const std::string& dataSetId, const std::vector<double>& quantiles)
+{
+    if (!mManifestBuilt)
+    {
+        std::cerr << "SimulationExperiment::aggregateDataSet: the manifest has not been built" << std::endl;
+        return -1;
+    }
+    return mSed->aggregateDataSet(dataSetId, quantiles);
+}
+
+int SimulationExperiment::decimateReport(const std::string& reportId, const DecimationOptions& options)
+{
+    if (!mManifestBuilt)
+    {
+        std::cerr << "SimulationExperiment::decimateReport: the manifest has not been built" << std::endl;
+        return -1;
+    }
+    return mSed->decimateReport(reportId, options);
+}
+
+int SimulationExperiment::execute(const ExecutionCallbacks& callbacks)
+{
+    if (!mManifestBuilt)
+    {
+        std::cerr << "SimulationExperiment::execute: the manifest has not been built" << std::endl;
+        return -1;
+    }
+    CallbackListener listener(callbacks);
+    bool listening = callbacks.streamStarted || callbacks.row || callbacks.streamFinished;
+    if (listening) mSed->publishResults(&listener);
+    int status = mSed->execute();
+    if (listening) mSed->publishResults(NULL);
+    return status;
+}
+
+int SimulationExperiment::reports(std::vector<ReportView>& reports) const
+{
+    if (!mSed) return -1;
+    return mSed->reportViews(reports);
+}
+
+int SimulationExperiment::serialiseReports(std::ostream& os)
+{
+    if (!mSed) return -1;
+    return mSed->serialiseReports(os);
+}
+
+int SimulationExperiment::serialiseSolverStatistics(std::ostream& os)
+{
+    if (!mSed) return -1;
+    return mSed->serialiseSolverStatistics(os);
+}
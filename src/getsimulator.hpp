@@ -0,0 +1,163 @@
+#ifndef GETSIMULATOR_HPP
+#define GETSIMULATOR_HPP
+
+/**
+ * @brief The programming interface of libget-simulator, for running SED-ML simulation experiments from other
+ * programs without going through get-sed-ml-client and its text output.
+ */
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include <functional>
+#include <stdint.h>
+
+class Sedml;
+class OmexArchive;
+class DecimationOptions;
+
+/**
+ * @brief A read-only view of one column of a report: the values of one of its data sets. The values belong to the
+ * experiment and the view is valid until the experiment is executed again or destroyed.
+ */
+class ReportColumn
+{
+public:
+    ReportColumn() : data(NULL), size(0)
+    {
+    }
+
+    std::string id;
+    std::string label;
+    const double* data;
+    size_t size;
+};
+
+/**
+ * @brief The columns of a report, in the order they are serialised. Aggregated data sets are not included, their
+ * statistics are only available by serialising the reports.
+ */
+class ReportView
+{
+public:
+    std::string id;
+    std::vector<ReportColumn> columns;
+};
+
+/**
+ * @brief Functions called while an experiment is executed, any of which may be left empty. They are called from
+ * the thread calling execute.
+ */
+class ExecutionCallbacks
+{
+public:
+    // a task has started producing rows, with the names of the values in each row
+    std::function<void(uint32_t stream, const std::string& taskId, const std::vector<std::string>& columnNames)>
+        streamStarted;
+    // the values of a row, as they are stored
+    std::function<void(uint32_t stream, double time, const std::vector<double>& values)> row;
+    // the task has produced all its rows
+    std::function<void(uint32_t stream)> streamFinished;
+};
+
+/**
+ * @brief A SED-ML simulation experiment: load the document, build its execution manifest, execute it and read the
+ * reports.
+ *
+ * Each experiment holds its own state. Running experiments in different threads at once is checked under
+ * ThreadSanitizer by testing/concurrency-test.cpp, but it also relies on CSim and libSEDML being safe to use from
+ * several threads for different documents, so run that test against the versions in use before doing so. Errors
+ * are reported as non-zero return values, with the details written to std::cerr.
+ */
+class SimulationExperiment
+{
+public:
+    /**
+     * @brief Create an experiment. The first experiment initialises curl for the process, so it should be created
+     * before any other threads use curl.
+     */
+    SimulationExperiment();
+    ~SimulationExperiment();
+
+    /**
+     * @brief Load a SED-ML document or the master SED-ML document of a COMBINE archive.
+     * @param url The URL of the document, relative URLs are resolved against the current working directory.
+     * @return zero on success.
+     */
+    int load(const std::string& url);
+
+    /**
+     * @brief Load the given SED-ML document.
+     * @param document The SED-ML document.
+     * @param baseUrl The URL used to resolve relative model references.
+     * @return zero on success.
+     */
+    int loadFromString(const std::string& document, const std::string& baseUrl);
+
+    /**
+     * @brief Work out the tasks to execute for the loaded document, see Sedml::buildExecutionManifest.
+     * @return zero on success.
+     */
+    int buildManifest();
+
+    /**
+     * @brief Summarise a data set (or all, "*") by its statistics over the repeats of its task, see
+     * Sedml::aggregateDataSet. Must be called after building the manifest.
+     * @return zero on success.
+     */
+    int aggregateDataSet(const std::string& dataSetId, const std::vector<double>& quantiles);
+
+    /**
+     * @brief Decimate the samples of a report (or all, "*"), see Sedml::decimateReport. Must be called after
+     * building the manifest.
+     * @return zero on success.
+     */
+    int decimateReport(const std::string& reportId, const DecimationOptions& options);
+
+    /**
+     * @brief Execute the tasks of the manifest.
+     * @param callbacks The functions to call as the results are produced.
+     * @return zero on success.
+     */
+    int execute(const ExecutionCallbacks& callbacks = ExecutionCallbacks());
+
+    /**
+     * @brief Views of the reports, once the experiment has been executed.
+     * @param reports On success, the reports.
+     * @return zero on success.
+     */
+    int reports(std::vector<ReportView>& reports) const;
+
+    /**
+     * @brief Write the reports as get-sed-ml-client does, once the experiment has been executed.
+     * @return zero on success.
+     */
+    int serialiseReports(std::ostream& os);
+
+    /**
+     * @brief Write the solver statistics of each task as JSON, once the experiment has been executed (see
+     * Sedml::serialiseSolverStatistics).
+     * @return zero on success.
+     */
+    int serialiseSolverStatistics(std::ostream& os);
+
+    /**
+     * @brief The URL of the loaded document.
+     */
+    const std::string& url() const { return mUrl; }
+
+private:
+    SimulationExperiment(const SimulationExperiment&) = delete;
+    SimulationExperiment& operator=(const SimulationExperiment&) = delete;
+
+    // parse the NUL terminated document, replacing any previous document
+    int parse(const char* document, const std::string& baseUrl);
+
+    std::string mUrl;
+    Sedml* mSed;
+    // the archive the document came from, if any, which must outlive the execution
+    OmexArchive* mArchive;
+    bool mManifestBuilt;
+};
+
+#endif // GETSIMULATOR_HPP
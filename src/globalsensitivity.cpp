@@ -0,0 +1,215 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "globalsensitivity.hpp"
+
+// the number of base samples simulated together, each needing k+2 simulations
+#define BASE_SAMPLES_PER_BLOCK 64
+
+/*
+ * Running sums for the Sobol indices of one output at one time.
+ */
+class SobolAccumulator
+{
+public:
+    SobolAccumulator(unsigned int numberOfInputs = 0) : count(0), mean(0.0), m2(0.0), n(0),
+        first(numberOfInputs, 0.0), total(numberOfInputs, 0.0)
+    {
+    }
+
+    // Welford's algorithm for the output variance, over the values for both the A and B matrices
+    void addToVariance(double f)
+    {
+        ++count;
+        double delta = f - mean;
+        mean += delta / count;
+        m2 += delta * (f - mean);
+    }
+
+    double variance() const
+    {
+        return (count > 1) ? m2 / (count - 1) : 0.0;
+    }
+
+    long count;
+    double mean, m2;
+    // the number of base samples and the sums for the first and total order estimators
+    long n;
+    std::vector<double> first, total;
+};
+
+void SobolIndices::write(std::ostream& os, const std::vector<std::string>& outputNames,
+                         const std::vector<std::string>& inputNames) const
+{
+    os << "# time";
+    for (unsigned int k = 0; k < variance.size(); ++k)
+    {
+        os << "\t" << outputNames[k] << ":variance";
+        for (unsigned int i = 0; i < inputNames.size(); ++i)
+            os << "\t" << outputNames[k] << ":S[" << inputNames[i] << "]\t" << outputNames[k] << ":ST["
+               << inputNames[i] << "]";
+    }
+    os << std::endl;
+    for (unsigned int j = 0; j < times.size(); ++j)
+    {
+        os << times[j];
+        for (unsigned int k = 0; k < variance.size(); ++k)
+        {
+            os << "\t" << variance[k][j];
+            for (unsigned int i = 0; i < firstOrder[k][j].size(); ++i)
+                os << "\t" << firstOrder[k][j][i] << "\t" << totalOrder[k][j][i];
+        }
+        os << std::endl;
+    }
+}
+
+/*
+ * The values of the inputs at a point in the unit hypercube.
+ */
+static std::vector<double> inputValues(const std::vector<SamplingInput>& inputs, const std::vector<double>& u)
+{
+    std::vector<double> values(u.size());
+    for (unsigned int j = 0; j < u.size(); ++j) values[j] = inputs[j].quantile(u[j]);
+    return values;
+}
+
+int estimateSobolIndices(const std::vector<SamplingInput>& inputs, unsigned int numberOfOutputs,
+                         const std::vector<double>& times, const SamplingOptions& options,
+                         const SobolEvaluator& evaluate, SobolIndices& results)
+{
+    unsigned int k = inputs.size(), N = options.numberOfSamples;
+    if (N < 2)
+    {
+        std::cerr << "estimateSobolIndices: need at least two base samples" << std::endl;
+        return -1;
+    }
+    // the A and B matrices are the two halves of a single design in 2k dimensions
+    std::vector<std::vector<double> > design;
+    if (generateDesign(options.design, N, 2*k, options.seed, design) != 0)
+    {
+        std::cerr << "estimateSobolIndices: unable to generate the base samples for " << k << " inputs" << std::endl;
+        return -1;
+    }
+    results = SobolIndices();
+    results.times = times;
+    std::vector<std::vector<SobolAccumulator> > sums(numberOfOutputs,
+                                                     std::vector<SobolAccumulator>(results.times.size(),
+                                                                                   SobolAccumulator(k)));
+
+    std::vector<std::vector<double> > points;
+    std::vector<std::vector<std::vector<double> > > trajectories;
+    std::vector<char> success;
+    for (unsigned int start = 0; start < N; start += BASE_SAMPLES_PER_BLOCK)
+    {
+        unsigned int m = std::min((unsigned int)BASE_SAMPLES_PER_BLOCK, N - start);
+        // the simulations for base sample b are A, B, then AB_i for each input i
+        points.clear();
+        for (unsigned int b = 0; b < m; ++b)
+        {
+            const std::vector<double>& u = design[start + b];
+            std::vector<double> a(u.begin(), u.begin() + k), bb(u.begin() + k, u.end());
+            points.push_back(inputValues(inputs, a));
+            points.push_back(inputValues(inputs, bb));
+            for (unsigned int i = 0; i < k; ++i)
+            {
+                std::vector<double> ab(a);
+                ab[i] = bb[i];
+                points.push_back(inputValues(inputs, ab));
+            }
+        }
+        trajectories.resize(points.size());
+        success.assign(points.size(), 0);
+        int status = evaluate(points, [&trajectories, &success](unsigned int index, bool ok, const std::vector<double>&,
+                                                                const std::vector<std::vector<double> >& outputs)
+        {
+            success[index] = ok;
+            if (ok) trajectories[index] = outputs;
+        });
+        if (status != 0) return status;
+
+        // reduce this block into the running sums
+        for (unsigned int b = 0; b < m; ++b)
+        {
+            unsigned int first = b * (k + 2);
+            bool ok = true;
+            for (unsigned int s = 0; s < k + 2; ++s) ok = ok && success[first + s];
+            if (!ok)
+            {
+                ++results.numberOfFailures;
+                continue;
+            }
+            ++results.numberOfBaseSamples;
+            for (unsigned int o = 0; o < numberOfOutputs; ++o)
+            {
+                std::vector<SobolAccumulator>& accumulators = sums[o];
+                for (unsigned int j = 0; j < accumulators.size(); ++j)
+                {
+                    SobolAccumulator& sum = accumulators[j];
+                    double fA = trajectories[first][o][j];
+                    double fB = trajectories[first + 1][o][j];
+                    sum.addToVariance(fA);
+                    sum.addToVariance(fB);
+                    ++sum.n;
+                    for (unsigned int i = 0; i < k; ++i)
+                    {
+                        double fAB = trajectories[first + 2 + i][o][j];
+                        sum.first[i] += fB * (fAB - fA);
+                        sum.total[i] += (fA - fAB) * (fA - fAB);
+                    }
+                }
+            }
+        }
+    }
+    if (results.numberOfFailures > 0)
+        std::cerr << "estimateSobolIndices: " << results.numberOfFailures << " of " << N
+                  << " base samples had failed simulations and were left out of the estimates" << std::endl;
+    if (results.numberOfBaseSamples < 2)
+    {
+        std::cerr << "estimateSobolIndices: not enough successful base samples to estimate the indices" << std::endl;
+        return -2;
+    }
+
+    unsigned int T = results.times.size();
+    results.variance.assign(numberOfOutputs, std::vector<double>(T, 0.0));
+    results.firstOrder.assign(numberOfOutputs, std::vector<std::vector<double> >(T, std::vector<double>(k, 0.0)));
+    results.totalOrder = results.firstOrder;
+    for (unsigned int o = 0; o < numberOfOutputs; ++o)
+    {
+        for (unsigned int j = 0; j < T; ++j)
+        {
+            const SobolAccumulator& sum = sums[o][j];
+            double V = sum.variance();
+            results.variance[o][j] = V;
+            // constant outputs (e.g., at the initial time) have no variance to apportion
+            if (V <= 0.0) continue;
+            for (unsigned int i = 0; i < k; ++i)
+            {
+                results.firstOrder[o][j][i] = sum.first[i] / sum.n / V;
+                results.totalOrder[o][j][i] = sum.total[i] / (2.0 * sum.n) / V;
+            }
+        }
+    }
+    return 0;
+}
+
+int SobolAnalysis::initialise(const std::string& modelUrl, const MySimulation& simulation,
+                              const std::vector<SamplingInput>& inputs, const std::vector<MyVariable>& outputs,
+                              int numberOfWorkers)
+{
+    mInputs = inputs;
+    mNumberOfOutputs = outputs.size();
+    return mSampling.initialise(modelUrl, simulation, inputs, outputs, numberOfWorkers);
+}
+
+int SobolAnalysis::run(const SamplingOptions& options, SobolIndices& results)
+{
+    TaskEnsemble& ensemble = mSampling.ensemble();
+    return estimateSobolIndices(mInputs, mNumberOfOutputs, ensemble.sampleTimes(), options,
+                                [&ensemble](const std::vector<std::vector<double> >& points,
+                                            const EnsembleResultHandler& handler)
+                                {
+                                    return ensemble.run(points, handler);
+                                }, results);
+}
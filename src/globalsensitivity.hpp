@@ -0,0 +1,100 @@
+#ifndef GLOBALSENSITIVITY_HPP
+#define GLOBALSENSITIVITY_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <functional>
+
+#include "sampling.hpp"
+
+/**
+ * The first-order and total-order Sobol indices of each output with respect to each input at each point of the
+ * simulation time course.
+ */
+class SobolIndices
+{
+public:
+    SobolIndices() : numberOfBaseSamples(0), numberOfFailures(0)
+    {
+    }
+
+    /**
+     * @brief Write the indices as tab separated columns: the time, then for each output its variance followed by
+     * the first-order and total-order index with respect to each input.
+     * @param os The stream to write to.
+     * @param outputNames The name of each output for the column headers.
+     * @param inputNames The name of each input for the column headers.
+     */
+    void write(std::ostream& os, const std::vector<std::string>& outputNames,
+               const std::vector<std::string>& inputNames) const;
+
+    std::vector<double> times;
+    // the variance of each output (outer) at each time (inner)
+    std::vector<std::vector<double> > variance;
+    // the indices of each output (outer) at each time (middle) with respect to each input (inner)
+    std::vector<std::vector<std::vector<double> > > firstOrder, totalOrder;
+    // the number of base samples used in the estimates and the number left out because a simulation failed
+    long numberOfBaseSamples, numberOfFailures;
+};
+
+/**
+ * Evaluate the outputs at each of a block of input values, calling the handler with the result of each, as
+ * TaskEnsemble::run does. Returns zero on success.
+ */
+typedef std::function<int(const std::vector<std::vector<double> >& points, const EnsembleResultHandler& handler)>
+    SobolEvaluator;
+
+/**
+ * @brief Estimate the Sobol indices of the outputs of a model with respect to its inputs.
+ *
+ * The Saltelli scheme is used: for N base samples of the k inputs, two independent sample matrices A and B and the
+ * k matrices AB_i (A with column i taken from B) are evaluated, N(k+2) evaluations in all. First-order indices use
+ * the estimator of Saltelli et al (2010) and total-order indices that of Jansen (1999). The base samples are
+ * evaluated in blocks and the outputs of each block are reduced into running sums as soon as it is complete, so
+ * only one block of trajectories is stored at any time.
+ *
+ * @param inputs The distributions of the inputs.
+ * @param numberOfOutputs The number of outputs of the model.
+ * @param times The times at which the outputs are given.
+ * @param options The sampling options: the design and seed used to generate the base samples and the number of
+ * base samples (N). The quantiles and number of workers are not used.
+ * @param evaluate Evaluates the model at each point of a block.
+ * @param results On success, the Sobol indices.
+ * @return zero on success.
+ */
+int estimateSobolIndices(const std::vector<SamplingInput>& inputs, unsigned int numberOfOutputs,
+                         const std::vector<double>& times, const SamplingOptions& options,
+                         const SobolEvaluator& evaluate, SobolIndices& results);
+
+/**
+ * @brief Variance-based global sensitivity analysis of a CSim simulation task, see estimateSobolIndices. The
+ * blocks of base samples are simulated in parallel by a TaskEnsemble.
+ */
+class SobolAnalysis
+{
+public:
+    /**
+     * @brief Load and compile the model for each worker.
+     * @sa SamplingEngine::initialise
+     */
+    int initialise(const std::string& modelUrl, const MySimulation& simulation,
+                   const std::vector<SamplingInput>& inputs, const std::vector<MyVariable>& outputs,
+                   int numberOfWorkers);
+
+    /**
+     * @brief Compute the Sobol indices.
+     * @param options The sampling options: the design and seed used to generate the base samples, the number of
+     * base samples (N) and the number of workers. The quantiles are not used.
+     * @param results On success, the Sobol indices.
+     * @return zero on success.
+     */
+    int run(const SamplingOptions& options, SobolIndices& results);
+
+private:
+    SamplingEngine mSampling;
+    std::vector<SamplingInput> mInputs;
+    unsigned int mNumberOfOutputs;
+};
+
+#endif // GLOBALSENSITIVITY_HPP
@@ -14,6 +14,9 @@
 
 #include "common.hpp"
 #include "GeneralModel.hpp"
+#include "kinsol.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
 
 #define ZERO   RCONST(0.0)
 #define ONE    RCONST(1.0)
@@ -28,16 +31,17 @@
 static int func(N_Vector u, N_Vector f, void *user_data);
 
 /* Private Helper Functions */
-static int SolveIt(void *kmem, N_Vector u, N_Vector s, int glstr, int mset);
+static int SolveIt(void *kmem, N_Vector u, N_Vector s, int glstr, int mset, const SimulationContext& context);
 //static void PrintHeader(int globalstrategy, realtype fnormtol,
 //		realtype scsteptol);
-static void PrintOutput(N_Vector u);
-static void PrintFinalStats(void *kmem);
+static void PrintOutput(N_Vector u, std::ostream& os);
+static void PrintFinalStats(void *kmem, std::ostream& os);
 static int check_flag(void *flagvalue, const char *funcname, int opt);
 
 typedef struct
 {
     GeneralModel* model;
+    PotentialSolution solution;
     double minimumValue;
     double maximumValue;
 } UserData;
@@ -50,8 +54,8 @@ void handleKinsolError(int code, const char *module, const char *function, char
 }
 
 /**
- * mode == 0: voltage clamp (solving for U_a)
- * mode != 0: open-circuit (solving for U_t)
+ * solution == VoltageClampPotentials: voltage clamp (solving for U_a)
+ * solution == OpenCircuitPotentials: open-circuit (solving for U_t)
  * include the constraint that minimumValue <= U <= maximumValue to ensure that physiological potentials
  * only are solved (i.e., try and restrain unrealistic values for the exp(U) functions).
  *
@@ -64,8 +68,9 @@ void handleKinsolError(int code, const char *module, const char *function, char
  *    l >= 0
  *    L <= 0
  */
-int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumValue)
+int solveOneVariable(GeneralModel* model, PotentialSolution solution, double minimuimValue, double maximumValue)
 {
+    GET_TRACE_SCOPE("solver", "KINSOL solve");
     int NEQ = 1 /* variable, U */ + 2 /* constraints, l and L */;
 	realtype fnormtol, scsteptol;
     N_Vector u, s, c;
@@ -84,6 +89,7 @@ int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumVa
     data->maximumValue = maximumValue;
     data->minimumValue = minimuimValue;
     data->model = model;
+    data->solution = solution;
 
 	/* Create serial vectors of length NEQ */
 	u = N_VNew_Serial(NEQ);
@@ -98,7 +104,7 @@ int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumVa
 
 	// set initial guess
 	realtype *udata = NV_DATA_S(u);
-	if (model->mode)
+	if (solution == OpenCircuitPotentials)
 		udata[0] = model->U_t;
 	else
         udata[0] = model->U_a;
@@ -157,7 +163,10 @@ int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumVa
 
     glstr = KIN_LINESEARCH;
     mset = 0;
-    int returnCode = SolveIt(kmem, u, s, glstr, mset);
+    int returnCode = SolveIt(kmem, u, s, glstr, mset, model->context);
+    long int iterations;
+    ++model->statistics.kinsolSolves;
+    if (KINGetNumNonlinSolvIters(kmem, &iterations) >= 0) model->statistics.kinsolIterations += iterations;
 
 	//glstr = KIN_LINESEARCH;
 	//mset = 1;
@@ -176,7 +185,7 @@ int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumVa
       */
 	// assign final value
 	udata = NV_DATA_S(u);
-	if (model->mode)
+	if (solution == OpenCircuitPotentials)
     {
 		model->U_t = udata[0];
         int errorFlag;
@@ -198,7 +207,7 @@ int solveOneVariable(GeneralModel* model, double minimuimValue, double maximumVa
     return (returnCode);
 }
 
-static int SolveIt(void *kmem, N_Vector u, N_Vector s, int glstr, int mset)
+static int SolveIt(void *kmem, N_Vector u, N_Vector s, int glstr, int mset, const SimulationContext& context)
 {
 	int flag;
 
@@ -243,13 +252,13 @@ static int SolveIt(void *kmem, N_Vector u, N_Vector s, int glstr, int mset)
         return (1);
     }
 
-    if (debugLevel() > 15)
+    if (GET_CONTEXT_DEBUG(context, 15))
     {
-        printf("Solution:\n  U = ");
-        PrintOutput(u);
+        *context.diagnostics << "Solution:\n  U = ";
+        PrintOutput(u, *context.diagnostics);
     }
 
-    if (debugLevel() > 30) PrintFinalStats(kmem);
+    if (GET_CONTEXT_DEBUG(context, 30)) PrintFinalStats(kmem, *context.diagnostics);
 
 	return (0);
 
@@ -272,7 +281,7 @@ static int func(N_Vector u, N_Vector f, void *user_data)
 	fdata = NV_DATA_S(f);
 
     int errorFlag = 0;
-    if (data->model->mode)
+    if (data->solution == OpenCircuitPotentials)
 	{
 		// Open-circuit case (solving for E_t)
         data->model->U_t = udata[0];
@@ -328,22 +337,18 @@ static int func(N_Vector u, N_Vector f, void *user_data)
  * Print solution
  */
 
-static void PrintOutput(N_Vector u)
+static void PrintOutput(N_Vector u, std::ostream& os)
 {
-#if defined(SUNDIALS_EXTENDED_PRECISION)
-	printf(" %8.6Lg\n", Ith(u,1));
-#elif defined(SUNDIALS_DOUBLE_PRECISION)
-	printf(" %8.6lg\n", Ith(u,1));
-#else
-	printf(" %8.6g\n", Ith(u,1));
-#endif
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), " %8.6g\n", double(Ith(u,1)));
+    os << buffer;
 }
 
 /*
  * Print final statistics contained in iopt
  */
 
-static void PrintFinalStats(void *kmem)
+static void PrintFinalStats(void *kmem, std::ostream& os)
 {
     long int nni, nfe, nje, nfeD;
     int flag;
@@ -358,9 +363,10 @@ static void PrintFinalStats(void *kmem)
     flag = KINDlsGetNumFuncEvals(kmem, &nfeD);
     check_flag(&flag, "KINDlsGetNumFuncEvals", 1);
 
-    printf("Final Statistics:\n");
-    printf("  nni = %5ld    nfe  = %5ld \n", nni, nfe);
-    printf("  nje = %5ld    nfeD = %5ld \n", nje, nfeD);
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "Final Statistics:\n  nni = %5ld    nfe  = %5ld \n  nje = %5ld    nfeD = %5ld \n",
+             nni, nfe, nje, nfeD);
+    os << buffer;
 }
 
 /*
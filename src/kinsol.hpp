@@ -11,8 +11,20 @@
 class GeneralModel;
 
 /**
- * Utility to wrap KINSOL for use in get.
+ * The membrane potential solved for by solveOneVariable.
  */
-int solveOneVariable(GeneralModel* model, double minimumValue, double maximumValue);
+enum PotentialSolution
+{
+    // voltage clamp: solve for U_a at the current U_t
+    VoltageClampPotentials = 0,
+    // open circuit: solve for U_t
+    OpenCircuitPotentials = 1
+};
+
+/**
+ * Utility to wrap KINSOL for use in get. The solution is passed to the KINSOL callbacks rather than kept in the
+ * model, so the open-circuit solve can nest voltage clamp solves of the same model.
+ */
+int solveOneVariable(GeneralModel* model, PotentialSolution solution, double minimumValue, double maximumValue);
 
 #endif /* KINSOL_HPP_ */
@@ -0,0 +1,58 @@
+#include <iostream>
+#include <mutex>
+#include <cstdlib>
+
+#include "logging.hpp"
+
+std::atomic<int> _logLevel_(LogInfo);
+
+static std::mutex logMutex;
+static std::ostream* logStream = &std::cout;
+
+void setLogLevel(LogLevel level)
+{
+    _logLevel_ = level;
+}
+
+LogLevel logLevel()
+{
+    return LogLevel(_logLevel_.load());
+}
+
+int parseLogLevel(const std::string& name, LogLevel& level)
+{
+    static const char* names[] = { "error", "warning", "info", "debug", "trace" };
+    for (int i = LogError; i <= LogTrace; ++i)
+    {
+        if (name == names[i])
+        {
+            level = LogLevel(i);
+            return 0;
+        }
+    }
+    char* end;
+    long value = strtol(name.c_str(), &end, 10);
+    if (name.empty() || (*end != '\0') || (value < LogError) || (value > LogTrace))
+    {
+        std::cerr << "parseLogLevel: invalid log level: " << name << std::endl;
+        return -1;
+    }
+    level = LogLevel(value);
+    return 0;
+}
+
+void setLogStream(std::ostream* os)
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+    logStream = os;
+}
+
+void writeLogMessage(LogLevel level, const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::ostream& os = (level <= LogWarning) ? std::cerr : *logStream;
+    if (level == LogError) os << "Error: ";
+    else if (level == LogWarning) os << "Warning: ";
+    // flush each message so the progress is seen as it happens
+    os << message << std::endl;
+}
@@ -0,0 +1,84 @@
+#ifndef LOGGING_HPP
+#define LOGGING_HPP
+
+#include <string>
+#include <sstream>
+#include <atomic>
+
+/**
+ * @brief The levels of the progress messages, in increasing verbosity.
+ */
+enum LogLevel
+{
+    LogError = 0,
+    LogWarning = 1,
+    // the progress of the execution, e.g., the tasks being executed
+    LogInfo = 2,
+    // the details of the execution, e.g., each change applied in each iteration of a repeated task
+    LogDebug = 3,
+    // the internals of the execution, e.g., the variables added to each simulation engine
+    LogTrace = 4
+};
+
+/*
+ * Messages more verbose than this level are removed at compile time, along with the debug diagnostics of the
+ * solvers when it is below LogDebug. Set with the CMake option GET_LOG_MAX_LEVEL.
+ */
+#ifndef GET_LOG_MAX_LEVEL
+#define GET_LOG_MAX_LEVEL 4
+#endif
+
+/**
+ * @brief Set the most verbose level of the messages that are written, e.g., LogWarning for a quiet run. The default
+ * is LogInfo.
+ */
+void setLogLevel(LogLevel level);
+LogLevel logLevel();
+
+/**
+ * @brief Parse a log level given by name (error, warning, info, debug or trace) or number.
+ * @return zero on success.
+ */
+int parseLogLevel(const std::string& name, LogLevel& level);
+
+/**
+ * @brief Set the stream the messages are written to, std::cout by default. The stream must outlive the logging.
+ */
+void setLogStream(std::ostream* os);
+
+/**
+ * @brief Write a complete message as one line, messages from concurrent threads are not interleaved.
+ */
+void writeLogMessage(LogLevel level, const std::string& message);
+
+// the runtime log level, only for the inline check below
+extern std::atomic<int> _logLevel_;
+
+inline bool logEnabled(LogLevel level)
+{
+    return (level <= GET_LOG_MAX_LEVEL) && (level <= _logLevel_.load(std::memory_order_relaxed));
+}
+
+/**
+ * @brief Log a message built with stream insertions, e.g., GET_LOG(LogDebug, "value: " << value). The message is
+ * only formatted if its level is enabled, and is removed at compile time if the level is above GET_LOG_MAX_LEVEL.
+ */
+#define GET_LOG(level, message) \
+    do \
+    { \
+        if (logEnabled(level)) \
+        { \
+            std::ostringstream logMessage_; \
+            logMessage_ << message; \
+            writeLogMessage(level, logMessage_.str()); \
+        } \
+    } while (0)
+
+/**
+ * @brief Whether the diagnostics of the given simulation context above the given debug level are written. Always
+ * false, so the diagnostics are removed at compile time, if GET_LOG_MAX_LEVEL is below LogDebug.
+ */
+#define GET_CONTEXT_DEBUG(context, threshold) \
+    ((GET_LOG_MAX_LEVEL >= LogDebug) && ((context).debugLevel > (threshold)))
+
+#endif // LOGGING_HPP
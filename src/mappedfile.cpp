@@ -0,0 +1,82 @@
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#ifndef _MSC_VER
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+MappedFile::MappedFile() : mData(""), mSize(0), mMapping(NULL), mMappingSize(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+#ifndef _MSC_VER
+    if (mMapping) munmap(mMapping, mMappingSize);
+#endif
+    mMapping = NULL;
+    mMappingSize = 0;
+    mBuffer.clear();
+    mData = "";
+    mSize = 0;
+}
+
+int MappedFile::open(const std::string& path)
+{
+    close();
+#ifndef _MSC_VER
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "MappedFile::open: unable to open the file: " << path << std::endl;
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        std::cerr << "MappedFile::open: unable to get the size of the file: " << path << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    if ((size > 0) && (pageSize > 0) && ((size % pageSize) != 0))
+    {
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED)
+        {
+            // the parsers read straight through the document
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            ::close(fd);
+            mMapping = mapping;
+            mMappingSize = size;
+            mData = static_cast<const char*>(mapping);
+            mSize = size;
+            return 0;
+        }
+    }
+    ::close(fd);
+#endif
+    std::ifstream is(path.c_str(), std::ios::binary);
+    if (!is)
+    {
+        std::cerr << "MappedFile::open: unable to read the file: " << path << std::endl;
+        return -2;
+    }
+    mBuffer.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    mData = mBuffer.c_str();
+    mSize = mBuffer.size();
+    return 0;
+}
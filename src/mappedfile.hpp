@@ -0,0 +1,43 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+
+/**
+ * @brief A read-only memory mapping of a local file.
+ *
+ * The content is always followed by a NUL character so that it can be handed directly to parsers expecting a C
+ * string. The file is mapped whenever the page holding its last byte has room for the NUL (the rest of the page
+ * reads as zeros); otherwise (a file that exactly fills its last page, or a platform without mmap) the content is
+ * read into a buffer instead.
+ */
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    /**
+     * @brief Map the given file, replacing any previous mapping.
+     * @param path The path of the file.
+     * @return zero on success.
+     */
+    int open(const std::string& path);
+
+    void close();
+
+    const char* data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* mData;
+    size_t mSize;
+    void* mMapping;
+    size_t mMappingSize;
+    std::string mBuffer;
+};
+
+#endif // MAPPEDFILE_HPP
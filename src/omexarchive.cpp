@@ -0,0 +1,439 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <zlib.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+#ifndef _MSC_VER
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "omexarchive.hpp"
+
+#define ZIP_LOCAL_HEADER_SIGNATURE 0x04034b50
+#define ZIP_CENTRAL_HEADER_SIGNATURE 0x02014b50
+#define ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE 0x06054b50
+#define ZIP_STORED 0
+#define ZIP_DEFLATED 8
+// the amount inflated at a time
+#define OMEX_INFLATE_CHUNK 65536
+
+class OmexEntry
+{
+public:
+    uint16_t flags;
+    uint16_t method;
+    uint32_t crc;
+    uint32_t compressedSize;
+    uint32_t size;
+    uint32_t localHeaderOffset;
+};
+
+/*
+ * The archives that are currently open, so that omex:// URLs can be resolved.
+ */
+static std::map<int, OmexArchive*> openArchives;
+static int nextArchiveId = 0;
+static std::mutex openArchivesMutex;
+
+static uint16_t read16(const unsigned char* p)
+{
+    return uint16_t(p[0]) | (uint16_t(p[1]) << 8);
+}
+
+static uint32_t read32(const unsigned char* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+static std::string normaliseLocation(const std::string& location)
+{
+    std::string l(location);
+    while ((l.compare(0, 2, "./") == 0) || (l.compare(0, 1, "/") == 0)) l.erase(0, (l[0] == '/') ? 1 : 2);
+    return l;
+}
+
+/*
+ * Check that the (normalised) location of an entry stays within the directory it is extracted to, i.e., it is not
+ * absolute (nor a drive path) and has no ".." segments. Backslashes are treated as separators too, as on Windows.
+ */
+static bool isContainedLocation(const std::string& location)
+{
+    if (location.empty() || (location[0] == '/') || (location[0] == '\\')) return false;
+    if (location.find(':') != std::string::npos) return false;
+    size_t start = 0;
+    while (start <= location.size())
+    {
+        size_t end = location.find_first_of("/\\", start);
+        if (end == std::string::npos) end = location.size();
+        if (location.compare(start, end - start, "..") == 0) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+OmexArchive::OmexArchive() : mId(-1)
+{
+}
+
+OmexArchive::~OmexArchive()
+{
+    close();
+}
+
+void OmexArchive::close()
+{
+    if (mId >= 0)
+    {
+        std::lock_guard<std::mutex> lock(openArchivesMutex);
+        openArchives.erase(mId);
+        mId = -1;
+    }
+    // directories were recorded before the files in them, and remove deletes (empty) directories too
+    for (auto f = mScratchFiles.rbegin(); f != mScratchFiles.rend(); ++f) std::remove(f->c_str());
+    mScratchFiles.clear();
+    mScratchDirectory.clear();
+    for (auto& e: mEntries) delete e.second;
+    mEntries.clear();
+    mContents.clear();
+    mMaster.clear();
+    mFile.close();
+}
+
+int OmexArchive::open(const std::string& path)
+{
+    close();
+    mPath = path;
+    if (mFile.open(path) != 0) return -1;
+    if (readCentralDirectory() != 0)
+    {
+        std::cerr << "OmexArchive::open: unable to read the archive: " << path << std::endl;
+        close();
+        return -2;
+    }
+    if (readManifest() != 0)
+    {
+        std::cerr << "OmexArchive::open: unable to read the manifest of the archive: " << path << std::endl;
+        close();
+        return -3;
+    }
+    std::lock_guard<std::mutex> lock(openArchivesMutex);
+    mId = nextArchiveId++;
+    openArchives[mId] = this;
+    return 0;
+}
+
+int OmexArchive::readCentralDirectory()
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(mFile.data());
+    size_t size = mFile.size();
+    if (size < 22) return -1;
+    // the end of central directory record is followed by a comment of up to 64k
+    size_t end = size - 22;
+    size_t limit = (end > 65535) ? end - 65535 : 0;
+    while (read32(data + end) != ZIP_END_OF_CENTRAL_DIRECTORY_SIGNATURE)
+    {
+        if (end == limit) return -2;
+        --end;
+    }
+    uint16_t numberOfEntries = read16(data + end + 10);
+    uint32_t directorySize = read32(data + end + 12);
+    uint32_t directoryOffset = read32(data + end + 16);
+    if ((numberOfEntries == 0xffff) || (directoryOffset == 0xffffffff))
+    {
+        std::cerr << "OmexArchive: ZIP64 archives are not supported" << std::endl;
+        return -3;
+    }
+    if ((size_t(directoryOffset) + directorySize) > end) return -4;
+    size_t p = directoryOffset;
+    for (int i = 0; i < numberOfEntries; ++i)
+    {
+        if ((p + 46 > end) || (read32(data + p) != ZIP_CENTRAL_HEADER_SIGNATURE)) return -5;
+        uint16_t nameLength = read16(data + p + 28);
+        uint16_t extraLength = read16(data + p + 30);
+        uint16_t commentLength = read16(data + p + 32);
+        if (p + 46 + nameLength > end) return -5;
+        OmexEntry* entry = new OmexEntry();
+        entry->flags = read16(data + p + 8);
+        entry->method = read16(data + p + 10);
+        entry->crc = read32(data + p + 16);
+        entry->compressedSize = read32(data + p + 20);
+        entry->size = read32(data + p + 24);
+        entry->localHeaderOffset = read32(data + p + 42);
+        std::string name(reinterpret_cast<const char*>(data + p + 46), nameLength);
+        if (mEntries.count(name)) delete mEntries[name];
+        mEntries[name] = entry;
+        p += 46 + nameLength + extraLength + commentLength;
+    }
+    return 0;
+}
+
+int OmexArchive::readManifest()
+{
+    std::string manifest;
+    if (read("manifest.xml", manifest) != 0) return -1;
+    xmlDocPtr doc = xmlReadMemory(manifest.data(), manifest.size(), "manifest.xml", NULL, XML_PARSE_NONET);
+    if (!doc) return -2;
+    xmlNodePtr root = xmlDocGetRootElement(doc);
+    for (xmlNodePtr n = root ? root->children : NULL; n; n = n->next)
+    {
+        if ((n->type != XML_ELEMENT_NODE) || !xmlStrEqual(n->name, BAD_CAST "content")) continue;
+        xmlChar* location = xmlGetProp(n, BAD_CAST "location");
+        xmlChar* format = xmlGetProp(n, BAD_CAST "format");
+        xmlChar* master = xmlGetProp(n, BAD_CAST "master");
+        if (location)
+        {
+            std::string l = normaliseLocation((char*)location);
+            mContents.push_back(std::make_pair(l, format ? std::string((char*)format) : std::string()));
+            if (master && xmlStrEqual(master, BAD_CAST "true")) mMaster = l;
+        }
+        if (location) xmlFree(location);
+        if (format) xmlFree(format);
+        if (master) xmlFree(master);
+    }
+    xmlFreeDoc(doc);
+    return 0;
+}
+
+bool OmexArchive::hasEntry(const std::string& location) const
+{
+    return mEntries.count(normaliseLocation(location)) > 0;
+}
+
+int OmexArchive::read(const std::string& location, std::string& content) const
+{
+    auto i = mEntries.find(normaliseLocation(location));
+    if (i == mEntries.end())
+    {
+        std::cerr << "OmexArchive::read: no entry " << location << " in the archive: " << mPath << std::endl;
+        return -1;
+    }
+    const OmexEntry& entry = *(i->second);
+    if (entry.flags & 0x1)
+    {
+        std::cerr << "OmexArchive::read: encrypted entries are not supported: " << location << std::endl;
+        return -2;
+    }
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(mFile.data());
+    size_t offset = entry.localHeaderOffset;
+    if ((offset + 30 > mFile.size()) || (read32(data + offset) != ZIP_LOCAL_HEADER_SIGNATURE)) return -3;
+    offset += 30 + read16(data + offset + 26) + read16(data + offset + 28);
+    if (offset + entry.compressedSize > mFile.size()) return -3;
+    content.clear();
+    if (entry.method == ZIP_STORED)
+    {
+        // the size is within the archive, checked above
+        if (entry.compressedSize != entry.size) return -3;
+        content.assign(reinterpret_cast<const char*>(data + offset), entry.size);
+    }
+    else if (entry.method == ZIP_DEFLATED)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        // negative window bits for the raw deflate data of ZIP entries
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return -4;
+        stream.next_in = const_cast<Bytef*>(data + offset);
+        stream.avail_in = entry.compressedSize;
+        /*
+         * The size in the header can't be trusted to allocate the content up front, so the content grows as it is
+         * inflated, and inflating stops as soon as it is larger than the header says.
+         */
+        std::vector<char> buffer(OMEX_INFLATE_CHUNK);
+        int status = Z_OK;
+        while ((status == Z_OK) && (content.size() <= entry.size))
+        {
+            stream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+            stream.avail_out = buffer.size();
+            status = inflate(&stream, Z_NO_FLUSH);
+            content.append(&buffer[0], buffer.size() - stream.avail_out);
+            // no more input and no more output, so the data is truncated
+            if ((status == Z_OK) && (stream.avail_in == 0) && (stream.avail_out == buffer.size())) break;
+        }
+        inflateEnd(&stream);
+        if ((status != Z_STREAM_END) || (content.size() != entry.size))
+        {
+            std::cerr << "OmexArchive::read: error decompressing the entry: " << location << std::endl;
+            content.clear();
+            return -4;
+        }
+    }
+    else
+    {
+        std::cerr << "OmexArchive::read: unsupported compression method (" << entry.method << ") for the entry: "
+                  << location << std::endl;
+        return -5;
+    }
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(content.data()), content.size());
+    if (crc != entry.crc)
+    {
+        std::cerr << "OmexArchive::read: checksum mismatch for the entry: " << location << std::endl;
+        return -6;
+    }
+    return 0;
+}
+
+std::string OmexArchive::masterSedmlLocation() const
+{
+    if (!mMaster.empty()) return mMaster;
+    for (const auto& c: mContents)
+    {
+        const std::string& format = c.second;
+        if ((format.find("sed-ml") != std::string::npos) || (format.find("sedml") != std::string::npos))
+            return c.first;
+    }
+    return "";
+}
+
+std::string OmexArchive::url(const std::string& location) const
+{
+    std::ostringstream url;
+    url << "omex://" << mId << "/" << normaliseLocation(location);
+    return url.str();
+}
+
+int OmexArchive::extract(const std::string& location)
+{
+    std::string l = normaliseLocation(location);
+    if (!isContainedLocation(l))
+    {
+        std::cerr << "OmexArchive::extract: refusing to extract an entry outside the scratch directory: "
+                  << location << std::endl;
+        return -4;
+    }
+    std::string content;
+    if (read(location, content) != 0) return -1;
+    // create any directories in the location
+    for (size_t p = l.find('/'); p != std::string::npos; p = l.find('/', p + 1))
+    {
+        std::string d = mScratchDirectory + "/" + l.substr(0, p);
+#ifndef _MSC_VER
+        if (mkdir(d.c_str(), 0700) == 0) mScratchFiles.push_back(d);
+#endif
+    }
+    std::string path = mScratchDirectory + "/" + l;
+#ifndef _MSC_VER
+    // and make sure nothing already in the scratch directory (e.g., a link) takes the entry somewhere else
+    char* directory = realpath(path.substr(0, path.rfind('/')).c_str(), NULL);
+    char* scratch = realpath(mScratchDirectory.c_str(), NULL);
+    bool contained = directory && scratch && ((std::string(directory) + "/").compare(0, strlen(scratch) + 1,
+                                                                                      std::string(scratch) + "/") == 0);
+    free(directory);
+    free(scratch);
+    if (!contained)
+    {
+        std::cerr << "OmexArchive::extract: refusing to extract an entry outside the scratch directory: "
+                  << location << std::endl;
+        return -4;
+    }
+#endif
+    std::ofstream os(path.c_str(), std::ios::binary);
+    if (!os) return -2;
+    mScratchFiles.push_back(path);
+    os.write(content.data(), content.size());
+    return os ? 0 : -3;
+}
+
+std::string OmexArchive::localUrl(const std::string& location)
+{
+    std::lock_guard<std::mutex> lock(mScratchMutex);
+    if (mScratchDirectory.empty())
+    {
+#ifndef _MSC_VER
+        const char* tmp = getenv("TMPDIR");
+        std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-omex-XXXXXX";
+        std::vector<char> name(pattern.begin(), pattern.end());
+        name.push_back('\0');
+        if (!mkdtemp(&name[0]))
+        {
+            std::cerr << "OmexArchive::localUrl: unable to create a scratch directory" << std::endl;
+            return "";
+        }
+        mScratchDirectory = &name[0];
+        mScratchFiles.push_back(mScratchDirectory);
+#else
+        std::cerr << "OmexArchive::localUrl: not supported on this platform" << std::endl;
+        return "";
+#endif
+        // the models may import any of the CellML documents in the archive
+        for (const auto& c: mContents)
+        {
+            if ((c.second.find("cellml") != std::string::npos) && hasEntry(c.first)) extract(c.first);
+        }
+    }
+    std::string l = normaliseLocation(location);
+    if (!isContainedLocation(l))
+    {
+        std::cerr << "OmexArchive::localUrl: the location is outside the archive: " << location << std::endl;
+        return "";
+    }
+    std::string path = mScratchDirectory + "/" + l;
+    std::ifstream existing(path.c_str());
+    if (!existing && (extract(location) != 0)) return "";
+    return "file://" + path;
+}
+
+/*
+ * Apply the given operation to the archive and location for an omex:// URL. The registry stays locked while the
+ * operation runs, so the archive can't be closed (and destroyed) while it is in use.
+ * @return false if the archive for the URL is not open.
+ */
+static bool withOmexArchive(const std::string& url,
+                            const std::function<void(OmexArchive&, const std::string&)>& operation)
+{
+    if (url.compare(0, 7, "omex://") != 0) return false;
+    size_t slash = url.find('/', 7);
+    if (slash == std::string::npos) return false;
+    int id = atoi(url.substr(7, slash - 7).c_str());
+    std::string location = url.substr(slash + 1);
+    std::lock_guard<std::mutex> lock(openArchivesMutex);
+    auto i = openArchives.find(id);
+    if (i == openArchives.end()) return false;
+    operation(*(i->second), location);
+    return true;
+}
+
+bool isOmexUrl(const std::string& url)
+{
+    return url.compare(0, 7, "omex://") == 0;
+}
+
+int getOmexUrlContent(const std::string& url, std::string& content)
+{
+    int status = -1;
+    if (!withOmexArchive(url, [&](OmexArchive& archive, const std::string& location) {
+            status = archive.read(location, content);
+        }))
+    {
+        std::cerr << "The archive for this URL is not open: " << url << std::endl;
+    }
+    return status;
+}
+
+std::string omexLocalUrl(const std::string& url)
+{
+    std::string localUrl = url;
+    withOmexArchive(url, [&](OmexArchive& archive, const std::string& location) {
+        localUrl = archive.localUrl(location);
+    });
+    return localUrl;
+}
+
+bool isZipFile(const std::string& path)
+{
+    std::ifstream is(path.c_str(), std::ios::binary);
+    unsigned char signature[4];
+    if (!is.read(reinterpret_cast<char*>(signature), 4)) return false;
+    return read32(signature) == ZIP_LOCAL_HEADER_SIGNATURE;
+}
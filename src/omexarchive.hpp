@@ -0,0 +1,108 @@
+#ifndef OMEXARCHIVE_HPP
+#define OMEXARCHIVE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+#include "mappedfile.hpp"
+
+class OmexEntry;
+
+/**
+ * @brief A COMBINE/OMEX archive read in place.
+ *
+ * The archive file is memory mapped and only its central directory is read when it is opened; entries are
+ * decompressed with zlib each time they are read. While an archive is open its entries are available to
+ * getUrlContent through URLs of the form omex://<archive id>/<location>, so relative references in the documents
+ * it contains resolve to other entries in the archive with buildAbsoluteUri.
+ *
+ * Only stored and deflated entries are supported, not ZIP64 or encrypted archives.
+ */
+class OmexArchive
+{
+public:
+    OmexArchive();
+    ~OmexArchive();
+
+    /**
+     * @brief Open the archive at the given path and read its manifest.
+     * @return zero on success.
+     */
+    int open(const std::string& path);
+
+    bool hasEntry(const std::string& location) const;
+
+    /**
+     * @brief Decompress an entry of the archive.
+     * @param location The location of the entry in the archive, with or without a leading "./".
+     * @param content On success, the content of the entry.
+     * @return zero on success.
+     */
+    int read(const std::string& location, std::string& content) const;
+
+    /**
+     * @brief The location of the master SED-ML document given in the manifest, or the first SED-ML document if
+     * none is marked as the master. Empty if there is no SED-ML document in the archive.
+     */
+    std::string masterSedmlLocation() const;
+
+    /**
+     * @brief The URL for the given entry in this archive.
+     */
+    std::string url(const std::string& location) const;
+
+    /**
+     * @brief A file:// URL for the given entry, for tools that can only load models from a URL themselves.
+     *
+     * On first use, the entry and all the CellML entries of the archive (which it may import) are written to a
+     * scratch directory that is removed when the archive is closed.
+     */
+    std::string localUrl(const std::string& location);
+
+    void close();
+
+private:
+    OmexArchive(const OmexArchive&) = delete;
+    OmexArchive& operator=(const OmexArchive&) = delete;
+
+    int readCentralDirectory();
+    int readManifest();
+    int extract(const std::string& location);
+
+    int mId;
+    std::string mPath;
+    MappedFile mFile;
+    std::map<std::string, OmexEntry*> mEntries;
+    // the location and format of each document listed in the manifest, and the master document if there is one
+    std::vector<std::pair<std::string, std::string> > mContents;
+    std::string mMaster;
+    // the scratch directory for localUrl and what has been written to it
+    std::string mScratchDirectory;
+    std::vector<std::string> mScratchFiles;
+    std::mutex mScratchMutex;
+};
+
+/**
+ * @brief Check if the given URL refers to an entry in an open OMEX archive.
+ */
+bool isOmexUrl(const std::string& url);
+
+/**
+ * @brief Read the entry for the given omex:// URL.
+ * @return zero on success.
+ */
+int getOmexUrlContent(const std::string& url, std::string& content);
+
+/**
+ * @brief Map an omex:// URL to a file:// URL, see OmexArchive::localUrl. Other URLs are returned unchanged.
+ */
+std::string omexLocalUrl(const std::string& url);
+
+/**
+ * @brief Check if the given file is a ZIP archive (i.e., starts with a local file header).
+ */
+bool isZipFile(const std::string& path);
+
+#endif // OMEXARCHIVE_HPP
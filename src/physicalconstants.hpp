@@ -0,0 +1,9 @@
+#ifndef PHYSICALCONSTANTS_HPP
+#define PHYSICALCONSTANTS_HPP
+
+// Physical constants
+static const double F = 9.6485341e4; // nC.nmol^-1
+static const double R = 8.314472e3;  // pJ.nmol^-1.K^-1
+static const double T = 310.0;       // K (value?)
+
+#endif // PHYSICALCONSTANTS_HPP
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+#include "GeneralModel.hpp"
+#include "cvodes.hpp"
+#include "protocol.hpp"
+
+// tolerance used when comparing times against events and the output grid
+#define TIME_EPSILON 1.0e-9
+
+static bool eventBefore(const ProtocolEvent& a, const ProtocolEvent& b)
+{
+    return a.time < b.time;
+}
+
+/*
+ * Copy the integrator state into the model and evaluate the model at that state, so that the membrane potentials
+ * and fluxes correspond to the state being sampled rather than the last trial state used by the integrator.
+ */
+static int updateModel(GeneralModel& model, Cvodes& cvodes, double t)
+{
+    model.V = Ith(cvodes.y, 1);
+    for (unsigned int i = 0; i < model.mC_c.size(); ++i) *(model.mC_c[i]) = Ith(cvodes.y, i+2);
+    int errorFlag = 0;
+    model.calculateRHS(t, errorFlag);
+    return errorFlag;
+}
+
+void Protocol::addEvent(double time, const std::string& description,
+                        const std::function<int(GeneralModel&)>& action)
+{
+    ProtocolEvent event;
+    event.time = time;
+    event.description = description;
+    event.action = action;
+    // keep the schedule sorted, after any existing events at the same time
+    mEvents.insert(std::upper_bound(mEvents.begin(), mEvents.end(), event, eventBefore), event);
+}
+
+void Protocol::setSampleObserver(const std::function<void(double)>& observer)
+{
+    mSampleObserver = observer;
+}
+
+int Protocol::run(GeneralModel& model, Cvodes& cvodes, double& t, double endTime, double outputInterval,
+                  TrajectoryWriter& output)
+{
+    if (outputInterval <= 0.0)
+    {
+        std::cerr << "Protocol::run: the output interval must be positive" << std::endl;
+        return -1;
+    }
+    // skip any events before the current time
+    std::vector<ProtocolEvent>::const_iterator event = mEvents.begin();
+    while ((event != mEvents.end()) && (event->time < (t - TIME_EPSILON))) ++event;
+    // the next point on the output grid
+    long int nextOutput = (long int)floor(t / outputInterval + TIME_EPSILON) + 1;
+
+    while (true)
+    {
+        // apply the events at the current time
+        bool discontinuity = false;
+        while ((event != mEvents.end()) && (event->time <= (t + TIME_EPSILON)) && (t < (endTime - TIME_EPSILON)))
+        {
+            if (!discontinuity && (updateModel(model, cvodes, t) != 0))
+            {
+                std::cerr << "Protocol::run: unable to evaluate the model before the event: " << event->description
+                          << std::endl;
+                return 1;
+            }
+            if (event->action(model) != 0)
+            {
+                std::cerr << "Protocol::run: failed to apply the event at t = " << event->time << ": "
+                          << event->description << std::endl;
+                return 2;
+            }
+            discontinuity = true;
+            ++event;
+        }
+        if (discontinuity)
+        {
+            // the events may have changed the state as well as the parameters
+            Ith(cvodes.y, 1) = model.V;
+            for (unsigned int i = 0; i < model.mC_c.size(); ++i) Ith(cvodes.y, i+2) = *(model.mC_c[i]);
+            if (cvodes.reInitialise(t) != 0) return 3;
+        }
+        if (t >= (endTime - TIME_EPSILON)) break;
+
+        // integrate through to the next discontinuity, sampling the output grid on the way
+        double segmentEnd = endTime;
+        if ((event != mEvents.end()) && (event->time < segmentEnd)) segmentEnd = event->time;
+        if (cvodes.setStopTime(segmentEnd) != 0) return 4;
+        while (true)
+        {
+            double outputTime = nextOutput * outputInterval;
+            if (outputTime > (segmentEnd + TIME_EPSILON)) break;
+            double tout = (outputTime > (segmentEnd - TIME_EPSILON)) ? segmentEnd : outputTime;
+            if (cvodes.integrate(t, tout) != 0)
+            {
+                std::cerr << "Protocol::run: integration failed at t = " << t << std::endl;
+                return 5;
+            }
+            if (updateModel(model, cvodes, t) != 0) return 6;
+            model.printState(output, t);
+            if (mSampleObserver) mSampleObserver(t);
+            ++nextOutput;
+        }
+        if (t < (segmentEnd - TIME_EPSILON))
+        {
+            if (cvodes.integrate(t, segmentEnd) != 0)
+            {
+                std::cerr << "Protocol::run: integration failed at t = " << t << std::endl;
+                return 5;
+            }
+        }
+        // avoid accumulating round-off in the event times
+        t = segmentEnd;
+    }
+    if (updateModel(model, cvodes, t) != 0) return 6;
+    return 0;
+}
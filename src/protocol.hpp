@@ -0,0 +1,77 @@
+/*
+ * protocol.hpp
+ *
+ * Experimental protocols for GeneralModel described as a schedule of discontinuities.
+ */
+
+#ifndef PROTOCOL_HPP_
+#define PROTOCOL_HPP_
+
+#include <vector>
+#include <string>
+#include <functional>
+
+class GeneralModel;
+class Cvodes;
+class TrajectoryWriter;
+
+/**
+ * A discontinuity in a protocol: a mode switch, bath change, parameter change, etc.
+ */
+class ProtocolEvent
+{
+public:
+    // the time at which the event occurs
+    double time;
+    // a short description of the event for messages
+    std::string description;
+    // the action to apply to the model at the event time, returning zero on success
+    std::function<int(GeneralModel&)> action;
+};
+
+/**
+ * @brief A protocol is a time-ordered schedule of events applied to a GeneralModel during integration.
+ *
+ * Between events the model is integrated at the natural step size of the integrator, with the integrator stop
+ * time set to the next event so that it never steps over a discontinuity. The integrator is only re-initialised
+ * at the events. The model state is sampled onto a fixed output grid independently of both the integrator steps
+ * and the events.
+ */
+class Protocol
+{
+public:
+    /**
+     * @brief Add an event to this protocol. Events at the same time are applied in the order they are added.
+     * @param time The time of the event.
+     * @param description A short description of the event.
+     * @param action The change to apply to the model.
+     */
+    void addEvent(double time, const std::string& description, const std::function<int(GeneralModel&)>& action);
+
+    /**
+     * @brief Run this protocol from t to endTime.
+     * Events scheduled in [t, endTime) are applied, with those at t applied before integration starts. The
+     * model state is written to output at every multiple of outputInterval in (t, endTime].
+     * @param model The model being simulated.
+     * @param cvodes The integrator, already initialised for the model.
+     * @param t The current time, updated to endTime on success.
+     * @param endTime The time to stop the protocol.
+     * @param outputInterval The interval of the output grid.
+     * @param output The trajectory to write the sampled model state to.
+     * @return zero on success.
+     */
+    int run(GeneralModel& model, Cvodes& cvodes, double& t, double endTime, double outputInterval,
+            TrajectoryWriter& output);
+
+    /**
+     * @brief Set a function to be called each time the model state is sampled, e.g., to write additional outputs.
+     * @param observer The function to call with the sample time.
+     */
+    void setSampleObserver(const std::function<void(double)>& observer);
+
+private:
+    std::vector<ProtocolEvent> mEvents;
+    std::function<void(double)> mSampleObserver;
+};
+
+#endif /* PROTOCOL_HPP_ */
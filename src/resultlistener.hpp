@@ -0,0 +1,34 @@
+#ifndef RESULTLISTENER_HPP
+#define RESULTLISTENER_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * @brief Receives the rows of the reports' trajectories as they are stored while the tasks are executed.
+ *
+ * Each execution of a task (e.g., each repeat of a repeated task) is a separate stream of rows. The methods are
+ * called from the thread executing the tasks.
+ */
+class ResultListener
+{
+public:
+    virtual ~ResultListener()
+    {
+    }
+
+    /**
+     * @brief Start a new stream of rows.
+     * @param name A name for the stream, the ID of the task.
+     * @param columnNames The names of the values in each row.
+     * @return the ID of the stream.
+     */
+    virtual uint32_t beginStream(const std::string& name, const std::vector<std::string>& columnNames) = 0;
+
+    virtual void publishRow(uint32_t stream, double time, const std::vector<double>& values) = 0;
+
+    virtual void endStream(uint32_t stream) = 0;
+};
+
+#endif // RESULTLISTENER_HPP
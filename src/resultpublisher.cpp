@@ -0,0 +1,296 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include "resultpublisher.hpp"
+
+// how long the background thread waits for clients before checking for new frames, in milliseconds
+#define PUBLISHER_POLL_INTERVAL 20
+// how long a client may block the background thread before it is disconnected, in seconds
+#define PUBLISHER_SEND_TIMEOUT 1
+
+#ifdef MSG_NOSIGNAL
+#define PUBLISHER_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define PUBLISHER_SEND_FLAGS 0
+#endif
+
+static void appendUint32(std::string& frame, uint32_t value)
+{
+    frame.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendString(std::string& frame, const std::string& s)
+{
+    appendUint32(frame, s.size());
+    frame.append(s);
+}
+
+// start a frame, leaving space for its length
+static void startFrame(std::string& frame, ResultPublisher::FrameType type)
+{
+    frame.assign(sizeof(uint32_t), '\0');
+    frame.push_back(char(type));
+}
+
+static void finishFrame(std::string& frame)
+{
+    uint32_t length = frame.size() - sizeof(uint32_t);
+    memcpy(&frame[0], &length, sizeof(length));
+}
+
+ResultPublisher::ResultPublisher(size_t capacity) : mHead(0), mTail(0), mNextStream(1), mDropped(0),
+    mTotalDropped(0), mListener(-1), mClosing(false)
+{
+    size_t size = 1024;
+    while (size < capacity) size <<= 1;
+    mRing.resize(size);
+    mMask = size - 1;
+}
+
+ResultPublisher::~ResultPublisher()
+{
+    close();
+}
+
+int ResultPublisher::open(const std::string& socketPath)
+{
+    close();
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "ResultPublisher::open: the socket path is too long: " << socketPath << std::endl;
+        return -1;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    mListener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (mListener < 0)
+    {
+        std::cerr << "ResultPublisher::open: unable to create a socket: " << strerror(errno) << std::endl;
+        return -2;
+    }
+    unlink(socketPath.c_str());
+    if ((bind(mListener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) ||
+        (listen(mListener, 8) != 0))
+    {
+        std::cerr << "ResultPublisher::open: unable to listen on: " << socketPath << ": " << strerror(errno)
+                  << std::endl;
+        ::close(mListener);
+        mListener = -1;
+        return -3;
+    }
+    mSocketPath = socketPath;
+    mHead = 0;
+    mTail = 0;
+    mDropped = 0;
+    mTotalDropped = 0;
+    mHeld.clear();
+    mClosing = false;
+    mThread = std::thread(&ResultPublisher::run, this);
+    return 0;
+}
+
+void ResultPublisher::close()
+{
+    if (!mThread.joinable()) return;
+    // the background thread always empties the ring buffer, so the held frames will fit
+    while (!pushHeld()) std::this_thread::yield();
+    mClosing = true;
+    mThread.join();
+    for (int client: mClients) ::close(client);
+    mClients.clear();
+    mOpenStreams.clear();
+    ::close(mListener);
+    mListener = -1;
+    unlink(mSocketPath.c_str());
+    if (mTotalDropped > 0)
+        std::cerr << "ResultPublisher: " << mTotalDropped << " rows were not published as the clients fell behind"
+                  << std::endl;
+}
+
+uint32_t ResultPublisher::beginStream(const std::string& name, const std::vector<std::string>& columnNames)
+{
+    uint32_t stream = mNextStream++;
+    if (!isOpen()) return stream;
+    startFrame(mFrame, Begin);
+    appendUint32(mFrame, stream);
+    appendUint32(mFrame, columnNames.size());
+    appendString(mFrame, name);
+    for (const std::string& column: columnNames) appendString(mFrame, column);
+    finishFrame(mFrame);
+    // the clients can't interpret the rows without this, so hold it until there is room rather than drop it
+    pushControl(mFrame);
+    return stream;
+}
+
+void ResultPublisher::publishRow(uint32_t stream, double time, const std::vector<double>& values)
+{
+    if (!isOpen()) return;
+    // the row can only follow the held frames and the count of the rows dropped before it
+    if (pushHeld() && (mDropped > 0) && push(droppedFrame())) mDropped = 0;
+    startFrame(mFrame, Row);
+    appendUint32(mFrame, stream);
+    mFrame.append(reinterpret_cast<const char*>(&time), sizeof(time));
+    mFrame.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(double));
+    finishFrame(mFrame);
+    if (!mHeld.empty() || (mDropped > 0) || !push(mFrame))
+    {
+        ++mDropped;
+        ++mTotalDropped;
+    }
+}
+
+void ResultPublisher::endStream(uint32_t stream)
+{
+    if (!isOpen()) return;
+    if (mDropped > 0)
+    {
+        pushControl(droppedFrame());
+        mDropped = 0;
+    }
+    startFrame(mFrame, End);
+    appendUint32(mFrame, stream);
+    finishFrame(mFrame);
+    pushControl(mFrame);
+}
+
+std::string ResultPublisher::droppedFrame()
+{
+    std::string frame;
+    startFrame(frame, Dropped);
+    frame.append(reinterpret_cast<const char*>(&mDropped), sizeof(mDropped));
+    finishFrame(frame);
+    return frame;
+}
+
+void ResultPublisher::pushControl(const std::string& frame)
+{
+    if (frame.size() > mRing.size())
+    {
+        std::cerr << "ResultPublisher: a frame of " << frame.size() << " bytes does not fit in the ring buffer"
+                  << std::endl;
+        return;
+    }
+    if (!pushHeld() || !push(frame)) mHeld.push_back(frame);
+}
+
+bool ResultPublisher::pushHeld()
+{
+    while (!mHeld.empty() && push(mHeld.front())) mHeld.pop_front();
+    return mHeld.empty();
+}
+
+bool ResultPublisher::push(const std::string& frame)
+{
+    size_t head = mHead.load(std::memory_order_relaxed);
+    if ((mRing.size() - (head - mTail.load(std::memory_order_acquire))) < frame.size()) return false;
+    size_t start = head & mMask;
+    size_t first = std::min(frame.size(), mRing.size() - start);
+    memcpy(&mRing[start], frame.data(), first);
+    memcpy(&mRing[0], frame.data() + first, frame.size() - first);
+    mHead.store(head + frame.size(), std::memory_order_release);
+    return true;
+}
+
+size_t ResultPublisher::pop(std::string& frames)
+{
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    size_t size = mHead.load(std::memory_order_acquire) - tail;
+    size_t start = tail & mMask;
+    size_t first = std::min(size, mRing.size() - start);
+    frames.assign(&mRing[start], first);
+    frames.append(&mRing[0], size - first);
+    mTail.store(tail + size, std::memory_order_release);
+    return size;
+}
+
+static bool sendAll(int client, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(client, data, size, PUBLISHER_SEND_FLAGS);
+        if (n <= 0)
+        {
+            if ((n < 0) && (errno == EINTR)) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void ResultPublisher::run()
+{
+    std::string frames;
+    while (true)
+    {
+        bool closing = mClosing;
+        struct pollfd listener;
+        listener.fd = mListener;
+        listener.events = POLLIN;
+        listener.revents = 0;
+        if ((poll(&listener, 1, closing ? 0 : PUBLISHER_POLL_INTERVAL) > 0) && (listener.revents & POLLIN))
+        {
+            int client = accept(mListener, NULL, NULL);
+            if (client >= 0)
+            {
+                struct timeval timeout;
+                timeout.tv_sec = PUBLISHER_SEND_TIMEOUT;
+                timeout.tv_usec = 0;
+                setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+                int on = 1;
+                setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+                bool connected = true;
+                for (const auto& stream: mOpenStreams)
+                    connected = connected && sendAll(client, stream.second.data(), stream.second.size());
+                if (connected) mClients.push_back(client);
+                else ::close(client);
+            }
+        }
+        size_t size = pop(frames);
+        if (size == 0)
+        {
+            if (closing) break;
+            continue;
+        }
+        // keep track of the open streams for clients that connect later
+        for (size_t position = 0; position < size; )
+        {
+            uint32_t length, stream;
+            memcpy(&length, &frames[position], sizeof(length));
+            FrameType type = FrameType(frames[position + sizeof(length)]);
+            if ((type == Begin) || (type == End))
+            {
+                memcpy(&stream, &frames[position + sizeof(length) + 1], sizeof(stream));
+                if (type == Begin) mOpenStreams[stream] = frames.substr(position, sizeof(length) + length);
+                else mOpenStreams.erase(stream);
+            }
+            position += sizeof(length) + length;
+        }
+        for (auto client = mClients.begin(); client != mClients.end(); )
+        {
+            if (sendAll(*client, frames.data(), size)) ++client;
+            else
+            {
+                // disconnected or too slow
+                ::close(*client);
+                client = mClients.erase(client);
+            }
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef RESULTPUBLISHER_HPP
+#define RESULTPUBLISHER_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <stdint.h>
+
+#include "resultlistener.hpp"
+
+/**
+ * @brief Publish result rows as they are produced to monitoring clients on a UNIX domain socket.
+ *
+ * The thread producing the results (e.g., executing a simulation task) only copies each row into a lock-free
+ * single-producer single-consumer ring buffer; a background thread accepts clients and sends them the frames. If
+ * the ring buffer is full the row is dropped rather than waiting, and clients are told how many rows were dropped.
+ * The Begin, End and Dropped frames are never dropped: if there is no room for them they are held by the
+ * publishing thread, in order, until there is, and rows are dropped while any are held. So a client that stops
+ * reading never blocks the publishing thread. Only one thread may publish (and close the publisher).
+ *
+ * Each frame is a uint32 length of the rest of the frame, a uint8 type and then, in native byte order:
+ *  - Begin (1): uint32 stream ID, uint32 number of columns, then each column name as a uint32 length and its
+ *    characters; the stream name is sent the same way before the column names.
+ *  - Row (2): uint32 stream ID, double time and a double for each column.
+ *  - End (3): uint32 stream ID.
+ *  - Dropped (4): uint64 number of rows dropped since the previous frame.
+ * Clients connecting part way through a run are first sent the Begin frames of the streams that are still open.
+ */
+class ResultPublisher : public ResultListener
+{
+public:
+    enum FrameType
+    {
+        Begin = 1,
+        Row = 2,
+        End = 3,
+        Dropped = 4
+    };
+
+    /**
+     * @param capacity The size of the ring buffer in bytes, rounded up to a power of two.
+     */
+    ResultPublisher(size_t capacity = 1 << 22);
+    ~ResultPublisher();
+
+    /**
+     * @brief Create the socket at the given path (replacing any stale socket) and start accepting clients.
+     * @return zero on success.
+     */
+    int open(const std::string& socketPath);
+
+    /**
+     * @brief Send any remaining frames, disconnect the clients and remove the socket. This waits for the background
+     * thread to take any held frames, which it does once it has sent the previous frames or given up on the clients.
+     */
+    void close();
+
+    bool isOpen() const { return mThread.joinable(); }
+
+    /**
+     * @brief Start a new stream of rows, e.g., for one execution of a task.
+     * @param name A name for the stream.
+     * @param columnNames The names of the values in each row.
+     * @return the ID of the stream.
+     */
+    uint32_t beginStream(const std::string& name, const std::vector<std::string>& columnNames);
+
+    void publishRow(uint32_t stream, double time, const std::vector<double>& values);
+
+    void endStream(uint32_t stream);
+
+    unsigned long numberOfDroppedRows() const { return mTotalDropped; }
+
+private:
+    ResultPublisher(const ResultPublisher&) = delete;
+    ResultPublisher& operator=(const ResultPublisher&) = delete;
+
+    bool push(const std::string& frame);
+    void pushControl(const std::string& frame);
+    bool pushHeld();
+    std::string droppedFrame();
+    size_t pop(std::string& frames);
+    void run();
+
+    // the ring buffer, the producer only writes mHead and the consumer only writes mTail
+    std::vector<char> mRing;
+    size_t mMask;
+    std::atomic<size_t> mHead;
+    std::atomic<size_t> mTail;
+    // owned by the producer
+    uint32_t mNextStream;
+    uint64_t mDropped;
+    std::atomic<unsigned long> mTotalDropped;
+    std::string mFrame;
+    // control frames waiting for room in the ring buffer
+    std::deque<std::string> mHeld;
+    // owned by the consumer: the Begin frames of open streams, for clients that connect later
+    std::map<uint32_t, std::string> mOpenStreams;
+    std::vector<int> mClients;
+    int mListener;
+    std::string mSocketPath;
+    std::atomic<bool> mClosing;
+    std::thread mThread;
+};
+
+#endif // RESULTPUBLISHER_HPP
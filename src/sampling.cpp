@@ -0,0 +1,383 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <mutex>
+
+#include "utils.hpp"
+#include "sampling.hpp"
+
+/*
+ * Direction numbers for the Sobol sequence from the new-joe-kuo-6.21201 set: the degree s and coefficients a of
+ * the primitive polynomial and the initial direction numbers m_1..m_s for each dimension after the first.
+ */
+struct SobolPolynomial
+{
+    unsigned int s, a;
+    unsigned int m[7];
+};
+
+static const SobolPolynomial SobolPolynomials[] =
+{
+    { 1,  0, { 1 } },
+    { 2,  1, { 1, 3 } },
+    { 3,  1, { 1, 3, 1 } },
+    { 3,  2, { 1, 1, 1 } },
+    { 4,  1, { 1, 1, 3, 3 } },
+    { 4,  4, { 1, 3, 5, 13 } },
+    { 5,  2, { 1, 1, 5, 5, 17 } },
+    { 5,  4, { 1, 1, 5, 5, 5 } },
+    { 5,  7, { 1, 1, 7, 11, 19 } },
+    { 5, 11, { 1, 1, 5, 1, 1 } },
+    { 5, 13, { 1, 1, 1, 3, 11 } },
+    { 5, 14, { 1, 3, 5, 5, 31 } },
+    { 6,  1, { 1, 3, 3, 9, 7, 49 } },
+    { 6, 13, { 1, 1, 1, 15, 21, 21 } },
+    { 6, 16, { 1, 3, 1, 13, 27, 49 } },
+    { 6, 19, { 1, 1, 1, 15, 7, 5 } },
+    { 6, 22, { 1, 3, 1, 15, 13, 25 } },
+    { 6, 25, { 1, 1, 5, 5, 19, 61 } },
+    { 7,  1, { 1, 3, 7, 11, 23, 15, 103 } },
+    { 7,  4, { 1, 3, 7, 13, 13, 15, 69 } }
+};
+
+#define SOBOL_BITS 32
+
+const unsigned int SobolSequence::maximumDimension = 1 + sizeof(SobolPolynomials) / sizeof(SobolPolynomial);
+
+SobolSequence::SobolSequence(unsigned int dimension) : mDimension(dimension), mIndex(0)
+{
+    if ((dimension < 1) || (dimension > maximumDimension)) return;
+    mDirections.resize(dimension, std::vector<unsigned int>(SOBOL_BITS + 1, 0));
+    // the first dimension is the van der Corput sequence
+    for (unsigned int i = 1; i <= SOBOL_BITS; ++i) mDirections[0][i] = 1u << (SOBOL_BITS - i);
+    for (unsigned int j = 1; j < dimension; ++j)
+    {
+        const SobolPolynomial& p = SobolPolynomials[j-1];
+        std::vector<unsigned int>& v = mDirections[j];
+        for (unsigned int i = 1; (i <= p.s) && (i <= SOBOL_BITS); ++i) v[i] = p.m[i-1] << (SOBOL_BITS - i);
+        for (unsigned int i = p.s + 1; i <= SOBOL_BITS; ++i)
+        {
+            v[i] = v[i-p.s] ^ (v[i-p.s] >> p.s);
+            for (unsigned int k = 1; k < p.s; ++k) v[i] ^= ((p.a >> (p.s - 1 - k)) & 1) * v[i-k];
+        }
+    }
+    mX.assign(dimension, 0);
+}
+
+int SobolSequence::next(std::vector<double>& point)
+{
+    if (mDirections.empty())
+    {
+        std::cerr << "SobolSequence: only dimensions 1 to " << maximumDimension << " are supported" << std::endl;
+        return -1;
+    }
+    if (mIndex >= 0xFFFFFFFFul) return 1;
+    // Gray code ordering, the index of the rightmost zero bit of the current index gives the direction to apply
+    unsigned int c = 1;
+    unsigned long value = mIndex;
+    while (value & 1)
+    {
+        value >>= 1;
+        ++c;
+    }
+    ++mIndex;
+    point.resize(mDimension);
+    for (unsigned int j = 0; j < mDimension; ++j)
+    {
+        mX[j] ^= mDirections[j][c];
+        point[j] = (double)mX[j] / 4294967296.0;
+    }
+    return 0;
+}
+
+/*
+ * The inverse of the standard normal cumulative distribution, using the rational approximation of Acklam refined
+ * with one step of Halley's method.
+ */
+static double inverseNormal(double p)
+{
+    static const double a[6] = { -3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                 1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00 };
+    static const double b[5] = { -5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                 6.680131188771972e+01, -1.328068155288572e+01 };
+    static const double c[6] = { -7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                 -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00 };
+    static const double d[4] = { 7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                 3.754408661907416e+00 };
+    const double pLow = 0.02425;
+    double x;
+    if (p < pLow)
+    {
+        double q = sqrt(-2.0 * log(p));
+        x = (((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.0);
+    }
+    else if (p <= 1.0 - pLow)
+    {
+        double q = p - 0.5;
+        double r = q * q;
+        x = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q
+                / (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1.0);
+    }
+    else
+    {
+        double q = sqrt(-2.0 * log(1.0 - p));
+        x = -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5]) / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1.0);
+    }
+    double e = 0.5 * erfc(-x / sqrt(2.0)) - p;
+    double u = e * sqrt(2.0 * M_PI) * exp(x * x / 2.0);
+    return x - u / (1.0 + x * u / 2.0);
+}
+
+double SamplingInput::quantile(double u) const
+{
+    switch (distribution)
+    {
+    case Uniform:
+        return a + u * (b - a);
+    case LogUniform:
+        return exp(log(a) + u * (log(b) - log(a)));
+    case Normal:
+        return a + b * inverseNormal(u);
+    case LogNormal:
+        return exp(a + b * inverseNormal(u));
+    }
+    return a;
+}
+
+/*
+ * A uniform random number in (0, 1), excluding zero so that all points can be mapped through the inverse
+ * cumulative distributions.
+ */
+static double uniform(std::mt19937_64& generator)
+{
+    std::uniform_real_distribution<double> distribution(0.0, 1.0);
+    double u;
+    do u = distribution(generator);
+    while (u <= 0.0);
+    return u;
+}
+
+int generateDesign(SamplingOptions::Design design, unsigned int numberOfPoints, unsigned int dimension,
+                   unsigned long seed, std::vector<std::vector<double> >& points)
+{
+    points.assign(numberOfPoints, std::vector<double>(dimension));
+    std::mt19937_64 generator(seed);
+    if (design == SamplingOptions::MonteCarlo)
+    {
+        for (unsigned int i = 0; i < numberOfPoints; ++i)
+            for (unsigned int j = 0; j < dimension; ++j) points[i][j] = uniform(generator);
+    }
+    else if (design == SamplingOptions::LatinHypercube)
+    {
+        // one point in each of the numberOfPoints equal probability strata of each dimension
+        std::vector<unsigned int> strata(numberOfPoints);
+        for (unsigned int j = 0; j < dimension; ++j)
+        {
+            for (unsigned int i = 0; i < numberOfPoints; ++i) strata[i] = i;
+            std::shuffle(strata.begin(), strata.end(), generator);
+            for (unsigned int i = 0; i < numberOfPoints; ++i)
+                points[i][j] = (strata[i] + uniform(generator)) / numberOfPoints;
+        }
+    }
+    else if (design == SamplingOptions::Sobol)
+    {
+        SobolSequence sequence(dimension);
+        for (unsigned int i = 0; i < numberOfPoints; ++i)
+        {
+            if (sequence.next(points[i]) != 0) return -1;
+        }
+    }
+    else
+    {
+        std::cerr << "generateDesign: unknown design" << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+void EnsembleStatistics::write(std::ostream& os, const std::vector<std::string>& outputNames) const
+{
+    os << "# time";
+    for (unsigned int k = 0; k < statistics.size(); ++k)
+    {
+        const std::string& name = outputNames[k];
+        os << "\t" << name << ":count\t" << name << ":mean\t" << name << ":sd\t" << name << ":min\t" << name
+           << ":max";
+        if (!statistics[k].empty())
+        {
+            for (unsigned int i = 0; i < statistics[k][0].numberOfQuantiles(); ++i)
+                os << "\t" << name << ":q" << statistics[k][0].quantileProbability(i);
+        }
+    }
+    os << std::endl;
+    for (unsigned int j = 0; j < times.size(); ++j)
+    {
+        os << times[j];
+        for (unsigned int k = 0; k < statistics.size(); ++k)
+        {
+            const RunningStatistics& s = statistics[k][j];
+            os << "\t" << s.count() << "\t" << s.mean() << "\t" << sqrt(s.variance()) << "\t" << s.minimum()
+               << "\t" << s.maximum();
+            for (unsigned int i = 0; i < s.numberOfQuantiles(); ++i) os << "\t" << s.quantile(i);
+        }
+        os << std::endl;
+    }
+}
+
+int SamplingEngine::initialise(const std::string& modelUrl, const MySimulation& simulation,
+                               const std::vector<SamplingInput>& inputs, const std::vector<MyVariable>& outputs,
+                               int numberOfWorkers)
+{
+    if (inputs.empty() || outputs.empty())
+    {
+        std::cerr << "SamplingEngine::initialise: need at least one input and one output" << std::endl;
+        return -1;
+    }
+    mInputs = inputs;
+    mNumberOfOutputs = outputs.size();
+    std::vector<MySetValueChange> changes;
+    for (const SamplingInput& input: inputs) changes.push_back(input.change);
+    return mEnsemble.initialise(modelUrl, simulation, changes, outputs, numberOfWorkers);
+}
+
+std::vector<double> SamplingEngine::inputValues(const std::vector<double>& u) const
+{
+    std::vector<double> values(u.size());
+    for (unsigned int j = 0; j < u.size(); ++j) values[j] = mInputs[j].quantile(u[j]);
+    return values;
+}
+
+int SamplingEngine::run(const SamplingOptions& options, EnsembleStatistics& results)
+{
+    std::vector<std::vector<double> > points;
+    if (generateDesign(options.design, options.numberOfSamples, mInputs.size(), options.seed, points) != 0)
+        return -1;
+    for (auto& point: points) point = inputValues(point);
+
+    results = EnsembleStatistics();
+    results.statistics.resize(mNumberOfOutputs);
+    std::mutex mutex;
+    int status = mEnsemble.run(points, [&options, &results, &mutex](unsigned int, bool success,
+                                         const std::vector<double>& times,
+                                         const std::vector<std::vector<double> >& outputs)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++results.numberOfSamples;
+        if (!success)
+        {
+            ++results.numberOfFailures;
+            return;
+        }
+        if (results.times.empty())
+        {
+            results.times = times;
+            for (auto& s: results.statistics) s.assign(times.size(), RunningStatistics(options.quantiles));
+        }
+        for (unsigned int k = 0; k < outputs.size(); ++k)
+            for (unsigned int j = 0; j < outputs[k].size(); ++j) results.statistics[k][j].add(outputs[k][j]);
+    });
+    if (status != 0) return status;
+    if (results.numberOfFailures > 0)
+        std::cerr << "SamplingEngine::run: " << results.numberOfFailures << " of " << results.numberOfSamples
+                  << " samples failed to simulate and were left out of the statistics" << std::endl;
+    return 0;
+}
+
+int readSamplingSpecification(const std::string& url, std::string& taskId, std::vector<SamplingInput>& inputs,
+                              std::vector<MyVariable>& outputs, SamplingOptions& options)
+{
+    std::string content = getUrlContent(url);
+    if (content.empty())
+    {
+        std::cerr << "Unable to load the sampling specification: " << url << std::endl;
+        return 1;
+    }
+    int numberOfErrors = 0;
+    std::istringstream lines(content);
+    std::string line;
+    int lineNumber = 0;
+    bool quantilesGiven = false;
+    while (std::getline(lines, line))
+    {
+        ++lineNumber;
+        std::size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        std::istringstream entry(line);
+        std::string keyword;
+        if (!(entry >> keyword)) continue;
+        bool valid = true;
+        if (keyword == "task") valid = static_cast<bool>(entry >> taskId);
+        else if (keyword == "input")
+        {
+            SamplingInput input;
+            std::string distribution;
+            valid = static_cast<bool>(entry >> input.change.targetXpath >> distribution >> input.a >> input.b);
+            if (distribution == "uniform") input.distribution = SamplingInput::Uniform;
+            else if (distribution == "loguniform") input.distribution = SamplingInput::LogUniform;
+            else if (distribution == "normal") input.distribution = SamplingInput::Normal;
+            else if (distribution == "lognormal") input.distribution = SamplingInput::LogNormal;
+            else valid = false;
+            if ((input.distribution == SamplingInput::LogUniform) && ((input.a <= 0.0) || (input.b <= 0.0)))
+                valid = false;
+            if (((input.distribution == SamplingInput::Normal) || (input.distribution == SamplingInput::LogNormal))
+                    && (input.b < 0.0)) valid = false;
+            if (valid) inputs.push_back(input);
+        }
+        else if (keyword == "output")
+        {
+            MyVariable output;
+            valid = static_cast<bool>(entry >> output.target);
+            if (valid) outputs.push_back(output);
+        }
+        else if (keyword == "design")
+        {
+            std::string design;
+            valid = static_cast<bool>(entry >> design);
+            if (design == "monte-carlo") options.design = SamplingOptions::MonteCarlo;
+            else if (design == "latin-hypercube") options.design = SamplingOptions::LatinHypercube;
+            else if (design == "sobol") options.design = SamplingOptions::Sobol;
+            else valid = false;
+        }
+        else if (keyword == "samples") valid = static_cast<bool>(entry >> options.numberOfSamples);
+        else if (keyword == "seed") valid = static_cast<bool>(entry >> options.seed);
+        else if (keyword == "workers") valid = static_cast<bool>(entry >> options.numberOfWorkers);
+        else if (keyword == "quantiles")
+        {
+            if (!quantilesGiven) options.quantiles.clear();
+            quantilesGiven = true;
+            double p;
+            while (entry >> p)
+            {
+                if ((p <= 0.0) || (p >= 1.0)) valid = false;
+                else options.quantiles.push_back(p);
+            }
+        }
+        else valid = false;
+        if (!valid)
+        {
+            std::cerr << "Invalid entry on line " << lineNumber << " of the sampling specification: " << line
+                      << std::endl;
+            ++numberOfErrors;
+        }
+    }
+    if (taskId.empty())
+    {
+        std::cerr << "The sampling specification must give the task to sample" << std::endl;
+        ++numberOfErrors;
+    }
+    return numberOfErrors;
+}
+
+std::string outputName(const std::string& target)
+{
+    std::size_t start = target.rfind("@name=");
+    if ((start == std::string::npos) || (start + 7 >= target.size())) return target;
+    char quote = target[start + 6];
+    std::size_t end = target.find(quote, start + 7);
+    if (end == std::string::npos) return target;
+    return target.substr(start + 7, end - start - 7);
+}
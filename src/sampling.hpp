@@ -0,0 +1,213 @@
+#ifndef SAMPLING_HPP
+#define SAMPLING_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "dataset.hpp"
+#include "setvaluechange.hpp"
+#include "utilityclasses.hpp"
+#include "statistics.hpp"
+#include "ensemble.hpp"
+
+/**
+ * A model input to be sampled from a distribution. The input is mapped to the model in the same way as the set
+ * value changes of a repeated task.
+ */
+class SamplingInput
+{
+public:
+    enum Distribution
+    {
+        Uniform = 1,
+        LogUniform = 2,
+        Normal = 3,
+        LogNormal = 4
+    };
+
+    SamplingInput() : distribution(Uniform), a(0.0), b(1.0)
+    {
+    }
+
+    /**
+     * @brief Map a probability to a value of this input using the inverse of its cumulative distribution.
+     * @param u The probability, in (0, 1).
+     * @return The corresponding value of the input.
+     */
+    double quantile(double u) const;
+
+    MySetValueChange change;
+    Distribution distribution;
+    // the lower and upper bounds of the uniform distributions, or the mean and standard deviation of the normal
+    // distribution (of the logarithm of the input for the log-normal distribution)
+    double a, b;
+};
+
+class SamplingOptions
+{
+public:
+    enum Design
+    {
+        MonteCarlo = 1,
+        LatinHypercube = 2,
+        Sobol = 3
+    };
+
+    SamplingOptions() : design(LatinHypercube), numberOfSamples(100), seed(1), numberOfWorkers(0)
+    {
+        quantiles.push_back(0.05);
+        quantiles.push_back(0.5);
+        quantiles.push_back(0.95);
+    }
+
+    Design design;
+    unsigned int numberOfSamples;
+    // the seed for the random designs
+    unsigned long seed;
+    // the number of simulation engines to run the samples with in parallel, zero to use all available cores
+    int numberOfWorkers;
+    // the probabilities of the quantiles to estimate for each output
+    std::vector<double> quantiles;
+};
+
+/**
+ * @brief The Sobol low-discrepancy sequence in up to SobolSequence::maximumDimension dimensions, using the
+ * direction numbers of Joe and Kuo (2008). The first point (the origin) is skipped so that all coordinates are in
+ * (0, 1).
+ */
+class SobolSequence
+{
+public:
+    static const unsigned int maximumDimension;
+
+    SobolSequence(unsigned int dimension);
+
+    /**
+     * @brief Get the next point in the sequence.
+     * @param point On return, the next point.
+     * @return zero on success, non-zero if the dimension is not supported or the sequence is exhausted.
+     */
+    int next(std::vector<double>& point);
+
+private:
+    unsigned int mDimension;
+    unsigned long mIndex;
+    std::vector<std::vector<unsigned int> > mDirections;
+    std::vector<unsigned int> mX;
+};
+
+/**
+ * @brief Generate a sampling design of points in the unit hypercube, with all coordinates in (0, 1).
+ * @param design The type of design.
+ * @param numberOfPoints The number of points.
+ * @param dimension The dimension of the hypercube.
+ * @param seed The seed for the random designs.
+ * @param points On success, the points.
+ * @return zero on success.
+ */
+int generateDesign(SamplingOptions::Design design, unsigned int numberOfPoints, unsigned int dimension,
+                   unsigned long seed, std::vector<std::vector<double> >& points);
+
+/**
+ * The summary statistics of each output of an ensemble at each point of the simulation time course.
+ */
+class EnsembleStatistics
+{
+public:
+    EnsembleStatistics() : numberOfSamples(0), numberOfFailures(0)
+    {
+    }
+
+    /**
+     * @brief Write the statistics as tab separated columns: the time, then the count, mean, standard deviation,
+     * minimum, maximum and quantiles of each output.
+     * @param os The stream to write to.
+     * @param outputNames The name of each output for the column headers.
+     */
+    void write(std::ostream& os, const std::vector<std::string>& outputNames) const;
+
+    std::vector<double> times;
+    // the statistics of each output (outer) at each time (inner)
+    std::vector<std::vector<RunningStatistics> > statistics;
+    long numberOfSamples, numberOfFailures;
+};
+
+/**
+ * @brief Sample the inputs of a CSim simulation task and accumulate streaming statistics of its outputs.
+ *
+ * The samples are simulated in parallel with a TaskEnsemble and each trajectory is added to the statistics as soon
+ * as it is complete, so only one trajectory per worker is stored at any time.
+ */
+class SamplingEngine
+{
+public:
+    /**
+     * @brief Load and compile the model for each worker.
+     * @param modelUrl The URL of the CellML model.
+     * @param simulation The simulation to run for each sample, must be a CSim simulation.
+     * @param inputs The inputs to sample, their namespaces must be set to resolve their target XPaths.
+     * @param outputs The outputs to summarise, their namespaces must be set to resolve their target XPaths.
+     * @param numberOfWorkers The number of workers, zero to use all available cores.
+     * @return zero on success.
+     */
+    int initialise(const std::string& modelUrl, const MySimulation& simulation,
+                   const std::vector<SamplingInput>& inputs, const std::vector<MyVariable>& outputs,
+                   int numberOfWorkers);
+
+    /**
+     * @brief Generate the design and simulate all of its samples.
+     * @param options The sampling options.
+     * @param results On success, the statistics of the outputs.
+     * @return zero on success.
+     */
+    int run(const SamplingOptions& options, EnsembleStatistics& results);
+
+    /**
+     * @brief Map a point in the unit hypercube to values of the inputs.
+     * @param u The point, with each coordinate in (0, 1).
+     * @return The value of each input.
+     */
+    std::vector<double> inputValues(const std::vector<double>& u) const;
+
+    /**
+     * @brief The ensemble used to simulate the samples, e.g., to run designs generated elsewhere.
+     */
+    TaskEnsemble& ensemble() { return mEnsemble; }
+
+private:
+    TaskEnsemble mEnsemble;
+    std::vector<SamplingInput> mInputs;
+    unsigned int mNumberOfOutputs;
+};
+
+/**
+ * @brief Read a sampling specification. The specification is a text file with one entry per line, with '#'
+ * starting a comment:
+ *
+ *    task <task id>
+ *    input <target XPath> uniform|loguniform|normal|lognormal <a> <b>
+ *    output <target XPath>
+ *    design monte-carlo|latin-hypercube|sobol
+ *    samples <number of samples>
+ *    seed <random seed>
+ *    workers <number of workers>
+ *    quantiles <probability>...
+ *
+ * @param url The URL of the specification.
+ * @param taskId On success, the ID of the task to sample.
+ * @param inputs On success, the inputs to sample.
+ * @param outputs On success, the outputs to summarise.
+ * @param options On success, the sampling options.
+ * @return zero on success, otherwise the number of errors.
+ */
+int readSamplingSpecification(const std::string& url, std::string& taskId, std::vector<SamplingInput>& inputs,
+                              std::vector<MyVariable>& outputs, SamplingOptions& options);
+
+/**
+ * @brief A short name for an output with the given target XPath, the name of the variable it refers to if it can
+ * be found.
+ */
+std::string outputName(const std::string& target);
+
+#endif // SAMPLING_HPP
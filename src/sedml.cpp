@@ -2,6 +2,9 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <cmath>
+#include <memory>
+#include <chrono>
 
 #include <sbml/SBMLTypes.h>
 
@@ -12,20 +15,38 @@
 #include "simulationengineget.hpp"
 #include "utilityclasses.hpp"
 #include "setvaluechange.hpp"
+#include "estimation.hpp"
+#include "sampling.hpp"
+#include "globalsensitivity.hpp"
+#include "resultlistener.hpp"
+#include "enginecache.hpp"
+#include "getsimulator.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
+#include "solverstatistics.hpp"
+#include "documentmirror.hpp"
 
 LIBSEDML_CPP_NAMESPACE_USE
 
+// a variable with this symbol prefix is the sensitivity of its target with respect to the parameter whose XPath
+// follows the prefix, e.g., symbol="urn:get:sensitivity:/cellml:model/cellml:component[@name='c']/..."
+static const std::string SensitivitySymbolPrefix = "urn:get:sensitivity:";
+
 static void printStringMap(StringMap& map)
 {
     for (auto i = map.begin(); i != map.end(); ++i)
     {
-        std::cout << "Key: " << i->first.c_str() << " ==> " << i->second.c_str() << std::endl;
+        GET_LOG(LogTrace, "Key: " << i->first.c_str() << " ==> " << i->second.c_str());
     }
 }
 
-static std::string nonEssentialString()
+static double secondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string nonEssentialString(int& counter)
 {
-    static int counter = 1000;
     std::stringstream ss;
     ss << counter++;
     std::string number(ss.str());
@@ -71,6 +92,7 @@ public:
     MyTask()
     {
         isRepeatedTask = false;
+        executions = 0;
     }
 
     /**
@@ -104,13 +126,13 @@ public:
         std::vector<MySetValueChange> localSetValueChanges(setValueChanges);
         for (double rangeValue: r.rangeData)
         {
-            std::cout << "Execute repeat with master range (" << masterRangeId << ") value: " << rangeValue << std::endl;
+            GET_LOG(LogDebug, "Execute repeat with master range (" << masterRangeId << ") value: " << rangeValue);
             // update the set value changes to have the current values
             for (MySetValueChange& svc: localSetValueChanges)
             {
                 const MyRange& rr = ranges[svc.rangeId];
                 svc.currentRangeValue = rr.rangeData[rangeIndex];
-                std::cout << "Setting range: " << svc.rangeId << "; to value: " << svc.currentRangeValue << std::endl;
+                GET_LOG(LogDebug, "Setting range: " << svc.rangeId << "; to value: " << svc.currentRangeValue);
             }
             // and add them to the existing set of changes
             localSetValueChanges.insert(localSetValueChanges.end(), changesToApply.begin(), changesToApply.end());
@@ -126,17 +148,18 @@ public:
                       DataSet& dataSets, const std::string& masterTaskId, bool resetModel,
                       std::vector<MySetValueChange>& changesToApply)
     {
+        GET_TRACE_SCOPE("sedml", "execute task");
         int numberOfErrors = 0;
-        std::cout << "\n\nExecuting: " << id.c_str() << std::endl;
-        std::cout << "\tsimulation = " << simulationReference.c_str() << std::endl;
-        std::cout << "\tmodel = " << modelReference.c_str() << std::endl;
-        std::cout << "\tnumber of changes to apply = " << changesToApply.size() << std::endl;
+        GET_LOG(LogInfo, "Executing: " << id << "\n\tsimulation = " << simulationReference << "\n\tmodel = "
+                << modelReference << "\n\tnumber of changes to apply = " << changesToApply.size());
         const MyModel& model = models[modelReference];
         const MySimulation& simulation = simulations[simulationReference];
         std::vector<std::string> outputVariables;
+        SolverStatistics executionStatistics;
+        std::chrono::steady_clock::time_point phaseStart = std::chrono::steady_clock::now();
         if (simulation.isCsim())
         {
-            std::cout << "\trunning simulation task using CSim..." << std::endl;
+            GET_LOG(LogInfo, "\trunning simulation task using CSim...");
             // we need to keep track of exisiting CSim objects so that when executing repeated tasks
             // the already created and initialised CSim can be used.
             SimulationEngineCsim* csim;
@@ -147,58 +170,89 @@ public:
             }
             else
             {
-                csim = new SimulationEngineCsim();
-                csim->loadModel(model.source);
-                // keep track of the data arrays to store the simulation results
+                // the variables relevant to this task (the master task) and the changes to set as inputs, in the
+                // order they are added to the engine
+                std::vector<MyVariable*> taskVariables;
                 for (auto& di: dataSets)
                 {
                     MyData& d = di.second;
-                    // we only want variables relevant to this task (the master task)
                     for (auto& variables: d.variables)
                     {
                         MyVariable& v = variables.second;
                         if (v.taskReference == masterTaskId)
                         {
                             outputVariables.push_back(variables.first);
-                            std::cout << "\tAdding variable: "
-                                      << variables.first
-                                      << "; to the outputs for this task."
-                                      << std::endl;
-                            csim->addOutputVariable(v);
+                            taskVariables.push_back(&v);
                         }
                     }
                 }
-                // we also need to access the variables for setting changes as inputs
+                std::vector<MySetValueChange*> taskChanges;
                 for (MySetValueChange& change: changesToApply)
                 {
-                    if (change.modelReference == modelReference)
+                    if (change.modelReference == modelReference) taskChanges.push_back(&change);
+                }
+                // a long-running process may already have an engine instantiated for the same model and variables
+                std::string key;
+                csim = NULL;
+                if (simulationEngineCacheEnabled())
+                {
+                    key = simulationEngineKey(model.source, taskVariables, taskChanges);
+                    csim = acquireSimulationEngine(key);
+                    if (csim && (csim->restoreRegistration(taskVariables, taskChanges) != 0))
                     {
-                        csim->addInputVariable(change);
+                        delete csim;
+                        csim = NULL;
                     }
+                    if (csim) GET_LOG(LogInfo, "\tusing a cached simulation engine for: " << model.source);
                 }
-                // initialise the engine
-                if (csim->instantiateSimulation() != 0)
+                if (!csim)
                 {
-                    std::cerr << "Error instantiating the simulation?" << std::endl;
-                    return -1;
+                    csim = new SimulationEngineCsim();
+                    csim->loadModel(model.localSource);
+                    executionStatistics.loadTime = secondsSince(phaseStart);
+                    // keep track of the data arrays to store the simulation results
+                    for (unsigned int i = 0; i < taskVariables.size(); ++i)
+                    {
+                        MyVariable& v = *(taskVariables[i]);
+                        GET_LOG(LogTrace, "\tAdding variable: " << outputVariables[i]
+                                << "; to the outputs for this task.");
+                        if (v.sensitivityTarget.empty()) csim->addOutputVariable(v);
+                        else csim->addSensitivityVariable(v);
+                    }
+                    // we also need to access the variables for setting changes as inputs
+                    for (MySetValueChange* change: taskChanges) csim->addInputVariable(*change);
+                    // initialise the engine
+                    phaseStart = std::chrono::steady_clock::now();
+                    if (csim->instantiateSimulation() != 0)
+                    {
+                        std::cerr << "Error instantiating the simulation?" << std::endl;
+                        delete csim;
+                        return -1;
+                    }
+                    executionStatistics.instantiateTime = secondsSince(phaseStart);
                 }
                 csimList[id] = csim;
+                csimKeys[id] = key;
             }
+            // the engine may have been used before, so its counters before this execution are subtracted
+            SolverStatistics previousCounters;
+            csim->getSolverStatistics(previousCounters);
             // apply relevant changes
             for (const MySetValueChange& change: changesToApply)
             {
-                std::cout << "Change to apply: " << std::endl;
                 if (change.modelReference == modelReference)
                 {
-                    std::cout << "Applying set value change, value: " << change.currentRangeValue << std::endl;
+                    GET_LOG(LogDebug, "Applying set value change, value: " << change.currentRangeValue);
                     csim->applySetValueChange(change);
                 }
             }
             // initialise the simulation
+            phaseStart = std::chrono::steady_clock::now();
             csim->initialiseSimulation(simulation, simulation.initialTime, simulation.startTime);
-            std::cout << "got to here 2345" << std::endl;
+            executionStatistics.initialiseTime = secondsSince(phaseStart);
             // set up the results capture
-            std::vector<std::vector<double>*> results;
+            std::vector<MyVariable*> results;
+            std::vector<std::string> resultNames;
             for (auto di = dataSets.begin(); di != dataSets.end(); ++di)
             {
                 MyData& d = di->second;
@@ -206,24 +260,70 @@ public:
                 {
                     MyVariable& v = variables.second;
                     if (v.taskReference == masterTaskId)
-                        results.push_back(&(v.data));
+                    {
+                        results.push_back(&v);
+                        resultNames.push_back(variables.first);
+                    }
                 }
             }
-            std::vector<double> stepResults = csim->getOutputValues();
-            int r = 0;
-            for (auto j = stepResults.begin(); j != stepResults.end(); ++j, ++r)
-                results[r]->push_back(*j);
-            std::cout << "Got to here 1234" << std::endl;
+            // the trajectories of the variables that aren't aggregated are stored and may be decimated and
+            // published, aggregated variables keep every sample point so that their statistics stay aligned across
+            // repeats
+            std::vector<MyVariable*> trajectories;
+            std::vector<std::string> trajectoryNames;
+            for (unsigned int k = 0; k < results.size(); ++k)
+            {
+                MyVariable* v = results[k];
+                if (!v->aggregate && ((v->sensitivityIndex >= 0) || (v->outputIndex >= 0)))
+                {
+                    trajectories.push_back(v);
+                    trajectoryNames.push_back(resultNames[k]);
+                }
+            }
+            ResultListener* publisher = dataSets.publisher;
+            uint32_t stream = 0;
+            if (publisher && !trajectories.empty()) stream = publisher->beginStream(masterTaskId, trajectoryNames);
+            auto storeRow = [&trajectories, publisher, stream](double time, const std::vector<double>& values)
+            {
+                for (unsigned int k = 0; k < trajectories.size(); ++k) trajectories[k]->addValue(values[k]);
+                if (publisher) publisher->publishRow(stream, time, values);
+            };
+            std::unique_ptr<Decimator> decimator;
+            if ((dataSets.decimation.method != DecimationOptions::None) && !trajectories.empty())
+            {
+                decimator.reset(new Decimator(dataSets.decimation, simulation.numberOfPoints + 1,
+                                              trajectories.size(), storeRow));
+            }
+            std::vector<double> trajectoryValues(trajectories.size());
+            // each variable takes its value from either the outputs or the sensitivities of the simulation
+            auto captureResults = [&results, &decimator, &trajectoryValues, &storeRow, csim](double time)
+            {
+                const std::vector<double>& outputs = csim->getOutputValues();
+                const std::vector<double>& sensitivities = csim->getSensitivityValues();
+                unsigned int k = 0;
+                for (MyVariable* v: results)
+                {
+                    double value;
+                    if (v->sensitivityIndex >= 0) value = sensitivities[v->sensitivityIndex];
+                    else if (v->outputIndex >= 0) value = outputs[v->outputIndex];
+                    else continue;
+                    if (v->aggregate) v->addValue(value);
+                    else trajectoryValues[k++] = value;
+                }
+                if (trajectoryValues.empty()) return;
+                if (decimator) decimator->add(time, trajectoryValues);
+                else storeRow(time, trajectoryValues);
+            };
+            for (MyVariable* v: results) v->startTrajectory();
+            captureResults(simulation.startTime);
+            phaseStart = std::chrono::steady_clock::now();
             double dt = (simulation.endTime - simulation.startTime) / simulation.numberOfPoints;
             double time = simulation.startTime;
             for (int i = 1; i <= simulation.numberOfPoints; ++i, time += dt)
             {
                 if (csim->simulateModelOneStep(dt) == 0)
                 {
-                    stepResults = csim->getOutputValues();
-                    r = 0;
-                    for (auto j = stepResults.begin(); j != stepResults.end(); ++j, ++r)
-                        results[r]->push_back(*j);
+                    captureResults(simulation.startTime + i * dt);
                 }
                 else
                 {
@@ -231,12 +331,26 @@ public:
                     break;
                 }
             }
+            executionStatistics.simulateTime = secondsSince(phaseStart);
+            SolverStatistics counters;
+            csim->getSolverStatistics(counters);
+            counters.subtractCounters(previousCounters);
+            executionStatistics.add(counters);
+            if (decimator)
+            {
+                decimator->finish();
+                GET_LOG(LogInfo, "\tdecimated " << decimator->numberOfSamples() << " samples to "
+                        << decimator->numberOfSelectedSamples());
+            }
+            if (publisher && !trajectories.empty()) publisher->endStream(stream);
         }
         else if (simulation.isGet())
         {
-            std::cout << "\trunning simulation task using GET..." << std::endl;
+            GET_LOG(LogInfo, "\trunning simulation task using GET...");
             SimulationEngineGet get;
-            get.loadModel(model.source);
+            get.setActiveTransport(simulation.activeTransport);
+            get.loadModel(model.localSource);
+            executionStatistics.loadTime = secondsSince(phaseStart);
             int columnIndex = 1;
             for (auto di = dataSets.begin(); di != dataSets.end(); ++di, ++columnIndex)
             {
@@ -248,24 +362,52 @@ public:
                     if (v.taskReference == this->id)
                     {
                         outputVariables.push_back(variables.first);
-                        std::cout << "\tAdding variable: " << variables.first
-                                  << "; to the outputs for this task."
-                                  << std::endl;
+                        GET_LOG(LogTrace, "\tAdding variable: " << variables.first
+                                << "; to the outputs for this task.");
                         get.addOutputVariable(v, columnIndex);
                     }
                 }
             }
+            // the GET engine simulates the model as it is initialised
+            phaseStart = std::chrono::steady_clock::now();
             get.initialiseSimulation();
+            executionStatistics.simulateTime = secondsSince(phaseStart);
+            executionStatistics.add(get.solverStatistics());
             get.getOutputValues();
         }
         else
         {
             std::cerr << "Unknown type of simulation?" << std::endl;
             ++numberOfErrors;
+            return numberOfErrors;
         }
+        statistics.add(executionStatistics);
+        ++executions;
         return numberOfErrors;
     }
 
+    /**
+     * @brief Write the solver statistics of the simple tasks that have been executed, including the sub-tasks of
+     * repeated tasks, as JSON objects in a list.
+     * @param first Whether no objects have been written to the list yet, updated as they are written.
+     */
+    void writeStatistics(std::ostream& os, const std::string& reportId, const std::string& masterTaskId,
+                         bool& first) const
+    {
+        if (isRepeatedTask)
+        {
+            for (const MyTask& st: subTasks) st.writeStatistics(os, reportId, masterTaskId, first);
+            return;
+        }
+        if (executions == 0) return;
+        // SED-ML identifiers are SIds, so need no escaping
+        os << (first ? "\n" : ",\n") << "{\"report\":\"" << reportId << "\",\"task\":\"" << masterTaskId
+           << "\",\"id\":\"" << id << "\",\"executions\":" << executions << ",";
+        statistics.writeJsonMembers(os);
+        os << "}";
+        first = false;
+    }
+
     std::string id;
     std::string name;
     std::string modelReference;
@@ -277,10 +419,16 @@ public:
     std::vector<MyTask> subTasks;
     std::vector<MySetValueChange> setValueChanges;
     std::map<std::string, SimulationEngineCsim*> csimList;
+    // the engine cache keys of the CSim objects, empty if they are not to be cached
+    std::map<std::string, std::string> csimKeys;
+    // the work done by the solvers over the executions of this (simple) task
+    SolverStatistics statistics;
+    unsigned int executions;
 
     ~MyTask()
     {
-        for (auto i = csimList.begin(); i != csimList.end(); ++i) delete i->second;
+        for (auto i = csimList.begin(); i != csimList.end(); ++i)
+            releaseSimulationEngine(csimKeys[i->first], i->second);
     }
 };
 
@@ -288,7 +436,10 @@ public:
 class MyReport
 {
 public:
-    MyReport(const SedReport* sedReport)
+    /**
+     * @param nextGeneratedId The number used for the ID of the next data set without one, updated as they are used.
+     */
+    MyReport(const SedReport* sedReport, int& nextGeneratedId)
     {
         sed = sedReport;
         id = sed->getId();
@@ -297,7 +448,7 @@ public:
             const SedDataSet* dataSet = sed->getDataSet(i);
             MyData d;
             // these strings are not required in the SED-ML document, so need to handle them being absent
-            d.id = dataSet->isSetId() ? dataSet->getId() : nonEssentialString();
+            d.id = dataSet->isSetId() ? dataSet->getId() : nonEssentialString(nextGeneratedId);
             d.label = dataSet->getLabel(); // empty string if no label set
             d.dataReference = dataSet->getDataReference();
             dataSets[d.id] = d;
@@ -309,10 +460,9 @@ public:
         int numberOfErrors = 0;
         for (auto i = dataSets.begin(); i != dataSets.end(); ++i)
         {
-            std::cout << "DataSet " << i->first.c_str() << ":" << std::endl;
             MyData& d = i->second;
-            std::cout << "\tdata reference: " << d.dataReference.c_str() << std::endl;
-            std::cout << "\tlabel: " << (d.label == "" ? "no label" : d.label.c_str()) << std::endl;
+            GET_LOG(LogDebug, "DataSet " << i->first << ":\n\tdata reference: " << d.dataReference << "\n\tlabel: "
+                    << (d.label == "" ? "no label" : d.label));
             SedDataGenerator* dg = doc->getDataGenerator(d.dataReference);
             if (dg->getNumVariables() < 1)
             {
@@ -328,18 +478,24 @@ public:
                     var.target = v->getTarget();
                     var.taskReference = v->getTaskReference();
                     var.namespaces = getAllNamespaces(v);
-                    std::cout << "\t\tVariable " << v->getId()
-                              << ": target=" << var.target
-                              << "; task=" << var.taskReference << std::endl;
-                    printStringMap(var.namespaces);
+                    if (v->isSetSymbol() && (v->getSymbol().compare(0, SensitivitySymbolPrefix.size(),
+                                                                   SensitivitySymbolPrefix) == 0))
+                    {
+                        var.sensitivityTarget = v->getSymbol().substr(SensitivitySymbolPrefix.size());
+                        GET_LOG(LogDebug, "\t\tSensitivity with respect to: " << var.sensitivityTarget);
+                    }
+                    GET_LOG(LogDebug, "\t\tVariable " << v->getId()
+                            << ": target=" << var.target
+                            << "; task=" << var.taskReference);
+                    if (logEnabled(LogTrace)) printStringMap(var.namespaces);
                     d.variables[v->getId()] = var;
                 }
             }
             for (int pc=0; pc < dg->getNumParameters(); ++pc)
             {
                 SedParameter* p = dg->getParameter(pc);
-                std::cout << "\t\tParameter " << p->getId()
-                          << ": value=" << p->getValue() << std::endl;
+                GET_LOG(LogDebug, "\t\tParameter " << p->getId()
+                        << ": value=" << p->getValue());
                 d.parameters[p->getId()] = p->getValue();
             }
         }
@@ -351,7 +507,7 @@ public:
         int numberOfErrors = 0;
         for (auto i = dataSets.begin(); i != dataSets.end(); ++i)
         {
-            std::cout << "DataSet " << i->first.c_str() << ":" << std::endl;
+            GET_LOG(LogDebug, "DataSet " << i->first << ":");
             MyData& d = i->second;
             for (auto& variables: d.variables)
             {
@@ -361,11 +517,11 @@ public:
                 t.id = task->getId();
                 if (tasks.count(t.id) == 0)
                 {
-                    std::cout << "Adding task: " << t.id << " to the execution manifest" << std::endl;
+                    GET_LOG(LogDebug, "Adding task: " << t.id << " to the execution manifest");
                     resolveTask(t, task);
                     tasks[t.id] = t;
                 }
-                else std::cout << "Task (" << t.id << ") already in the execution manifest" << std::endl;
+                else GET_LOG(LogDebug, "Task (" << t.id << ") already in the execution manifest");
             }
         }
         return numberOfErrors;
@@ -475,7 +631,7 @@ public:
           const SedTask* task = sedRepeat->getSedDocument()->getTask(current->getTask());
           MyTask st;
           st.id = task->getId();
-          std::cout << "Adding sub task: " << st.id.c_str() << " to the execution manifest" << std::endl;
+          GET_LOG(LogDebug, "Adding sub task: " << st.id.c_str() << " to the execution manifest");
           resolveTask(st, task);
           if (current->isSetOrder())
           {
@@ -493,7 +649,7 @@ public:
         m.id = model->getId();
         if (models.count(m.id) == 0)
         {
-            std::cout << "Adding model: " << m.id.c_str() << " to the execution manifest" << std::endl;
+            GET_LOG(LogDebug, "Adding model: " << m.id.c_str() << " to the execution manifest");
             std::string language = model->getLanguage();
             // we can only handle CellML models.
             if (language.find("cellml"))
@@ -502,8 +658,8 @@ public:
                 // FIXME: assuming here that the source is always a cellml model, but could be a reference to
                 // another model? or would that be a modelReference?
                 m.source = buildAbsoluteUri(model->getSource(), baseUri);
-                std::cout << "\tModel source: " << model->getSource().c_str() << std::endl;
-                std::cout << "\tModel URL: " << m.source.c_str() << std::endl;
+                m.localSource = m.source;
+                GET_LOG(LogDebug, "\tModel source: " << model->getSource() << "\n\tModel URL: " << m.source);
                 models[m.id] = m;
             }
             else
@@ -512,7 +668,7 @@ public:
                 ++numberOfErrors;
             }
         }
-        else std::cout << "Model (" << m.id.c_str() << ") is already in the execution manifest" << std::endl;
+        else GET_LOG(LogDebug, "Model (" << m.id.c_str() << ") is already in the execution manifest");
         return numberOfErrors;
     }
 
@@ -557,7 +713,7 @@ public:
             s.id = simulation->getId();
             if (simulations.count(s.id) == 0)
             {
-                std::cout << "Adding simulation: " << s.id.c_str() << " to the execution manifest" << std::endl;
+                GET_LOG(LogDebug, "Adding simulation: " << s.id.c_str() << " to the execution manifest");
                 const SedUniformTimeCourse* tc = static_cast<const SedUniformTimeCourse*>(simulation);
                 const SedAlgorithm* alg = tc->getAlgorithm();
                 std::string kisaoId = alg->getKisaoID();
@@ -581,29 +737,29 @@ public:
                         {
                             // absolute tolerance
                             s.absoluteTolerance = std::stod(ap->getValue());
-                            std::cout << "resolveSimulation: setting absolute tolerance = "
-                                      << s.absoluteTolerance << std::endl;
+                            GET_LOG(LogDebug, "resolveSimulation: setting absolute tolerance = "
+                                    << s.absoluteTolerance);
                         }
                         else if (apki == "KISAO:0000209")
                         {
                             // relative tolerance
                             s.relativeTolerance = std::stod(ap->getValue());
-                            std::cout << "resolveSimulation: setting relative tolerance = "
-                                      << s.relativeTolerance << std::endl;
+                            GET_LOG(LogDebug, "resolveSimulation: setting relative tolerance = "
+                                    << s.relativeTolerance);
                         }
                         else if (apki == "KISAO:0000467")
                         {
                             // maximum step size
                             s.maximumStepSize = std::stod(ap->getValue());
-                            std::cout << "resolveSimulation: setting max step size = "
-                                      << s.maximumStepSize << std::endl;
+                            GET_LOG(LogDebug, "resolveSimulation: setting max step size = "
+                                    << s.maximumStepSize);
                         }
                         else if (apki == "KISAO:0000415")
                         {
                             // maximum number of steps
                             s.maximumNumberOfSteps = std::stod(ap->getValue());
-                            std::cout << "resolveSimulation: setting max number of steps = "
-                                      << s.maximumNumberOfSteps << std::endl;
+                            GET_LOG(LogDebug, "resolveSimulation: setting max number of steps = "
+                                    << s.maximumNumberOfSteps);
                         }
                     }
                     simulations[s.id] = s;
@@ -631,6 +787,8 @@ public:
                         else
                         {
                             s.setSimulationTypeGet(csimGetSimulator.getAttrValue("method"));
+                            s.activeTransport = csimGetSimulator.hasAttr("activeTransport") &&
+                                (csimGetSimulator.getAttrValue("activeTransport") == "true");
                             s.initialTime = tc->getInitialTime();
                             s.startTime = tc->getOutputStartTime();
                             s.endTime = tc->getOutputEndTime();
@@ -640,7 +798,7 @@ public:
                     }
                 }
             }
-            else std::cout << "Simulation (" << s.id.c_str() << ") already in execution manifest." << std::endl;
+            else GET_LOG(LogDebug, "Simulation (" << s.id.c_str() << ") already in execution manifest.");
         }
         else
         {
@@ -706,6 +864,7 @@ public:
         for (const auto& ds: dataSets)
         {
             MyData d = ds.second;
+            if (!d.variables.empty() && d.variables.begin()->second.aggregate) continue;
             if (first) os << ",";
             else first = 1;
             os << d.label;
@@ -722,6 +881,7 @@ public:
             for (const auto& ds: dataSets)
             {
                 MyData d = ds.second;
+                if (!d.variables.empty() && d.variables.begin()->second.aggregate) continue;
                 if (first) os << ",";
                 else first = 1;
 #ifdef FIX_SERIALISATION
@@ -730,9 +890,89 @@ public:
             }
             os << std::endl;
         }
+        numberOfErrors += serialiseAggregates(os);
         return numberOfErrors;
     }
 
+    void writeStatistics(std::ostream& os, bool& first) const
+    {
+        for (const auto& t: tasks) t.second.writeStatistics(os, id, t.first, first);
+    }
+
+    void view(ReportView& view) const
+    {
+        view.id = id;
+        view.columns.clear();
+        for (const auto& ds: dataSets)
+        {
+            const MyData& d = ds.second;
+            if (!d.variables.empty() && d.variables.begin()->second.aggregate) continue;
+            ReportColumn column;
+            column.id = d.id;
+            column.label = d.label;
+            // FIXME: as for serialise, the data generator math is not applied, we use its first variable
+            if (!d.variables.empty() && !d.variables.begin()->second.data.empty())
+            {
+                column.data = d.variables.begin()->second.data.data();
+                column.size = d.variables.begin()->second.data.size();
+            }
+            view.columns.push_back(column);
+        }
+    }
+
+    /*
+     * Data sets that are aggregated are written as the statistics of their trajectories at each sample point: the
+     * count, mean, standard deviation, minimum, maximum and quantiles.
+     */
+    int serialiseAggregates(std::ostream& os)
+    {
+        std::vector<const MyData*> aggregated;
+        std::vector<const MyVariable*> variables;
+        unsigned int numberOfPoints = 0;
+        for (const auto& ds: dataSets)
+        {
+            const MyData& d = ds.second;
+            if (d.variables.empty() || !d.variables.begin()->second.aggregate) continue;
+            // FIXME: as for the plain data sets, the data generator math is not applied, we use its first variable
+            const MyVariable& v = d.variables.begin()->second;
+            aggregated.push_back(&d);
+            variables.push_back(&v);
+            if (v.statistics.size() > numberOfPoints) numberOfPoints = v.statistics.size();
+        }
+        if (aggregated.empty()) return 0;
+        for (unsigned int k = 0; k < aggregated.size(); ++k)
+        {
+            const std::string& name = aggregated[k]->label.empty() ? aggregated[k]->id : aggregated[k]->label;
+            if (k > 0) os << ",";
+            os << name << ":count," << name << ":mean," << name << ":sd," << name << ":min," << name << ":max";
+            for (double p: variables[k]->aggregateQuantiles) os << "," << name << ":q" << p;
+        }
+        os << std::endl;
+        for (unsigned int i = 0; i < numberOfPoints; ++i)
+        {
+            for (unsigned int k = 0; k < variables.size(); ++k)
+            {
+                if (k > 0) os << ",";
+                const std::vector<RunningStatistics>& statistics = variables[k]->statistics;
+                if (i < statistics.size())
+                {
+                    const RunningStatistics& s = statistics[i];
+                    os << s.count() << "," << s.mean() << "," << sqrt(s.variance()) << "," << s.minimum() << ","
+                       << s.maximum();
+                    for (unsigned int q = 0; q < s.numberOfQuantiles(); ++q) os << "," << s.quantile(q);
+                }
+                else
+                {
+                    // a shorter trajectory, keep the columns aligned
+                    os << "0,,,,";
+                    for (unsigned int q = 0; q < variables[k]->aggregateQuantiles.size(); ++q) os << ",";
+                }
+            }
+            os << std::endl;
+        }
+        return 0;
+    }
+
     const SedReport* sed;
     std::string id;
     DataSet dataSets;
@@ -744,6 +984,13 @@ public:
 class MyReportList : public std::vector<MyReport>
 {
 public:
+    MyReportList() : nextGeneratedId(1000)
+    {
+    }
+
+    // the number used for the next generated data set ID, so the IDs only depend on the document
+    int nextGeneratedId;
+
     int resolveTasks(SedDocument* doc, const std::string& baseUri)
     {
         int numberOfErrors = 0;
@@ -767,6 +1014,38 @@ public:
         return numberOfErrors;
     }
 
+    int setAggregation(const std::string& dataSetId, const std::vector<double>& quantiles)
+    {
+        int numberOfDataSets = 0;
+        for (auto i = begin(); i != end(); ++i)
+        {
+            for (auto& ds: i->dataSets)
+            {
+                if ((dataSetId != "*") && (ds.first != dataSetId)) continue;
+                ds.second.setAggregation(quantiles);
+                ++numberOfDataSets;
+            }
+        }
+        return numberOfDataSets;
+    }
+
+    int setDecimation(const std::string& reportId, const DecimationOptions& options)
+    {
+        int numberOfReports = 0;
+        for (auto i = begin(); i != end(); ++i)
+        {
+            if ((reportId != "*") && (i->id != reportId)) continue;
+            i->dataSets.decimation = options;
+            ++numberOfReports;
+        }
+        return numberOfReports;
+    }
+
+    void setPublisher(ResultListener* publisher)
+    {
+        for (auto i = begin(); i != end(); ++i) i->dataSets.publisher = publisher;
+    }
+
     int serialise(std::ostream& os)
     {
         int numberOfErrors = 0;
@@ -776,9 +1055,21 @@ public:
         }
         return numberOfErrors;
     }
+
+    void writeStatistics(std::ostream& os) const
+    {
+        bool first = true;
+        for (auto i = begin(); i != end(); ++i) i->writeStatistics(os, first);
+    }
+
+    void view(std::vector<ReportView>& views) const
+    {
+        views.resize(size());
+        for (unsigned int i = 0; i < size(); ++i) at(i).view(views[i]);
+    }
 };
 
-Sedml::Sedml() : mSed(NULL), mReports(NULL), mExecutionPerformed(false)
+Sedml::Sedml() : mSed(NULL), mReports(NULL), mMirror(NULL), mExecutionPerformed(false)
 {
 }
 
@@ -786,15 +1077,22 @@ Sedml::~Sedml()
 {
     if (mSed) delete mSed;
     if (mReports) delete mReports;
+    if (mMirror) delete mMirror;
 }
 
 int Sedml::parseFromString(const std::string &xmlDocument)
 {
-    mSed = readSedMLFromString(xmlDocument.c_str());
+    return parseFromBuffer(xmlDocument.c_str(), xmlDocument);
+}
+
+int Sedml::parseFromBuffer(const char* xmlDocument, const std::string& source)
+{
+    GET_TRACE_SCOPE("sedml", "parse document");
+    mSed = readSedMLFromString(xmlDocument);
     int numErrors = mSed->getErrorLog()->getNumFailsWithSeverity(LIBSEDML_SEV_ERROR);
     if (numErrors > 0)
     {
-        std::cerr << "Error loading SED-ML document: " << xmlDocument.c_str() << std::endl;
+        std::cerr << "Error loading SED-ML document: " << source.c_str() << std::endl;
         std::cerr << mSed->getErrorLog()->toString();
         delete mSed;
         mSed = NULL;
@@ -802,7 +1100,7 @@ int Sedml::parseFromString(const std::string &xmlDocument)
     }
     if (mSed->getNumErrors() > 0)
     {
-      std::cout << "Warnings: " << mSed->getErrorLog()->toString() << std::endl;
+      GET_LOG(LogWarning, mSed->getErrorLog()->toString());
     }
 
     return 0;
@@ -810,6 +1108,7 @@ int Sedml::parseFromString(const std::string &xmlDocument)
 
 int Sedml::buildExecutionManifest(const std::string& baseUri)
 {
+    GET_TRACE_SCOPE("sedml", "build execution manifest");
     int numberOfErrors = 0;
     if (mReports) delete mReports;
     for (unsigned int i = 0; i < mSed->getNumOutputs(); ++i)
@@ -820,25 +1119,26 @@ int Sedml::buildExecutionManifest(const std::string& baseUri)
         case SEDML_OUTPUT_REPORT:
         {
           if (!mReports) mReports = new MyReportList();
-          mReports->push_back(MyReport(static_cast<SedReport*>(current)));
+          mReports->push_back(MyReport(static_cast<SedReport*>(current), mReports->nextGeneratedId));
           break;
         }
         case SEDML_OUTPUT_PLOT2D:
         {
           SedPlot2D* p = static_cast<SedPlot2D*>(current);
-          std::cout << "\t[unsupported] Plot2d id=" << current->getId() << " numCurves=" << p->getNumCurves() << std::endl;
+          GET_LOG(LogWarning, "[unsupported] Plot2d id=" << current->getId() << " numCurves=" << p->getNumCurves());
           ++numberOfErrors;
           break;
         }
         case SEDML_OUTPUT_PLOT3D:
         {
           SedPlot3D* p = static_cast<SedPlot3D*>(current);
-          std::cout << "\t[unsupported] Plot3d id=" << current->getId() << " numSurfaces=" << p->getNumSurfaces() << std::endl;
+          GET_LOG(LogWarning, "[unsupported] Plot3d id=" << current->getId() << " numSurfaces="
+                  << p->getNumSurfaces());
           ++numberOfErrors;
           break;
         }
         default:
-          std::cout << "\tEncountered unknown output " << current->getId() << std::endl;
+          GET_LOG(LogWarning, "Encountered unknown output " << current->getId());
           ++numberOfErrors;
           break;
       }
@@ -849,6 +1149,21 @@ int Sedml::buildExecutionManifest(const std::string& baseUri)
         // we have some outputs that we can handle, so make sure we have all the information that we need
         // to start configuring and running simulations.
         numberOfErrors = mReports->resolveTasks(mSed, baseUri);
+        if (numberOfErrors == 0)
+        {
+            // fetch all the models and their imports together now rather than one at a time as they are loaded, and
+            // give CSim the local copies so it doesn't fetch them again
+            std::vector<std::string> modelUrls;
+            for (const MyReport& report: *mReports)
+                for (const auto& m: report.models) modelUrls.push_back(m.second.source);
+            if (mMirror) delete mMirror;
+            mMirror = new DocumentMirror();
+            int numberOfFailures = mMirror->mirror(modelUrls);
+            if (numberOfFailures > 0) std::cerr << "Unable to prefetch " << numberOfFailures << " model document(s)"
+                                                << ", they will be fetched again when needed" << std::endl;
+            for (MyReport& report: *mReports)
+                for (auto& m: report.models) m.second.localSource = mMirror->localUrl(m.second.source);
+        }
     }
 
     return numberOfErrors;
@@ -856,14 +1171,68 @@ int Sedml::buildExecutionManifest(const std::string& baseUri)
 
 int Sedml::execute()
 {
+    GET_TRACE_SCOPE("sedml", "execute");
     int numberOfErrors = 0;
     if (mReports) numberOfErrors = mReports->execute();
     mExecutionPerformed = true;
     return numberOfErrors;
 }
 
+int Sedml::aggregateDataSet(const std::string& dataSetId, const std::vector<double>& quantiles)
+{
+    if (!mReports)
+    {
+        std::cerr << "Sedml::aggregateDataSet: need to build the execution manifest first" << std::endl;
+        return -1;
+    }
+    if (mReports->setAggregation(dataSetId, quantiles) == 0)
+    {
+        std::cerr << "Sedml::aggregateDataSet: no report data set with the ID: " << dataSetId << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+int Sedml::decimateReport(const std::string& reportId, const DecimationOptions& options)
+{
+    if (!mReports)
+    {
+        std::cerr << "Sedml::decimateReport: need to build the execution manifest first" << std::endl;
+        return -1;
+    }
+    if (mReports->setDecimation(reportId, options) == 0)
+    {
+        std::cerr << "Sedml::decimateReport: no report with the ID: " << reportId << std::endl;
+        return -2;
+    }
+    return 0;
+}
+
+int Sedml::publishResults(ResultListener* publisher)
+{
+    if (!mReports)
+    {
+        std::cerr << "Sedml::publishResults: need to build the execution manifest first" << std::endl;
+        return -1;
+    }
+    mReports->setPublisher(publisher);
+    return 0;
+}
+
+int Sedml::reportViews(std::vector<ReportView>& views) const
+{
+    if (!mExecutionPerformed || !mReports)
+    {
+        std::cerr << "Sedml::reportViews: you need to execute the simulation tasks first" << std::endl;
+        return -1;
+    }
+    mReports->view(views);
+    return 0;
+}
+
 int Sedml::serialiseReports(std::ostream& os)
 {
+    GET_TRACE_SCOPE("output", "serialise reports");
     int numberOfErrors = 0;
     if (mExecutionPerformed)
     {
@@ -877,6 +1246,161 @@ int Sedml::serialiseReports(std::ostream& os)
     return numberOfErrors;
 }
 
+int Sedml::serialiseSolverStatistics(std::ostream& os)
+{
+    if (!mExecutionPerformed)
+    {
+        std::cerr << "You need to execute the simulation tasks before serialising the solver statistics?"
+                  << std::endl;
+        return 1;
+    }
+    os << "{\"tasks\":[";
+    if (mReports) mReports->writeStatistics(os);
+    os << "\n]}" << std::endl;
+    return 0;
+}
+
+/*
+ * Find the given CSim simulation task in the execution manifest, along with its model, simulation and the
+ * namespaces in scope for the task in the SED-ML document.
+ */
+static int resolveCsimTask(const MyReportList* reports, SedDocument* doc, const std::string& taskId,
+                           const MyTask*& task, const MyModel*& model, const MySimulation*& simulation,
+                           std::map<std::string, std::string>& namespaces)
+{
+    if (!reports)
+    {
+        std::cerr << "Need to build the execution manifest first" << std::endl;
+        return -1;
+    }
+    task = NULL;
+    model = NULL;
+    simulation = NULL;
+    for (const MyReport& report: *reports)
+    {
+        auto t = report.tasks.find(taskId);
+        if (t == report.tasks.end()) continue;
+        task = &(t->second);
+        if (task->isRepeatedTask) break;
+        auto m = report.models.find(task->modelReference);
+        auto s = report.simulations.find(task->simulationReference);
+        if (m != report.models.end()) model = &(m->second);
+        if (s != report.simulations.end()) simulation = &(s->second);
+        break;
+    }
+    if (!task)
+    {
+        std::cerr << "The task " << taskId << " is not in the execution manifest" << std::endl;
+        return -2;
+    }
+    if (task->isRepeatedTask || !model || !simulation || !simulation->isCsim())
+    {
+        std::cerr << "The task " << taskId << " is not a CSim simulation task" << std::endl;
+        return -3;
+    }
+    namespaces = getAllNamespaces(doc->getTask(taskId));
+    return 0;
+}
+
+int Sedml::estimateParameters(const std::string& taskId, std::vector<EstimationParameter>& parameters,
+                              std::vector<EstimationData>& data, const EstimationOptions& options, double& value)
+{
+    const MyTask* task;
+    const MyModel* model;
+    const MySimulation* simulation;
+    std::map<std::string, std::string> namespaces;
+    if (resolveCsimTask(mReports, mSed, taskId, task, model, simulation, namespaces) != 0)
+    {
+        std::cerr << "Sedml::estimateParameters: unable to resolve the task: " << taskId << std::endl;
+        return -1;
+    }
+    // resolve the targets in the same way as the task's own changes and variables
+    for (EstimationParameter& p: parameters)
+    {
+        p.change.modelReference = task->modelReference;
+        if (p.change.namespaces.empty()) p.change.namespaces = namespaces;
+    }
+    for (EstimationData& d: data)
+    {
+        d.variable.taskReference = taskId;
+        if (d.variable.namespaces.empty()) d.variable.namespaces = namespaces;
+    }
+    ParameterEstimation estimation;
+    int status = estimation.initialise(model->localSource, *simulation, parameters, data, options.numberOfWorkers);
+    if (status != 0)
+    {
+        std::cerr << "Sedml::estimateParameters: error initialising the estimation" << std::endl;
+        return -4;
+    }
+    status = estimation.estimate(options, parameters, value);
+    GET_LOG(LogInfo, "Parameter estimation for task " << taskId << " used " << estimation.numberOfEvaluations()
+            << " objective evaluations");
+    return status;
+}
+
+/*
+ * Resolve the sampled inputs and summarised outputs of a sampling specification against the given task.
+ */
+static void bindSamplingToTask(const MyTask* task, const std::string& taskId,
+                               const std::map<std::string, std::string>& namespaces,
+                               std::vector<SamplingInput>& inputs, std::vector<MyVariable>& outputs)
+{
+    for (SamplingInput& input: inputs)
+    {
+        input.change.modelReference = task->modelReference;
+        if (input.change.namespaces.empty()) input.change.namespaces = namespaces;
+    }
+    for (MyVariable& output: outputs)
+    {
+        output.taskReference = taskId;
+        if (output.namespaces.empty()) output.namespaces = namespaces;
+    }
+}
+
+int Sedml::sampleTask(const std::string& taskId, std::vector<SamplingInput>& inputs,
+                      std::vector<MyVariable>& outputs, const SamplingOptions& options, EnsembleStatistics& results)
+{
+    const MyTask* task;
+    const MyModel* model;
+    const MySimulation* simulation;
+    std::map<std::string, std::string> namespaces;
+    if (resolveCsimTask(mReports, mSed, taskId, task, model, simulation, namespaces) != 0)
+    {
+        std::cerr << "Sedml::sampleTask: unable to resolve the task: " << taskId << std::endl;
+        return -1;
+    }
+    bindSamplingToTask(task, taskId, namespaces, inputs, outputs);
+    SamplingEngine engine;
+    if (engine.initialise(model->localSource, *simulation, inputs, outputs, options.numberOfWorkers) != 0)
+    {
+        std::cerr << "Sedml::sampleTask: error initialising the sampling engine" << std::endl;
+        return -4;
+    }
+    return engine.run(options, results);
+}
+
+int Sedml::sobolIndices(const std::string& taskId, std::vector<SamplingInput>& inputs,
+                        std::vector<MyVariable>& outputs, const SamplingOptions& options, SobolIndices& results)
+{
+    const MyTask* task;
+    const MyModel* model;
+    const MySimulation* simulation;
+    std::map<std::string, std::string> namespaces;
+    if (resolveCsimTask(mReports, mSed, taskId, task, model, simulation, namespaces) != 0)
+    {
+        std::cerr << "Sedml::sobolIndices: unable to resolve the task: " << taskId << std::endl;
+        return -1;
+    }
+    bindSamplingToTask(task, taskId, namespaces, inputs, outputs);
+    SobolAnalysis analysis;
+    if (analysis.initialise(model->localSource, *simulation, inputs, outputs, options.numberOfWorkers) != 0)
+    {
+        std::cerr << "Sedml::sobolIndices: error initialising the sensitivity analysis" << std::endl;
+        return -4;
+    }
+    return analysis.run(options, results);
+}
+
 int Sedml::checkBob()
 {
     int numberOfErrors = 0;
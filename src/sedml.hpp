@@ -6,9 +6,22 @@
  */
 
 #include <string>
+#include <vector>
 #include <sedml/SedTypes.h>
 
 class MyReportList;
+class EstimationParameter;
+class EstimationData;
+class EstimationOptions;
+class SamplingInput;
+class SamplingOptions;
+class EnsembleStatistics;
+class SobolIndices;
+class MyVariable;
+class DecimationOptions;
+class ResultListener;
+class ReportView;
+class DocumentMirror;
 
 class Sedml
 {
@@ -23,6 +36,14 @@ public:
      */
     int parseFromString(const std::string& xmlDocument);
 
+    /**
+     * @brief Parse the given SED-ML document directly from a buffer, e.g., a memory mapped file.
+     * @param xmlDocument The SED-ML document to parse, NUL terminated.
+     * @param source Where the document came from, for error messages.
+     * @return 0 if no error, otherwise the number of errors in the SED-ML document
+     */
+    int parseFromBuffer(const char* xmlDocument, const std::string& source);
+
     /**
      * @brief Snoop through this SED-ML document and build a list of the simulations that need to be executed.
      *
@@ -41,17 +62,125 @@ public:
      */
     int execute();
 
+    /**
+     * @brief Summarise a report data set by streaming statistics rather than storing every trajectory.
+     *
+     *Each execution of the data set's task (e.g., each repeat of a repeated task) is added to the running mean,
+     *variance, minimum, maximum and approximate quantiles at each sample point, so memory does not depend on the
+     *number of repeats. The statistics are serialised in place of the trajectories. Must be called after the
+     *execution manifest has been built and before the simulation tasks are executed.
+     *
+     * @param dataSetId The ID of the data set, or "*" for all data sets.
+     * @param quantiles The probabilities of the quantiles to estimate.
+     * @return zero on success.
+     */
+    int aggregateDataSet(const std::string& dataSetId, const std::vector<double>& quantiles);
+
+    /**
+     * @brief Decimate the samples of a report as they are produced, keeping only those needed to represent its
+     * time courses to the given fidelity. Samples are kept or dropped for all the data sets of the report together,
+     * aggregated data sets are not decimated. Must be called after the execution manifest has been built and
+     * before the simulation tasks are executed.
+     *
+     * @param reportId The ID of the report, or "*" for all reports.
+     * @param options The decimation to apply.
+     * @return zero on success.
+     */
+    int decimateReport(const std::string& reportId, const DecimationOptions& options);
+
+    /**
+     * @brief Publish the rows of the reports' trajectories as they are stored while the tasks are executed, so
+     * long runs can be monitored. Each execution of a task is a separate stream. Must be called after the
+     * execution manifest has been built.
+     *
+     * @param publisher The publisher (e.g., a ResultPublisher) to use, it must outlive the execution of the tasks;
+     * NULL to stop publishing.
+     * @return zero on success.
+     */
+    int publishResults(ResultListener* publisher);
+
+    /**
+     * @brief Views of the columns of the reports, which refer to the stored results so are only valid until the
+     * tasks are executed again or this object is destroyed.
+     * @param views On success, a view of each report.
+     * @return zero on success, non-zero if the tasks have not been executed.
+     */
+    int reportViews(std::vector<ReportView>& views) const;
+
     /**
      * @brief Serialise the reports that we know about, presumably after the simulation tasks have been executed.
      * @return zero on success.
      */
     int serialiseReports(std::ostream&);
 
+    /**
+     * @brief Serialise the work done by the solvers for each simple task (and sub-task of a repeated task) that
+     * has been executed as JSON: {"tasks": [{"report", "task", "id", "executions", "steps", "rhsEvaluations",
+     * "jacobianEvaluations", "nonlinearIterations", "convergenceFailures", "errorTestFailures", "kinsolSolves",
+     * "kinsolIterations", "kinsolSolvesPerRhsEvaluation", "wallTime": {"load", "instantiate", "initialise",
+     * "simulate"}}, ...]}, with the times in seconds. See SolverStatistics.
+     * @return zero on success.
+     */
+    int serialiseSolverStatistics(std::ostream& os);
+
+    /**
+     * @brief Estimate inputs of one of the simulation tasks in this SED-ML document against reference data.
+     *
+     *The execution manifest must have been built and must contain the task, which must be a CSim simulation
+     *task. The target XPaths of the parameters and data are resolved with the namespaces in scope for the task
+     *in this document. The model is compiled once for each worker and kept for all objective evaluations.
+     *
+     * @param taskId The ID of the task.
+     * @param parameters The inputs to estimate, updated with their estimates on success.
+     * @param data The reference data for the model outputs.
+     * @param options The estimation options.
+     * @param value On success, the objective value at the estimate.
+     * @return zero on success, a positive value if the estimation did not converge, a negative value on error.
+     */
+    int estimateParameters(const std::string& taskId, std::vector<EstimationParameter>& parameters,
+                           std::vector<EstimationData>& data, const EstimationOptions& options, double& value);
+
+    /**
+     * @brief Sample inputs of one of the simulation tasks in this SED-ML document and summarise its outputs.
+     *
+     *The execution manifest must contain the task, which must be a CSim simulation task. Target XPaths are
+     *resolved as for estimateParameters. The samples are simulated in parallel and only the streaming
+     *statistics of the outputs are kept.
+     *
+     * @param taskId The ID of the task.
+     * @param inputs The inputs to sample.
+     * @param outputs The outputs to summarise.
+     * @param options The sampling options.
+     * @param results On success, the statistics of the outputs.
+     * @return zero on success.
+     */
+    int sampleTask(const std::string& taskId, std::vector<SamplingInput>& inputs, std::vector<MyVariable>& outputs,
+                   const SamplingOptions& options, EnsembleStatistics& results);
+
+    /**
+     * @brief Compute the first-order and total-order Sobol indices of the outputs of one of the simulation tasks in
+     * this SED-ML document with respect to the given inputs.
+     *
+     *The task and target XPaths are resolved as for sampleTask. The number of samples in the options is the
+     *number of base samples, N, and N(k+2) simulations are needed for k inputs.
+     *
+     * @param taskId The ID of the task.
+     * @param inputs The inputs to vary, sampled from their distributions.
+     * @param outputs The outputs to analyse.
+     * @param options The sampling options.
+     * @param results On success, the Sobol indices.
+     * @return zero on success.
+     */
+    int sobolIndices(const std::string& taskId, std::vector<SamplingInput>& inputs, std::vector<MyVariable>& outputs,
+                     const SamplingOptions& options, SobolIndices& results);
+
     int checkBob();
 
 private:
     libsedml::SedDocument* mSed;
     MyReportList* mReports;
+    // local copies of the models, for as long as they may be loaded
+    DocumentMirror* mMirror;
     bool mExecutionPerformed;
 };
 
@@ -1,21 +1,25 @@
 #include <iostream>
 #include <map>
 #include <cmath>
+#include <cfloat>
 #include <vector>
 
 #include <csim/model.h>
 #include <csim/error_codes.h>
 #include <csim/executable_functions.h>
 
-#include <cvode/cvode.h>             /* main integrator header file */
+#include <cvodes/cvodes.h>           /* main integrator header file */
 #include <nvector/nvector_serial.h>  /* serial N_Vector types, fct. and macros */
 #include <sundials/sundials_types.h> /* definition of realtype */
-#include <cvode/cvode_dense.h>
+#include <cvodes/cvodes_dense.h>
 
 #include "dataset.hpp"
 #include "simulationenginecsim.hpp"
 #include "setvaluechange.hpp"
 #include "utils.hpp"
+#include "omexarchive.hpp"
+#include "tracing.hpp"
+#include "solverstatistics.hpp"
 
 /* Functions called by CVODE */
 static int f(realtype t, N_Vector y, N_Vector ydot, void *user_data);
@@ -31,13 +35,13 @@ static int check_flag(void *flagvalue, const char *funcname, int opt);
 class CellmlSimulator
 {
 public:
-    CellmlSimulator() : mCvode(0), mMethod(UNKOWN_ALG)
+    CellmlSimulator() : nv_states(0), nv_rates(0), yS(0), mCvode(0), mMethod(UNKOWN_ALG)
     {
 
     }
     ~CellmlSimulator()
     {
-        if (mCvode) CVodeFree(&mCvode);
+        freeIntegrator();
     }
 
     csim::Model model;
@@ -52,10 +56,43 @@ public:
         std::vector<double> states, outputs, inputs;
     } cache;
 
+    // forward sensitivities with respect to model inputs: the input index of each sensitivity parameter, the
+    // state sensitivities, and the (output index, parameter) of each sensitivity output along with its value
+    std::vector<int> sensitivityInputs;
+    N_Vector* yS;
+    std::vector<std::pair<int, int> > sensitivityOutputMap;
+    std::vector<double> sensitivityOutputs;
+
+    // the counters of the integrators that have been freed
+    SolverStatistics completedStatistics;
+
+    void freeIntegrator()
+    {
+        if (yS) N_VDestroyVectorArray_Serial(yS, sensitivityInputs.size());
+        yS = 0;
+        if (mCvode)
+        {
+            addCvodeStatistics(mCvode, completedStatistics);
+            CVodeFree(&mCvode);
+        }
+        // the state vector wraps our own storage, so only the rates own their data
+        if (nv_states) N_VDestroy_Serial(nv_states);
+        if (nv_rates) N_VDestroy_Serial(nv_rates);
+        nv_states = nv_rates = 0;
+    }
+
     int createIntegrator(const MySimulation& simulation, double x0)
     {
         if (simulation.mMethod == "KISAO:0000019") mMethod = CVODE_ALG;
         else if (simulation.mMethod == "KISAO:0000030") mMethod = EULER_ALG;
+        if ((mMethod != CVODE_ALG) && (sensitivityInputs.size() > 0))
+        {
+            std::cerr << "CellmlSimulator::createIntegrator: sensitivities can only be computed with CVODE"
+                      << std::endl;
+            return 1;
+        }
+        // in case of a previous simulation (e.g., repeated tasks)
+        freeIntegrator();
         // initialise our variable of integration
         voi = x0;
         // create and initialise our CVODE integrator
@@ -80,6 +117,10 @@ public:
             // add our user data
             flag = CVodeSetUserData(mCvode, (void*)(this));
             if (check_flag(&flag,"CVodeSetUserData",1)) return(1);
+            if (sensitivityInputs.size() > 0)
+            {
+                if (createSensitivities() != 0) return(1);
+            }
         }
         else
         {
@@ -90,6 +131,58 @@ public:
         return 0;
     }
 
+    int createSensitivities()
+    {
+        int Ns = sensitivityInputs.size();
+        // the initial state is assumed independent of the sensitivity parameters
+        yS = N_VCloneVectorArray_Serial(Ns, nv_states);
+        if (check_flag((void*)yS, "N_VCloneVectorArray_Serial", 0)) return(1);
+        for (int i = 0; i < Ns; ++i) N_VConst_Serial(RCONST(0.0), yS[i]);
+        // CVODES perturbs the inputs directly when computing the sensitivity right hand sides
+        sensitivityScales.resize(Ns);
+        for (int i = 0; i < Ns; ++i)
+        {
+            double p = inputs[sensitivityInputs[i]];
+            sensitivityScales[i] = (p != 0.0) ? fabs(p) : 1.0;
+        }
+        int flag = CVodeSensInit(mCvode, Ns, CV_STAGGERED, NULL, yS);
+        if (check_flag(&flag, "CVodeSensInit", 1)) return(1);
+        flag = CVodeSensEEtolerances(mCvode);
+        if (check_flag(&flag, "CVodeSensEEtolerances", 1)) return(1);
+        flag = CVodeSetSensParams(mCvode, inputs.data(), sensitivityScales.data(), sensitivityInputs.data());
+        if (check_flag(&flag, "CVodeSetSensParams", 1)) return(1);
+        flag = CVodeSetSensErrCon(mCvode, TRUE);
+        if (check_flag(&flag, "CVodeSetSensErrCon", 1)) return(1);
+        return 0;
+    }
+
+    /*
+     * The sensitivity of an output g(t, y, p) to parameter j is dg/dy.s_j + dg/dp_j, evaluated here as a single
+     * directional difference of the model function for each parameter.
+     */
+    void calculateSensitivityOutputs()
+    {
+        sensitivityOutputs.assign(sensitivityOutputMap.size(), 0.0);
+        if (!yS) return;
+        std::vector<double> perturbedStates(states.size()), rates(states.size()), perturbedOutputs(outputs.size());
+        std::vector<double> perturbedInputs;
+        for (unsigned int j = 0; j < sensitivityInputs.size(); ++j)
+        {
+            double sigma = sqrt(DBL_EPSILON) * sensitivityScales[j];
+            for (unsigned int i = 0; i < states.size(); ++i)
+                perturbedStates[i] = states[i] + sigma * NV_Ith_S(yS[j], i);
+            perturbedInputs = inputs;
+            perturbedInputs[sensitivityInputs[j]] += sigma;
+            modelFunction(voi, perturbedStates.data(), rates.data(), perturbedOutputs.data(), perturbedInputs.data());
+            for (unsigned int k = 0; k < sensitivityOutputMap.size(); ++k)
+            {
+                if (sensitivityOutputMap[k].second != (int)j) continue;
+                int o = sensitivityOutputMap[k].first;
+                sensitivityOutputs[k] = (perturbedOutputs[o] - outputs[o]) / sigma;
+            }
+        }
+    }
+
     void callInitialise()
     {
         initialiseFunction(states.data(), outputs.data(), inputs.data());
@@ -110,6 +203,13 @@ public:
             if (check_flag(&flag,"CVode",1)) return(1);
             // make sure the non-state variables are at the correct time
             callModel();
+            if (yS)
+            {
+                realtype tret;
+                flag = CVodeGetSens(mCvode, &tret, yS);
+                if (check_flag(&flag,"CVodeGetSens",1)) return(1);
+                calculateSensitivityOutputs();
+            }
         }
         else if (mMethod == EULER_ALG)
         {
@@ -119,6 +219,8 @@ public:
                 voi += maxStepSize;
                 if (voi > xout) voi = xout;
                 callModel();
+                ++completedStatistics.steps;
+                ++completedStatistics.rhsEvaluations;
                 for (unsigned i = 0; i < states.size(); ++i)
                 {
                     NV_Ith_S(nv_states, i) += maxStepSize * NV_Ith_S(nv_rates, i);
@@ -128,6 +230,11 @@ public:
         }
         return 0;
     }
+    void statistics(SolverStatistics& s) const
+    {
+        s = completedStatistics;
+        if (mCvode) addCvodeStatistics(mCvode, s);
+    }
     void checkpointModelValues()
     {
         cache.voi = voi;
@@ -143,6 +250,7 @@ public:
         states = cache.states;
     }
 private:
+    std::vector<double> sensitivityScales;
     void* mCvode;
     enum Method {
         CVODE_ALG = 1,
@@ -165,7 +273,10 @@ SimulationEngineCsim::~SimulationEngineCsim()
 
 int SimulationEngineCsim::loadModel(const std::string &modelUrl)
 {
-    if (mCsim->model.loadCellmlModel(modelUrl) != csim::CSIM_OK)
+    GET_TRACE_SCOPE("model", "load model");
+    // CSim fetches the model itself, so models in an OMEX archive need to be given to it as local files
+    std::string url = omexLocalUrl(modelUrl);
+    if (url.empty() || (mCsim->model.loadCellmlModel(url) != csim::CSIM_OK))
     {
         std::cerr << "Error loading CellML model: " << modelUrl << std::endl;
         return -2;
@@ -189,6 +300,38 @@ int SimulationEngineCsim::addOutputVariable(MyVariable &variable)
         // make sure the output vector is big enough
         if (variable.outputIndex >= (int)mCsim->outputs.size()) mCsim->outputs.resize(variable.outputIndex+1);
     }
+    if (variable.sensitivityTarget.empty())
+        mRegisteredVariables.push_back(std::make_pair(variable.outputIndex, variable.sensitivityIndex));
+    return numberOfErrors;
+}
+
+int SimulationEngineCsim::addSensitivityVariable(MyVariable& variable)
+{
+    // the output being differentiated
+    MyVariable output(variable);
+    output.sensitivityTarget = "";
+    int numberOfErrors = addOutputVariable(output);
+    if (numberOfErrors > 0) return numberOfErrors;
+    variable.outputIndex = output.outputIndex;
+    // and the parameter it is being differentiated with respect to
+    std::string variableId = mCsim->model.mapXpathToVariableId(variable.sensitivityTarget, variable.namespaces);
+    int inputIndex = mCsim->model.setVariableAsInput(variableId);
+    if (inputIndex < 0)
+    {
+        std::cerr << "Unable to map sensitivity parameter to a variable in the model: " << variable.sensitivityTarget
+                  << " (id: " << variableId << ")" << "; error code: " << inputIndex << std::endl;
+        return ++numberOfErrors;
+    }
+    if (inputIndex >= (int)mCsim->inputs.size()) mCsim->inputs.resize(inputIndex+1);
+    unsigned int parameter = 0;
+    while ((parameter < mCsim->sensitivityInputs.size()) && (mCsim->sensitivityInputs[parameter] != inputIndex))
+        ++parameter;
+    if (parameter == mCsim->sensitivityInputs.size()) mCsim->sensitivityInputs.push_back(inputIndex);
+    variable.sensitivityIndex = mCsim->sensitivityOutputMap.size();
+    mCsim->sensitivityOutputMap.push_back(std::make_pair(variable.outputIndex, (int)parameter));
+    mCsim->sensitivityOutputs.resize(mCsim->sensitivityOutputMap.size());
+    // replace the registration of the output it is the sensitivity of
+    mRegisteredVariables.back() = std::make_pair(variable.outputIndex, variable.sensitivityIndex);
     return numberOfErrors;
 }
 
@@ -208,11 +351,13 @@ int SimulationEngineCsim::addInputVariable(MySetValueChange& change)
         // make sure the inputs vector is large enough
         if (change.inputIndex >= (int)mCsim->inputs.size()) mCsim->inputs.resize(change.inputIndex+1);
     }
+    mRegisteredChanges.push_back(change.inputIndex);
     return numberOfErrors;
 }
 
 int SimulationEngineCsim::instantiateSimulation()
 {
+    GET_TRACE_SCOPE("model", "instantiate simulation");
     if (mCsim->model.instantiate() != csim::CSIM_OK)
     {
         std::cerr <<"SimulationEngineCsim::initialiseSimulation - Error compiling model." << std::endl;
@@ -221,12 +366,14 @@ int SimulationEngineCsim::instantiateSimulation()
     mCsim->initialiseFunction = mCsim->model.getInitialiseFunction();
     mCsim->modelFunction = mCsim->model.getModelFunction();
     mCsim->states.resize(mCsim->model.numberOfStateVariables());
+    mInitialInputs = mCsim->inputs;
     mCsim->callInitialise();
     return 0;
 }
 
 int SimulationEngineCsim::initialiseSimulation(const MySimulation& simulation, double initialTime, double startTime)
 {
+    GET_TRACE_SCOPE("solver", "initialise simulation");
     // create our integrator
     if (mCsim->createIntegrator(simulation, initialTime) != 0)
     {
@@ -235,6 +382,7 @@ int SimulationEngineCsim::initialiseSimulation(const MySimulation& simulation, d
     }
     // ensure the model is correct for the given initial value
     mCsim->callModel();
+    mCsim->calculateSensitivityOutputs();
     // and checkpoint the model at the initial point
     mCsim->checkpointModelValues();
     // and then integrate to the start time in "one" step
@@ -248,14 +396,25 @@ const std::vector<double>& SimulationEngineCsim::getOutputValues()
     return mCsim->outputs;
 }
 
+const std::vector<double>& SimulationEngineCsim::getSensitivityValues()
+{
+    return mCsim->sensitivityOutputs;
+}
+
 int SimulationEngineCsim::simulateModelOneStep(double step)
 {
+    GET_TRACE_SCOPE("solver", "integrator step");
     if (mInitialised) return mCsim->simulateModelOneStep(step);
     std::cerr << "SimulationEngineCsim::simulateModelOneStep: must initialise "
                  "simulation prior to calling this method." << std::endl;
     return -1;
 }
 
+void SimulationEngineCsim::getSolverStatistics(SolverStatistics& statistics) const
+{
+    mCsim->statistics(statistics);
+}
+
 int SimulationEngineCsim::resetSimulator(bool resetModel)
 {
     // nothing to do with the "integrator" at present.
@@ -277,6 +436,32 @@ int SimulationEngineCsim::applySetValueChange(const MySetValueChange& change)
     return 0;
 }
 
+int SimulationEngineCsim::resetToInitialConditions()
+{
+    mCsim->inputs = mInitialInputs;
+    mCsim->callInitialise();
+    mInitialised = false;
+    return 0;
+}
+
+int SimulationEngineCsim::restoreRegistration(const std::vector<MyVariable*>& variables,
+                                              const std::vector<MySetValueChange*>& changes) const
+{
+    if ((variables.size() != mRegisteredVariables.size()) || (changes.size() != mRegisteredChanges.size()))
+    {
+        std::cerr << "SimulationEngineCsim::restoreRegistration: the variables and changes don't match those of the"
+                  << " engine." << std::endl;
+        return -1;
+    }
+    for (unsigned int i = 0; i < variables.size(); ++i)
+    {
+        variables[i]->outputIndex = mRegisteredVariables[i].first;
+        variables[i]->sensitivityIndex = mRegisteredVariables[i].second;
+    }
+    for (unsigned int i = 0; i < changes.size(); ++i) changes[i]->inputIndex = mRegisteredChanges[i];
+    return 0;
+}
+
 int f(realtype x, N_Vector y, N_Vector ydot, void *user_data)
 {
     CellmlSimulator* ud = (CellmlSimulator*)user_data;
@@ -9,6 +9,7 @@
 
 class CellmlSimulator;
 class MySetValueChange;
+class SolverStatistics;
 
 class SimulationEngineCsim
 {
@@ -33,6 +34,18 @@ public:
      */
     int addOutputVariable(MyVariable& variable);
 
+    /**
+     * @brief Add the given sensitivity variable to this CSim instance's list of outputs.
+     * The variable's target is the output variable and its sensitivityTarget the parameter, which will be flagged
+     * as an input of the model. This method will update the variable object with information on where its values
+     * are stored in the sensitivity values. All sensitivities must be flagged prior to instantiating the
+     * simulation and can only be computed with CVODE.
+     * @sa getSensitivityValues
+     * @param variable The sensitivity variable to register.
+     * @return zero on success, non-zero on failure.
+     */
+    int addSensitivityVariable(MyVariable& variable);
+
     /**
      * @brief Add the required variable from the given set value change to this CSim's list of input variables.
      * This method will update the change object with the information on where it is stored in the inputs of the model.
@@ -70,6 +83,12 @@ public:
      */
     const std::vector<double>& getOutputValues();
 
+    /**
+     * @brief Fetch the current values of the sensitivity variables for this instance of the simulation engine.
+     * @return A vector of the sensitivity variable values.
+     */
+    const std::vector<double>& getSensitivityValues();
+
     /**
      * @brief Simulate the model for one time period.
      * The simulation must be initialised prior to calling this method.
@@ -78,6 +97,13 @@ public:
      */
     int simulateModelOneStep(double step);
 
+    /**
+     * @brief Get the counters of the integrators this engine has used since it was created, for the work done by a
+     * task take the difference of the counters before and after it is executed. The times are left as zero.
+     * @param statistics Replaced with the counters.
+     */
+    void getSolverStatistics(SolverStatistics& statistics) const;
+
     /**
      * @brief Reset the simulator.
      * @param resetModel If true, the model will be reset back to initial conditions.
@@ -92,11 +118,33 @@ public:
      */
     int applySetValueChange(const MySetValueChange& change);
 
+    /**
+     * @brief Return an instantiated simulation to the state it was in just after it was instantiated, i.e., the
+     * initial conditions and input values of the model, so that it can be reused for another task.
+     * @return zero on success.
+     */
+    int resetToInitialConditions();
+
+    /**
+     * @brief Give the variables and changes the indices they were given when they were added to this engine, for
+     * reusing an instantiated engine with new, identical, variables and changes.
+     * @param variables The output and sensitivity variables, in the order they were added.
+     * @param changes The input changes, in the order they were added.
+     * @return zero on success, non-zero if they don't match those that were added.
+     */
+    int restoreRegistration(const std::vector<MyVariable*>& variables,
+                            const std::vector<MySetValueChange*>& changes) const;
+
 private:
     std::string mModelUrl;
     CellmlSimulator* mCsim;
     // will only be true once the simulation has been initialised.
     bool mInitialised;
+    // the (output, sensitivity) indices of each variable and the input index of each change, as they were added
+    std::vector<std::pair<int, int> > mRegisteredVariables;
+    std::vector<int> mRegisteredChanges;
+    // the input values just after instantiation
+    std::vector<double> mInitialInputs;
 };
 
 #endif // SIMULATIONENGINECSIM_HPP
@@ -1,5 +1,5 @@
 #include <iostream>
-#include <fstream>
+#include <sstream>
 #include <map>
 #include <cmath>
 #if 0
@@ -9,12 +9,12 @@
 #include "common.hpp"
 #include "molecule.hpp"
 #include "GeneralModel.hpp"
-#include "cvodes.hpp"
-#include "kinsol.hpp"
+#include "transporters.hpp"
+#include "steadystate.hpp"
 #include "dataset.hpp"
 #include "simulationengineget.hpp"
 
-SimulationEngineGet::SimulationEngineGet()
+SimulationEngineGet::SimulationEngineGet() : mActiveTransport(false)
 {
 #if 0
     mCsim = new CellmlSimulator();
@@ -76,7 +76,7 @@ int SimulationEngineGet::addOutputVariable(const MyVariable &variable, int colum
 int SimulationEngineGet::initialiseSimulation()
 {
     GeneralModel model;
-    setDebugLevel(0);
+    model.context.debugLevel = 0;
 
     // define our model
     Molecule molecule;
@@ -117,90 +117,57 @@ int SimulationEngineGet::initialiseSimulation()
     model.A_a = 1.8; model.A_b = 8.8; // cm^2/cm^2 tissue
     model.V = 0.001; // cm^3/cm^2 tissue
 
+    // basolateral Na-K pump (Latta et al (1984) eq 9), only when requested so the passive cell is unchanged
+    TransporterSet<SodiumPotassiumPump> transporters = makeTransporterSet(SodiumPotassiumPump());
+    if (mActiveTransport && (model.setActiveTransport(transporters) != 0))
+    {
+        std::cerr << "get: unable to set up the active transport pathways" << std::endl;
+        return 1;
+    }
+
     // initial guesses for membrane potentials
     model.E_a = -20.0;
     model.E_b = -60.0;
     model.E_t = -40.0;
 
     // set up output
-    std::ofstream output;
-    output.open("results.data");
-    output.precision(5);
-    output.setf(std::ios_base::uppercase | std::ios_base::scientific);
-    // set the way numbers should be streamed out
-    std::cout.precision(5);
-    std::cout.setf(std::ios_base::uppercase | std::ios_base::scientific);
-
-    // we'll use CVODES for integration
-    Cvodes cvodes;
-
+    TrajectoryWriter output;
+    if (output.open("results.data", TrajectoryWriter::Text, model.stateColumnNames()) != 0) return 1;
     /*
-     * 1) transport parameters, initial conditions, t_initial, t_final, and
-     * delta_t are specified, and integration variable t is initialised to t_initial.
+     * Transport parameters and initial conditions are specified above, we now solve directly for the steady
+     * state in the open-circuit mode rather than integrating the model until it stops changing.
      */
-    double t_initial = 0.0; // seconds
-    double t_final = 1500; // seconds
-    double delta_t = 1.0; // seconds
-    double t = t_initial;
+    double t = 0.0; // seconds
     model.initialise();
-    model.printStateHeader(output);
-    model.printState(output, t_initial);
-    cvodes.initialise(&model, t_initial, delta_t);
+    model.printState(output, t);
 
     double initialVolume = model.V;
 
-    /*
-     * Solve to steady state in the open-circuit mode.
-     */
     model.modelMode = GeneralModel::OpenCircuit;
-    while (t <= t_final)
+    int status = solveSteadyState(&model);
+    mStatistics = model.statistics;
+    if (status != 0)
     {
-        double tout = t + delta_t;
-        /*
-         * 2) membrane potentials are computed.
-         * @FIXME: this needs to be done inside the CVODE RHS function...but maybe ok if small enough time step?
-         */
-        //        model.mode = 1; // we want to solve for membrane potentials at the open-circuit conditions
-        //        if (solveOneVariable(&model) > 0)
-        //        {
-        //            std::cerr << "Failed to solve open circuit case" << std::endl;
-        //            break;
-        //        }
-
-        /*
-         * 3) solute and water fluxes are computed using the membrane potentials and the
-         * respective flux equations.
-         */
-        /*
-         * 4) the state equations are evaluated and are integrated to t+delta_t.
-         */
-        if (cvodes.integrate(t, tout) != 0)
-        {
-            std::cerr << "get: integration failed in steady-state block" << std::endl;
-            output.close();
-            return 1;
-        }
-        /*
-         * 5) additional variables are computed, and all results saved off-line.
-         */
-        /*
-         * 6) t is updated to t+delta_t and a comparison is made with t_final. If t_final
-         * has been reached, the computation ends. Otherwise, the program returns to step
-         * 2 to continue the integration.
-         */
-
-        model.printState(output, t);
+        std::cerr << "get: unable to solve for the open-circuit steady state" << std::endl;
+        output.close();
+        return 1;
     }
-
-    // dump out SS results to compare to table 2 in Latta et al paper.
-    std::cout << "Steady state results\n"
-              << "====================\n"
-              /*<< "C_c[Na] = " << model.C_c[GeneralModel::Na]
-              << "; C_c[K] = " << model.C_c[GeneralModel::K]
-              << "; C_c[Cl] = " << model.C_c[GeneralModel::Cl] << "\n"*/
-              << "E_t = " << model.E_t << "; E_a = " << model.E_a
-              << "; E_b = " << model.E_b << "\n"
-              << "V/V(t=0) = " << model.V / initialVolume << std::endl;
+    model.printState(output, t);
+    if (output.close() != 0) return 1;
+
+    // dump out SS results to compare to table 2 in Latta et al paper, formatted without changing the shared stream
+    std::ostringstream results;
+    results.precision(5);
+    results.setf(std::ios_base::uppercase | std::ios_base::scientific);
+    results << "Steady state results\n"
+            << "====================\n"
+            /*<< "C_c[Na] = " << model.C_c[GeneralModel::Na]
+            << "; C_c[K] = " << model.C_c[GeneralModel::K]
+            << "; C_c[Cl] = " << model.C_c[GeneralModel::Cl] << "\n"*/
+            << "E_t = " << model.E_t << "; E_a = " << model.E_a
+            << "; E_b = " << model.E_b << "\n"
+            << "V/V(t=0) = " << model.V / initialVolume << std::endl;
+    *model.context.diagnostics << results.str();
 
     return 0;
 }
@@ -3,6 +3,8 @@
 
 #include <vector>
 
+#include "solverstatistics.hpp"
+
 class CellmlSimulator;
 
 class SimulationEngineGet
@@ -26,6 +28,16 @@ public:
      */
     int addOutputVariable(const MyVariable& variable, int columnIndex);
 
+    /**
+     * @brief Include the basolateral Na-K pump of Latta et al (1984) in the simulated cell. The pump is off by
+     * default, giving the passive cell.
+     * @param activeTransport true to include the pump.
+     */
+    void setActiveTransport(bool activeTransport)
+    {
+        mActiveTransport = activeTransport;
+    }
+
     /**
      * @brief Initialise this instance of the GET simulator.
      * @return zero on success.
@@ -38,8 +50,18 @@ public:
      */
     std::vector<double> getOutputValues();
 
+    /**
+     * @brief The work done by the solvers in the last simulation, the times are left as zero.
+     */
+    const SolverStatistics& solverStatistics() const
+    {
+        return mStatistics;
+    }
+
 private:
     std::string mModelUrl;
+    SolverStatistics mStatistics;
+    bool mActiveTransport;
 #if 0
     CellmlSimulator* mCsim;
 #endif
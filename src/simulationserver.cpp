@@ -0,0 +1,495 @@
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include "simulationserver.hpp"
+#include "utils.hpp"
+#include "getsimulator.hpp"
+#include "decimation.hpp"
+#include "enginecache.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
+
+// how long the accepting thread waits for a connection before checking if it should stop, in milliseconds
+#define SERVER_POLL_INTERVAL 200
+// how long a client may take to send its request, or to accept the response, in seconds
+#define SERVER_SOCKET_TIMEOUT 60
+// the largest request headers and body we accept
+#define SERVER_MAXIMUM_HEADER_SIZE (64*1024)
+#define SERVER_MAXIMUM_BODY_SIZE (256*1024*1024)
+// how often the rows of a streaming job are sent when they are produced faster than the buffer fills, in milliseconds
+#define SERVER_STREAM_FLUSH_INTERVAL 100
+
+#ifdef MSG_NOSIGNAL
+#define SERVER_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SERVER_SEND_FLAGS 0
+#endif
+
+static bool sendAll(int connection, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(connection, data, size, SERVER_SEND_FLAGS);
+        if (n <= 0)
+        {
+            if ((n < 0) && (errno == EINTR)) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/**
+ * Buffer the response body written to a std::ostream, sending it to the client as the buffer fills.
+ */
+class SocketStreamBuffer : public std::streambuf
+{
+public:
+    explicit SocketStreamBuffer(int connection) : mConnection(connection), mBuffer(64*1024), mFailed(false)
+    {
+        setp(mBuffer.data(), mBuffer.data() + mBuffer.size());
+    }
+
+    ~SocketStreamBuffer()
+    {
+        sync();
+    }
+
+    bool failed() const { return mFailed; }
+
+protected:
+    int_type overflow(int_type c)
+    {
+        if (sync() != 0) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync()
+    {
+        size_t size = pptr() - pbase();
+        if ((size > 0) && !mFailed) mFailed = !sendAll(mConnection, pbase(), size);
+        setp(mBuffer.data(), mBuffer.data() + mBuffer.size());
+        return mFailed ? -1 : 0;
+    }
+
+private:
+    int mConnection;
+    std::vector<char> mBuffer;
+    bool mFailed;
+};
+
+class HttpRequest
+{
+public:
+    std::string method;
+    std::string path;
+    std::map<std::string, std::string> headers; // with lower case names
+    std::multimap<std::string, std::string> query;
+    std::string body;
+
+    std::string parameter(const std::string& name) const
+    {
+        auto p = query.find(name);
+        return (p == query.end()) ? std::string() : p->second;
+    }
+};
+
+static std::string percentDecode(const std::string& s)
+{
+    std::string decoded;
+    for (size_t i = 0; i < s.size(); ++i)
+    {
+        if (s[i] == '+') decoded.push_back(' ');
+        else if ((s[i] == '%') && ((i + 2) < s.size()) && isxdigit(s[i+1]) && isxdigit(s[i+2]))
+        {
+            decoded.push_back(char(strtol(s.substr(i + 1, 2).c_str(), NULL, 16)));
+            i += 2;
+        }
+        else decoded.push_back(s[i]);
+    }
+    return decoded;
+}
+
+static void sendResponse(int connection, int status, const std::string& reason, const std::string& body,
+                         const char* contentType = "text/plain")
+{
+    std::ostringstream response;
+    response << "HTTP/1.1 " << status << " " << reason << "\r\n"
+             << "Content-Type: " << contentType << "\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n"
+             << body;
+    sendAll(connection, response.str().data(), response.str().size());
+}
+
+static int readRequest(int connection, HttpRequest& request)
+{
+    std::string data;
+    char buffer[8192];
+    size_t headerEnd;
+    while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos)
+    {
+        if (data.size() > SERVER_MAXIMUM_HEADER_SIZE) return -1;
+        ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if ((n < 0) && (errno == EINTR)) continue;
+        if (n <= 0) return -1;
+        data.append(buffer, n);
+    }
+    std::istringstream headers(data.substr(0, headerEnd));
+    std::string line, target;
+    std::getline(headers, line);
+    std::istringstream requestLine(line);
+    if (!(requestLine >> request.method >> target)) return -1;
+    while (std::getline(headers, line))
+    {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = line.substr(0, colon);
+        for (char& c: name) c = tolower(c);
+        size_t start = line.find_first_not_of(" \t", colon + 1);
+        size_t end = line.find_last_not_of(" \t\r");
+        request.headers[name] = (start == std::string::npos) ? "" : line.substr(start, end - start + 1);
+    }
+    request.path = percentDecode(target.substr(0, target.find('?')));
+    if (target.find('?') != std::string::npos)
+    {
+        std::istringstream query(target.substr(target.find('?') + 1));
+        std::string parameter;
+        while (std::getline(query, parameter, '&'))
+        {
+            size_t equals = parameter.find('=');
+            request.query.insert(std::make_pair(percentDecode(parameter.substr(0, equals)),
+                (equals == std::string::npos) ? "" : percentDecode(parameter.substr(equals + 1))));
+        }
+    }
+    size_t contentLength = 0;
+    if (request.headers.count("content-length")) contentLength = strtoul(request.headers["content-length"].c_str(),
+                                                                         NULL, 10);
+    if (contentLength > SERVER_MAXIMUM_BODY_SIZE) return -2;
+    // curl asks before sending large bodies
+    if (request.headers.count("expect") && (data.size() == headerEnd + 4) && (contentLength > 0))
+    {
+        const std::string proceed = "HTTP/1.1 100 Continue\r\n\r\n";
+        sendAll(connection, proceed.data(), proceed.size());
+    }
+    request.body = data.substr(headerEnd + 4);
+    while (request.body.size() < contentLength)
+    {
+        ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if ((n < 0) && (errno == EINTR)) continue;
+        if (n <= 0) return -1;
+        request.body.append(buffer, n);
+    }
+    request.body.resize(contentLength);
+    return 0;
+}
+
+static const std::string okHeader = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n";
+
+/**
+ * Execute the experiment, sending the rows of each task to the client as they are produced and then the reports.
+ * The response is started before the tasks are executed, so errors executing them are reported in the body.
+ * @return zero on success.
+ */
+static int runStreamingJob(int connection, SimulationExperiment& experiment)
+{
+    if (!sendAll(connection, okHeader.data(), okHeader.size())) return -5;
+    SocketStreamBuffer buffer(connection);
+    std::ostream os(&buffer);
+    auto lastFlush = std::chrono::steady_clock::now();
+    ExecutionCallbacks callbacks;
+    callbacks.streamStarted = [&os](uint32_t stream, const std::string& taskId,
+                                    const std::vector<std::string>& columnNames)
+    {
+        os << "# begin stream " << stream << " of task " << taskId << ": time";
+        for (const std::string& name: columnNames) os << "," << name;
+        os << std::endl;
+    };
+    callbacks.row = [&os, &lastFlush](uint32_t stream, double time, const std::vector<double>& values)
+    {
+        os << stream << "," << time;
+        for (double value: values) os << "," << value;
+        os << "\n";
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastFlush > std::chrono::milliseconds(SERVER_STREAM_FLUSH_INTERVAL))
+        {
+            os.flush();
+            lastFlush = now;
+        }
+    };
+    callbacks.streamFinished = [&os](uint32_t stream)
+    {
+        os << "# end stream " << stream << std::endl;
+    };
+    if (experiment.execute(callbacks) != 0)
+    {
+        os << "# error: there were some errors executing the simulation tasks of: " << experiment.url() << std::endl;
+        return -4;
+    }
+    os << "# reports" << std::endl;
+    if ((experiment.serialiseReports(os) != 0) || !os.flush() || buffer.failed())
+    {
+        std::cerr << "SimulationServer: unable to send the reports of: " << experiment.url() << std::endl;
+        return -5;
+    }
+    return 0;
+}
+
+/**
+ * Execute the SED-ML document of a run request, streaming the reports back to the client.
+ * @return zero on success.
+ */
+static int runJob(int connection, const HttpRequest& request)
+{
+    SimulationExperiment experiment;
+    int status;
+    if (request.method == "POST")
+        status = experiment.loadFromString(request.body, buildAbsoluteUri(request.parameter("base"), ""));
+    else status = experiment.load(request.parameter("url"));
+    if (status != 0)
+    {
+        std::string source = (request.method == "POST") ? "in the request" : request.parameter("url");
+        sendResponse(connection, 400, "Bad Request", "Unable to load the SED-ML document " + source + "\n");
+        return -1;
+    }
+    if (experiment.buildManifest() != 0)
+    {
+        sendResponse(connection, 400, "Bad Request",
+                     "There were errors building the simulation execution manifest for: " + experiment.url() + "\n");
+        return -2;
+    }
+    const std::vector<double> aggregateQuantiles = { 0.05, 0.5, 0.95 };
+    auto aggregate = request.query.equal_range("aggregate");
+    for (auto p = aggregate.first; p != aggregate.second; ++p)
+    {
+        if (experiment.aggregateDataSet(p->second, aggregateQuantiles) != 0)
+        {
+            sendResponse(connection, 400, "Bad Request", "Unable to aggregate the data set: " + p->second + "\n");
+            return -3;
+        }
+    }
+    auto decimate = request.query.equal_range("decimate");
+    for (auto p = decimate.first; p != decimate.second; ++p)
+    {
+        std::string reportId = p->second.substr(0, p->second.find(':'));
+        DecimationOptions options;
+        if ((p->second.find(':') == std::string::npos) || (options.parse(p->second.substr(reportId.size() + 1)) != 0)
+            || (experiment.decimateReport(reportId, options) != 0))
+        {
+            sendResponse(connection, 400, "Bad Request", "Unable to decimate the report: " + p->second + "\n");
+            return -3;
+        }
+    }
+    if (!request.parameter("stream").empty()) return runStreamingJob(connection, experiment);
+    if (experiment.execute() != 0)
+    {
+        sendResponse(connection, 500, "Internal Server Error",
+                     "There were some errors executing the simulation tasks of: " + experiment.url() + "\n");
+        return -4;
+    }
+    if (!sendAll(connection, okHeader.data(), okHeader.size())) return -5;
+    SocketStreamBuffer buffer(connection);
+    std::ostream os(&buffer);
+    if ((experiment.serialiseReports(os) != 0) || !os.flush() || buffer.failed())
+    {
+        std::cerr << "SimulationServer: unable to send the reports of: " << experiment.url() << std::endl;
+        return -5;
+    }
+    return 0;
+}
+
+SimulationServer::SimulationServer() : mListener(-1), mStopping(false), mJobs(0), mFailedJobs(0)
+{
+}
+
+SimulationServer::~SimulationServer()
+{
+    close();
+}
+
+int SimulationServer::open(const std::string& socketPath, unsigned int numberOfWorkers)
+{
+    close();
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "SimulationServer::open: the socket path is too long: " << socketPath << std::endl;
+        return -1;
+    }
+    strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    mListener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (mListener < 0)
+    {
+        std::cerr << "SimulationServer::open: unable to create a socket: " << strerror(errno) << std::endl;
+        return -2;
+    }
+    unlink(socketPath.c_str());
+    if ((bind(mListener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) ||
+        (listen(mListener, 64) != 0))
+    {
+        std::cerr << "SimulationServer::open: unable to listen on: " << socketPath << ": " << strerror(errno)
+                  << std::endl;
+        ::close(mListener);
+        mListener = -1;
+        return -3;
+    }
+    mSocketPath = socketPath;
+    mStopping = false;
+    if (numberOfWorkers == 0) numberOfWorkers = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < numberOfWorkers; ++i) mWorkers.push_back(std::thread(&SimulationServer::work, this));
+    return 0;
+}
+
+void SimulationServer::close()
+{
+    mStopping = true;
+    mConnectionAvailable.notify_all();
+    for (std::thread& worker: mWorkers) worker.join();
+    mWorkers.clear();
+    // the connections that were never picked up
+    for (int connection: mConnections)
+    {
+        sendResponse(connection, 503, "Service Unavailable", "The server is stopping.\n");
+        ::close(connection);
+    }
+    mConnections.clear();
+    if (mListener >= 0)
+    {
+        ::close(mListener);
+        mListener = -1;
+        unlink(mSocketPath.c_str());
+    }
+}
+
+int SimulationServer::run()
+{
+    if (mListener < 0)
+    {
+        std::cerr << "SimulationServer::run: the server has not been opened." << std::endl;
+        return -1;
+    }
+    GET_LOG(LogInfo, "Serving SED-ML jobs on: " << mSocketPath << " with " << mWorkers.size() << " workers");
+    while (!mStopping)
+    {
+        struct pollfd listener;
+        listener.fd = mListener;
+        listener.events = POLLIN;
+        listener.revents = 0;
+        if ((poll(&listener, 1, SERVER_POLL_INTERVAL) <= 0) || !(listener.revents & POLLIN)) continue;
+        int connection = accept(mListener, NULL, NULL);
+        if (connection < 0) continue;
+        struct timeval timeout;
+        timeout.tv_sec = SERVER_SOCKET_TIMEOUT;
+        timeout.tv_usec = 0;
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+        int on = 1;
+        setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        std::lock_guard<std::mutex> lock(mMutex);
+        mConnections.push_back(connection);
+        mConnectionAvailable.notify_one();
+    }
+    GET_LOG(LogInfo, "Stopping the server after " << mJobs << " jobs (" << mFailedJobs << " failed)");
+    close();
+    return 0;
+}
+
+void SimulationServer::work()
+{
+    while (true)
+    {
+        int connection;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            // wake up regularly, as stop may be called from a signal handler which can't notify us
+            while (mConnections.empty() && !mStopping)
+                mConnectionAvailable.wait_for(lock, std::chrono::milliseconds(SERVER_POLL_INTERVAL));
+            if (mStopping) return;
+            connection = mConnections.front();
+            mConnections.pop_front();
+        }
+        handle(connection);
+        ::close(connection);
+    }
+}
+
+void SimulationServer::handle(int connection)
+{
+    HttpRequest request;
+    int status = readRequest(connection, request);
+    if (status != 0)
+    {
+        if (status == -2) sendResponse(connection, 413, "Payload Too Large", "The request is too large.\n");
+        else sendResponse(connection, 400, "Bad Request", "Unable to read the request.\n");
+        return;
+    }
+    if ((request.path == "/run") && ((request.method == "POST") || (request.method == "GET")))
+    {
+        if ((request.method == "GET") && request.parameter("url").empty())
+        {
+            sendResponse(connection, 400, "Bad Request", "The URL of the SED-ML document is required.\n");
+            return;
+        }
+        unsigned long job = ++mJobs;
+        GET_LOG(LogInfo, "SimulationServer: starting job " << job);
+        if (runJob(connection, request) != 0) ++mFailedJobs;
+        GET_LOG(LogInfo, "SimulationServer: finished job " << job);
+    }
+    else if ((request.path == "/status") && (request.method == "GET"))
+    {
+        unsigned int size;
+        unsigned long hits, misses;
+        simulationEngineCacheStatistics(size, hits, misses);
+        std::ostringstream body;
+        body << "workers: " << mWorkers.size() << "\n"
+             << "jobs: " << mJobs << "\n"
+             << "failed jobs: " << mFailedJobs << "\n"
+             << "cached engines: " << size << "\n"
+             << "engine cache hits: " << hits << "\n"
+             << "engine cache misses: " << misses << "\n";
+        sendResponse(connection, 200, "OK", body.str());
+    }
+    else if ((request.path == "/flush") && (request.method == "POST"))
+    {
+        clearSimulationEngineCache();
+        sendResponse(connection, 200, "OK", "The simulation engine cache has been cleared.\n");
+    }
+    else if ((request.path == "/trace") && (request.method == "GET"))
+    {
+        if (!tracingEnabled())
+        {
+            sendResponse(connection, 409, "Conflict", "Tracing is not enabled, start the server with --trace.\n");
+            return;
+        }
+        std::ostringstream body;
+        writeChromeTrace(body);
+        sendResponse(connection, 200, "OK", body.str(), "application/json");
+    }
+    else sendResponse(connection, 404, "Not Found", "Unknown request: " + request.method + " " + request.path + "\n");
+}
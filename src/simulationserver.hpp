@@ -0,0 +1,83 @@
+#ifndef SIMULATIONSERVER_HPP
+#define SIMULATIONSERVER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * @brief A long-running server that executes SED-ML documents for clients of a UNIX domain socket.
+ *
+ * Requests are HTTP/1.1, so any HTTP client able to use a UNIX domain socket can submit jobs, e.g.,
+ *   curl --unix-socket <socket> --data-binary @sim.xml "http://localhost/run?base=file:///path/to/sim.xml"
+ * The requests are:
+ *  - POST /run: execute the SED-ML document in the body, with relative model references resolved against the
+ *    base URL (default the server's working directory).
+ *  - GET /run?url=<SED-ML document URL>: execute the document at the given URL.
+ *  - GET /status: the number of jobs run and the state of the simulation engine cache.
+ *  - POST /flush: discard the cached simulation engines, e.g., after editing a model.
+ *  - GET /trace: the trace events recorded so far as Chrome trace JSON, if tracing is started (see tracing.hpp).
+ * The run requests also take aggregate=<data set ID>|* and decimate=<report ID>|*:<decimation> parameters, as
+ * for the --aggregate and --decimate options of get-sed-ml-client, and the reports are streamed back as the
+ * response body once the tasks have been executed. With stream=1 the rows of each task are also sent as they are
+ * produced, before the reports:
+ *   # begin stream <n> of task <task ID>: time,<column>,...
+ *   <n>,<time>,<value>,...
+ *   # end stream <n>
+ *   # reports
+ * followed by the reports, or a "# error: ..." line if the tasks could not be executed, as the 200 OK response has
+ * already been sent.
+ *
+ * The jobs are run by a pool of worker threads, one job per connection, and the instantiated CSim engines are kept
+ * in the simulation engine cache (see enginecache.hpp) so later jobs using the same models are not compiled again.
+ */
+class SimulationServer
+{
+public:
+    SimulationServer();
+    ~SimulationServer();
+
+    /**
+     * @brief Create the socket at the given path (replacing any stale socket) and start the workers.
+     * @param socketPath The path of the socket.
+     * @param numberOfWorkers The number of jobs to run at once, zero for the number of processors.
+     * @return zero on success.
+     */
+    int open(const std::string& socketPath, unsigned int numberOfWorkers);
+
+    /**
+     * @brief Accept connections until stop is called, then wait for the jobs being run to complete.
+     * @return zero on success.
+     */
+    int run();
+
+    /**
+     * @brief Ask the server to stop, safe to call from a signal handler.
+     */
+    void stop() { mStopping = true; }
+
+private:
+    SimulationServer(const SimulationServer&) = delete;
+    SimulationServer& operator=(const SimulationServer&) = delete;
+
+    void close();
+    void work();
+    void handle(int connection);
+
+    int mListener;
+    std::string mSocketPath;
+    std::atomic<bool> mStopping;
+    std::vector<std::thread> mWorkers;
+    // the connections waiting for a worker
+    std::deque<int> mConnections;
+    std::mutex mMutex;
+    std::condition_variable mConnectionAvailable;
+    std::atomic<unsigned long> mJobs;
+    std::atomic<unsigned long> mFailedJobs;
+};
+
+#endif // SIMULATIONSERVER_HPP
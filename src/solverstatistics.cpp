@@ -0,0 +1,86 @@
+#include <iostream>
+
+#include <cvodes/cvodes.h>
+#include <cvodes/cvodes_dense.h>
+
+#include "solverstatistics.hpp"
+
+SolverStatistics::SolverStatistics() : steps(0), rhsEvaluations(0), jacobianEvaluations(0), nonlinearIterations(0),
+    convergenceFailures(0), errorTestFailures(0), kinsolSolves(0), kinsolIterations(0), loadTime(0.0),
+    instantiateTime(0.0), initialiseTime(0.0), simulateTime(0.0)
+{
+}
+
+void SolverStatistics::add(const SolverStatistics& other)
+{
+    steps += other.steps;
+    rhsEvaluations += other.rhsEvaluations;
+    jacobianEvaluations += other.jacobianEvaluations;
+    nonlinearIterations += other.nonlinearIterations;
+    convergenceFailures += other.convergenceFailures;
+    errorTestFailures += other.errorTestFailures;
+    kinsolSolves += other.kinsolSolves;
+    kinsolIterations += other.kinsolIterations;
+    loadTime += other.loadTime;
+    instantiateTime += other.instantiateTime;
+    initialiseTime += other.initialiseTime;
+    simulateTime += other.simulateTime;
+}
+
+void SolverStatistics::subtractCounters(const SolverStatistics& earlier)
+{
+    steps -= earlier.steps;
+    rhsEvaluations -= earlier.rhsEvaluations;
+    jacobianEvaluations -= earlier.jacobianEvaluations;
+    nonlinearIterations -= earlier.nonlinearIterations;
+    convergenceFailures -= earlier.convergenceFailures;
+    errorTestFailures -= earlier.errorTestFailures;
+    kinsolSolves -= earlier.kinsolSolves;
+    kinsolIterations -= earlier.kinsolIterations;
+}
+
+double SolverStatistics::kinsolSolvesPerRhsEvaluation() const
+{
+    return (rhsEvaluations > 0) ? double(kinsolSolves) / rhsEvaluations : 0.0;
+}
+
+void SolverStatistics::writeJsonMembers(std::ostream& os) const
+{
+    os << "\"steps\":" << steps
+       << ",\"rhsEvaluations\":" << rhsEvaluations
+       << ",\"jacobianEvaluations\":" << jacobianEvaluations
+       << ",\"nonlinearIterations\":" << nonlinearIterations
+       << ",\"convergenceFailures\":" << convergenceFailures
+       << ",\"errorTestFailures\":" << errorTestFailures
+       << ",\"kinsolSolves\":" << kinsolSolves
+       << ",\"kinsolIterations\":" << kinsolIterations
+       << ",\"kinsolSolvesPerRhsEvaluation\":" << kinsolSolvesPerRhsEvaluation()
+       << ",\"wallTime\":{\"load\":" << loadTime
+       << ",\"instantiate\":" << instantiateTime
+       << ",\"initialise\":" << initialiseTime
+       << ",\"simulate\":" << simulateTime << "}";
+}
+
+int addCvodeStatistics(void* cvodeMem, SolverStatistics& statistics)
+{
+    long int nst, nfe, nfeLS, nje, nni, ncfn, netf;
+    // the SUNDIALS functions return a negative flag on failure
+    if ((CVodeGetNumSteps(cvodeMem, &nst) < 0) ||
+        (CVodeGetNumRhsEvals(cvodeMem, &nfe) < 0) ||
+        (CVodeGetNumNonlinSolvIters(cvodeMem, &nni) < 0) ||
+        (CVodeGetNumNonlinSolvConvFails(cvodeMem, &ncfn) < 0) ||
+        (CVodeGetNumErrTestFails(cvodeMem, &netf) < 0) ||
+        (CVDlsGetNumJacEvals(cvodeMem, &nje) < 0) ||
+        (CVDlsGetNumRhsEvals(cvodeMem, &nfeLS) < 0))
+    {
+        std::cerr << "addCvodeStatistics: unable to get the integrator statistics." << std::endl;
+        return -1;
+    }
+    statistics.steps += nst;
+    statistics.rhsEvaluations += nfe + nfeLS;
+    statistics.jacobianEvaluations += nje;
+    statistics.nonlinearIterations += nni;
+    statistics.convergenceFailures += ncfn;
+    statistics.errorTestFailures += netf;
+    return 0;
+}
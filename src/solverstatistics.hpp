@@ -0,0 +1,61 @@
+#ifndef SOLVERSTATISTICS_HPP
+#define SOLVERSTATISTICS_HPP
+
+#include <iosfwd>
+
+/**
+ * @brief The work done by the solvers of a simulation and the time it took, accumulated over its executions, e.g.,
+ * to find the tasks whose tolerances need tuning.
+ */
+class SolverStatistics
+{
+public:
+    SolverStatistics();
+
+    void add(const SolverStatistics& other);
+
+    /**
+     * @brief Subtract the counters of an earlier snapshot of the same solvers, leaving the work done since. The
+     * times are not changed.
+     */
+    void subtractCounters(const SolverStatistics& earlier);
+
+    /**
+     * @brief The number of KINSOL solves for each evaluation of the right hand side, zero if there were none.
+     */
+    double kinsolSolvesPerRhsEvaluation() const;
+
+    /**
+     * @brief Write the statistics as the members of a JSON object, without the enclosing braces.
+     */
+    void writeJsonMembers(std::ostream& os) const;
+
+    // integrator steps
+    long steps;
+    // evaluations of the right hand side, including those for difference quotient Jacobians
+    long rhsEvaluations;
+    long jacobianEvaluations;
+    // iterations of the nonlinear (Newton) solver of the integrator or steady state solver, and its failures to
+    // converge
+    long nonlinearIterations;
+    long convergenceFailures;
+    // steps rejected by the local error test, a sign the tolerances are tight for the maximum step size
+    long errorTestFailures;
+    // the KINSOL solves for the membrane potentials of GET models, and their iterations
+    long kinsolSolves;
+    long kinsolIterations;
+    // wall time in seconds loading and instantiating (compiling) the model, initialising the simulation and then
+    // simulating the output points
+    double loadTime;
+    double instantiateTime;
+    double initialiseTime;
+    double simulateTime;
+};
+
+/**
+ * @brief Add the counters of the given CVODE integrator (with a direct linear solver) to the statistics.
+ * @return zero on success.
+ */
+int addCvodeStatistics(void* cvodeMem, SolverStatistics& statistics);
+
+#endif // SOLVERSTATISTICS_HPP
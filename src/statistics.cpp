@@ -0,0 +1,108 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "statistics.hpp"
+
+QuantileEstimator::QuantileEstimator(double p) : mP(p), mCount(0)
+{
+    for (int i = 0; i < 5; ++i) mQ[i] = mN[i] = 0.0;
+    mNp[0] = 1.0;
+    mNp[1] = 1.0 + 2.0 * p;
+    mNp[2] = 1.0 + 4.0 * p;
+    mNp[3] = 3.0 + 2.0 * p;
+    mNp[4] = 5.0;
+    mDn[0] = 0.0;
+    mDn[1] = p / 2.0;
+    mDn[2] = p;
+    mDn[3] = (1.0 + p) / 2.0;
+    mDn[4] = 1.0;
+}
+
+void QuantileEstimator::add(double x)
+{
+    if (mCount < 5)
+    {
+        // the first five values are kept (sorted) as the initial marker heights
+        mQ[mCount++] = x;
+        std::sort(mQ, mQ + mCount);
+        if (mCount == 5) for (int i = 0; i < 5; ++i) mN[i] = i + 1;
+        return;
+    }
+    ++mCount;
+    int k;
+    if (x < mQ[0])
+    {
+        mQ[0] = x;
+        k = 0;
+    }
+    else if (x >= mQ[4])
+    {
+        mQ[4] = x;
+        k = 3;
+    }
+    else
+    {
+        k = 0;
+        while (x >= mQ[k+1]) ++k;
+    }
+    for (int i = k + 1; i < 5; ++i) mN[i] += 1.0;
+    for (int i = 0; i < 5; ++i) mNp[i] += mDn[i];
+    // adjust the heights of the middle markers if they are off their desired positions
+    for (int i = 1; i < 4; ++i)
+    {
+        double d = mNp[i] - mN[i];
+        if (((d >= 1.0) && (mN[i+1] - mN[i] > 1.0)) || ((d <= -1.0) && (mN[i-1] - mN[i] < -1.0)))
+        {
+            int s = (d > 0.0) ? 1 : -1;
+            double q = parabolic(i, s);
+            if ((mQ[i-1] < q) && (q < mQ[i+1])) mQ[i] = q;
+            else mQ[i] = linear(i, s);
+            mN[i] += s;
+        }
+    }
+}
+
+double QuantileEstimator::value() const
+{
+    if (mCount == 0) return 0.0;
+    if (mCount >= 5) return mQ[2];
+    // exact (interpolated) quantile of the values seen so far
+    double position = mP * (mCount - 1);
+    int i = (int)floor(position);
+    if (i >= mCount - 1) return mQ[mCount-1];
+    return mQ[i] + (position - i) * (mQ[i+1] - mQ[i]);
+}
+
+double QuantileEstimator::parabolic(int i, double d) const
+{
+    return mQ[i] + d / (mN[i+1] - mN[i-1]) * ((mN[i] - mN[i-1] + d) * (mQ[i+1] - mQ[i]) / (mN[i+1] - mN[i])
+                                              + (mN[i+1] - mN[i] - d) * (mQ[i] - mQ[i-1]) / (mN[i] - mN[i-1]));
+}
+
+double QuantileEstimator::linear(int i, int d) const
+{
+    return mQ[i] + d * (mQ[i+d] - mQ[i]) / (mN[i+d] - mN[i]);
+}
+
+RunningStatistics::RunningStatistics(const std::vector<double>& quantiles) : mCount(0), mMean(0.0), mM2(0.0),
+    mMinimum(DBL_MAX), mMaximum(-DBL_MAX)
+{
+    for (double p: quantiles) mQuantiles.push_back(QuantileEstimator(p));
+}
+
+void RunningStatistics::add(double x)
+{
+    ++mCount;
+    double delta = x - mMean;
+    mMean += delta / mCount;
+    mM2 += delta * (x - mMean);
+    if (x < mMinimum) mMinimum = x;
+    if (x > mMaximum) mMaximum = x;
+    for (auto& q: mQuantiles) q.add(x);
+}
+
+double RunningStatistics::variance() const
+{
+    return (mCount > 1) ? mM2 / (mCount - 1) : 0.0;
+}
@@ -0,0 +1,60 @@
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <vector>
+
+/**
+ * @brief Streaming estimate of a single quantile using the P-square algorithm (Jain and Chlamtac, 1985).
+ * Only five markers are kept, however many values are added. The estimate is exact until five values have been
+ * added.
+ */
+class QuantileEstimator
+{
+public:
+    QuantileEstimator(double p = 0.5);
+
+    void add(double x);
+    double value() const;
+    double probability() const { return mP; }
+
+private:
+    double parabolic(int i, double d) const;
+    double linear(int i, int d) const;
+
+    double mP;
+    long mCount;
+    // marker heights, actual positions, desired positions and desired position increments
+    double mQ[5], mN[5], mNp[5], mDn[5];
+};
+
+/**
+ * @brief Streaming summary statistics of a sequence of values: count, mean and variance (Welford's algorithm),
+ * minimum, maximum and a set of approximate quantiles. Memory use does not depend on the number of values.
+ */
+class RunningStatistics
+{
+public:
+    /**
+     * @param quantiles The probabilities of the quantiles to estimate, e.g., {0.05, 0.5, 0.95}.
+     */
+    RunningStatistics(const std::vector<double>& quantiles = std::vector<double>());
+
+    void add(double x);
+
+    long count() const { return mCount; }
+    double mean() const { return mMean; }
+    // the (unbiased) sample variance
+    double variance() const;
+    double minimum() const { return mMinimum; }
+    double maximum() const { return mMaximum; }
+    unsigned int numberOfQuantiles() const { return mQuantiles.size(); }
+    double quantile(int i) const { return mQuantiles[i].value(); }
+    double quantileProbability(int i) const { return mQuantiles[i].probability(); }
+
+private:
+    long mCount;
+    double mMean, mM2, mMinimum, mMaximum;
+    std::vector<QuantileEstimator> mQuantiles;
+};
+
+#endif // STATISTICS_HPP
@@ -0,0 +1,352 @@
+/*
+ * steadystate.cpp
+ *
+ * Direct solution of the steady state of a GeneralModel.
+ */
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include <kinsol/kinsol.h>
+#include <kinsol/kinsol_dense.h>
+#include <nvector/nvector_serial.h>
+#include <sundials/sundials_types.h>
+#include <sundials/sundials_dense.h>
+
+#include "common.hpp"
+#include "GeneralModel.hpp"
+#include "cvodes.hpp"
+#include "steadystate.hpp"
+#include "logging.hpp"
+
+#define ZERO   RCONST(0.0)
+#define ONE    RCONST(1.0)
+#define TWO    RCONST(2.0)
+
+#define MAX_NEWTON_ITERATIONS 50
+#define MAX_PSEUDO_TIME RCONST(1.0e7)  /* seconds */
+
+typedef struct
+{
+    GeneralModel* model;
+    // true for species which can not cross either cell membrane and hence have a conserved intracellular amount
+    std::vector<bool> conserved;
+    std::vector<double> amount;
+} SteadyStateData;
+
+/* Functions Called by the KINSOL Solver */
+static int residual(N_Vector u, N_Vector r, void *user_data);
+static int jacobian(long int N, N_Vector u, N_Vector fu, DlsMat J, void *user_data, N_Vector tmp1, N_Vector tmp2);
+
+/* Private Helper Functions */
+static int newtonSolve(SteadyStateData* data, double tolerance);
+static int newtonIterate(SteadyStateData* data, double tolerance, void* kmem, N_Vector u, N_Vector us, N_Vector fs,
+                         N_Vector c);
+static void setModelState(GeneralModel* model, N_Vector u);
+static double relativeRateNorm(GeneralModel* model, int& errorFlag);
+static int check_flag(void *flagvalue, const char *funcname, int opt);
+
+// failures are handled by the pseudo-transient fallback, so the KINSol errors are only logged for debugging
+static void handleKinsolError(int code, const char *module, const char *function, char *msg, void *dat)
+{
+    GET_LOG(LogDebug, "solveSteadyState: " << module << " error " << code << " in " << function << ": " << msg);
+}
+
+int solveSteadyState(GeneralModel* model, double tolerance)
+{
+    unsigned int i, N = model->mC_c.size();
+    SteadyStateData data;
+    data.model = model;
+    data.conserved.resize(N);
+    data.amount.resize(N);
+    int numberConserved = 0;
+    for (i = 0; i < N; ++i)
+    {
+        data.conserved[i] = !model->isMembranePermeant(i);
+        data.amount[i] = *(model->mC_c[i]) * model->V;
+        if (data.conserved[i]) ++numberConserved;
+    }
+    const SimulationContext& context = model->context;
+    if ((numberConserved == 0) && GET_CONTEXT_DEBUG(context, 0))
+    {
+        *context.diagnostics << "solveSteadyState: no membrane impermeant species, the cell volume is not uniquely "
+                     "determined by the steady state." << std::endl;
+    }
+
+    // save the initial state so we can start the fallback from there
+    double initialV = model->V;
+    std::vector<double> initialC(N);
+    for (i = 0; i < N; ++i) initialC[i] = *(model->mC_c[i]);
+    double initialU_a = model->U_a, initialU_t = model->U_t;
+
+    if (newtonSolve(&data, tolerance) == 0) return 0;
+
+    /*
+     * Pseudo-transient continuation: integrate the model over increasingly long intervals of pseudo-time, which
+     * brings the state into the region of convergence of Newton's method.
+     */
+    if (GET_CONTEXT_DEBUG(context, 0))
+        *context.diagnostics << "solveSteadyState: Newton failed, using pseudo-transient continuation" << std::endl;
+    model->V = initialV;
+    for (i = 0; i < N; ++i) *(model->mC_c[i]) = initialC[i];
+    model->U_a = initialU_a;
+    model->U_t = initialU_t;
+
+    Cvodes cvodes;
+    double t = 0.0, dt = 1.0;
+    if (cvodes.initialise(model, t, MAX_PSEUDO_TIME) != 0)
+    {
+        std::cerr << "solveSteadyState: unable to initialise the pseudo-transient integrator" << std::endl;
+        return 1;
+    }
+    while (t < MAX_PSEUDO_TIME)
+    {
+        if (cvodes.integrate(t, t + dt) != 0)
+        {
+            std::cerr << "solveSteadyState: pseudo-transient integration failed at t = " << t << std::endl;
+            return 2;
+        }
+        setModelState(model, cvodes.y);
+        int errorFlag = 0;
+        double norm = relativeRateNorm(model, errorFlag);
+        if (errorFlag != 0) return 3;
+        if (GET_CONTEXT_DEBUG(context, 10))
+            *context.diagnostics << "solveSteadyState: pseudo-time = " << t << "; relative rate norm = " << norm
+                                 << std::endl;
+        if ((norm <= tolerance) || (newtonSolve(&data, tolerance) == 0)) return 0;
+        // the Newton attempt will have moved the model away from the integrator state
+        setModelState(model, cvodes.y);
+        dt *= 2.0;
+    }
+    std::cerr << "solveSteadyState: unable to find a steady state" << std::endl;
+    return 4;
+}
+
+static int newtonSolve(SteadyStateData* data, double tolerance)
+{
+    GeneralModel* model = data->model;
+    int NEQ = model->mC_c.size() + 1; // number of species + cell volume
+    N_Vector u = N_VNew_Serial(NEQ);
+    N_Vector us = N_VNew_Serial(NEQ);
+    N_Vector fs = N_VNew_Serial(NEQ);
+    N_Vector c = N_VNew_Serial(NEQ);
+    void* kmem = KINCreate();
+    int returnCode = 1;
+    if (!check_flag((void *) u, "N_VNew_Serial", 0) && !check_flag((void *) us, "N_VNew_Serial", 0) &&
+        !check_flag((void *) fs, "N_VNew_Serial", 0) && !check_flag((void *) c, "N_VNew_Serial", 0) &&
+        !check_flag((void *) kmem, "KINCreate", 0))
+    {
+        returnCode = newtonIterate(data, tolerance, kmem, u, us, fs, c);
+    }
+    // the single exit, so nothing allocated above is leaked whichever step failed
+    if (u) N_VDestroy_Serial(u);
+    if (us) N_VDestroy_Serial(us);
+    if (fs) N_VDestroy_Serial(fs);
+    if (c) N_VDestroy_Serial(c);
+    KINFree(&kmem);
+    return (returnCode);
+}
+
+static int newtonIterate(SteadyStateData* data, double tolerance, void* kmem, N_Vector u, N_Vector us, N_Vector fs,
+                         N_Vector c)
+{
+    GeneralModel* model = data->model;
+    unsigned int i, N = model->mC_c.size();
+    int NEQ = N + 1; // number of species + cell volume
+    int flag, returnCode = 0;
+
+    // initial guess is the current state of the model
+    NV_Ith_S(u, 0) = model->V;
+    for (i = 0; i < N; ++i) NV_Ith_S(u, i+1) = *(model->mC_c[i]);
+
+    /*
+     * Scale the residuals so that they are relative rates of change of the state variables, and the unknowns by
+     * their typical magnitudes (the volume is several orders of magnitude smaller than the concentrations).
+     */
+    NV_Ith_S(us, 0) = 1.0 / model->V;
+    NV_Ith_S(fs, 0) = 1.0 / model->V;
+    NV_Ith_S(c, 0) = TWO;    /* V > 0 */
+    for (i = 0; i < N; ++i)
+    {
+        double C = fabs(*(model->mC_c[i])) > 1.0 ? fabs(*(model->mC_c[i])) : 1.0;
+        NV_Ith_S(us, i+1) = 1.0 / C;
+        NV_Ith_S(fs, i+1) = 1.0 / (C * model->V);
+        NV_Ith_S(c, i+1) = ONE;   /* C_c >= 0 */
+    }
+
+    flag = KINSetUserData(kmem, static_cast<void*>(data));
+    if (check_flag(&flag, "KINSetUserData", 1)) return (1);
+    flag = KINSetConstraints(kmem, c);
+    if (check_flag(&flag, "KINSetConstraints", 1)) return (1);
+    flag = KINSetFuncNormTol(kmem, tolerance);
+    if (check_flag(&flag, "KINSetFuncNormTol", 1)) return (1);
+    flag = KINSetNumMaxIters(kmem, MAX_NEWTON_ITERATIONS);
+    if (check_flag(&flag, "KINSetNumMaxIters", 1)) return (1);
+    // exact Newton, the analytic Jacobian is cheap compared to a residual evaluation
+    flag = KINSetMaxSetupCalls(kmem, 1);
+    if (check_flag(&flag, "KINSetMaxSetupCalls", 1)) return (1);
+    flag = KINInit(kmem, residual, u);
+    if (check_flag(&flag, "KINInit", 1)) return (1);
+    flag = KINDense(kmem, NEQ);
+    if (check_flag(&flag, "KINDense", 1)) return (1);
+    flag = KINDlsSetDenseJacFn(kmem, jacobian);
+    if (check_flag(&flag, "KINDlsSetDenseJacFn", 1)) return (1);
+    KINSetPrintLevel(kmem, 0);
+    KINSetErrHandlerFn(kmem, handleKinsolError, NULL);
+
+    flag = KINSol(kmem, u, KIN_LINESEARCH, us, fs);
+    if (flag == 2)
+    {
+        // step tolerance reached, make sure it is really a solution
+        realtype fnorm;
+        KINGetFuncNorm(kmem, &fnorm);
+        if (fnorm > tolerance) flag = -1;
+    }
+    long int iterations;
+    if (KINGetNumNonlinSolvIters(kmem, &iterations) >= 0) model->statistics.nonlinearIterations += iterations;
+    if (flag < 0)
+    {
+        if (GET_CONTEXT_DEBUG(model->context, 0))
+            *model->context.diagnostics << "solveSteadyState: KINSol failed with error code: " << flag << std::endl;
+        ++model->statistics.convergenceFailures;
+        returnCode = 1;
+    }
+    else
+    {
+        if (GET_CONTEXT_DEBUG(model->context, 10))
+        {
+            long int nni, nfe, nje;
+            KINGetNumNonlinSolvIters(kmem, &nni);
+            KINGetNumFuncEvals(kmem, &nfe);
+            KINDlsGetNumJacEvals(kmem, &nje);
+            *model->context.diagnostics << "solveSteadyState: converged in " << nni << " Newton iterations (" << nfe
+                      << " residual and " << nje << " Jacobian evaluations)" << std::endl;
+        }
+        // make sure the potentials and fluxes are consistent with the final state
+        setModelState(model, u);
+        int errorFlag = 0;
+        model->calculateRHS(0.0, errorFlag);
+        if (errorFlag != 0) returnCode = 1;
+    }
+
+    return (returnCode);
+}
+
+/*
+ *--------------------------------------------------------------------
+ * FUNCTIONS CALLED BY KINSOL
+ *--------------------------------------------------------------------
+ */
+
+/*
+ * The steady state residual: water balance, flux balance for each permeant species (the rate equation multiplied
+ * through by V) and conservation of the intracellular amount of each impermeant species.
+ */
+static int residual(N_Vector u, N_Vector r, void *user_data)
+{
+    SteadyStateData* data = static_cast<SteadyStateData*>(user_data);
+    GeneralModel* model = data->model;
+    setModelState(model, u);
+
+    int errorFlag = 0;
+    std::vector<double> f = model->calculateRHS(0.0, errorFlag);
+    if (errorFlag != 0) return 1; // positive to indicate a recoverable failure, KINSOL will shorten the step
+
+    NV_Ith_S(r, 0) = f[0];
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i)
+    {
+        if (data->conserved[i]) NV_Ith_S(r, i+1) = *(model->mC_c[i]) * model->V - data->amount[i];
+        else NV_Ith_S(r, i+1) = model->V * f[i+1];
+    }
+    return 0;
+}
+
+static int jacobian(long int N, N_Vector u, N_Vector fu, DlsMat J, void *user_data, N_Vector tmp1, N_Vector tmp2)
+{
+    SteadyStateData* data = static_cast<SteadyStateData*>(user_data);
+    GeneralModel* model = data->model;
+    setModelState(model, u);
+
+    // make sure the membrane potentials are those for this state
+    int errorFlag = 0;
+    model->calculateRHS(0.0, errorFlag);
+    if (errorFlag != 0) return 1;
+    std::vector<double> dfdy = model->calculateJacobian(0.0, errorFlag);
+    if (errorFlag != 0) return 1;
+
+    for (long int j = 0; j < N; ++j) DENSE_ELEM(J, 0, j) = dfdy[j*N];
+    for (long int i = 1; i < N; ++i)
+    {
+        if (data->conserved[i-1])
+        {
+            for (long int j = 0; j < N; ++j) DENSE_ELEM(J, i, j) = ZERO;
+            DENSE_ELEM(J, i, 0) = *(model->mC_c[i-1]);
+            DENSE_ELEM(J, i, i) = model->V;
+        }
+        else
+        {
+            // d(V.f_i)/dV = f_i + V.df_i/dV = 0 since df_i/dV = -f_i/V
+            DENSE_ELEM(J, i, 0) = ZERO;
+            for (long int j = 1; j < N; ++j) DENSE_ELEM(J, i, j) = model->V * dfdy[j*N + i];
+        }
+    }
+    return 0;
+}
+
+/*
+ *--------------------------------------------------------------------
+ * PRIVATE FUNCTIONS
+ *--------------------------------------------------------------------
+ */
+
+static void setModelState(GeneralModel* model, N_Vector u)
+{
+    model->V = NV_Ith_S(u, 0);
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i) *(model->mC_c[i]) = NV_Ith_S(u, i+1);
+}
+
+static double relativeRateNorm(GeneralModel* model, int& errorFlag)
+{
+    std::vector<double> f = model->calculateRHS(0.0, errorFlag);
+    double norm = fabs(f[0]) / model->V;
+    for (unsigned int i = 0; i < model->mC_c.size(); ++i)
+    {
+        double C = fabs(*(model->mC_c[i])) > 1.0 ? fabs(*(model->mC_c[i])) : 1.0;
+        if (fabs(f[i+1]) / C > norm) norm = fabs(f[i+1]) / C;
+    }
+    return norm;
+}
+
+/*
+ * Check function return value...
+ *    opt == 0 means SUNDIALS function allocates memory so check if
+ *             returned NULL pointer
+ *    opt == 1 means SUNDIALS function returns a flag so check if
+ *             flag >= 0
+ */
+
+static int check_flag(void *flagvalue, const char *funcname, int opt)
+{
+    int *errflag;
+
+    /* Check if SUNDIALS function returned NULL pointer - no memory allocated */
+    if (opt == 0 && flagvalue == NULL)
+    {
+        fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed - returned NULL pointer\n\n", funcname);
+        return (1);
+    }
+
+    /* Check if flag < 0 */
+    else if (opt == 1)
+    {
+        errflag = (int *) flagvalue;
+        if (*errflag < 0)
+        {
+            fprintf(stderr, "\nSUNDIALS_ERROR: %s() failed with flag = %d\n\n", funcname, *errflag);
+            return (1);
+        }
+    }
+
+    return (0);
+}
@@ -0,0 +1,28 @@
+/*
+ * steadystate.hpp
+ *
+ * Direct solution of the steady state of a GeneralModel.
+ */
+
+#ifndef STEADYSTATE_HPP_
+#define STEADYSTATE_HPP_
+
+class GeneralModel;
+
+/**
+ * Solve directly for the steady state of the given (initialised) model in its current mode, updating the cell
+ * volume, intracellular concentrations and membrane potentials in the model.
+ *
+ * A globalised (line search) Newton method is used first. For species that cannot cross either cell membrane the
+ * intracellular amount (C_c * V) is conserved, and these conservation relations replace the corresponding rate
+ * equations so that the cell volume is uniquely determined. Should the Newton iteration fail, the model is
+ * integrated in time over increasingly long pseudo-time intervals and the Newton solve is retried from each of
+ * the resulting states.
+ *
+ * @param model The model to solve, current values of the state variables are used as the initial guess.
+ * @param tolerance The tolerance on the relative rates of change of the state variables (per second).
+ * @return zero on success.
+ */
+int solveSteadyState(GeneralModel* model, double tolerance = 1.0e-6);
+
+#endif /* STEADYSTATE_HPP_ */
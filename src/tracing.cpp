@@ -0,0 +1,234 @@
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+
+#include <unistd.h>
+
+#include "tracing.hpp"
+
+std::atomic<bool> _tracing_(false);
+
+// the fields are atomic so the exporter can read them while the thread that owns the buffer overwrites them
+struct TraceEvent
+{
+    std::atomic<const char*> category;
+    std::atomic<const char*> name;
+    std::atomic<uint64_t> start;
+    std::atomic<uint64_t> duration;
+};
+
+/*
+ * A single-producer ring buffer of the events of one thread, only the owning thread writes the events and advances
+ * mHead. The oldest events are overwritten once it is full.
+ */
+class TraceBuffer
+{
+public:
+    TraceBuffer(size_t capacity, unsigned int threadNumber) : mHead(0), mThreadNumber(threadNumber)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mEvents.reset(new TraceEvent[size]);
+        mMask = size - 1;
+    }
+
+    void record(const char* category, const char* name, uint64_t start, uint64_t duration)
+    {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        TraceEvent& event = mEvents[head & mMask];
+        event.category.store(category, std::memory_order_relaxed);
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.duration.store(duration, std::memory_order_relaxed);
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+    std::unique_ptr<TraceEvent[]> mEvents;
+    uint64_t mMask;
+    std::atomic<uint64_t> mHead;
+    unsigned int mThreadNumber;
+};
+
+struct ExportedEvent
+{
+    const char* category;
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+static std::mutex traceMutex;
+// never freed, as the exporter may be reading them, but the buffer of a finished thread is reused by the next thread
+// to record events, so there are only as many as the threads recording events at once
+static std::vector<TraceBuffer*> traceBuffers;
+static std::vector<TraceBuffer*> freeTraceBuffers;
+static size_t traceBufferCapacity = 1 << 16;
+static std::chrono::steady_clock::time_point traceOrigin = std::chrono::steady_clock::now();
+
+/*
+ * The buffer of the calling thread, handed back for reuse when the thread finishes (e.g., the workers created for
+ * each evaluation of an ensemble).
+ */
+class ThreadTraceBuffer
+{
+public:
+    ThreadTraceBuffer() : buffer(NULL)
+    {
+    }
+
+    ~ThreadTraceBuffer()
+    {
+        if (!buffer) return;
+        std::lock_guard<std::mutex> lock(traceMutex);
+        freeTraceBuffers.push_back(buffer);
+        buffer = NULL;
+    }
+
+    TraceBuffer* buffer;
+};
+
+static thread_local ThreadTraceBuffer threadBuffer;
+
+static uint64_t traceClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+                                                                - traceOrigin).count();
+}
+
+/*
+ * A buffer for the calling thread, the events of the threads that used a reused buffer before stay in it and are
+ * exported as the same (Chrome trace) thread, which is fine as those threads did not run at the same time.
+ */
+static TraceBuffer* registerThread()
+{
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if (!freeTraceBuffers.empty())
+    {
+        TraceBuffer* buffer = freeTraceBuffers.back();
+        freeTraceBuffers.pop_back();
+        return buffer;
+    }
+    TraceBuffer* buffer = new TraceBuffer(traceBufferCapacity, traceBuffers.size() + 1);
+    traceBuffers.push_back(buffer);
+    return buffer;
+}
+
+// copy the events still in the buffer, leaving out any the owning thread overwrote while they were being copied
+static void copyEvents(const TraceBuffer& buffer, std::vector<ExportedEvent>& events)
+{
+    uint64_t size = buffer.mMask + 1;
+    uint64_t head = buffer.mHead.load(std::memory_order_acquire);
+    uint64_t first = (head > size) ? (head - size) : 0;
+    std::vector<ExportedEvent> copied;
+    copied.reserve(head - first);
+    for (uint64_t i = first; i < head; ++i)
+    {
+        const TraceEvent& e = buffer.mEvents[i & buffer.mMask];
+        ExportedEvent event;
+        // acquire so the events are read before mHead is read again below
+        event.category = e.category.load(std::memory_order_acquire);
+        event.name = e.name.load(std::memory_order_acquire);
+        event.start = e.start.load(std::memory_order_acquire);
+        event.duration = e.duration.load(std::memory_order_acquire);
+        copied.push_back(event);
+    }
+    // the owning thread may be writing the event at index head, overwriting the event at head - size
+    uint64_t latest = buffer.mHead.load(std::memory_order_relaxed);
+    uint64_t valid = ((latest + 1) > size) ? (latest + 1 - size) : 0;
+    for (uint64_t i = first; i < head; ++i)
+    {
+        if (i >= valid) events.push_back(copied[i - first]);
+    }
+}
+
+static void writeJsonString(std::ostream& os, const char* s)
+{
+    os << '"';
+    for (; *s; ++s)
+    {
+        if ((*s == '"') || (*s == '\\')) os << '\\';
+        os << *s;
+    }
+    os << '"';
+}
+
+// microseconds, the unit of the Chrome trace event format
+static void writeMicroseconds(std::ostream& os, uint64_t nanoseconds)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%llu.%03u", (unsigned long long)(nanoseconds / 1000),
+             (unsigned int)(nanoseconds % 1000));
+    os << buffer;
+}
+
+void startTracing(size_t eventsPerThread)
+{
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        // only applies to the threads that have not recorded any events yet
+        traceBufferCapacity = eventsPerThread;
+    }
+    _tracing_ = true;
+}
+
+void stopTracing()
+{
+    _tracing_ = false;
+}
+
+void TraceScope::begin(const char* category, const char* name)
+{
+    mCategory = category;
+    mName = name;
+    mStart = traceClock();
+}
+
+void TraceScope::end()
+{
+    uint64_t end = traceClock();
+    if (!threadBuffer.buffer) threadBuffer.buffer = registerThread();
+    threadBuffer.buffer->record(mCategory, mName, mStart, end - mStart);
+}
+
+int writeChromeTrace(std::ostream& os)
+{
+    std::vector<TraceBuffer*> buffers;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        buffers = traceBuffers;
+    }
+    int pid = getpid();
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    os << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+       << ",\"tid\":0,\"args\":{\"name\":\"GET Simulator\"}}";
+    std::vector<ExportedEvent> events;
+    for (const TraceBuffer* buffer: buffers)
+    {
+        os << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->mThreadNumber
+           << ",\"args\":{\"name\":\"thread " << buffer->mThreadNumber << "\"}}";
+        events.clear();
+        copyEvents(*buffer, events);
+        for (const ExportedEvent& event: events)
+        {
+            os << ",\n{\"ph\":\"X\",\"cat\":";
+            writeJsonString(os, event.category);
+            os << ",\"name\":";
+            writeJsonString(os, event.name);
+            os << ",\"pid\":" << pid << ",\"tid\":" << buffer->mThreadNumber << ",\"ts\":";
+            writeMicroseconds(os, event.start);
+            os << ",\"dur\":";
+            writeMicroseconds(os, event.duration);
+            os << "}";
+        }
+    }
+    os << "\n]}\n";
+    if (!os)
+    {
+        std::cerr << "writeChromeTrace: error writing the trace." << std::endl;
+        return -1;
+    }
+    return 0;
+}
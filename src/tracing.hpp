@@ -0,0 +1,80 @@
+#ifndef TRACING_HPP
+#define TRACING_HPP
+
+#include <iosfwd>
+#include <atomic>
+#include <cstddef>
+#include <stdint.h>
+
+/**
+ * @brief Start recording trace events, keeping the most recent given number of events of each thread.
+ *
+ * Each thread records its events in its own lock-free ring buffer, so recording an event costs two clock reads and
+ * a few stores, and while tracing is stopped a traced scope only checks a flag. The buffers are created the first
+ * time a thread records an event and are kept, with their events, for the life of the process, so the events of
+ * threads that have finished are still exported. The buffer of a finished thread is reused by the next thread to
+ * record events, so the events of both are exported as one thread and the oldest may be overwritten.
+ */
+void startTracing(size_t eventsPerThread = 1 << 16);
+
+void stopTracing();
+
+/**
+ * @brief Write the recorded events in the Chrome trace event format (JSON), which can be opened in Perfetto
+ * (https://ui.perfetto.dev) or chrome://tracing. Threads may keep recording while the trace is written, but the
+ * events they record meanwhile may be left out.
+ * @return zero on success.
+ */
+int writeChromeTrace(std::ostream& os);
+
+// whether tracing is started, only for the inline check below
+extern std::atomic<bool> _tracing_;
+
+inline bool tracingEnabled()
+{
+    return _tracing_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Record the time spent in a scope as a trace event if tracing is started when the scope is entered.
+ *
+ * The category and name are not copied, so they must be string literals (or otherwise outlive the process).
+ */
+class TraceScope
+{
+public:
+    TraceScope(const char* category, const char* name) : mName(NULL)
+    {
+        if (tracingEnabled()) begin(category, name);
+    }
+
+    ~TraceScope()
+    {
+        if (mName) end();
+    }
+
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    void begin(const char* category, const char* name);
+    void end();
+
+    const char* mCategory;
+    const char* mName;
+    uint64_t mStart;
+};
+
+/*
+ * Trace the rest of the enclosing scope, e.g., GET_TRACE_SCOPE("solver", "KINSOL solve"). Removed at compile time
+ * if GET_NO_TRACING is defined (the CMake option GET_TRACING).
+ */
+#ifndef GET_NO_TRACING
+#define GET_TRACE_CONCATENATE_(a, b) a##b
+#define GET_TRACE_CONCATENATE(a, b) GET_TRACE_CONCATENATE_(a, b)
+#define GET_TRACE_SCOPE(category, name) TraceScope GET_TRACE_CONCATENATE(traceScope_, __LINE__)(category, name)
+#else
+#define GET_TRACE_SCOPE(category, name) do {} while (0)
+#endif
+
+#endif // TRACING_HPP
@@ -0,0 +1,226 @@
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+
+#include "trajectorywriter.hpp"
+
+// the longest text representation of a value, e.g., -1.23456E+308 and a separator
+#define TRAJECTORY_MAXIMUM_VALUE_LENGTH 32
+
+static const char BINARY_MAGIC[8] = { 'G', 'E', 'T', 'T', 'R', 'A', 'J', '2' };
+static const char BINARY_MAGIC_1[8] = { 'G', 'E', 'T', 'T', 'R', 'A', 'J', '1' };
+static const uint32_t BYTE_ORDER_MARKER = 0x01020304;
+
+TrajectoryWriter::TrajectoryWriter() : mFormat(Text), mEncoding(Plain), mNumberOfColumns(0), mError(false)
+{
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    close();
+}
+
+int TrajectoryWriter::parseEncoding(const std::string& name, Encoding& encoding)
+{
+    if (name == "plain") encoding = Plain;
+    else if (name == "delta") encoding = Delta;
+    else if (name == "xor") encoding = Xor;
+    else
+    {
+        std::cerr << "TrajectoryWriter: unknown encoding: " << name << " (expected plain, delta or xor)"
+                  << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+int TrajectoryWriter::open(const std::string& path, Format format, const std::vector<std::string>& columnNames,
+                           Encoding encoding)
+{
+    close();
+    if (mOutput.open(path, CompressedOutput::compressionForPath(path)) != 0) return -1;
+    mFormat = format;
+    mEncoding = (format == Binary) ? encoding : Plain;
+    mNumberOfColumns = columnNames.size();
+    mRow.resize((format == Binary) ? mNumberOfColumns * sizeof(double)
+                                   : mNumberOfColumns * TRAJECTORY_MAXIMUM_VALUE_LENGTH + 1);
+    mPrevious.assign(mNumberOfColumns, 0);
+    mError = false;
+    std::string header;
+    if (format == Binary)
+    {
+        header.append(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+        header.append(reinterpret_cast<const char*>(&BYTE_ORDER_MARKER), sizeof(uint32_t));
+        uint32_t e = mEncoding;
+        header.append(reinterpret_cast<const char*>(&e), sizeof(uint32_t));
+        uint32_t n = mNumberOfColumns;
+        header.append(reinterpret_cast<const char*>(&n), sizeof(uint32_t));
+        for (const std::string& name: columnNames)
+        {
+            uint32_t length = name.size();
+            header.append(reinterpret_cast<const char*>(&length), sizeof(uint32_t));
+            header.append(name);
+        }
+    }
+    else
+    {
+        header = "#";
+        for (unsigned int i = 0; i < columnNames.size(); ++i) header += (i ? "\t" : " ") + columnNames[i];
+        header += "\n";
+    }
+    if (mOutput.write(header.data(), header.size()) != 0)
+    {
+        std::cerr << "TrajectoryWriter::open: unable to write the header to: " << path << std::endl;
+        mOutput.close();
+        return -2;
+    }
+    return 0;
+}
+
+void TrajectoryWriter::writeRow(const double* values)
+{
+    if (!mOutput.isOpen()) return;
+    size_t size;
+    if (mFormat == Binary)
+    {
+        size = mNumberOfColumns * sizeof(double);
+        if (mEncoding == Plain) memcpy(mRow.data(), values, size);
+        else
+        {
+            uint64_t* encoded = reinterpret_cast<uint64_t*>(mRow.data());
+            for (unsigned int i = 0; i < mNumberOfColumns; ++i)
+            {
+                uint64_t bits;
+                memcpy(&bits, values + i, sizeof(uint64_t));
+                encoded[i] = (mEncoding == Delta) ? (bits - mPrevious[i]) : (bits ^ mPrevious[i]);
+                mPrevious[i] = bits;
+            }
+        }
+    }
+    else
+    {
+        char* p = mRow.data();
+        for (unsigned int i = 0; i < mNumberOfColumns; ++i)
+            p += snprintf(p, TRAJECTORY_MAXIMUM_VALUE_LENGTH, (i ? "\t%.5E" : "%.5E"), values[i]);
+        *p++ = '\n';
+        size = p - mRow.data();
+    }
+    if ((mOutput.write(mRow.data(), size) != 0) && !mError)
+    {
+        std::cerr << "TrajectoryWriter::writeRow: error writing the trajectory" << std::endl;
+        mError = true;
+    }
+}
+
+int TrajectoryWriter::flush()
+{
+    if (!mOutput.isOpen()) return -1;
+    mOutput.flush();
+    return mError ? -2 : 0;
+}
+
+int TrajectoryWriter::close()
+{
+    if (!mOutput.isOpen()) return 0;
+    int status = (mOutput.close() != 0) ? -3 : 0;
+    if (mError) status = -2;
+    mRow.clear();
+    mPrevious.clear();
+    return status;
+}
+
+static int readBinaryTrajectory(const std::string& data, bool hasEncoding, std::vector<std::string>& columnNames,
+                                std::vector<std::vector<double> >& rows)
+{
+    size_t position = sizeof(BINARY_MAGIC);
+    auto readUint32 = [&data, &position](uint32_t& value)
+    {
+        if (position + sizeof(uint32_t) > data.size()) return false;
+        memcpy(&value, data.data() + position, sizeof(uint32_t));
+        position += sizeof(uint32_t);
+        return true;
+    };
+    uint32_t marker, encoding = TrajectoryWriter::Plain, n;
+    if (!readUint32(marker) || (hasEncoding && !readUint32(encoding)) || !readUint32(n)) return -1;
+    if (marker != BYTE_ORDER_MARKER)
+    {
+        std::cerr << "readTrajectory: the trajectory was written on a machine with a different byte order" << std::endl;
+        return -2;
+    }
+    if (encoding > TrajectoryWriter::Xor)
+    {
+        std::cerr << "readTrajectory: unknown encoding: " << encoding << std::endl;
+        return -2;
+    }
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t length;
+        if (!readUint32(length) || (position + length > data.size())) return -1;
+        columnNames.push_back(data.substr(position, length));
+        position += length;
+    }
+    if (n == 0) return 0;
+    // a partial last row (e.g., from an interrupted run) is ignored
+    size_t numberOfRows = (data.size() - position) / (n * sizeof(double));
+    rows.reserve(numberOfRows);
+    std::vector<uint64_t> previous(n, 0), bits(n);
+    std::vector<double> row(n);
+    for (size_t r = 0; r < numberOfRows; ++r)
+    {
+        memcpy(bits.data(), data.data() + position, n * sizeof(double));
+        position += n * sizeof(double);
+        for (uint32_t i = 0; i < n; ++i)
+        {
+            if (encoding == TrajectoryWriter::Delta) bits[i] += previous[i];
+            else if (encoding == TrajectoryWriter::Xor) bits[i] ^= previous[i];
+            previous[i] = bits[i];
+        }
+        memcpy(row.data(), bits.data(), n * sizeof(double));
+        rows.push_back(row);
+    }
+    return 0;
+}
+
+static int readTextTrajectory(const std::string& data, std::vector<std::string>& columnNames,
+                              std::vector<std::vector<double> >& rows)
+{
+    std::istringstream is(data);
+    std::string line;
+    while (std::getline(is, line))
+    {
+        if (line.empty()) continue;
+        if (line[0] == '#')
+        {
+            if (!rows.empty() || !columnNames.empty()) continue;
+            std::istringstream names(line.substr(1));
+            std::string name;
+            while (names >> name) columnNames.push_back(name);
+            continue;
+        }
+        std::istringstream values(line);
+        std::vector<double> row;
+        double v;
+        while (values >> v) row.push_back(v);
+        rows.push_back(row);
+    }
+    return 0;
+}
+
+int readTrajectory(const std::string& path, std::vector<std::string>& columnNames,
+                   std::vector<std::vector<double> >& rows)
+{
+    columnNames.clear();
+    rows.clear();
+    std::string data;
+    if (readCompressedFile(path, data) != 0) return -1;
+    if ((data.size() >= sizeof(BINARY_MAGIC)) && (memcmp(data.data(), BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0))
+        return readBinaryTrajectory(data, true, columnNames, rows);
+    if ((data.size() >= sizeof(BINARY_MAGIC_1)) &&
+        (memcmp(data.data(), BINARY_MAGIC_1, sizeof(BINARY_MAGIC_1)) == 0))
+        return readBinaryTrajectory(data, false, columnNames, rows);
+    return readTextTrajectory(data, columnNames, rows);
+}
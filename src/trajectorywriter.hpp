@@ -0,0 +1,110 @@
+#ifndef TRAJECTORYWRITER_HPP
+#define TRAJECTORYWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "compressedoutput.hpp"
+
+/**
+ * @brief Write a trajectory (a table of rows of doubles, one per output time) to a file.
+ *
+ * Rows are collected in large blocks and written, compressed if the path ends in .gz, .xz or .bz2, by a background
+ * thread (see CompressedOutput). Two formats are supported:
+ *
+ * Text: gnuplot compatible, a "# name1\tname2..." header then tab separated rows in upper case scientific
+ * notation with 5 digits after the point, as get-simulator has always written.
+ *
+ * Binary: the 8 byte magic "GETTRAJ2", a uint32 byte order marker (0x01020304 in the writer's byte order), the
+ * uint32 encoding, a uint32 number of columns, then each column name as a uint32 length followed by its
+ * characters; and then the rows as native 64 bit values. The number of rows is implied by the file size, so a
+ * partially written file is still readable. Files with the magic "GETTRAJ1" have no encoding field and are Plain.
+ *
+ * The Delta and Xor encodings store the difference or exclusive or of the bits of each value with the bits of the
+ * value in the same column of the previous row. Smoothly varying columns then have mostly zero high order bytes,
+ * which compress much better. Both are lossless.
+ */
+class TrajectoryWriter
+{
+public:
+    enum Format
+    {
+        Text = 1,
+        Binary = 2
+    };
+
+    enum Encoding
+    {
+        Plain = 0,
+        Delta = 1,
+        Xor = 2
+    };
+
+    TrajectoryWriter();
+    ~TrajectoryWriter();
+
+    /**
+     * @brief Create the file and write the header.
+     * @param path The path of the file, its extension selects the compression.
+     * @param format The format to write.
+     * @param columnNames The name of each column.
+     * @param encoding The encoding of the values, for the binary format only.
+     * @return zero on success.
+     */
+    int open(const std::string& path, Format format, const std::vector<std::string>& columnNames,
+             Encoding encoding = Plain);
+
+    /**
+     * @brief Add a row, which must have a value for every column.
+     */
+    void writeRow(const double* values);
+    void writeRow(const std::vector<double>& values) { writeRow(values.data()); }
+
+    /**
+     * @brief Hand any buffered rows to the background thread.
+     * @return zero on success.
+     */
+    int flush();
+
+    /**
+     * @brief Write out all the rows and close the file.
+     * @return zero on success.
+     */
+    int close();
+
+    bool isOpen() const { return mOutput.isOpen(); }
+    unsigned int numberOfColumns() const { return mNumberOfColumns; }
+
+    /**
+     * @brief Parse the name of an encoding (plain, delta or xor).
+     * @return zero on success.
+     */
+    static int parseEncoding(const std::string& name, Encoding& encoding);
+
+private:
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    CompressedOutput mOutput;
+    Format mFormat;
+    Encoding mEncoding;
+    unsigned int mNumberOfColumns;
+    // the formatted or encoded row and, for the encodings, the bits of the previous row
+    std::vector<char> mRow;
+    std::vector<uint64_t> mPrevious;
+    bool mError;
+};
+
+/**
+ * @brief Read a trajectory written in either format by TrajectoryWriter (the format and compression are detected
+ * from the file).
+ * @param path The path of the file.
+ * @param columnNames On success, the name of each column.
+ * @param rows On success, the rows of the trajectory.
+ * @return zero on success.
+ */
+int readTrajectory(const std::string& path, std::vector<std::string>& columnNames,
+                   std::vector<std::vector<double> >& rows);
+
+#endif // TRAJECTORYWRITER_HPP
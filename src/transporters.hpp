@@ -0,0 +1,310 @@
+/*
+ * transporters.hpp
+ *
+ * Active transport terms for GeneralModel.
+ */
+
+#ifndef TRANSPORTERS_HPP_
+#define TRANSPORTERS_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <initializer_list>
+
+#include "GeneralModel.hpp"
+#include "physicalconstants.hpp"
+
+/*
+ * Each transport term is a small class providing:
+ *
+ *   int resolve(const GeneralModel& model)
+ *       look up the indices of the molecules it transports, zero on success;
+ *   void markTransported(std::vector<bool>& transported) const
+ *       flag the molecules it transports;
+ *   void addFluxes(GeneralModel& model) const
+ *       add its fluxes to the current membrane fluxes of the model;
+ *   void addDerivatives(const GeneralModel& model, MembraneFluxDerivatives& derivatives) const
+ *       add the partial derivatives of its fluxes with respect to the intracellular concentrations and membrane
+ *       potentials.
+ *
+ * Terms are combined into a TransporterSet, which is resolved entirely at compile time so that all of the terms
+ * are inlined into the membrane flux evaluation. Fluxes follow the same sign convention as the passive fluxes:
+ * J_a is positive from the mucosal compartment into the cell and J_b is positive from the cell into the serosal
+ * compartment.
+ */
+
+enum Membrane
+{
+    Apical = 0,
+    Basolateral = 1
+};
+
+/**
+ * Access to the fluxes and concentrations on either side of the given membrane. Side 1 is the side the positive
+ * flux comes from and side 2 the side it goes to.
+ */
+template<Membrane M> class MembraneSides;
+
+template<> class MembraneSides<Apical>
+{
+public:
+    static double& J(GeneralModel& model, int i) { return *(model.mJ_a[i]); }
+    static double C1(const GeneralModel& model, int i) { return *(model.mC_a[i]); }
+    static double C2(const GeneralModel& model, int i) { return *(model.mC_c[i]); }
+    static std::vector<double>& dJ_dCc(MembraneFluxDerivatives& d) { return d.dJa_dCc; }
+    // the intracellular compartment is on side 2 of the apical membrane
+    static const int intracellularSide = 2;
+};
+
+template<> class MembraneSides<Basolateral>
+{
+public:
+    static double& J(GeneralModel& model, int i) { return *(model.mJ_b[i]); }
+    static double C1(const GeneralModel& model, int i) { return *(model.mC_c[i]); }
+    static double C2(const GeneralModel& model, int i) { return *(model.mC_b[i]); }
+    static std::vector<double>& dJ_dCc(MembraneFluxDerivatives& d) { return d.dJb_dCc; }
+    // the intracellular compartment is on side 1 of the basolateral membrane
+    static const int intracellularSide = 1;
+};
+
+/**
+ * The basolateral Na-K pump from the Latta et al (1984) model (eq 9),
+ *    I_p = Imax / ((1 + (K_Na/C_c[Na])^n_Na) (1 + (K_K/C_b[K])^n_K))
+ * with n_Na sodium ions pumped out of the cell and n_K potassium ions into the cell for each cycle.
+ * Default parameter values are from Table 1 in Latta et al (1984).
+ */
+class SodiumPotassiumPump
+{
+public:
+    SodiumPotassiumPump(double Imax = 5.61, double K_Na = 14.2, double K_K = 2.3, double n_Na = 3.0,
+                        double n_K = 2.0, const std::string& sodium = "http://cellml.sourceforge.net/ns/ion/Na",
+                        const std::string& potassium = "http://cellml.sourceforge.net/ns/ion/K") :
+        Imax(Imax), K_Na(K_Na), K_K(K_K), n_Na(n_Na), n_K(n_K), mSodium(sodium), mPotassium(potassium),
+        mNa(-1), mK(-1)
+    {
+    }
+
+    int resolve(const GeneralModel& model)
+    {
+        mNa = model.moleculeIndex(mSodium);
+        mK = model.moleculeIndex(mPotassium);
+        if ((mNa < 0) || (mK < 0))
+        {
+            std::cerr << "SodiumPotassiumPump: unable to find the molecules " << mSodium << " and " << mPotassium
+                      << " in the model" << std::endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    void markTransported(std::vector<bool>& transported) const
+    {
+        transported[mNa] = transported[mK] = true;
+    }
+
+    inline double current(const GeneralModel& model) const
+    {
+        double C_Na = *(model.mC_c[mNa]);
+        if (C_Na <= 0.0) return 0.0;
+        return Imax / ((1.0 + pow(K_Na / C_Na, n_Na)) * (1.0 + pow(K_K / *(model.mC_b[mK]), n_K)));
+    }
+
+    inline void addFluxes(GeneralModel& model) const
+    {
+        double I_p = current(model);
+        *(model.mJ_b[mNa]) += n_Na * I_p / F;
+        *(model.mJ_b[mK]) -= n_K * I_p / F;
+    }
+
+    inline void addDerivatives(const GeneralModel& model, MembraneFluxDerivatives& derivatives) const
+    {
+        double C_Na = *(model.mC_c[mNa]);
+        if (C_Na <= 0.0) return;
+        int N = model.mC_c.size();
+        double x = pow(K_Na / C_Na, n_Na);
+        double dIp_dNa = current(model) * n_Na * x / (C_Na * (1.0 + x));
+        derivatives.dJb_dCc[mNa*N + mNa] += n_Na * dIp_dNa / F;
+        derivatives.dJb_dCc[mK*N + mNa] -= n_K * dIp_dNa / F;
+    }
+
+    double Imax, K_Na, K_K, n_Na, n_K;
+
+private:
+    std::string mSodium, mPotassium;
+    int mNa, mK;
+};
+
+/**
+ * A carrier mediated transporter on the given membrane moving NS species with a mass-action flux,
+ *    J = P (prod_s C_from(s)^|n_s| - prod_s C_to(s)^|n_s|)
+ * where species with a positive stoichiometry n_s move in the direction of positive flux for the membrane and
+ * those with a negative stoichiometry move in the opposite direction. The flux of each species is n_s J. The
+ * carrier is voltage independent, but electrogenic if the net charge moved is not zero.
+ */
+template<Membrane M, int NS>
+class Carrier
+{
+public:
+    Carrier(double permeability, std::initializer_list<std::string> species,
+            std::initializer_list<double> stoichiometry) : P(permeability), mValid(true)
+    {
+        if ((species.size() != NS) || (stoichiometry.size() != NS))
+        {
+            mValid = false;
+            return;
+        }
+        int s = 0;
+        for (auto i = species.begin(); i != species.end(); ++i, ++s) mSpecies[s] = *i;
+        s = 0;
+        for (auto i = stoichiometry.begin(); i != stoichiometry.end(); ++i, ++s) n[s] = *i;
+        for (s = 0; s < NS; ++s) mIndex[s] = -1;
+    }
+
+    int resolve(const GeneralModel& model)
+    {
+        if (!mValid)
+        {
+            std::cerr << "Carrier: expected " << NS << " species and stoichiometries" << std::endl;
+            return -1;
+        }
+        for (int s = 0; s < NS; ++s)
+        {
+            mIndex[s] = model.moleculeIndex(mSpecies[s]);
+            if (mIndex[s] < 0)
+            {
+                std::cerr << "Carrier: unable to find the molecule " << mSpecies[s] << " in the model" << std::endl;
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    void markTransported(std::vector<bool>& transported) const
+    {
+        for (int s = 0; s < NS; ++s) transported[mIndex[s]] = true;
+    }
+
+    inline double flux(const GeneralModel& model) const
+    {
+        double forward = P, reverse = P;
+        for (int s = 0; s < NS; ++s)
+        {
+            forward *= pow(concentration(model, s, fromSide(s)), fabs(n[s]));
+            reverse *= pow(concentration(model, s, toSide(s)), fabs(n[s]));
+        }
+        return forward - reverse;
+    }
+
+    inline void addFluxes(GeneralModel& model) const
+    {
+        double J = flux(model);
+        for (int s = 0; s < NS; ++s) MembraneSides<M>::J(model, mIndex[s]) += n[s] * J;
+    }
+
+    inline void addDerivatives(const GeneralModel& model, MembraneFluxDerivatives& derivatives) const
+    {
+        int N = model.mC_c.size();
+        std::vector<double>& dJ_dCc = MembraneSides<M>::dJ_dCc(derivatives);
+        for (int k = 0; k < NS; ++k)
+        {
+            // only one of the two mass-action terms contains the intracellular concentration of species k
+            bool inForward = (fromSide(k) == MembraneSides<M>::intracellularSide);
+            double dJ = inForward ? P : -P;
+            for (int s = 0; s < NS; ++s)
+            {
+                double C = concentration(model, s, inForward ? fromSide(s) : toSide(s));
+                double e = fabs(n[s]);
+                dJ *= (s == k) ? e * pow(C, e - 1.0) : pow(C, e);
+            }
+            for (int s = 0; s < NS; ++s) dJ_dCc[mIndex[s]*N + mIndex[k]] += n[s] * dJ;
+        }
+    }
+
+    double P;
+    double n[NS];
+
+private:
+    inline int fromSide(int s) const { return (n[s] > 0.0) ? 1 : 2; }
+    inline int toSide(int s) const { return (n[s] > 0.0) ? 2 : 1; }
+    inline double concentration(const GeneralModel& model, int s, int side) const
+    {
+        return (side == 1) ? MembraneSides<M>::C1(model, mIndex[s]) : MembraneSides<M>::C2(model, mIndex[s]);
+    }
+
+    std::string mSpecies[NS];
+    int mIndex[NS];
+    bool mValid;
+};
+
+/**
+ * A cotransporter (symporter), all stoichiometries positive.
+ */
+template<Membrane M, int NS> using Cotransporter = Carrier<M, NS>;
+
+/**
+ * An exchanger (antiporter), the exchanged species are given negative stoichiometries.
+ */
+template<Membrane M, int NS> using Exchanger = Carrier<M, NS>;
+
+/**
+ * A compile-time collection of transport terms.
+ */
+template<typename... Terms> class TransporterSet;
+
+template<> class TransporterSet<>
+{
+public:
+    int resolve(const GeneralModel&) { return 0; }
+    void markTransported(std::vector<bool>&) const {}
+    inline void addFluxes(GeneralModel&) const {}
+    inline void addDerivatives(const GeneralModel&, MembraneFluxDerivatives&) const {}
+};
+
+template<typename Term, typename... Rest>
+class TransporterSet<Term, Rest...>
+{
+public:
+    TransporterSet(const Term& term, const Rest&... rest) : head(term), tail(rest...)
+    {
+    }
+
+    int resolve(const GeneralModel& model)
+    {
+        return head.resolve(model) + tail.resolve(model);
+    }
+
+    void markTransported(std::vector<bool>& transported) const
+    {
+        head.markTransported(transported);
+        tail.markTransported(transported);
+    }
+
+    inline void addFluxes(GeneralModel& model) const
+    {
+        head.addFluxes(model);
+        tail.addFluxes(model);
+    }
+
+    inline void addDerivatives(const GeneralModel& model, MembraneFluxDerivatives& derivatives) const
+    {
+        head.addDerivatives(model, derivatives);
+        tail.addDerivatives(model, derivatives);
+    }
+
+    Term head;
+    TransporterSet<Rest...> tail;
+};
+
+/**
+ * Convenience function to create a transporter set, e.g.,
+ *    auto transporters = makeTransporterSet(SodiumPotassiumPump(), Cotransporter<Apical, 2>(P, {Na, Cl}, {1, 1}));
+ */
+template<typename... Terms>
+TransporterSet<Terms...> makeTransporterSet(const Terms&... terms)
+{
+    return TransporterSet<Terms...>(terms...);
+}
+
+#endif /* TRANSPORTERS_HPP_ */
@@ -11,6 +11,8 @@ public:
     std::string id;
     std::string name;
     std::string source;
+    // the URL to load the model from, a local copy of source once the models have been fetched
+    std::string localSource;
 };
 
 class MySimulation
@@ -20,6 +22,7 @@ public:
     {
         mCsim = false;
         mGet = false;
+        activeTransport = false;
         // set some reasonable defaults
         absoluteTolerance = 1.0e-6;
         relativeTolerance = 1.0e-8;
@@ -55,6 +58,7 @@ public:
     int numberOfPoints;
 
     std::string mMethod; // GET: open-circuit or closed-circuit? or CSim algorithm ID (KiSAO)
+    bool activeTransport; // GET: include the basolateral Na-K pump
 
     double absoluteTolerance;
     double relativeTolerance;
@@ -3,7 +3,12 @@
 #include <vector>
 #include <sstream>
 #include <iostream>
+#include <map>
+#include <set>
+#include <mutex>
 #include <libxml/uri.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
 
 // FIXME: need to do this better?
 #ifdef _MSC_VER
@@ -16,24 +21,39 @@
 #endif
 
 #include "utils.hpp"
+#include "documentcache.hpp"
+#include "mappedfile.hpp"
+#include "omexarchive.hpp"
+#include "logging.hpp"
+#include "tracing.hpp"
 
 class CurlData
 {
 public:
     CurlData()
     {
-        std::cout << "Creating a persistent CurlData handle" << std::endl;
+        GET_LOG(LogTrace, "Creating a persistent CurlData handle");
         mCurl = curl_easy_init();
     }
     ~CurlData()
     {
-        std::cout << "Destroying a persistent CurlData handle" << std::endl;
+        GET_LOG(LogTrace, "Destroying a persistent CurlData handle");
         if (mCurl) curl_easy_cleanup(mCurl);
     }
 
     CURL* mCurl;
 };
 
+/*
+ * curl_global_init is not thread-safe, so it is only ever called once for the process and never cleaned up.
+ */
+static std::once_flag curlInitialised;
+
+void initialiseUrlFetching()
+{
+    std::call_once(curlInitialised, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
 static size_t retrieveContent(char* buffer, size_t size, size_t nmemb, void* string)
 {
     std::string* s = static_cast<std::string*>(string);
@@ -61,37 +81,319 @@ std::string buildAbsoluteUri(const std::string& uri, const std::string& base)
     return url;
 }
 
+bool isFileUrl(const std::string& url)
+{
+    return url.compare(0, 7, "file://") == 0;
+}
+
+std::string fileUrlPath(const std::string& url)
+{
+    std::string path = url.substr(7);
+    // drop any authority, e.g., file://localhost/path
+    if (!path.empty() && (path[0] != '/')) path.erase(0, path.find('/'));
+    char* unescaped = xmlURIUnescapeString(path.c_str(), 0, NULL);
+    if (unescaped)
+    {
+        path = unescaped;
+        xmlFree(unescaped);
+    }
+    return path;
+}
+
+/*
+ * Read a local file without going through curl.
+ */
+static bool getFileContent(const std::string& url, std::string& content)
+{
+    MappedFile file;
+    if (file.open(fileUrlPath(url)) != 0) return false;
+    content.assign(file.data(), file.size());
+    return true;
+}
+
 std::string getUrlContent(const std::string &url)
 {
-    std::cout << "URL to fetch: " << url.c_str() << std::endl;
-    static CurlData curlHandle;
+    GET_TRACE_SCOPE("io", "fetch document");
+    GET_LOG(LogDebug, "URL to fetch: " << url);
     std::string data, headerData;
+    if (isFileUrl(url))
+    {
+        getFileContent(url, data);
+        return data;
+    }
+    if (isOmexUrl(url))
+    {
+        getOmexUrlContent(url, data);
+        return data;
+    }
+    initialiseUrlFetching();
+    CachedDocument cached;
+    std::string cachedContent;
+    bool isCached = findCachedDocument(url, cached, cachedContent);
+    if (isCached && cachedDocumentIsFresh(cached)) return cachedContent;
+    if (isCacheableUrl(url) && documentCacheOffline())
+    {
+        std::cerr << "Working offline and the URL is not in the document cache: " << url << std::endl;
+        return "";
+    }
+    // one handle for each thread, so documents can be fetched concurrently (e.g., by the server's workers)
+    static thread_local CurlData curlHandle;
     CURL* curl = curlHandle.mCurl;
+    struct curl_slist* requestHeaders = NULL;
+    if (isCached)
+    {
+        for (const std::string& h: conditionalRequestHeaders(cached))
+            requestHeaders = curl_slist_append(requestHeaders, h.c_str());
+    }
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, requestHeaders);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, retrieveContent);
     curl_easy_setopt(curl, CURLOPT_WRITEHEADER, static_cast<void*>(&headerData));
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void*>(&data));
     //curl_easy_setopt(curl, CURLOPT_HEADER, 1);
     CURLcode res = curl_easy_perform(curl);
+    // the handle is re-used, so don't leave it pointing at the freed headers
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
+    curl_slist_free_all(requestHeaders);
     if(CURLE_OK != res)
     {
         /* we failed */
         std::cerr << "curl told us " << res << std::endl;
+        if (isCached)
+        {
+            std::cerr << "Using the cached copy of: " << url << std::endl;
+            return cachedContent;
+        }
         return "";
     }
     // check headers
-    std::vector<std::string> headers;
-    headers = splitString(headerData, '\n', headers);
-    if (headers.size() > 0)
+    int status = responseStatusCode(headerData);
+    if (isCached && (status == 304))
+    {
+        // not modified, so the cached content is still good
+        refreshCachedDocument(cached);
+        return cachedContent;
+    }
+    if ((status != 0) && (status != 200))
+    {
+        // HTTP 200 OK header response not seen so delete any returned data
+        data.clear();
+    }
+    else if (status == 200) storeCachedDocument(url, headerData, data);
+    return data;
+}
+
+/*
+ * A single transfer in a prefetch.
+ */
+class PrefetchTransfer
+{
+public:
+    PrefetchTransfer() : isCached(false), requestHeaders(NULL)
     {
-        // have some headers to check
-        if (headers[0].find("200") == std::string::npos)
+    }
+
+    std::string url;
+    std::string data;
+    std::string headers;
+    // the cache entry being revalidated, if any
+    bool isCached;
+    CachedDocument cached;
+    std::string cachedContent;
+    struct curl_slist* requestHeaders;
+};
+
+/*
+ * Collect the resolved URLs of all the CellML imports in the given document.
+ */
+static void findImportUrls(xmlNodePtr node, const std::string& baseUrl, std::vector<std::string>& urls)
+{
+    for (xmlNodePtr n = node; n; n = n->next)
+    {
+        if (n->type != XML_ELEMENT_NODE) continue;
+        if (xmlStrEqual(n->name, BAD_CAST "import"))
         {
-            // HTTP 200 OK header response not seen so delete any returned data
-            data.clear();
+            xmlChar* href = xmlGetNsProp(n, BAD_CAST "href", BAD_CAST "http://www.w3.org/1999/xlink");
+            if (href)
+            {
+                urls.push_back(buildAbsoluteUri((char*)href, baseUrl));
+                xmlFree(href);
+            }
         }
+        findImportUrls(n->children, baseUrl, urls);
     }
-    return data;
+}
+
+static void findImportUrls(const std::string& content, const std::string& baseUrl, std::vector<std::string>& urls)
+{
+    xmlDocPtr doc = xmlReadMemory(content.data(), content.size(), baseUrl.c_str(), NULL,
+                                  XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+    if (!doc) return;
+    findImportUrls(xmlDocGetRootElement(doc), baseUrl, urls);
+    xmlFreeDoc(doc);
+}
+
+/*
+ * The state of a prefetch: the multi handle with the transfers in progress and the URLs already requested.
+ */
+class Prefetch
+{
+public:
+    Prefetch(CURLM* m, bool f, std::map<std::string, std::string>& d) :
+        multi(m), followImports(f), documents(d), numberOfTransfers(0), numberOfFailures(0)
+    {
+    }
+
+    /*
+     * Start fetching the given URL, unless it has already been requested or can be served from the cache.
+     */
+    void request(const std::string& url)
+    {
+        if (requested.count(url) || documents.count(url)) return;
+        requested.insert(url);
+        if (isFileUrl(url) || isOmexUrl(url))
+        {
+            std::string content;
+            bool ok = isFileUrl(url) ? getFileContent(url, content) : (getOmexUrlContent(url, content) == 0);
+            if (ok) complete(url, content);
+            else ++numberOfFailures;
+            return;
+        }
+        PrefetchTransfer* transfer = new PrefetchTransfer();
+        transfer->url = url;
+        transfer->isCached = findCachedDocument(url, transfer->cached, transfer->cachedContent);
+        if (transfer->isCached && cachedDocumentIsFresh(transfer->cached))
+        {
+            complete(url, transfer->cachedContent);
+            delete transfer;
+            return;
+        }
+        if (isCacheableUrl(url) && documentCacheOffline())
+        {
+            std::cerr << "prefetchUrls: working offline and the URL is not in the document cache: " << url
+                      << std::endl;
+            ++numberOfFailures;
+            delete transfer;
+            return;
+        }
+        if (transfer->isCached)
+        {
+            for (const std::string& h: conditionalRequestHeaders(transfer->cached))
+                transfer->requestHeaders = curl_slist_append(transfer->requestHeaders, h.c_str());
+        }
+        CURL* curl = curl_easy_init();
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->requestHeaders);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, retrieveContent);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void*>(&(transfer->data)));
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, retrieveContent);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, static_cast<void*>(&(transfer->headers)));
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, static_cast<void*>(transfer));
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        // prefer HTTP/2 over TLS and wait for an existing connection to multiplex on rather than opening a new one
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+        curl_multi_add_handle(multi, curl);
+        ++numberOfTransfers;
+    }
+
+    /*
+     * Handle a finished transfer.
+     */
+    void finished(CURLMsg* message)
+    {
+        CURL* curl = message->easy_handle;
+        char* p;
+        curl_easy_getinfo(curl, CURLINFO_PRIVATE, &p);
+        PrefetchTransfer* transfer = reinterpret_cast<PrefetchTransfer*>(p);
+        int status = responseStatusCode(transfer->headers);
+        if (message->data.result != CURLE_OK)
+        {
+            std::cerr << "prefetchUrls: unable to fetch " << transfer->url << " (curl told us "
+                      << message->data.result << ")" << std::endl;
+            if (transfer->isCached) complete(transfer->url, transfer->cachedContent);
+            else ++numberOfFailures;
+        }
+        else if (transfer->isCached && (status == 304))
+        {
+            refreshCachedDocument(transfer->cached);
+            complete(transfer->url, transfer->cachedContent);
+        }
+        // as for getUrlContent, only accept HTTP 200 OK responses (non-HTTP URLs have no status)
+        else if ((status == 0) || (status == 200))
+        {
+            if (status == 200) storeCachedDocument(transfer->url, transfer->headers, transfer->data);
+            complete(transfer->url, transfer->data);
+        }
+        else
+        {
+            std::cerr << "prefetchUrls: unable to fetch " << transfer->url << " (HTTP status " << status << ")"
+                      << std::endl;
+            ++numberOfFailures;
+        }
+        curl_multi_remove_handle(multi, curl);
+        curl_easy_cleanup(curl);
+        curl_slist_free_all(transfer->requestHeaders);
+        delete transfer;
+        --numberOfTransfers;
+    }
+
+    CURLM* multi;
+    bool followImports;
+    std::map<std::string, std::string>& documents;
+    int numberOfTransfers, numberOfFailures;
+    std::set<std::string> requested;
+
+private:
+    void complete(const std::string& url, std::string& content)
+    {
+        if (followImports)
+        {
+            std::vector<std::string> imports;
+            findImportUrls(content, url, imports);
+            for (const std::string& i: imports) request(i);
+        }
+        documents[url].swap(content);
+    }
+};
+
+int prefetchUrls(const std::vector<std::string>& urls, bool followImports,
+                 std::map<std::string, std::string>& documents)
+{
+    initialiseUrlFetching();
+    CURLM* multi = curl_multi_init();
+    if (!multi)
+    {
+        std::cerr << "prefetchUrls: unable to create a curl multi handle" << std::endl;
+        return -1;
+    }
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    // transfers beyond this limit are queued by curl until a connection to the host is free
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, 6L);
+    Prefetch prefetch(multi, followImports, documents);
+    for (const std::string& url: urls) prefetch.request(url);
+    while (prefetch.numberOfTransfers > 0)
+    {
+        int running;
+        if (curl_multi_perform(multi, &running) != CURLM_OK)
+        {
+            std::cerr << "prefetchUrls: error performing the transfers" << std::endl;
+            ++prefetch.numberOfFailures;
+            break;
+        }
+        CURLMsg* message;
+        int numberOfMessages;
+        while ((message = curl_multi_info_read(multi, &numberOfMessages)))
+        {
+            if (message->msg == CURLMSG_DONE) prefetch.finished(message);
+        }
+        if (prefetch.numberOfTransfers > 0) curl_multi_wait(multi, NULL, 0, 1000, NULL);
+    }
+    curl_multi_cleanup(multi);
+    return prefetch.numberOfFailures;
 }
 
 std::vector<std::string>& splitString(const std::string &s, char delim, std::vector<std::string>& elems)
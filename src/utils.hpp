@@ -3,9 +3,42 @@
 
 #include <string>
 #include <vector>
+#include <map>
 
+/**
+ * Initialise curl for the process. Safe to call from any thread, and more than once; it should be called at
+ * startup, before any other threads use curl.
+ */
+void initialiseUrlFetching();
+
+/**
+ * Fetch the content of the given URL, going through the document cache for http(s) URLs.
+ */
 std::string getUrlContent(const std::string& url);
 
+/**
+ * Check if the given URL refers to a local file.
+ */
+bool isFileUrl(const std::string& url);
+
+/**
+ * The local path for the given file:// URL, with any percent-encoding removed.
+ */
+std::string fileUrlPath(const std::string& url);
+
+/**
+ * Fetch the given URLs concurrently, re-using connections and multiplexing requests over HTTP/2 where the server
+ * supports it. As for getUrlContent, http(s) documents go through the document cache.
+ * @param urls The URLs to fetch.
+ * @param followImports If true, also fetch the CellML imports of each document, recursively, as soon as the
+ * document importing them has been fetched.
+ * @param documents The content of each document fetched, keyed by URL. Documents already in the map are not
+ * fetched again.
+ * @return The number of URLs that could not be fetched.
+ */
+int prefetchUrls(const std::vector<std::string>& urls, bool followImports,
+                 std::map<std::string, std::string>& documents);
+
 std::vector<std::string>& splitString(const std::string &s, char delim, std::vector<std::string>& elems);
 
 /**
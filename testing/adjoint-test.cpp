@@ -0,0 +1,138 @@
+/*
+ * adjoint-test.cpp
+ *
+ * Checks the gradient of an objective of a Latta cell computed by computeAdjointGradient against central finite
+ * differences of the objective, each evaluated by a forward run with the parameter perturbed either side of its
+ * value. The objective has both an integrated and a terminal part so that both reach the adjoint system.
+ */
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "GeneralModel.hpp"
+#include "adjoint.hpp"
+#include "lattacell.hpp"
+
+#define END_TIME 50.0
+#define PERTURBATION 1.0e-3
+#define GRADIENT_TOLERANCE 1.0e-2
+
+static const char* parameterNames[] = { "P_a[Na]", "P_b[K]", "P_b[Cl]" };
+static const int numberOfParameters = sizeof(parameterNames) / sizeof(parameterNames[0]);
+
+/*
+ * The integrated squared relative change of the concentrations from their initial values, plus the squared
+ * relative change in the volume at the end.
+ */
+static AdjointObjective makeObjective(const std::vector<double>& y0)
+{
+    AdjointObjective objective;
+    objective.integrand = [y0](double t, const std::vector<double>& y)
+    {
+        double g = 0.0;
+        for (unsigned int i = 1; i < y.size(); ++i) g += pow((y[i] - y0[i]) / y0[i], 2.0);
+        return g;
+    };
+    objective.integrandGradient = [y0](double t, const std::vector<double>& y, std::vector<double>& dgdy)
+    {
+        dgdy.assign(y.size(), 0.0);
+        for (unsigned int i = 1; i < y.size(); ++i) dgdy[i] = 2.0 * (y[i] - y0[i]) / (y0[i] * y0[i]);
+    };
+    objective.terminal = [y0](const std::vector<double>& y)
+    {
+        return pow((y[0] - y0[0]) / y0[0], 2.0);
+    };
+    objective.terminalGradient = [y0](const std::vector<double>& y, std::vector<double>& dphidy)
+    {
+        dphidy.assign(y.size(), 0.0);
+        dphidy[0] = 2.0 * (y[0] - y0[0]) / (y0[0] * y0[0]);
+    };
+    return objective;
+}
+
+/*
+ * Evaluate the objective with the parameters scaled by the given factors and, if requested, its gradient with
+ * respect to them.
+ */
+static int evaluateObjective(const std::vector<double>& scales, double& value, std::vector<double>* gradient)
+{
+    GeneralModel model;
+    configureLattaCell(model);
+    model.initialise();
+    std::vector<double*> parameters;
+    for (int p = 0; p < numberOfParameters; ++p)
+    {
+        double* parameter = model.parameter(parameterNames[p]);
+        if (parameter == NULL)
+        {
+            std::cerr << "Unknown parameter: " << parameterNames[p] << std::endl;
+            return 1;
+        }
+        *parameter *= scales[p];
+        parameters.push_back(parameter);
+    }
+    std::vector<double> y0(1, model.V);
+    for (unsigned int i = 0; i < model.mC_c.size(); ++i) y0.push_back(*(model.mC_c[i]));
+    std::vector<double> g;
+    if (computeAdjointGradient(&model, gradient ? parameters : std::vector<double*>(), 0.0, END_TIME,
+                               makeObjective(y0), value, g) != 0)
+        return 1;
+    if (gradient)
+    {
+        // with respect to the relative change in each parameter, to compare with the perturbed runs
+        for (int p = 0; p < numberOfParameters; ++p) g[p] *= *(parameters[p]);
+        *gradient = g;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    double value;
+    std::vector<double> gradient;
+    std::vector<double> scales(numberOfParameters, 1.0);
+    if (evaluateObjective(scales, value, &gradient) != 0)
+    {
+        std::cerr << "FAILED: unable to compute the adjoint gradient" << std::endl;
+        return 1;
+    }
+    std::vector<double> difference(numberOfParameters);
+    double scale = 0.0;
+    for (int p = 0; p < numberOfParameters; ++p)
+    {
+        double plus, minus;
+        scales[p] = 1.0 + PERTURBATION;
+        int status = evaluateObjective(scales, plus, NULL);
+        scales[p] = 1.0 - PERTURBATION;
+        status += evaluateObjective(scales, minus, NULL);
+        scales[p] = 1.0;
+        if (status != 0)
+        {
+            std::cerr << "FAILED: " << parameterNames[p] << ": unable to evaluate the objective" << std::endl;
+            return 1;
+        }
+        difference[p] = (plus - minus) / (2.0 * PERTURBATION);
+        scale = std::max(scale, std::max(fabs(difference[p]), fabs(gradient[p])));
+    }
+    int errors = 0;
+    if (scale == 0.0)
+    {
+        std::cerr << "FAILED: the objective is not sensitive to the parameters, so nothing is being tested"
+                  << std::endl;
+        ++errors;
+    }
+    for (int p = 0; p < numberOfParameters; ++p)
+    {
+        // relative to the largest derivative, as the objective may be insensitive to some of the parameters
+        if (fabs(gradient[p] - difference[p]) > GRADIENT_TOLERANCE * scale)
+        {
+            std::cerr << "FAILED: " << parameterNames[p] << ": the adjoint derivative is " << gradient[p]
+                      << " rather than " << difference[p] << std::endl;
+            ++errors;
+        }
+    }
+    if (errors == 0) std::cout << "All adjoint tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,182 @@
+/*
+ * concurrency-test.cpp
+ *
+ * Runs GeneralModel simulations and SED-ML simulation experiments in many threads at once and checks that each
+ * gives the same results as when it is run on its own. It is only built in a ThreadSanitizer build (GET_TSAN_TESTS,
+ * see CMakeLists.txt), so any data race between the simulations fails the test too.
+ */
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "GeneralModel.hpp"
+#include "cvodes.hpp"
+#include "getsimulator.hpp"
+#include "lattacell.hpp"
+
+#define NUMBER_OF_THREADS 4
+#define NUMBER_OF_REPEATS 3
+#define END_TIME 20.0
+
+static const std::string modelDocument =
+    "<?xml version=\"1.0\"?>\n"
+    "<model xmlns=\"http://www.cellml.org/cellml/1.1#\" xmlns:cellml=\"http://www.cellml.org/cellml/1.1#\"\n"
+    "       name=\"decay\">\n"
+    "  <component name=\"main\">\n"
+    "    <variable name=\"time\" units=\"dimensionless\"/>\n"
+    "    <variable name=\"k\" units=\"dimensionless\" initial_value=\"0.5\"/>\n"
+    "    <variable name=\"x\" units=\"dimensionless\" initial_value=\"1\"/>\n"
+    "    <math xmlns=\"http://www.w3.org/1998/Math/MathML\">\n"
+    "      <apply><eq/>\n"
+    "        <apply><diff/><bvar><ci>time</ci></bvar><ci>x</ci></apply>\n"
+    "        <apply><times/><apply><minus/><ci>k</ci></apply><ci>x</ci></apply>\n"
+    "      </apply>\n"
+    "    </math>\n"
+    "  </component>\n"
+    "</model>\n";
+
+static const std::string experimentDocument =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<sedML xmlns=\"http://sed-ml.org/sed-ml/level1/version2\" xmlns:cellml=\"http://www.cellml.org/cellml/1.1#\"\n"
+    "       level=\"1\" version=\"2\">\n"
+    "  <listOfSimulations>\n"
+    "    <uniformTimeCourse id=\"simulation\" initialTime=\"0\" outputStartTime=\"0\" outputEndTime=\"20\"\n"
+    "                       numberOfPoints=\"200\">\n"
+    "      <algorithm kisaoID=\"KISAO:0000019\"/>\n"
+    "    </uniformTimeCourse>\n"
+    "  </listOfSimulations>\n"
+    "  <listOfModels>\n"
+    "    <model id=\"model\" language=\"urn:sedml:language:cellml.1_1\" source=\"decay.cellml\"/>\n"
+    "  </listOfModels>\n"
+    "  <listOfTasks>\n"
+    "    <task id=\"task\" modelReference=\"model\" simulationReference=\"simulation\"/>\n"
+    "  </listOfTasks>\n"
+    "  <listOfDataGenerators>\n"
+    "    <dataGenerator id=\"dg_time\" name=\"time\">\n"
+    "      <listOfVariables>\n"
+    "        <variable id=\"v_time\" taskReference=\"task\"\n"
+    "                  target=\"/cellml:model/cellml:component[@name='main']/cellml:variable[@name='time']\"/>\n"
+    "      </listOfVariables>\n"
+    "      <math xmlns=\"http://www.w3.org/1998/Math/MathML\"><ci>v_time</ci></math>\n"
+    "    </dataGenerator>\n"
+    "    <dataGenerator id=\"dg_x\" name=\"x\">\n"
+    "      <listOfVariables>\n"
+    "        <variable id=\"v_x\" taskReference=\"task\"\n"
+    "                  target=\"/cellml:model/cellml:component[@name='main']/cellml:variable[@name='x']\"/>\n"
+    "      </listOfVariables>\n"
+    "      <math xmlns=\"http://www.w3.org/1998/Math/MathML\"><ci>v_x</ci></math>\n"
+    "    </dataGenerator>\n"
+    "  </listOfDataGenerators>\n"
+    "  <listOfOutputs>\n"
+    "    <report id=\"report\">\n"
+    "      <listOfDataSets>\n"
+    "        <dataSet id=\"ds_time\" label=\"time\" dataReference=\"dg_time\"/>\n"
+    "        <dataSet id=\"ds_x\" label=\"x\" dataReference=\"dg_x\"/>\n"
+    "      </listOfDataSets>\n"
+    "    </report>\n"
+    "  </listOfOutputs>\n"
+    "</sedML>\n";
+
+/*
+ * Simulate a Latta cell, returning its final state, or an empty vector on failure.
+ */
+static std::vector<double> simulateCell()
+{
+    GeneralModel model;
+    configureLattaCell(model);
+    model.initialise();
+    Cvodes cvodes;
+    if (cvodes.initialise(&model, 0.0, 0.0) != 0) return std::vector<double>();
+    double t = 0.0;
+    for (double tout = 1.0; tout <= END_TIME; tout += 1.0)
+    {
+        if (cvodes.integrate(t, tout) != 0) return std::vector<double>();
+    }
+    std::vector<double> state(1, model.V);
+    for (unsigned int i = 0; i < model.mC_c.size(); ++i) state.push_back(*(model.mC_c[i]));
+    return state;
+}
+
+/*
+ * Execute the experiment, returning its serialised reports, or an empty string on failure.
+ */
+static std::string runExperiment(const std::string& baseUrl)
+{
+    SimulationExperiment experiment;
+    std::ostringstream reports;
+    if ((experiment.loadFromString(experimentDocument, baseUrl) != 0) || (experiment.buildManifest() != 0) ||
+        (experiment.execute() != 0) || (experiment.serialiseReports(reports) != 0))
+        return "";
+    return reports.str();
+}
+
+int main(int argc, char* argv[])
+{
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-concurrency-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(&name[0]))
+    {
+        std::cerr << "Unable to create a scratch directory" << std::endl;
+        return 1;
+    }
+    std::string directory(&name[0]);
+    std::string modelPath = directory + "/decay.cellml";
+    {
+        std::ofstream os(modelPath.c_str());
+        os << modelDocument;
+    }
+    std::string baseUrl = "file://" + directory + "/experiment.sedml";
+
+    // the results of each simulation on its own, in this thread
+    std::vector<double> expectedState = simulateCell();
+    std::string expectedReports = runExperiment(baseUrl);
+    int errors = 0;
+    if (expectedState.empty() || expectedReports.empty())
+    {
+        std::cerr << "FAILED: unable to run the simulations in a single thread" << std::endl;
+        ++errors;
+    }
+    else
+    {
+        std::vector<std::vector<double> > states(NUMBER_OF_THREADS * NUMBER_OF_REPEATS);
+        std::vector<std::string> reports(NUMBER_OF_THREADS * NUMBER_OF_REPEATS);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < NUMBER_OF_THREADS; ++i)
+        {
+            threads.push_back(std::thread([&states, i]() {
+                for (int r = 0; r < NUMBER_OF_REPEATS; ++r) states[i * NUMBER_OF_REPEATS + r] = simulateCell();
+            }));
+            threads.push_back(std::thread([&reports, &baseUrl, i]() {
+                for (int r = 0; r < NUMBER_OF_REPEATS; ++r)
+                    reports[i * NUMBER_OF_REPEATS + r] = runExperiment(baseUrl);
+            }));
+        }
+        for (std::thread& t: threads) t.join();
+        for (unsigned int i = 0; i < states.size(); ++i)
+        {
+            if (states[i] != expectedState)
+            {
+                std::cerr << "FAILED: GeneralModel simulation " << i << " differs when run concurrently" << std::endl;
+                ++errors;
+            }
+            if (reports[i] != expectedReports)
+            {
+                std::cerr << "FAILED: simulation experiment " << i << " differs when run concurrently" << std::endl;
+                ++errors;
+            }
+        }
+    }
+    std::remove(modelPath.c_str());
+    std::remove(directory.c_str());
+    if (errors == 0) std::cout << "All concurrency tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
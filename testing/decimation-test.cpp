@@ -0,0 +1,178 @@
+/*
+ * decimation-test.cpp
+ *
+ * Checks the online decimation of time courses: that the largest-triangle-three-buckets method keeps the requested
+ * number of samples, including the first and last and a spike between them, and that the piecewise-linear method
+ * keeps the first and last samples and few others while linear interpolation between the samples kept is within
+ * the tolerances of every sample of a known curve.
+ */
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "decimation.hpp"
+
+#define NUMBER_OF_SAMPLES 2001
+#define END_TIME 10.0
+#define LTTB_POINTS 100
+#define SPIKE_INDEX 1234
+#define RELATIVE_TOLERANCE 1.0e-3
+#define ABSOLUTE_TOLERANCE 1.0e-4
+
+/*
+ * A time course with its samples as rows: the time then the value of each column.
+ */
+typedef std::vector<std::vector<double> > TimeCourse;
+
+/*
+ * The known curves: a damped oscillation and a decay.
+ */
+static TimeCourse knownCurve()
+{
+    TimeCourse curve;
+    for (int i = 0; i < NUMBER_OF_SAMPLES; ++i)
+    {
+        double t = END_TIME * i / (NUMBER_OF_SAMPLES - 1);
+        curve.push_back({ t, exp(-0.2 * t) * sin(3.0 * t), 2.0 * exp(-t) });
+    }
+    return curve;
+}
+
+static TimeCourse decimate(const DecimationOptions& options, const TimeCourse& samples)
+{
+    TimeCourse selected;
+    Decimator decimator(options, samples.size(), samples[0].size() - 1,
+                        [&selected](double time, const std::vector<double>& values)
+    {
+        selected.push_back(std::vector<double>(1, time));
+        selected.back().insert(selected.back().end(), values.begin(), values.end());
+    });
+    for (const std::vector<double>& sample: samples)
+        decimator.add(sample[0], std::vector<double>(sample.begin() + 1, sample.end()));
+    decimator.finish();
+    return selected;
+}
+
+/*
+ * Check the samples selected are samples of the time course, in order, starting with the first and ending with
+ * the last.
+ */
+static int checkSelection(const char* test, const TimeCourse& samples, const TimeCourse& selected)
+{
+    int errors = 0;
+    if ((selected.size() < 2) || (selected.front() != samples.front()) || (selected.back() != samples.back()))
+    {
+        std::cerr << "FAILED: " << test << ": the first and last samples were not kept" << std::endl;
+        ++errors;
+    }
+    auto next = samples.begin();
+    for (const std::vector<double>& sample: selected)
+    {
+        next = std::find(next, samples.end(), sample);
+        if (next == samples.end())
+        {
+            std::cerr << "FAILED: " << test << ": the sample at time " << sample[0] << " is out of order or not a "
+                      << "sample of the time course" << std::endl;
+            return errors + 1;
+        }
+        ++next;
+    }
+    return errors;
+}
+
+static int testLttb()
+{
+    int errors = 0;
+    TimeCourse samples = knownCurve();
+    samples[SPIKE_INDEX][1] = 10.0;
+    DecimationOptions options;
+    if ((options.parse("lttb:" + std::to_string(LTTB_POINTS)) != 0) || (options.method != DecimationOptions::Lttb)
+        || (options.numberOfPoints != LTTB_POINTS))
+    {
+        std::cerr << "FAILED: lttb: unable to parse the decimation" << std::endl;
+        return 1;
+    }
+    TimeCourse selected = decimate(options, samples);
+    errors += checkSelection("lttb", samples, selected);
+    if (selected.size() != LTTB_POINTS)
+    {
+        std::cerr << "FAILED: lttb: " << selected.size() << " samples kept rather than " << LTTB_POINTS << std::endl;
+        ++errors;
+    }
+    if (std::find(selected.begin(), selected.end(), samples[SPIKE_INDEX]) == selected.end())
+    {
+        std::cerr << "FAILED: lttb: the spike was not kept" << std::endl;
+        ++errors;
+    }
+    // fewer samples than asked for are all kept
+    TimeCourse few(samples.begin(), samples.begin() + LTTB_POINTS / 2);
+    if (decimate(options, few) != few)
+    {
+        std::cerr << "FAILED: lttb: a short time course was not kept as it is" << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int testPiecewiseLinear()
+{
+    int errors = 0;
+    TimeCourse samples = knownCurve();
+    DecimationOptions options;
+    if ((options.parse("pla:0.001:0.0001") != 0) || (options.method != DecimationOptions::PiecewiseLinear)
+        || (options.relativeTolerance != RELATIVE_TOLERANCE) || (options.absoluteTolerance != ABSOLUTE_TOLERANCE))
+    {
+        std::cerr << "FAILED: pla: unable to parse the decimation" << std::endl;
+        return 1;
+    }
+    TimeCourse selected = decimate(options, samples);
+    errors += checkSelection("pla", samples, selected);
+    if (errors > 0) return errors;
+    // interpolate each sample between the samples kept either side of it
+    unsigned int segment = 0;
+    double largestError = 0.0;
+    for (const std::vector<double>& sample: samples)
+    {
+        while ((segment + 2 < selected.size()) && (selected[segment + 1][0] <= sample[0])) ++segment;
+        const std::vector<double>& a = selected[segment];
+        const std::vector<double>& b = selected[segment + 1];
+        double w = (sample[0] - a[0]) / (b[0] - a[0]);
+        for (unsigned int j = 1; j < sample.size(); ++j)
+        {
+            double y = a[j] + w * (b[j] - a[j]);
+            double tolerance = std::max(ABSOLUTE_TOLERANCE, RELATIVE_TOLERANCE * fabs(sample[j]));
+            // allowing for rounding in the interpolation
+            double error = fabs(y - sample[j]) / (tolerance * (1.0 + 1.0e-9));
+            largestError = std::max(largestError, error);
+        }
+    }
+    if (largestError > 1.0)
+    {
+        std::cerr << "FAILED: pla: the interpolation error is " << largestError << " times the tolerance"
+                  << std::endl;
+        ++errors;
+    }
+    if (selected.size() > samples.size() / 4)
+    {
+        std::cerr << "FAILED: pla: " << selected.size() << " of " << samples.size() << " samples kept" << std::endl;
+        ++errors;
+    }
+    // a straight line needs only its ends
+    TimeCourse line;
+    for (int i = 0; i < 100; ++i) line.push_back({ double(i), 1.0 + 0.5 * i });
+    if (decimate(options, line).size() != 2)
+    {
+        std::cerr << "FAILED: pla: a straight line was not reduced to its ends" << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = testLttb();
+    errors += testPiecewiseLinear();
+    if (errors == 0) std::cout << "All decimation tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * documentcache-test.cpp
+ *
+ * Checks that model documents fetched over HTTP are cached, revalidated with their ETag and Last-Modified
+ * validators, used when the server is unreachable or the cache is offline, and given to CSim as local copies by
+ * the DocumentMirror. The documents are served by a minimal HTTP server on the loopback interface.
+ */
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <ftw.h>
+#include <poll.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "utils.hpp"
+#include "documentcache.hpp"
+#include "documentmirror.hpp"
+
+#define MODEL_ETAG "\"model-v1\""
+#define UNITS_LAST_MODIFIED "Tue, 01 Sep 2026 10:00:00 GMT"
+
+static const std::string modelDocument =
+    "<?xml version=\"1.0\"?>\n"
+    "<model xmlns=\"http://www.cellml.org/cellml/1.1#\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" name=\"m\">\n"
+    "  <import xlink:href=\"units.cellml\"><units name=\"mV\" units_ref=\"mV\"/></import>\n"
+    "</model>\n";
+
+static const std::string unitsDocument =
+    "<?xml version=\"1.0\"?>\n"
+    "<model xmlns=\"http://www.cellml.org/cellml/1.1#\" name=\"units\">\n"
+    "  <units name=\"mV\"><unit units=\"volt\" prefix=\"milli\"/></units>\n"
+    "</model>\n";
+
+/*
+ * Serves the model, which has an ETag, and the units it imports, which have a Last-Modified date, one connection
+ * at a time, answering conditional requests that match with 304 Not Modified.
+ */
+class TestServer
+{
+public:
+    TestServer() : mSocket(-1), mPort(0), mStop(false)
+    {
+    }
+
+    ~TestServer()
+    {
+        stop();
+    }
+
+    int start()
+    {
+        mSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (mSocket < 0) return -1;
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if ((bind(mSocket, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(mSocket, 16) != 0) ||
+            (getsockname(mSocket, (struct sockaddr*)&address, &length) != 0))
+        {
+            close(mSocket);
+            mSocket = -1;
+            return -2;
+        }
+        mPort = ntohs(address.sin_port);
+        mStop = false;
+        mThread = std::thread(&TestServer::serve, this);
+        return 0;
+    }
+
+    /*
+     * Stop serving and close the socket, so that the server is unreachable.
+     */
+    void stop()
+    {
+        if (mThread.joinable())
+        {
+            mStop = true;
+            mThread.join();
+        }
+        if (mSocket >= 0) close(mSocket);
+        mSocket = -1;
+    }
+
+    std::string url(const std::string& path) const
+    {
+        std::ostringstream url;
+        url << "http://127.0.0.1:" << mPort << path;
+        return url.str();
+    }
+
+    /*
+     * The requests received and the status of each response, since the last call.
+     */
+    void takeRequests(std::vector<std::string>& requests, std::vector<int>& statuses)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        requests.swap(mRequests);
+        statuses.swap(mStatuses);
+        mRequests.clear();
+        mStatuses.clear();
+    }
+
+private:
+    void serve()
+    {
+        while (!mStop)
+        {
+            struct pollfd p;
+            p.fd = mSocket;
+            p.events = POLLIN;
+            if (poll(&p, 1, 50) <= 0) continue;
+            int connection = accept(mSocket, NULL, NULL);
+            if (connection < 0) continue;
+            respond(connection);
+            close(connection);
+        }
+    }
+
+    void respond(int connection)
+    {
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos)
+        {
+            ssize_t n = read(connection, buffer, sizeof(buffer));
+            if (n <= 0) return;
+            request.append(buffer, n);
+        }
+        std::string path = request.substr(4, request.find(' ', 4) - 4);
+        int status = 404;
+        std::string headers, body;
+        if (path == "/model.cellml")
+        {
+            headers = "ETag: " MODEL_ETAG "\r\n";
+            status = hasHeader(request, "If-None-Match: " MODEL_ETAG) ? 304 : 200;
+            body = modelDocument;
+        }
+        else if (path == "/units.cellml")
+        {
+            headers = "Last-Modified: " UNITS_LAST_MODIFIED "\r\n";
+            status = hasHeader(request, "If-Modified-Since: " UNITS_LAST_MODIFIED) ? 304 : 200;
+            body = unitsDocument;
+        }
+        if (status != 200) body.clear();
+        std::ostringstream response;
+        response << "HTTP/1.1 " << status << ((status == 200) ? " OK" : ((status == 304) ? " Not Modified" : " Not Found"))
+                 << "\r\n" << headers << "Content-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+        std::string r = response.str();
+        for (size_t written = 0; written < r.size(); )
+        {
+            ssize_t n = write(connection, r.data() + written, r.size() - written);
+            if (n <= 0) break;
+            written += n;
+        }
+        std::lock_guard<std::mutex> lock(mMutex);
+        mRequests.push_back(request);
+        mStatuses.push_back(status);
+    }
+
+    static bool hasHeader(const std::string& request, const std::string& header)
+    {
+        return request.find("\r\n" + header + "\r\n") != std::string::npos;
+    }
+
+    int mSocket;
+    int mPort;
+    std::atomic<bool> mStop;
+    std::thread mThread;
+    std::mutex mMutex;
+    std::vector<std::string> mRequests;
+    std::vector<int> mStatuses;
+};
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream is(path.c_str(), std::ios::binary);
+    std::ostringstream content;
+    content << is.rdbuf();
+    return content.str();
+}
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*)
+{
+    return std::remove(path);
+}
+
+static int expectStatuses(const std::string& test, TestServer& server, int expected, int count)
+{
+    std::vector<std::string> requests;
+    std::vector<int> statuses;
+    server.takeRequests(requests, statuses);
+    int errors = 0;
+    if ((int)statuses.size() != count)
+    {
+        std::cerr << "FAILED: " << test << ": " << statuses.size() << " requests rather than " << count << std::endl;
+        ++errors;
+    }
+    for (int s: statuses)
+    {
+        if (s != expected)
+        {
+            std::cerr << "FAILED: " << test << ": response status " << s << " rather than " << expected << std::endl;
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+/*
+ * Mirror the model and check that the local copy of the model imports the local copy of the units.
+ */
+static int expectMirrored(const std::string& test, TestServer& server)
+{
+    int errors = 0;
+    std::string modelUrl = server.url("/model.cellml"), unitsUrl = server.url("/units.cellml");
+    DocumentMirror mirror;
+    int numberOfFailures = mirror.mirror(std::vector<std::string>(1, modelUrl));
+    std::string localModel = mirror.localUrl(modelUrl), localUnits = mirror.localUrl(unitsUrl);
+    if ((numberOfFailures != 0) || !isFileUrl(localModel) || !isFileUrl(localUnits))
+    {
+        std::cerr << "FAILED: " << test << ": the model was not mirrored (" << numberOfFailures << " failures)"
+                  << std::endl;
+        return 1;
+    }
+    if (readFile(fileUrlPath(localModel)).find("xlink:href=\"" + localUnits + "\"") == std::string::npos)
+    {
+        std::cerr << "FAILED: " << test << ": the local model does not import the local units" << std::endl;
+        ++errors;
+    }
+    if (readFile(fileUrlPath(localUnits)).find("<unit units=\"volt\" prefix=\"milli\"/>") == std::string::npos)
+    {
+        std::cerr << "FAILED: " << test << ": the local units do not have the content served" << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int expectContent(const std::string& test, const std::string& url, const std::string& expected)
+{
+    if (getUrlContent(url) == expected) return 0;
+    std::cerr << "FAILED: " << test << ": unexpected content for " << url << std::endl;
+    return 1;
+}
+
+int main(int argc, char* argv[])
+{
+    initialiseUrlFetching();
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-cache-test-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(&name[0]))
+    {
+        std::cerr << "Unable to create a cache directory" << std::endl;
+        return 1;
+    }
+    std::string cacheDirectory(&name[0]);
+    TestServer server;
+    if (server.start() != 0)
+    {
+        std::cerr << "Unable to start the HTTP server" << std::endl;
+        return 1;
+    }
+    std::string modelUrl = server.url("/model.cellml");
+    int errors = 0;
+
+    // nothing cached, so the documents are fetched and stored
+    configureDocumentCache(cacheDirectory, false, 0);
+    errors += expectMirrored("200", server);
+    errors += expectStatuses("200", server, 200, 2);
+
+    // cached, so they are revalidated with If-None-Match and If-Modified-Since
+    errors += expectMirrored("304", server);
+    errors += expectStatuses("304", server, 304, 2);
+    errors += expectContent("304", modelUrl, modelDocument);
+    errors += expectStatuses("304", server, 304, 1);
+
+    // fresh entries are used without a request
+    configureDocumentCache(cacheDirectory, false, 3600);
+    errors += expectMirrored("fresh", server);
+    errors += expectStatuses("fresh", server, 200, 0);
+
+    // the cached copies are used when the server can't be reached
+    server.stop();
+    configureDocumentCache(cacheDirectory, false, 0);
+    errors += expectMirrored("unreachable", server);
+    errors += expectContent("unreachable", modelUrl, modelDocument);
+
+    // and offline, where uncached documents are not fetched at all
+    configureDocumentCache(cacheDirectory, true, 0);
+    errors += expectMirrored("offline", server);
+    errors += expectContent("offline", modelUrl, modelDocument);
+    std::string uncached = server.url("/uncached.cellml");
+    DocumentMirror mirror;
+    if ((mirror.mirror(std::vector<std::string>(1, uncached)) != 1) || (mirror.localUrl(uncached) != uncached))
+    {
+        std::cerr << "FAILED: offline: a document not in the cache was mirrored" << std::endl;
+        ++errors;
+    }
+
+    configureDocumentCache("", false, 0);
+    nftw(cacheDirectory.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    if (errors == 0) std::cout << "All document cache tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
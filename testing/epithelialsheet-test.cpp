@@ -0,0 +1,199 @@
+/*
+ * epithelialsheet-test.cpp
+ *
+ * Checks the potentials and rates of an EpithelialSheet of Latta cells: a sheet of identical cells behaves as
+ * a single open-circuit cell, no current flows through a sheet of different cells in open circuit, and the sheet
+ * integrates to the same state whatever the number of threads used to evaluate the cells, or after being initialised
+ * again.
+ */
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "GeneralModel.hpp"
+#include "epithelialsheet.hpp"
+#include "lattacell.hpp"
+
+#define NUMBER_OF_CELLS 8
+#define CURRENT_TOLERANCE 1.0e-7
+#define POTENTIAL_TOLERANCE 1.0e-6
+#define RATE_TOLERANCE 1.0e-4
+
+static bool close(double a, double b, double tolerance)
+{
+    return fabs(a - b) <= tolerance * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+/*
+ * Build a sheet of Latta cells whose apical sodium permeability increases across the sheet by the given
+ * fraction per cell.
+ */
+static int buildSheet(EpithelialSheet& sheet, double heterogeneity, int numberOfThreads)
+{
+    for (int i = 0; i < NUMBER_OF_CELLS; ++i) configureLattaCell(sheet.addCell());
+    sheet.lumenVolume = 0.01 * NUMBER_OF_CELLS;
+    sheet.interstitialVolume = 0.02 * NUMBER_OF_CELLS;
+    sheet.modelMode = GeneralModel::OpenCircuit;
+    sheet.context.debugLevel = 0;
+    if (sheet.initialise(0.0, 1.0, numberOfThreads) != 0)
+    {
+        std::cerr << "Unable to initialise the epithelial sheet." << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < NUMBER_OF_CELLS; ++i) *(sheet.cell(i).parameter("P_a[Na]")) *= 1.0 + heterogeneity * i;
+    return 0;
+}
+
+static int testIdenticalCells()
+{
+    int errors = 0;
+    GeneralModel single;
+    configureLattaCell(single);
+    single.initialise();
+    int errorFlag = 0;
+    std::vector<double> expected = single.calculateRHS(0.0, errorFlag);
+    if (errorFlag != 0)
+    {
+        std::cerr << "FAILED: unable to solve the open-circuit potentials of a single cell." << std::endl;
+        return 1;
+    }
+    EpithelialSheet sheet;
+    if (buildSheet(sheet, 0.0, 2) != 0) return 1;
+    std::vector<double> ydot(sheet.numberOfStates());
+    if (sheet.calculateRHS(0.0, &(sheet.y[0]), &(ydot[0])) != 0)
+    {
+        std::cerr << "FAILED: unable to evaluate the rates of a sheet of identical cells." << std::endl;
+        return 1;
+    }
+    if (!close(sheet.U_t, single.U_t, POTENTIAL_TOLERANCE))
+    {
+        std::cerr << "FAILED: sheet potential " << sheet.U_t << " differs from the single cell potential "
+                  << single.U_t << std::endl;
+        ++errors;
+    }
+    int numberOfCellStates = expected.size();
+    for (int i = 0; i < NUMBER_OF_CELLS; ++i)
+    {
+        for (int k = 0; k < numberOfCellStates; ++k)
+        {
+            if (!close(ydot[i * numberOfCellStates + k], expected[k], RATE_TOLERANCE))
+            {
+                std::cerr << "FAILED: rate " << k << " of cell " << i << " is " << ydot[i * numberOfCellStates + k]
+                          << " rather than " << expected[k] << std::endl;
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+static int testHeterogeneousCells()
+{
+    int errors = 0;
+    EpithelialSheet sheet;
+    if (buildSheet(sheet, 0.25, 2) != 0) return 1;
+    std::vector<double> ydot(sheet.numberOfStates());
+    if (sheet.calculateRHS(0.0, &(sheet.y[0]), &(ydot[0])) != 0)
+    {
+        std::cerr << "FAILED: unable to evaluate the rates of a sheet of different cells." << std::endl;
+        return 1;
+    }
+    double total = 0.0, smallest = 0.0, largest = 0.0;
+    for (int i = 0; i < NUMBER_OF_CELLS; ++i)
+    {
+        GeneralModel& c = sheet.cell(i);
+        if (c.U_t != sheet.U_t)
+        {
+            std::cerr << "FAILED: cell " << i << " is at " << c.U_t << " rather than the sheet potential "
+                      << sheet.U_t << std::endl;
+            ++errors;
+        }
+        double current = c.I_a + c.I_j;
+        total += current;
+        smallest = (i == 0) ? current : std::min(smallest, current);
+        largest = (i == 0) ? current : std::max(largest, current);
+    }
+    if (fabs(total) > CURRENT_TOLERANCE * NUMBER_OF_CELLS || fabs(sheet.I_t - total) > CURRENT_TOLERANCE)
+    {
+        std::cerr << "FAILED: open-circuit current through the sheet is " << total << " (" << sheet.I_t << ")"
+                  << std::endl;
+        ++errors;
+    }
+    if ((largest - smallest) < 100.0 * CURRENT_TOLERANCE)
+    {
+        std::cerr << "FAILED: the cells all carry the same current, " << largest << ", so the sheet potential is "
+                  << "not being tested." << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int testThreads()
+{
+    int errors = 0;
+    EpithelialSheet serial, parallel;
+    if ((buildSheet(serial, 0.25, 1) != 0) || (buildSheet(parallel, 0.25, 4) != 0)) return 1;
+    double tSerial = 0.0, tParallel = 0.0;
+    for (double tout = 1.0; tout <= 10.0; tout += 1.0)
+    {
+        if ((serial.integrate(tSerial, tout) != 0) || (parallel.integrate(tParallel, tout) != 0))
+        {
+            std::cerr << "FAILED: unable to integrate the sheet to " << tout << std::endl;
+            return 1;
+        }
+    }
+    for (int i = 0; i < serial.numberOfStates(); ++i)
+    {
+        if (!close(serial.y[i], parallel.y[i], 1.0e-12))
+        {
+            std::cerr << "FAILED: state " << i << " is " << parallel.y[i] << " with four threads and "
+                      << serial.y[i] << " with one." << std::endl;
+            ++errors;
+        }
+    }
+    if (fabs(parallel.I_t) > CURRENT_TOLERANCE * NUMBER_OF_CELLS)
+    {
+        std::cerr << "FAILED: open-circuit current through the integrated sheet is " << parallel.I_t << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int testReinitialise()
+{
+    int errors = 0;
+    EpithelialSheet once, twice;
+    if ((buildSheet(once, 0.25, 2) != 0) || (buildSheet(twice, 0.25, 4) != 0)) return 1;
+    if (twice.initialise(0.0, 1.0, 2) != 0)
+    {
+        std::cerr << "FAILED: unable to initialise the sheet again" << std::endl;
+        return 1;
+    }
+    double tOnce = 0.0, tTwice = 0.0;
+    if ((once.integrate(tOnce, 5.0) != 0) || (twice.integrate(tTwice, 5.0) != 0))
+    {
+        std::cerr << "FAILED: unable to integrate the sheet after initialising it again" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < once.numberOfStates(); ++i)
+    {
+        if (!close(once.y[i], twice.y[i], 1.0e-12))
+        {
+            std::cerr << "FAILED: state " << i << " is " << twice.y[i] << " after initialising again rather than "
+                      << once.y[i] << std::endl;
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = testIdenticalCells();
+    errors += testHeterogeneousCells();
+    errors += testThreads();
+    errors += testReinitialise();
+    if (errors == 0) std::cout << "All epithelial sheet tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
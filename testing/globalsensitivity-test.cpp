@@ -0,0 +1,95 @@
+/*
+ * globalsensitivity-test.cpp
+ *
+ * Checks the Sobol indices estimated by estimateSobolIndices for the Ishigami function,
+ *   f(x) = sin(x1) + a sin^2(x2) + b x3^4 sin(x1), with each x_i uniform in [-pi, pi],
+ * against its analytic first-order and total-order indices.
+ */
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include "globalsensitivity.hpp"
+
+#define ISHIGAMI_A 7.0
+#define ISHIGAMI_B 0.1
+#define NUMBER_OF_BASE_SAMPLES 8192
+// the quasi-random design converges much faster than the random one
+#define SOBOL_TOLERANCE 0.01
+#define LATIN_HYPERCUBE_TOLERANCE 0.05
+
+static double ishigami(const std::vector<double>& x)
+{
+    return sin(x[0]) + ISHIGAMI_A * sin(x[1]) * sin(x[1]) + ISHIGAMI_B * pow(x[2], 4.0) * sin(x[0]);
+}
+
+/*
+ * Evaluate the Ishigami function at each point, as a model with a single output at a single time.
+ */
+static int evaluateIshigami(const std::vector<std::vector<double> >& points, const EnsembleResultHandler& handler)
+{
+    std::vector<double> times(1, 0.0);
+    for (unsigned int i = 0; i < points.size(); ++i)
+        handler(i, true, times, std::vector<std::vector<double> >(1, std::vector<double>(1, ishigami(points[i]))));
+    return 0;
+}
+
+static int testIshigami(SamplingOptions::Design design, const char* name, double tolerance)
+{
+    std::vector<SamplingInput> inputs(3);
+    for (SamplingInput& input: inputs)
+    {
+        input.distribution = SamplingInput::Uniform;
+        input.a = -M_PI;
+        input.b = M_PI;
+    }
+    SamplingOptions options;
+    options.design = design;
+    options.numberOfSamples = NUMBER_OF_BASE_SAMPLES;
+    SobolIndices results;
+    if (estimateSobolIndices(inputs, 1, std::vector<double>(1, 0.0), options, evaluateIshigami, results) != 0)
+    {
+        std::cerr << "FAILED: " << name << ": unable to estimate the indices" << std::endl;
+        return 1;
+    }
+    // the partial variances of the Ishigami function
+    const double a = ISHIGAMI_A, b = ISHIGAMI_B, pi4 = pow(M_PI, 4.0), pi8 = pow(M_PI, 8.0);
+    const double V1 = 0.5 * (1.0 + b * pi4 / 5.0) * (1.0 + b * pi4 / 5.0), V2 = a * a / 8.0;
+    const double V13 = 8.0 * b * b * pi8 / 225.0;
+    const double V = V1 + V2 + V13;
+    const double firstOrder[3] = { V1 / V, V2 / V, 0.0 };
+    const double totalOrder[3] = { (V1 + V13) / V, V2 / V, V13 / V };
+    int errors = 0;
+    if (results.numberOfBaseSamples != NUMBER_OF_BASE_SAMPLES)
+    {
+        std::cerr << "FAILED: " << name << ": " << results.numberOfBaseSamples << " base samples used rather than "
+                  << NUMBER_OF_BASE_SAMPLES << std::endl;
+        ++errors;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        double S = results.firstOrder[0][0][i], ST = results.totalOrder[0][0][i];
+        if (fabs(S - firstOrder[i]) > tolerance)
+        {
+            std::cerr << "FAILED: " << name << ": S" << i + 1 << " is " << S << " rather than " << firstOrder[i]
+                      << std::endl;
+            ++errors;
+        }
+        if (fabs(ST - totalOrder[i]) > tolerance)
+        {
+            std::cerr << "FAILED: " << name << ": ST" << i + 1 << " is " << ST << " rather than " << totalOrder[i]
+                      << std::endl;
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = testIshigami(SamplingOptions::Sobol, "Sobol design", SOBOL_TOLERANCE);
+    errors += testIshigami(SamplingOptions::LatinHypercube, "Latin hypercube design",
+                           LATIN_HYPERCUBE_TOLERANCE);
+    if (errors == 0) std::cout << "All global sensitivity tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -1,3 +1,4 @@
+# plots the text results.data, convert binary output first with: get-trajectory-convert results.bin results.data
 set yrange [0:18];
 set y2range [58:74];
 set y2tics 70,4;
@@ -1,3 +1,4 @@
+# plots the text results.data, convert binary output first with: get-trajectory-convert results.bin results.data
 set xlabel "Time [seconds]";
 set yrange [0:85];
 set ylabel "Activity [mM]";
@@ -1,3 +1,4 @@
+# plots the text results.data, convert binary output first with: get-trajectory-convert results.bin results.data
 set terminal png;
 set output "Figure-6.png";
 plot [1300:3000] "results.data" u 1:11 w l title "J_net[Na]", \
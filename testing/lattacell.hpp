@@ -0,0 +1,41 @@
+#ifndef LATTACELL_HPP
+#define LATTACELL_HPP
+
+#include "GeneralModel.hpp"
+#include "molecule.hpp"
+
+/*
+ * Configure the given model as the cell of Latta et al (1984): Cl, Na and K with passive permeabilities, plus the
+ * impermeant anion and cation (X1, X2) that fix the cell volume, at the initial conditions of the paper.
+ */
+static void configureLattaCell(GeneralModel& model)
+{
+    Molecule molecule;
+    molecule.typeId = "Cl"; molecule.z = -1.0; molecule.C_a = molecule.C_b = 102.0; molecule.C_c = 16.0;
+    molecule.P_a = 0.0; molecule.P_b = 541.0e-9; molecule.P_j = 3.0e-9;
+    model.addMolecule(molecule);
+    molecule.typeId = "Na"; molecule.z = 1.0; molecule.C_a = molecule.C_b = 104.0; molecule.C_c = 7.0;
+    molecule.P_a = 100.0e-9; molecule.P_b = 20.0e-9; molecule.P_j = 3.0e-9;
+    model.addMolecule(molecule);
+    molecule.typeId = "K"; molecule.z = 1.0; molecule.C_a = molecule.C_b = 5.3; molecule.C_c = 72.0;
+    molecule.P_a = 50.0e-9; molecule.P_b = 463.0e-9; molecule.P_j = 3.0e-9;
+    model.addMolecule(molecule);
+    molecule.typeId = "X1"; molecule.z = -1.0; molecule.C_a = molecule.C_b = 7.3; molecule.C_c = 63.0;
+    molecule.P_a = 0.0; molecule.P_b = 0.0; molecule.P_j = 0.0;
+    model.addMolecule(molecule);
+    molecule.typeId = "X2"; molecule.z = 1.0; molecule.C_a = molecule.C_b = 81.4; molecule.C_c = 142.0;
+    molecule.P_a = 0.0; molecule.P_b = 0.0; molecule.P_j = 0.0;
+    model.addMolecule(molecule);
+    model.Lp_a = 1.0e-12;
+    model.Lp_b = 1.0e-11;
+    model.A_a = 1.8;
+    model.A_b = 8.8;
+    model.V = 0.001;
+    model.E_a = -20.0;
+    model.E_b = -60.0;
+    model.E_t = -40.0;
+    model.modelMode = GeneralModel::OpenCircuit;
+    model.context.debugLevel = 0;
+}
+
+#endif // LATTACELL_HPP
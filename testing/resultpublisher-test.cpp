@@ -0,0 +1,214 @@
+/*
+ * resultpublisher-test.cpp
+ *
+ * Checks that a ResultPublisher never blocks the publishing thread, even when a client stops reading, and that
+ * the other clients still get every Begin and End frame in order, with each row either delivered or counted in a
+ * Dropped frame.
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "resultpublisher.hpp"
+
+#define NUMBER_OF_STREAMS 50
+#define NUMBER_OF_ROWS 200
+#define NUMBER_OF_COLUMNS 32
+#define RING_CAPACITY 4096
+// the longest a call to the publisher may take, in seconds, well under the time a stalled client is waited for
+#define MAXIMUM_CALL_TIME 0.25
+
+static int connectClient(const std::string& path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client < 0) return -1;
+    if (connect(client, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+static bool readAll(int client, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = read(client, data, size);
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+/*
+ * What a client that keeps reading received, and any errors in the order of the frames.
+ */
+class Received
+{
+public:
+    Received() : begins(0), ends(0), rows(0), dropped(0), errors(0)
+    {
+    }
+
+    int begins, ends;
+    unsigned long rows, dropped;
+    int errors;
+};
+
+static void readFrames(int client, Received& received)
+{
+    // 0 before the Begin frame, 1 while open and 2 after the End frame
+    std::map<uint32_t, int> streams;
+    uint32_t length;
+    while (readAll(client, reinterpret_cast<char*>(&length), sizeof(length)))
+    {
+        std::string frame(length, '\0');
+        if (!readAll(client, &frame[0], length))
+        {
+            std::cerr << "FAILED: truncated frame" << std::endl;
+            ++received.errors;
+            break;
+        }
+        ResultPublisher::FrameType type = ResultPublisher::FrameType(frame[0]);
+        uint32_t stream = 0;
+        if (type != ResultPublisher::Dropped) memcpy(&stream, &frame[1], sizeof(stream));
+        int expected = (type == ResultPublisher::Begin) ? 0 : ((type == ResultPublisher::Dropped) ? -1 : 1);
+        if ((expected >= 0) && (streams[stream] != expected))
+        {
+            std::cerr << "FAILED: frame of type " << int(type) << " out of order for stream " << stream << std::endl;
+            ++received.errors;
+        }
+        if (type == ResultPublisher::Begin)
+        {
+            streams[stream] = 1;
+            ++received.begins;
+        }
+        else if (type == ResultPublisher::End)
+        {
+            streams[stream] = 2;
+            ++received.ends;
+        }
+        else if (type == ResultPublisher::Row)
+        {
+            ++received.rows;
+        }
+        else if (type == ResultPublisher::Dropped)
+        {
+            uint64_t n;
+            memcpy(&n, &frame[1], sizeof(n));
+            received.dropped += n;
+        }
+    }
+    close(client);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-publisher-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(&name[0]))
+    {
+        std::cerr << "Unable to create a scratch directory" << std::endl;
+        return 1;
+    }
+    std::string directory(&name[0]);
+    std::string socketPath = directory + "/publisher.sock";
+
+    ResultPublisher publisher(RING_CAPACITY);
+    if (publisher.open(socketPath) != 0)
+    {
+        std::cerr << "Unable to open the publisher" << std::endl;
+        return 1;
+    }
+    // one client that never reads and one that reads everything
+    int stalled = connectClient(socketPath);
+    int reading = connectClient(socketPath);
+    if ((stalled < 0) || (reading < 0))
+    {
+        std::cerr << "Unable to connect to the publisher" << std::endl;
+        return 1;
+    }
+    int size = 1024;
+    setsockopt(stalled, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    Received received;
+    std::thread reader(readFrames, reading, std::ref(received));
+    // give the publisher time to accept both clients
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<std::string> columns;
+    for (int c = 0; c < NUMBER_OF_COLUMNS; ++c) columns.push_back("column " + std::to_string(c));
+    std::vector<double> values(NUMBER_OF_COLUMNS, 1.0);
+    double longest = 0.0;
+    for (int s = 0; s < NUMBER_OF_STREAMS; ++s)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t stream = publisher.beginStream("stream " + std::to_string(s), columns);
+        longest = std::max(longest, secondsSince(start));
+        for (int r = 0; r < NUMBER_OF_ROWS; ++r)
+        {
+            start = std::chrono::steady_clock::now();
+            publisher.publishRow(stream, r, values);
+            longest = std::max(longest, secondsSince(start));
+            // at about the rate the background thread sends them, so the stalled client's socket buffer fills
+            if ((r % 10) == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        start = std::chrono::steady_clock::now();
+        publisher.endStream(stream);
+        longest = std::max(longest, secondsSince(start));
+    }
+    unsigned long numberOfDroppedRows = publisher.numberOfDroppedRows();
+    publisher.close();
+    reader.join();
+    close(stalled);
+    std::remove(directory.c_str());
+
+    int errors = received.errors;
+    if (longest > MAXIMUM_CALL_TIME)
+    {
+        std::cerr << "FAILED: the publishing thread was blocked for " << longest << " seconds" << std::endl;
+        ++errors;
+    }
+    if (numberOfDroppedRows == 0)
+    {
+        std::cerr << "FAILED: no rows were dropped, so the stalled client is not being tested" << std::endl;
+        ++errors;
+    }
+    if ((received.begins != NUMBER_OF_STREAMS) || (received.ends != NUMBER_OF_STREAMS))
+    {
+        std::cerr << "FAILED: received " << received.begins << " Begin and " << received.ends << " End frames rather "
+                  << "than " << NUMBER_OF_STREAMS << std::endl;
+        ++errors;
+    }
+    if (received.rows + received.dropped != NUMBER_OF_STREAMS * NUMBER_OF_ROWS)
+    {
+        std::cerr << "FAILED: received " << received.rows << " rows and " << received.dropped << " dropped rather than "
+                  << NUMBER_OF_STREAMS * NUMBER_OF_ROWS << " rows" << std::endl;
+        ++errors;
+    }
+    if (errors == 0) std::cout << "All result publisher tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
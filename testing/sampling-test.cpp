@@ -0,0 +1,150 @@
+/*
+ * sampling-test.cpp
+ *
+ * Checks the sampling designs: the first points of the Sobol sequence against the reference values for the
+ * new-joe-kuo-6.21201 direction numbers, the stratification of the Latin hypercube design, and the inverse normal
+ * cumulative distribution used for the normal inputs against known quantiles.
+ */
+#include <iostream>
+#include <cmath>
+#include <vector>
+
+#include "sampling.hpp"
+
+#define NUMBER_OF_SOBOL_POINTS 7
+#define SOBOL_DIMENSION 5
+#define NUMBER_OF_LHS_POINTS 50
+#define LHS_DIMENSION 4
+#define QUANTILE_TOLERANCE 1.0e-9
+
+// the points after the origin, as given by the Joe and Kuo generator
+static const double sobolPoints[NUMBER_OF_SOBOL_POINTS][SOBOL_DIMENSION] =
+{
+    { 0.5,   0.5,   0.5,   0.5,   0.5   },
+    { 0.75,  0.25,  0.25,  0.25,  0.75  },
+    { 0.25,  0.75,  0.75,  0.75,  0.25  },
+    { 0.375, 0.375, 0.625, 0.875, 0.375 },
+    { 0.875, 0.875, 0.125, 0.375, 0.875 },
+    { 0.625, 0.125, 0.875, 0.625, 0.625 },
+    { 0.125, 0.625, 0.375, 0.125, 0.125 }
+};
+
+static int testSobol()
+{
+    int errors = 0;
+    std::vector<std::vector<double> > points;
+    if (generateDesign(SamplingOptions::Sobol, NUMBER_OF_SOBOL_POINTS, SOBOL_DIMENSION, 0, points) != 0)
+    {
+        std::cerr << "FAILED: unable to generate the Sobol design" << std::endl;
+        return 1;
+    }
+    for (int i = 0; i < NUMBER_OF_SOBOL_POINTS; ++i)
+    {
+        for (int j = 0; j < SOBOL_DIMENSION; ++j)
+        {
+            // the points are dyadic rationals, so they are exact
+            if (points[i][j] != sobolPoints[i][j])
+            {
+                std::cerr << "FAILED: Sobol point " << i + 1 << " coordinate " << j << " is " << points[i][j]
+                          << " rather than " << sobolPoints[i][j] << std::endl;
+                ++errors;
+            }
+        }
+    }
+    SobolSequence unsupported(SobolSequence::maximumDimension + 1);
+    std::vector<double> point;
+    if (unsupported.next(point) == 0)
+    {
+        std::cerr << "FAILED: a Sobol sequence of unsupported dimension gave a point" << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int testLatinHypercube()
+{
+    int errors = 0;
+    std::vector<std::vector<double> > points;
+    if (generateDesign(SamplingOptions::LatinHypercube, NUMBER_OF_LHS_POINTS, LHS_DIMENSION, 3, points) != 0)
+    {
+        std::cerr << "FAILED: unable to generate the Latin hypercube design" << std::endl;
+        return 1;
+    }
+    for (int j = 0; j < LHS_DIMENSION; ++j)
+    {
+        // exactly one point in each stratum of each dimension
+        std::vector<int> count(NUMBER_OF_LHS_POINTS, 0);
+        for (int i = 0; i < NUMBER_OF_LHS_POINTS; ++i)
+        {
+            double u = points[i][j];
+            if ((u <= 0.0) || (u >= 1.0))
+            {
+                std::cerr << "FAILED: Latin hypercube coordinate " << u << " is not in (0, 1)" << std::endl;
+                ++errors;
+                continue;
+            }
+            ++count[int(floor(u * NUMBER_OF_LHS_POINTS))];
+        }
+        for (int k = 0; k < NUMBER_OF_LHS_POINTS; ++k)
+        {
+            if (count[k] != 1)
+            {
+                std::cerr << "FAILED: " << count[k] << " Latin hypercube points in stratum " << k << " of dimension "
+                          << j << std::endl;
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+static int testInverseNormal()
+{
+    int errors = 0;
+    // the standard normal quantiles of the given probabilities, covering the central and both tail regions
+    static const double known[][2] =
+    {
+        { 1.0e-6, -4.753424308822899 },
+        { 0.001, -3.090232306167814 },
+        { 0.025, -1.959963984540054 },
+        { 0.158655253931457, -1.0 },
+        { 0.5, 0.0 },
+        { 0.841344746068543, 1.0 },
+        { 0.975, 1.959963984540054 },
+        { 0.999, 3.090232306167814 }
+    };
+    SamplingInput input;
+    input.distribution = SamplingInput::Normal;
+    input.a = 0.0;
+    input.b = 1.0;
+    for (const auto& k: known)
+    {
+        double x = input.quantile(k[0]);
+        if (fabs(x - k[1]) > QUANTILE_TOLERANCE * std::max(1.0, fabs(k[1])))
+        {
+            std::cerr << "FAILED: the normal quantile of " << k[0] << " is " << x << " rather than " << k[1]
+                      << std::endl;
+            ++errors;
+        }
+    }
+    // and scaled for a log-normal input
+    input.distribution = SamplingInput::LogNormal;
+    input.a = 1.0;
+    input.b = 0.5;
+    double x = input.quantile(0.975), expected = exp(1.0 + 0.5 * 1.959963984540054);
+    if (fabs(x - expected) > QUANTILE_TOLERANCE * expected)
+    {
+        std::cerr << "FAILED: the log-normal quantile of 0.975 is " << x << " rather than " << expected << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = testSobol();
+    errors += testLatinHypercube();
+    errors += testInverseNormal();
+    if (errors == 0) std::cout << "All sampling tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
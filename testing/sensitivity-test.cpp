@@ -0,0 +1,103 @@
+/*
+ * sensitivity-test.cpp
+ *
+ * Checks the forward sensitivities of a Latta cell computed by Cvodes, whose right hand sides come from the
+ * analytic Jacobian and parameter derivatives of GeneralModel, against central finite differences of two forward
+ * runs with the parameter perturbed either side of its value.
+ */
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "GeneralModel.hpp"
+#include "cvodes.hpp"
+#include "lattacell.hpp"
+
+#define END_TIME 100.0
+#define PERTURBATION 0.05
+#define SENSITIVITY_TOLERANCE 0.05
+
+/*
+ * Integrate a Latta cell to END_TIME with the named parameter scaled by the given factor, returning the final state
+ * (volume then intracellular concentrations) and, if requested, its sensitivities to the parameter.
+ */
+static int simulateCell(const std::string& name, double scale, std::vector<double>& state,
+                        std::vector<double>* sensitivities)
+{
+    GeneralModel model;
+    configureLattaCell(model);
+    model.initialise();
+    double* parameter = model.parameter(name);
+    if (parameter == NULL)
+    {
+        std::cerr << "Unknown parameter: " << name << std::endl;
+        return 1;
+    }
+    *parameter *= scale;
+    Cvodes cvodes;
+    if (cvodes.initialise(&model, 0.0, 0.0) != 0) return 1;
+    if (sensitivities && (cvodes.enableSensitivities(std::vector<double*>(1, parameter)) != 0)) return 1;
+    double t = 0.0;
+    for (double tout = 10.0; tout <= END_TIME; tout += 10.0)
+    {
+        if (cvodes.integrate(t, tout) != 0) return 1;
+    }
+    state.assign(1, model.V);
+    for (unsigned int i = 0; i < model.mC_c.size(); ++i) state.push_back(*(model.mC_c[i]));
+    if (sensitivities)
+    {
+        // with respect to the relative change in the parameter, to compare with the perturbed runs
+        *sensitivities = cvodes.getSensitivities();
+        for (double& s: *sensitivities) s *= *parameter;
+    }
+    return 0;
+}
+
+static int testParameter(const std::string& name)
+{
+    std::vector<double> state, plus, minus, sensitivities;
+    if ((simulateCell(name, 1.0, state, &sensitivities) != 0) || (simulateCell(name, 1.0 + PERTURBATION, plus, NULL) != 0)
+        || (simulateCell(name, 1.0 - PERTURBATION, minus, NULL) != 0))
+    {
+        std::cerr << "FAILED: " << name << ": unable to integrate the cell" << std::endl;
+        return 1;
+    }
+    int errors = 0;
+    std::vector<double> difference(state.size());
+    // compare the volume and concentrations separately, relative to the largest sensitivity of each
+    double volumeScale = 0.0, concentrationScale = 0.0;
+    for (unsigned int i = 0; i < state.size(); ++i)
+    {
+        difference[i] = (plus[i] - minus[i]) / (2.0 * PERTURBATION);
+        double& scale = (i == 0) ? volumeScale : concentrationScale;
+        scale = std::max(scale, std::max(fabs(difference[i]), fabs(sensitivities[i])));
+    }
+    for (unsigned int i = 0; i < state.size(); ++i)
+    {
+        double scale = (i == 0) ? volumeScale : concentrationScale;
+        if (fabs(sensitivities[i] - difference[i]) > SENSITIVITY_TOLERANCE * scale)
+        {
+            std::cerr << "FAILED: " << name << ": sensitivity of state " << i << " is " << sensitivities[i]
+                      << " rather than " << difference[i] << std::endl;
+            ++errors;
+        }
+    }
+    if (concentrationScale == 0.0)
+    {
+        std::cerr << "FAILED: " << name << ": the concentrations are not sensitive to the parameter, so nothing is "
+                  << "being tested." << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    int errors = testParameter("P_a[Na]");
+    errors += testParameter("P_b[K]");
+    errors += testParameter("Lp_b");
+    if (errors == 0) std::cout << "All sensitivity tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
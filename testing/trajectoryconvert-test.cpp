@@ -0,0 +1,149 @@
+/*
+ * trajectoryconvert-test.cpp
+ *
+ * Checks that binary trajectories converted by get-trajectory-convert with each encoding (plain, delta and xor)
+ * and each compression (none, gz, xz and bz2), and then back to a plain uncompressed trajectory, have the same
+ * column names and bit-for-bit the same values as the original, including values such as -0, infinities, NaNs
+ * and subnormals. The path of get-trajectory-convert is given as the only argument.
+ */
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "trajectorywriter.hpp"
+
+#define NUMBER_OF_ROWS 5000
+
+/*
+ * A trajectory with smoothly varying columns, which the encodings are meant for, and a column of special values.
+ */
+static void makeTrajectory(std::vector<std::string>& columnNames, std::vector<std::vector<double> >& rows)
+{
+    columnNames = { "time", "V", "C_c[Na]", "special" };
+    const double special[] = { 0.0, -0.0, std::numeric_limits<double>::infinity(),
+                               -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::quiet_NaN(),
+                               std::numeric_limits<double>::denorm_min(), std::numeric_limits<double>::max(),
+                               -std::numeric_limits<double>::min(), 1.0 / 3.0 };
+    const int numberOfSpecial = sizeof(special) / sizeof(special[0]);
+    rows.clear();
+    for (int i = 0; i < NUMBER_OF_ROWS; ++i)
+    {
+        double t = 0.01 * i;
+        rows.push_back({ t, -60.0 + 5.0 * sin(t), 7.0 + 1.0e-3 * t * t, special[i % numberOfSpecial] });
+    }
+}
+
+static bool sameBits(const std::vector<std::vector<double> >& a, const std::vector<std::vector<double> >& b)
+{
+    if (a.size() != b.size()) return false;
+    for (unsigned int i = 0; i < a.size(); ++i)
+    {
+        if ((a[i].size() != b[i].size()) || (memcmp(a[i].data(), b[i].data(), a[i].size() * sizeof(double)) != 0))
+            return false;
+    }
+    return true;
+}
+
+static int expectTrajectory(const std::string& test, const std::string& path,
+                            const std::vector<std::string>& columnNames,
+                            const std::vector<std::vector<double> >& rows)
+{
+    std::vector<std::string> names;
+    std::vector<std::vector<double> > values;
+    if (readTrajectory(path, names, values) != 0)
+    {
+        std::cerr << "FAILED: " << test << ": unable to read " << path << std::endl;
+        return 1;
+    }
+    if (names != columnNames)
+    {
+        std::cerr << "FAILED: " << test << ": the column names of " << path << " differ" << std::endl;
+        return 1;
+    }
+    if (!sameBits(values, rows))
+    {
+        std::cerr << "FAILED: " << test << ": the values of " << path << " differ" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static int convert(const std::string& program, const std::string& input, const std::string& output,
+                   const std::string& encoding)
+{
+    std::ostringstream command;
+    command << "\"" << program << "\" \"" << input << "\" \"" << output << "\" --binary --encoding " << encoding;
+    return std::system(command.str().c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <path of get-trajectory-convert>" << std::endl;
+        return 1;
+    }
+    std::string program(argv[1]);
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string((tmp && tmp[0]) ? tmp : "/tmp") + "/get-simulator-convert-XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    if (!mkdtemp(&name[0]))
+    {
+        std::cerr << "Unable to create a scratch directory" << std::endl;
+        return 1;
+    }
+    std::string directory(&name[0]);
+
+    std::vector<std::string> columnNames;
+    std::vector<std::vector<double> > rows;
+    makeTrajectory(columnNames, rows);
+    std::string original = directory + "/original.bin";
+    TrajectoryWriter writer;
+    if (writer.open(original, TrajectoryWriter::Binary, columnNames) != 0)
+    {
+        std::cerr << "Unable to write the trajectory" << std::endl;
+        return 1;
+    }
+    for (const std::vector<double>& row: rows) writer.writeRow(row);
+    if (writer.close() != 0)
+    {
+        std::cerr << "Unable to write the trajectory" << std::endl;
+        return 1;
+    }
+
+    int errors = expectTrajectory("original", original, columnNames, rows);
+    std::vector<std::string> files(1, original);
+    for (const char* encoding: { "plain", "delta", "xor" })
+    {
+        for (const char* extension: { "", ".gz", ".xz", ".bz2" })
+        {
+            std::string test = std::string(encoding) + (extension[0] ? extension : " uncompressed");
+            std::string converted = directory + "/" + encoding + ".bin" + extension;
+            std::string back = directory + "/" + encoding + extension + ".plain.bin";
+            files.push_back(converted);
+            files.push_back(back);
+            if ((convert(program, original, converted, encoding) != 0) ||
+                (convert(program, converted, back, "plain") != 0))
+            {
+                std::cerr << "FAILED: " << test << ": get-trajectory-convert failed" << std::endl;
+                ++errors;
+                continue;
+            }
+            errors += expectTrajectory(test, converted, columnNames, rows);
+            errors += expectTrajectory(test, back, columnNames, rows);
+        }
+    }
+    for (const std::string& file: files) std::remove(file.c_str());
+    std::remove(directory.c_str());
+    if (errors == 0) std::cout << "All trajectory conversion tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+/*
+ * transporters-test.cpp
+ *
+ * Checks the active transport terms of a Latta cell: the Na-K pump flux against eq 9 of Latta et al (1984), and
+ * the analytic derivatives of the pump and carrier fluxes with respect to the intracellular concentrations (as
+ * given to GeneralModel by evaluateActiveFluxDerivatives) against central finite differences of the fluxes.
+ */
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "GeneralModel.hpp"
+#include "transporters.hpp"
+#include "lattacell.hpp"
+
+#define FLUX_TOLERANCE 1.0e-12
+#define DERIVATIVE_TOLERANCE 1.0e-6
+
+typedef TransporterSet<SodiumPotassiumPump, Cotransporter<Apical, 2> > LattaTransporters;
+
+static bool close(double a, double b, double tolerance)
+{
+    return fabs(a - b) <= tolerance * std::max(1.0e-12, std::max(fabs(a), fabs(b)));
+}
+
+/*
+ * The active fluxes alone, apical then basolateral.
+ */
+static std::vector<double> activeFluxes(GeneralModel& model, const LattaTransporters& transporters)
+{
+    int N = model.mC_c.size();
+    for (int i = 0; i < N; ++i) *(model.mJ_a[i]) = *(model.mJ_b[i]) = 0.0;
+    transporters.addFluxes(model);
+    std::vector<double> J(2 * N);
+    for (int i = 0; i < N; ++i)
+    {
+        J[i] = *(model.mJ_a[i]);
+        J[N + i] = *(model.mJ_b[i]);
+    }
+    return J;
+}
+
+static int testPumpFlux(GeneralModel& model, const LattaTransporters& transporters)
+{
+    int errors = 0;
+    int Na = model.moleculeIndex("Na"), K = model.moleculeIndex("K");
+    std::vector<double> J = activeFluxes(model, transporters);
+    int N = model.mC_c.size();
+    // eq 9 with the Table 1 parameters and the initial concentrations, C_c[Na] = 7 and C_b[K] = 5.3
+    double I_p = 5.61 / ((1.0 + pow(14.2 / 7.0, 3.0)) * (1.0 + pow(2.3 / 5.3, 2.0)));
+    if (!close(J[N + Na], 3.0 * I_p / F, FLUX_TOLERANCE) || !close(J[N + K], -2.0 * I_p / F, FLUX_TOLERANCE))
+    {
+        std::cerr << "FAILED: pump fluxes are " << J[N + Na] << " (Na) and " << J[N + K] << " (K) rather than "
+                  << 3.0 * I_p / F << " and " << -2.0 * I_p / F << std::endl;
+        ++errors;
+    }
+    return errors;
+}
+
+static int testFluxDerivatives(GeneralModel& model, const LattaTransporters& transporters)
+{
+    int errors = 0;
+    int N = model.mC_c.size();
+    MembraneFluxDerivatives d;
+    d.dJa_dCc.assign(N * N, 0.0);
+    d.dJb_dCc.assign(N * N, 0.0);
+    transporters.addDerivatives(model, d);
+    for (int k = 0; k < N; ++k)
+    {
+        double C = *(model.mC_c[k]);
+        double h = 1.0e-6 * std::max(1.0, fabs(C));
+        *(model.mC_c[k]) = C + h;
+        std::vector<double> plus = activeFluxes(model, transporters);
+        *(model.mC_c[k]) = C - h;
+        std::vector<double> minus = activeFluxes(model, transporters);
+        *(model.mC_c[k]) = C;
+        for (int i = 0; i < N; ++i)
+        {
+            double dJa = (plus[i] - minus[i]) / (2.0 * h), dJb = (plus[N + i] - minus[N + i]) / (2.0 * h);
+            if ((fabs(dJa) + fabs(d.dJa_dCc[i*N + k]) > 0.0) && !close(d.dJa_dCc[i*N + k], dJa, DERIVATIVE_TOLERANCE))
+            {
+                std::cerr << "FAILED: d(J_a[" << i << "])/d(C_c[" << k << "]) is " << d.dJa_dCc[i*N + k]
+                          << " rather than " << dJa << std::endl;
+                ++errors;
+            }
+            if ((fabs(dJb) + fabs(d.dJb_dCc[i*N + k]) > 0.0) && !close(d.dJb_dCc[i*N + k], dJb, DERIVATIVE_TOLERANCE))
+            {
+                std::cerr << "FAILED: d(J_b[" << i << "])/d(C_c[" << k << "]) is " << d.dJb_dCc[i*N + k]
+                          << " rather than " << dJb << std::endl;
+                ++errors;
+            }
+        }
+    }
+    return errors;
+}
+
+int main(int argc, char* argv[])
+{
+    GeneralModel model;
+    configureLattaCell(model);
+    model.initialise();
+    LattaTransporters transporters = makeTransporterSet(SodiumPotassiumPump(5.61, 14.2, 2.3, 3.0, 2.0, "Na", "K"),
+                                                        Cotransporter<Apical, 2>(1.0e-6, {"Na", "Cl"}, {1.0, 1.0}));
+    if (model.setActiveTransport(transporters) != 0)
+    {
+        std::cerr << "Unable to set up the active transport." << std::endl;
+        return 1;
+    }
+    int errors = testPumpFlux(model, transporters);
+    errors += testFluxDerivatives(model, transporters);
+    if (errors == 0) std::cout << "All transporter tests passed." << std::endl;
+    return errors == 0 ? 0 : 1;
+}